@@ -0,0 +1,688 @@
+/****************************************************************************\
+   Copyright 2021 Luca Beldi
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+       http://www.apache.org/licenses/LICENSE-2.0
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+\****************************************************************************/
+#ifndef FIXEDROLEGENERICMODEL_H
+#define FIXEDROLEGENERICMODEL_H
+#include <genericmodel.h>
+#include <QAbstractItemModel>
+#include <QVariant>
+#include <QVector>
+#include <QMap>
+#include <algorithm>
+#include <array>
+template <int... Roles>
+struct FixedRoleSlot;
+template <>
+struct FixedRoleSlot<>
+{
+    static constexpr int find(int, int) { return -1; }
+    static constexpr bool hasDuplicates() { return false; }
+    static constexpr bool contains(int) { return false; }
+};
+template <int First, int... Rest>
+struct FixedRoleSlot<First, Rest...>
+{
+    static constexpr int find(int role, int slot) { return role == First ? slot : FixedRoleSlot<Rest...>::find(role, slot + 1); }
+    static constexpr bool contains(int role) { return role == First || FixedRoleSlot<Rest...>::contains(role); }
+    static constexpr bool hasDuplicates() { return FixedRoleSlot<Rest...>::contains(First) || FixedRoleSlot<Rest...>::hasDuplicates(); }
+};
+
+/*!
+\class FixedRoleGenericModel
+\brief A GenericModel-like tree model whose roles are fixed at compile time
+\details Every cell stores its data in a \c{std::array<QVariant, N>} with one slot per role listed in \a Roles
+instead of a map keyed by role, so reading and writing a role is a constant time lookup with no allocation.
+The mapping from a role to its slot is resolved by a constexpr function.
+
+Roles not listed in \a Roles are not stored: data() returns an invalid QVariant and setData() returns false for them.
+If Qt::EditRole is not listed but Qt::DisplayRole is, the two are merged like GenericModel does when GenericModel::mergeDisplayEdit is true.
+
+The structure of the model (rows, columns and children) behaves like GenericModel, including moving rows and columns to a different parent.
+Sorting uses the same ordering as GenericModel::sort() and dragging a single cell exports the same mime types as GenericModel.
+Drag and drop otherwise use the default QAbstractItemModel serialisation so children of dragged items are not carried over.
+Spans, aggregates, keepSorted(), value interning, change tracking and the GenericModel serialisation format are not supported.
+
+\code
+FixedRoleGenericModel<Qt::DisplayRole, Qt::ToolTipRole, Qt::UserRole + 1> model;
+\endcode
+\sa GenericModel
+*/
+template <int... Roles>
+class FixedRoleGenericModel : public QAbstractItemModel
+{
+    static_assert(sizeof...(Roles) > 0, "FixedRoleGenericModel requires at least one role");
+    static_assert(!FixedRoleSlot<Roles...>::hasDuplicates(), "FixedRoleGenericModel roles must be unique");
+    Q_DISABLE_COPY(FixedRoleGenericModel)
+
+public:
+    enum { RoleCount = sizeof...(Roles) };
+    typedef std::array<QVariant, sizeof...(Roles)> RoleValues;
+    /*!
+    \brief Returns the slot used to store \a role or -1 if \a role is not stored by the model
+    */
+    static constexpr int roleSlot(int role)
+    {
+        return FixedRoleSlot<Roles...>::find(role, 0) >= 0
+                ? FixedRoleSlot<Roles...>::find(role, 0)
+                : (role == Qt::EditRole ? FixedRoleSlot<Roles...>::find(Qt::DisplayRole, 0) : -1);
+    }
+    explicit FixedRoleGenericModel(QObject *parent = Q_NULLPTR)
+        : QAbstractItemModel(parent)
+        , m_root(new Item(nullptr))
+    { }
+    ~FixedRoleGenericModel() { delete m_root; }
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override
+    {
+        const Item *parentItem = itemForIndex(parent);
+        if (row < 0 || column < 0 || row >= parentItem->rowCount || column >= parentItem->colCount)
+            return QModelIndex();
+        return createIndex(row, column, parentItem->childAt(row, column));
+    }
+    QModelIndex parent(const QModelIndex &index) const override
+    {
+        if (!index.isValid())
+            return QModelIndex();
+        Q_ASSERT(index.model() == this);
+        const Item *parentItem = itemForIndex(index)->parent;
+        if (parentItem == m_root)
+            return QModelIndex();
+        return createIndex(parentItem->row, parentItem->column, const_cast<Item *>(parentItem));
+    }
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override { return itemForIndex(parent)->rowCount; }
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override { return itemForIndex(parent)->colCount; }
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override
+    {
+        const int slot = roleSlot(role);
+        if (!index.isValid() || slot < 0)
+            return QVariant();
+        Q_ASSERT(index.model() == this);
+        return itemForIndex(index)->values[slot];
+    }
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override
+    {
+        const int slot = roleSlot(role);
+        if (!index.isValid() || slot < 0)
+            return false;
+        Q_ASSERT(index.model() == this);
+        Item *item = itemForIndex(index);
+        if (item->values[slot] == value)
+            return true;
+        item->values[slot] = value;
+        dataChanged(index, index, rolesForSlot(slot));
+        return true;
+    }
+    QMap<int, QVariant> itemData(const QModelIndex &index) const override
+    {
+        QMap<int, QVariant> result;
+        if (!index.isValid())
+            return result;
+        Q_ASSERT(index.model() == this);
+        const Item *item = itemForIndex(index);
+        for (int role : {Roles...}) {
+            const QVariant &value = item->values[roleSlot(role)];
+            if (value.isValid())
+                result.insert(role, value);
+        }
+        if (isEditMerged() && result.contains(Qt::DisplayRole))
+            result.insert(Qt::EditRole, result.value(Qt::DisplayRole));
+        return result;
+    }
+    bool setItemData(const QModelIndex &index, const QMap<int, QVariant> &roles) override
+    {
+        if (!index.isValid())
+            return false;
+        Q_ASSERT(index.model() == this);
+        Item *item = itemForIndex(index);
+        RoleValues newValues = item->values;
+        for (auto i = roles.constBegin(), iEnd = roles.constEnd(); i != iEnd; ++i) {
+            const int slot = roleSlot(i.key());
+            if (slot < 0)
+                return false;
+            if (i.key() == Qt::EditRole && isEditMerged() && roles.contains(Qt::DisplayRole))
+                continue;
+            newValues[slot] = i.value();
+        }
+        if (newValues == item->values)
+            return true;
+        QVector<int> changedRoles;
+        for (int role : {Roles...}) {
+            if (newValues[roleSlot(role)] != item->values[roleSlot(role)])
+                changedRoles += rolesForSlot(roleSlot(role));
+        }
+        item->values = newValues;
+        dataChanged(index, index, changedRoles);
+        return true;
+    }
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
+    bool clearItemData(const QModelIndex &index) override
+#else
+    bool clearItemData(const QModelIndex &index)
+#endif
+    {
+        if (!index.isValid())
+            return false;
+        Q_ASSERT(index.model() == this);
+        Item *item = itemForIndex(index);
+        bool hasData = false;
+        for (int i = 0; i < RoleCount && !hasData; ++i)
+            hasData = item->values[i].isValid();
+        if (hasData) {
+            item->values = RoleValues();
+            dataChanged(index, index);
+        }
+        return true;
+    }
+    Qt::ItemFlags flags(const QModelIndex &index) const override
+    {
+        if (!index.isValid())
+            return Qt::ItemIsDropEnabled;
+        Q_ASSERT(index.model() == this);
+        return itemForIndex(index)->flags;
+    }
+    /*!
+    \brief Sets the flags of the item at \a index
+    \details Returns false if \a index is invalid
+    */
+    bool setFlags(const QModelIndex &index, Qt::ItemFlags flags)
+    {
+        if (!index.isValid())
+            return false;
+        Q_ASSERT(index.model() == this);
+        Item *item = itemForIndex(index);
+        if (item->flags != flags) {
+            item->flags = flags;
+            dataChanged(index, index);
+        }
+        return true;
+    }
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override
+    {
+        const QVector<RoleValues> &headers = orientation == Qt::Horizontal ? m_hHeaderData : m_vHeaderData;
+        const int slot = roleSlot(role);
+        if (section < 0 || section >= headers.size() || slot < 0)
+            return QAbstractItemModel::headerData(section, orientation, role);
+        const QVariant &value = headers.at(section)[slot];
+        if (!value.isValid())
+            return QAbstractItemModel::headerData(section, orientation, role);
+        return value;
+    }
+    bool setHeaderData(int section, Qt::Orientation orientation, const QVariant &value, int role = Qt::EditRole) override
+    {
+        QVector<RoleValues> &headers = orientation == Qt::Horizontal ? m_hHeaderData : m_vHeaderData;
+        const int slot = roleSlot(role);
+        if (section < 0 || section >= headers.size() || slot < 0)
+            return false;
+        if (headers[section][slot] != value) {
+            headers[section][slot] = value;
+            headerDataChanged(orientation, section, section);
+        }
+        return true;
+    }
+    bool insertRows(int row, int count, const QModelIndex &parent = QModelIndex()) override
+    {
+        Item *parentItem = itemForIndex(parent);
+        if (row < 0 || count <= 0 || row > parentItem->rowCount)
+            return false;
+        beginInsertRows(parent, row, row + count - 1);
+        parentItem->insertRows(row, count);
+        if (parentItem == m_root)
+            m_vHeaderData.insert(row, count, RoleValues());
+        endInsertRows();
+        return true;
+    }
+    bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex()) override
+    {
+        Item *parentItem = itemForIndex(parent);
+        if (row < 0 || count <= 0 || row + count > parentItem->rowCount)
+            return false;
+        beginRemoveRows(parent, row, row + count - 1);
+        parentItem->removeRows(row, count);
+        if (parentItem == m_root)
+            m_vHeaderData.remove(row, count);
+        endRemoveRows();
+        return true;
+    }
+    bool insertColumns(int column, int count, const QModelIndex &parent = QModelIndex()) override
+    {
+        Item *parentItem = itemForIndex(parent);
+        if (column < 0 || count <= 0 || column > parentItem->colCount)
+            return false;
+        beginInsertColumns(parent, column, column + count - 1);
+        parentItem->insertColumns(column, count);
+        if (parentItem == m_root)
+            m_hHeaderData.insert(column, count, RoleValues());
+        endInsertColumns();
+        return true;
+    }
+    bool removeColumns(int column, int count, const QModelIndex &parent = QModelIndex()) override
+    {
+        Item *parentItem = itemForIndex(parent);
+        if (column < 0 || count <= 0 || column + count > parentItem->colCount)
+            return false;
+        beginRemoveColumns(parent, column, column + count - 1);
+        parentItem->removeColumns(column, count);
+        if (parentItem == m_root)
+            m_hHeaderData.remove(column, count);
+        endRemoveColumns();
+        return true;
+    }
+    /*!
+    \details If \a destinationParent has fewer columns than \a sourceParent, columns are appended to it before the move
+    */
+    bool moveRows(const QModelIndex &sourceParent, int sourceRow, int count, const QModelIndex &destinationParent, int destinationChild) override
+    {
+        Item *sourceItem = itemForIndex(sourceParent);
+        Item *destinationItem = itemForIndex(destinationParent);
+        if (sourceRow < 0 || count <= 0 || sourceRow + count > sourceItem->rowCount || destinationChild < 0
+            || destinationChild > destinationItem->rowCount)
+            return false;
+        if (sourceItem == destinationItem) {
+            if (!beginMoveRows(sourceParent, sourceRow, sourceRow + count - 1, destinationParent, destinationChild))
+                return false;
+            sourceItem->moveRows(sourceRow, count, destinationChild);
+            if (sourceItem == m_root)
+                moveRange(m_vHeaderData.begin(), sourceRow, count, destinationChild);
+            endMoveRows();
+            return true;
+        }
+        if (isMovedBranch(destinationItem, sourceItem, sourceRow, count, Qt::Vertical))
+            return false;
+        if (sourceItem->colCount > destinationItem->colCount)
+            insertColumns(destinationItem->colCount, sourceItem->colCount - destinationItem->colCount, destinationParent);
+        if (!beginMoveRows(sourceParent, sourceRow, sourceRow + count - 1, destinationParent, destinationChild))
+            return false;
+        const QVector<Item *> takenItems = sourceItem->takeRows(sourceRow, count);
+        QVector<Item *> movedItems;
+        movedItems.reserve(count * destinationItem->colCount);
+        for (int i = 0; i < count; ++i) {
+            for (int j = 0; j < destinationItem->colCount; ++j)
+                movedItems.append(j < sourceItem->colCount ? takenItems.at((i * sourceItem->colCount) + j) : new Item(destinationItem));
+        }
+        destinationItem->insertRows(destinationChild, count, movedItems);
+        if (sourceItem == m_root)
+            m_vHeaderData.remove(sourceRow, count);
+        if (destinationItem == m_root)
+            m_vHeaderData.insert(destinationChild, count, RoleValues());
+        endMoveRows();
+        return true;
+    }
+    /*!
+    \details If \a destinationParent has fewer rows than \a sourceParent, rows are appended to it before the move
+    */
+    bool moveColumns(const QModelIndex &sourceParent, int sourceColumn, int count, const QModelIndex &destinationParent,
+                     int destinationChild) override
+    {
+        Item *sourceItem = itemForIndex(sourceParent);
+        Item *destinationItem = itemForIndex(destinationParent);
+        if (sourceColumn < 0 || count <= 0 || sourceColumn + count > sourceItem->colCount || destinationChild < 0
+            || destinationChild > destinationItem->colCount)
+            return false;
+        if (sourceItem == destinationItem) {
+            if (!beginMoveColumns(sourceParent, sourceColumn, sourceColumn + count - 1, destinationParent, destinationChild))
+                return false;
+            sourceItem->moveColumns(sourceColumn, count, destinationChild);
+            if (sourceItem == m_root)
+                moveRange(m_hHeaderData.begin(), sourceColumn, count, destinationChild);
+            endMoveColumns();
+            return true;
+        }
+        if (isMovedBranch(destinationItem, sourceItem, sourceColumn, count, Qt::Horizontal))
+            return false;
+        if (sourceItem->rowCount > destinationItem->rowCount)
+            insertRows(destinationItem->rowCount, sourceItem->rowCount - destinationItem->rowCount, destinationParent);
+        if (!beginMoveColumns(sourceParent, sourceColumn, sourceColumn + count - 1, destinationParent, destinationChild))
+            return false;
+        const QVector<Item *> takenItems = sourceItem->takeColumns(sourceColumn, count);
+        QVector<Item *> movedItems;
+        movedItems.reserve(destinationItem->rowCount * count);
+        for (int i = 0; i < destinationItem->rowCount; ++i) {
+            for (int j = 0; j < count; ++j)
+                movedItems.append(i < sourceItem->rowCount ? takenItems.at((i * count) + j) : new Item(destinationItem));
+        }
+        destinationItem->insertColumns(destinationChild, count, movedItems);
+        if (sourceItem == m_root)
+            m_hHeaderData.remove(sourceColumn, count);
+        if (destinationItem == m_root)
+            m_hHeaderData.insert(destinationChild, count, RoleValues());
+        endMoveColumns();
+        return true;
+    }
+    /*!
+    \brief Sorts the top level rows by \a column using Qt::DisplayRole in the given \a order
+    */
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override
+    {
+        sort(QVector<GenericModel::SortKey>{GenericModel::SortKey(column, Qt::DisplayRole, order)});
+    }
+    /*!
+    \brief Sorts all children of \a parent using all the \a keys at once
+    \details Behaves like GenericModel::sort(), keys referring to a role that is not stored are ignored
+    */
+    void sort(const QVector<GenericModel::SortKey> &keys, const QModelIndex &parent = QModelIndex(), bool recursive = false)
+    {
+        Item *parentItem = itemForIndex(parent);
+        if (keys.isEmpty() || parentItem->rowCount == 0)
+            return;
+        for (const GenericModel::SortKey &key : keys) {
+            if (key.column < 0 || key.column >= parentItem->colCount)
+                return;
+        }
+        QList<QPersistentModelIndex> parents;
+        if (parent.isValid())
+            parents.append(parent);
+        layoutAboutToBeChanged(parents, QAbstractItemModel::VerticalSortHint);
+        sortChildren(parentItem, keys, recursive);
+        // the items keep their position so every persistent index can be remapped from the item it points to
+        const QModelIndexList persistentIndexes = persistentIndexList();
+        QModelIndexList changedFrom;
+        QModelIndexList changedTo;
+        for (const QModelIndex &idx : persistentIndexes) {
+            Item *item = itemForIndex(idx);
+            if (item->row != idx.row()) {
+                changedFrom.append(idx);
+                changedTo.append(createIndex(item->row, item->column, item));
+            }
+        }
+        changePersistentIndexList(changedFrom, changedTo);
+        layoutChanged(parents, QAbstractItemModel::VerticalSortHint);
+    }
+    /*!
+    \reimp
+    \details When a single index is dragged its value is also exported in the mime types GenericModel uses for it
+    */
+    QMimeData *mimeData(const QModelIndexList &indexes) const override
+    {
+        QMimeData *data = QAbstractItemModel::mimeData(indexes);
+        if (data && indexes.size() == 1)
+            GenericModel::mimeForVariant(data, indexes.first().data());
+        return data;
+    }
+    Qt::DropActions supportedDropActions() const override { return Qt::CopyAction | Qt::MoveAction; }
+    /*!
+    \brief Sets the role names returned by roleNames()
+    \details If \a rNames is empty the default QAbstractItemModel::roleNames() are used
+    */
+    void setRoleNames(const QHash<int, QByteArray> &rNames)
+    {
+        if (m_roleNames == rNames)
+            return;
+        m_roleNames = rNames;
+        if (m_root->rowCount > 0 && m_root->colCount > 0)
+            signalAllChanged(QModelIndex());
+    }
+    QHash<int, QByteArray> roleNames() const override
+    {
+        if (m_roleNames.isEmpty())
+            return QAbstractItemModel::roleNames();
+        return m_roleNames;
+    }
+
+private:
+    struct Item
+    {
+        explicit Item(Item *par)
+            : parent(par)
+            , flags(Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable | Qt::ItemIsDragEnabled | Qt::ItemIsDropEnabled)
+            , rowCount(0)
+            , colCount(0)
+            , row(-1)
+            , column(-1)
+        { }
+        ~Item() { qDeleteAll(children); }
+        Item *childAt(int r, int c) const { return children.at((r * colCount) + c); }
+        void renumberChildren()
+        {
+            for (int i = 0, maxI = children.size(); i < maxI; ++i) {
+                children[i]->row = i / colCount;
+                children[i]->column = i % colCount;
+            }
+        }
+        void insertRows(int r, int count)
+        {
+            rowCount += count;
+            if (colCount == 0)
+                return;
+            children.insert(r * colCount, count * colCount, nullptr);
+            for (int i = r * colCount, maxI = (r + count) * colCount; i < maxI; ++i)
+                children[i] = new Item(this);
+            renumberChildren();
+        }
+        void removeRows(int r, int count)
+        {
+            rowCount -= count;
+            if (colCount == 0)
+                return;
+            for (int i = r * colCount, maxI = (r + count) * colCount; i < maxI; ++i)
+                delete children.at(i);
+            children.remove(r * colCount, count * colCount);
+            renumberChildren();
+        }
+        void insertColumns(int c, int count)
+        {
+            const int oldColCount = colCount;
+            colCount += count;
+            if (rowCount == 0)
+                return;
+            QVector<Item *> newChildren;
+            newChildren.reserve(rowCount * colCount);
+            for (int i = 0; i < rowCount; ++i) {
+                for (int j = 0; j < colCount; ++j) {
+                    if (j >= c && j < c + count)
+                        newChildren.append(new Item(this));
+                    else
+                        newChildren.append(children.at((i * oldColCount) + (j < c ? j : j - count)));
+                }
+            }
+            children.swap(newChildren);
+            renumberChildren();
+        }
+        void removeColumns(int c, int count)
+        {
+            const int oldColCount = colCount;
+            colCount -= count;
+            if (rowCount == 0)
+                return;
+            QVector<Item *> newChildren;
+            newChildren.reserve(rowCount * colCount);
+            for (int i = 0; i < rowCount; ++i) {
+                for (int j = 0; j < oldColCount; ++j) {
+                    Item *child = children.at((i * oldColCount) + j);
+                    if (j >= c && j < c + count)
+                        delete child;
+                    else
+                        newChildren.append(child);
+                }
+            }
+            children.swap(newChildren);
+            renumberChildren();
+        }
+        QVector<Item *> takeRows(int r, int count)
+        {
+            rowCount -= count;
+            const QVector<Item *> result = children.mid(r * colCount, count * colCount);
+            children.remove(r * colCount, count * colCount);
+            renumberChildren();
+            return result;
+        }
+        void insertRows(int r, int count, const QVector<Item *> &rows)
+        {
+            Q_ASSERT(rows.size() == count * colCount);
+            rowCount += count;
+            for (Item *rowItem : rows)
+                rowItem->parent = this;
+            children.insert(r * colCount, rows.size(), nullptr);
+            std::copy(rows.constBegin(), rows.constEnd(), children.begin() + (r * colCount));
+            renumberChildren();
+        }
+        // the taken items are returned row by row
+        QVector<Item *> takeColumns(int c, int count)
+        {
+            const int oldColCount = colCount;
+            colCount -= count;
+            QVector<Item *> result;
+            result.reserve(rowCount * count);
+            QVector<Item *> newChildren;
+            newChildren.reserve(rowCount * colCount);
+            for (int i = 0; i < rowCount; ++i) {
+                for (int j = 0; j < oldColCount; ++j) {
+                    Item *child = children.at((i * oldColCount) + j);
+                    if (j >= c && j < c + count)
+                        result.append(child);
+                    else
+                        newChildren.append(child);
+                }
+            }
+            children.swap(newChildren);
+            renumberChildren();
+            return result;
+        }
+        void insertColumns(int c, int count, const QVector<Item *> &columns)
+        {
+            Q_ASSERT(columns.size() == count * rowCount);
+            const int oldColCount = colCount;
+            colCount += count;
+            QVector<Item *> newChildren;
+            newChildren.reserve(rowCount * colCount);
+            for (int i = 0; i < rowCount; ++i) {
+                for (int j = 0; j < colCount; ++j) {
+                    if (j >= c && j < c + count) {
+                        Item *columnItem = columns.at((i * count) + j - c);
+                        columnItem->parent = this;
+                        newChildren.append(columnItem);
+                    } else {
+                        newChildren.append(children.at((i * oldColCount) + (j < c ? j : j - count)));
+                    }
+                }
+            }
+            children.swap(newChildren);
+            renumberChildren();
+        }
+        void moveRows(int r, int count, int destination)
+        {
+            if (colCount == 0)
+                return;
+            moveRange(children.begin(), r * colCount, count * colCount, destination * colCount);
+            renumberChildren();
+        }
+        void moveColumns(int c, int count, int destination)
+        {
+            if (rowCount == 0)
+                return;
+            for (int i = 0; i < rowCount; ++i)
+                moveRange(children.begin() + (i * colCount), c, count, destination);
+            renumberChildren();
+        }
+        Item *parent;
+        RoleValues values;
+        Qt::ItemFlags flags;
+        int rowCount;
+        int colCount;
+        int row;
+        int column;
+        QVector<Item *> children;
+    };
+    template <class Iterator>
+    static void moveRange(Iterator begin, int first, int count, int destination)
+    {
+        if (destination < first)
+            std::rotate(begin + destination, begin + first, begin + first + count);
+        else if (destination > first + count)
+            std::rotate(begin + first, begin + first + count, begin + destination);
+    }
+    // true if item is one of the sections being moved or one of their descendants
+    static bool isMovedBranch(const Item *item, const Item *sourceItem, int first, int count, Qt::Orientation orientation)
+    {
+        for (; item && item != sourceItem; item = item->parent) {
+            const int section = orientation == Qt::Vertical ? item->row : item->column;
+            if (item->parent == sourceItem && section >= first && section < first + count)
+                return true;
+        }
+        return false;
+    }
+    void sortChildren(Item *parentItem, const QVector<GenericModel::SortKey> &keys, bool recursive)
+    {
+        QVector<GenericModel::SortKey> validKeys;
+        validKeys.reserve(keys.size());
+        for (const GenericModel::SortKey &key : keys) {
+            if (key.column < parentItem->colCount && roleSlot(key.role) >= 0)
+                validKeys.append(key);
+        }
+        if (parentItem->children.isEmpty() || validKeys.isEmpty())
+            return;
+        if (recursive) {
+            for (int i = 0, maxI = parentItem->children.size(); i < maxI; ++i)
+                sortChildren(parentItem->children.at(i), keys, recursive);
+        }
+        QVector<QVariant> keyValues;
+        keyValues.reserve(parentItem->rowCount * validKeys.size());
+        for (int i = 0; i < parentItem->rowCount; ++i) {
+            for (const GenericModel::SortKey &key : validKeys)
+                keyValues.append(parentItem->childAt(i, key.column)->values[roleSlot(key.role)]);
+        }
+        const QVector<int> sortedRows = GenericModel::sortOrder(keyValues, validKeys);
+        QVector<Item *> newChildren;
+        newChildren.reserve(parentItem->children.size());
+        for (int i = 0; i < parentItem->rowCount; ++i) {
+            for (int j = 0; j < parentItem->colCount; ++j)
+                newChildren.append(parentItem->childAt(sortedRows.at(i), j));
+        }
+        parentItem->children.swap(newChildren);
+        parentItem->renumberChildren();
+        if (parentItem == m_root)
+            permuteHeaders(sortedRows);
+    }
+    void permuteHeaders(const QVector<int> &sortedRows)
+    {
+        QVector<RoleValues> newHeaders;
+        newHeaders.reserve(m_vHeaderData.size());
+        for (int i = 0, maxI = sortedRows.size(); i < maxI; ++i)
+            newHeaders.append(m_vHeaderData.at(sortedRows.at(i)));
+        m_vHeaderData.swap(newHeaders);
+    }
+    void signalAllChanged(const QModelIndex &parent)
+    {
+        const int rowCnt = rowCount(parent);
+        const int colCnt = columnCount(parent);
+        for (int i = 0; i < rowCnt; ++i) {
+            for (int j = 0; j < colCnt; ++j) {
+                const QModelIndex currPar = index(i, j, parent);
+                if (hasChildren(currPar))
+                    signalAllChanged(currPar);
+            }
+        }
+        dataChanged(index(0, 0, parent), index(rowCnt - 1, colCnt - 1, parent));
+    }
+    static constexpr bool isEditMerged() { return !FixedRoleSlot<Roles...>::contains(Qt::EditRole) && roleSlot(Qt::DisplayRole) >= 0; }
+    static QVector<int> rolesForSlot(int slot)
+    {
+        QVector<int> result;
+        for (int role : {Roles...}) {
+            if (roleSlot(role) == slot)
+                result.append(role);
+        }
+        if (isEditMerged() && slot == roleSlot(Qt::DisplayRole))
+            result.append(Qt::EditRole);
+        return result;
+    }
+    Item *itemForIndex(const QModelIndex &index) const
+    {
+        if (!index.isValid())
+            return m_root;
+        Q_ASSERT(index.model() == this);
+        return static_cast<Item *>(index.internalPointer());
+    }
+    Item *m_root;
+    QVector<RoleValues> m_hHeaderData;
+    QVector<RoleValues> m_vHeaderData;
+    QHash<int, QByteArray> m_roleNames;
+};
+#endif // FIXEDROLEGENERICMODEL_H
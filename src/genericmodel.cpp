@@ -24,6 +24,9 @@
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QPair>
+#include <QThread>
+#include <QThreadPool>
+#include <QRegularExpression>
 #if (QT_VERSION > QT_VERSION_CHECK(5, 12, 0))
 #    include <QCborValue>
 #    include <QCborArray>
@@ -346,9 +349,25 @@ void GenericModelItem::setSpan(const QSize &sz)
     m_colSpan = sz.width();
 }
 
-void GenericModelItem::sortChildren(int column, int role, Qt::SortOrder order, bool recursive, QVector<RolesContainer> *headersToSort)
+void GenericModelItem::sortChildren(const QVector<GenericModel::SortKey> &keys, bool recursive, QVector<RolesContainer> *headersToSort,
+                                    QVector<int> *permutation)
 {
-    sortChildren(column, role, order, recursive, m_model->persistentIndexList(), headersToSort);
+    const QModelIndexList persistentIndexList = m_model->persistentIndexList();
+    QSet<QModelIndex> persistentIndexes;
+    persistentIndexes.reserve(persistentIndexList.size());
+    for (const QModelIndex &idx : persistentIndexList)
+        persistentIndexes.insert(idx);
+    sortChildren(keys, recursive, persistentIndexes, headersToSort, permutation);
+}
+
+void GenericModelItem::permuteChildren(const QVector<int> &sourceRows, QVector<RolesContainer> *headersToSort)
+{
+    const QModelIndexList persistentIndexList = m_model->persistentIndexList();
+    QSet<QModelIndex> persistentIndexes;
+    persistentIndexes.reserve(persistentIndexList.size());
+    for (const QModelIndex &idx : persistentIndexList)
+        persistentIndexes.insert(idx);
+    permuteChildren(sourceRows, persistentIndexes, headersToSort);
 }
 
 void GenericModelItem::moveChildRows(int sourceRow, int count, int destinationChild)
@@ -415,41 +434,49 @@ void GenericModelItem::setColumn(int c)
     m_column = c;
 }
 
-void GenericModelItem::sortChildren(int column, int role, Qt::SortOrder order, bool recursive, const QModelIndexList &persistentIndexes,
-                                    QVector<RolesContainer> *headersToSort)
+void GenericModelItem::sortChildren(const QVector<GenericModel::SortKey> &keys, bool recursive, const QSet<QModelIndex> &persistentIndexes,
+                                    QVector<RolesContainer> *headersToSort, QVector<int> *permutation)
 {
-    Q_ASSERT(column >= 0);
-    if (children.isEmpty() || column >= m_colCount)
+    QVector<GenericModel::SortKey> validKeys;
+    validKeys.reserve(keys.size());
+    for (const GenericModel::SortKey &key : keys) {
+        Q_ASSERT(key.column >= 0);
+        if (key.column < m_colCount)
+            validKeys.append(key);
+    }
+    if (children.isEmpty() || validKeys.isEmpty())
         return;
     if (recursive) {
         for (int i = 0, maxI = children.size(); i < maxI; ++i)
-            children.at(i)->sortChildren(column, role, order, recursive, persistentIndexes, nullptr);
-    }
-    QVector<GenericModelItem *> columnChildren;
-    columnChildren.reserve(m_rowCount);
-    for (int i = column, maxI = children.size(); i < maxI; i += m_colCount) {
-        GenericModelItem *columnChild = children.at(i);
-        columnChildren.append(columnChild);
-    }
-    const auto lessComparison = [role](const GenericModelItem *a, const GenericModelItem *b) -> bool {
-        return GenericModelPrivate::isVariantLessThan(a->data.value(role), b->data.value(role));
-    };
-    const auto greaterComparison = [role](const GenericModelItem *a, const GenericModelItem *b) -> bool {
-        return GenericModelPrivate::isVariantLessThan(b->data.value(role), a->data.value(role));
-    };
-    if (order == Qt::AscendingOrder)
-        std::stable_sort(columnChildren.begin(), columnChildren.end(), lessComparison);
-    else
-        std::stable_sort(columnChildren.begin(), columnChildren.end(), greaterComparison);
+            children.at(i)->sortChildren(keys, recursive, persistentIndexes, nullptr, nullptr);
+    }
+    // the values are extracted once so the comparison does not need to look up the roles containers at every step
+    const int keyCount = validKeys.size();
+    QVector<QVariant> keyValues;
+    keyValues.reserve(m_rowCount * keyCount);
+    for (int i = 0; i < m_rowCount; ++i) {
+        for (const GenericModel::SortKey &key : validKeys)
+            keyValues.append(children.at((i * m_colCount) + key.column)->data.value(key.role));
+    }
+    const QVector<int> sortedRows = GenericModel::sortOrder(keyValues, validKeys);
+    permuteChildren(sortedRows, persistentIndexes, headersToSort);
+    if (permutation)
+        *permutation = sortedRows;
+}
+
+// sourceRows[i] is the row that ends up in position i
+void GenericModelItem::permuteChildren(const QVector<int> &sourceRows, const QSet<QModelIndex> &persistentIndexes,
+                                       QVector<RolesContainer> *headersToSort)
+{
+    Q_ASSERT(sourceRows.size() == m_rowCount);
     QVector<RolesContainer> updatedHeadersToSort;
     if (headersToSort)
         updatedHeadersToSort = QVector<RolesContainer>(headersToSort->size(), RolesContainer());
     QVector<GenericModelItem *> newChildren;
     newChildren.reserve(children.size());
     QModelIndexList changedPersistentIndexesFrom, changedPersistentIndexesTo;
-    for (int toRow = 0, maxRow = columnChildren.size(); toRow < maxRow; ++toRow) {
-        GenericModelItem *const columnChild = columnChildren.at(toRow);
-        const int fromRow = columnChild->m_row;
+    for (int toRow = 0; toRow < m_rowCount; ++toRow) {
+        const int fromRow = sourceRows.at(toRow);
         if (headersToSort)
             updatedHeadersToSort[toRow] = headersToSort->at(fromRow);
         for (int i = m_colCount * fromRow; i < m_colCount * (fromRow + 1); ++i) {
@@ -473,39 +500,6 @@ void GenericModelItem::sortChildren(int column, int role, Qt::SortOrder order, b
     m_model->changePersistentIndexList(changedPersistentIndexesFrom, changedPersistentIndexesTo);
 }
 
-bool GenericModelPrivate::isVariantLessThan(const QVariant &left, const QVariant &right)
-{
-    if (left.userType() == QMetaType::UnknownType)
-        return false;
-    if (right.userType() == QMetaType::UnknownType)
-        return true;
-    switch (left.userType()) {
-    case QMetaType::Int:
-        return left.toInt() < right.toInt();
-    case QMetaType::UInt:
-        return left.toUInt() < right.toUInt();
-    case QMetaType::LongLong:
-        return left.toLongLong() < right.toLongLong();
-    case QMetaType::ULongLong:
-        return left.toULongLong() < right.toULongLong();
-    case QMetaType::Float:
-        return left.toFloat() < right.toFloat();
-    case QMetaType::Double:
-        return left.toDouble() < right.toDouble();
-    case QMetaType::Char:
-        return left.toChar() < right.toChar();
-    case QMetaType::QDate:
-        return left.toDate() < right.toDate();
-    case QMetaType::QTime:
-        return left.toTime() < right.toTime();
-    case QMetaType::QDateTime:
-        return left.toDateTime() < right.toDateTime();
-    case QMetaType::QString:
-    default:
-        return left.toString().compare(right.toString()) < 0;
-    }
-}
-
 GenericModelPrivate::~GenericModelPrivate()
 {
     delete root;
@@ -521,6 +515,10 @@ GenericModelPrivate::GenericModelPrivate(GenericModel *q)
     , root(new GenericModelItem(q))
     , m_mergeDisplayEdit(true)
     , sortRole(Qt::DisplayRole)
+    , m_keepSortedColumn(-1)
+    , m_keepSortedRole(Qt::DisplayRole)
+    , m_keepSortedOrder(Qt::AscendingOrder)
+    , m_trackChanges(false)
 {
     Q_ASSERT(q_ptr);
 }
@@ -544,10 +542,16 @@ QModelIndex GenericModelPrivate::indexForItem(GenericModelItem *item) const
 
 void GenericModelPrivate::insertColumns(int column, int count, const QModelIndex &parent)
 {
-    if (!parent.isValid())
-        hHeaderData.insert(column, count, RolesContainer());
     GenericModelItem *item = itemForIndex(parent);
+    releaseInternedChildren(item);
+    if (!parent.isValid()) {
+        hHeaderData.insert(column, count, RolesContainer());
+        insertAggregateColumns(column, count);
+        insertKeepSortedColumns(column, count);
+        insertInternedColumns(column, count);
+    }
     item->insertColumns(column, count);
+    internChildren(item);
 }
 
 void GenericModelPrivate::insertRows(int row, int count, const QModelIndex &parent)
@@ -560,10 +564,22 @@ void GenericModelPrivate::insertRows(int row, int count, const QModelIndex &pare
 
 void GenericModelPrivate::removeColumns(int column, int count, const QModelIndex &parent)
 {
-    if (!parent.isValid())
-        hHeaderData.erase(hHeaderData.begin() + column, hHeaderData.begin() + column + count);
     GenericModelItem *item = itemForIndex(parent);
+    releaseInternedChildren(item);
+    if (!parent.isValid()) {
+        hHeaderData.erase(hHeaderData.begin() + column, hHeaderData.begin() + column + count);
+        removeAggregateColumns(column, count);
+        removeKeepSortedColumns(column, count);
+        removeInternedColumns(column, count);
+    }
+    if (!m_changedItems.isEmpty()) {
+        for (int i = 0; i < item->rowCount(); ++i) {
+            for (int j = column; j < column + count; ++j)
+                forgetChanged(item->childAt(i, j));
+        }
+    }
     item->removeColumns(column, count);
+    internChildren(item);
 }
 
 void GenericModelPrivate::removeRows(int row, int count, const QModelIndex &parent)
@@ -571,6 +587,15 @@ void GenericModelPrivate::removeRows(int row, int count, const QModelIndex &pare
     if (!parent.isValid())
         vHeaderData.erase(vHeaderData.begin() + row, vHeaderData.begin() + row + count);
     GenericModelItem *item = itemForIndex(parent);
+    if (!m_internPool.isEmpty() || !m_changedItems.isEmpty() || (item == root && !m_aggregates.isEmpty())) {
+        for (int i = row; i < row + count; ++i) {
+            for (int j = 0; j < item->columnCount(); ++j) {
+                releaseInterned(item->childAt(i, j));
+                forgetChanged(item->childAt(i, j));
+                removeFromAggregates(item->childAt(i, j));
+            }
+        }
+    }
     item->removeRows(row, count);
 }
 
@@ -595,6 +620,12 @@ void GenericModelPrivate::moveRowsDifferentParent(const QModelIndex &sourceParen
     Q_Q(GenericModel);
     GenericModelItem *sourceItem = itemForIndex(sourceParent);
     GenericModelItem *destinationItem = itemForIndex(destinationParent);
+    if (sourceItem == root && !m_aggregates.isEmpty()) {
+        for (int i = sourceRow; i < sourceRow + count; ++i) {
+            for (int j = 0; j < sourceItem->columnCount(); ++j)
+                removeFromAggregates(sourceItem->childAt(i, j));
+        }
+    }
     QVector<GenericModelItem *> takenRows = sourceItem->takeRows(sourceRow, count);
     Q_ASSERT(!takenRows.isEmpty());
     if (sourceItem->columnCount() < destinationItem->columnCount()) {
@@ -610,6 +641,8 @@ void GenericModelPrivate::moveRowsDifferentParent(const QModelIndex &sourceParen
     }
     Q_ASSERT(takenRows.size() == count * destinationItem->columnCount());
     destinationItem->insertRows(destinationChild, takenRows);
+    for (int i = 0, maxI = takenRows.size(); i < maxI; ++i)
+        addToAggregates(takenRows.at(i));
     if (sourceItem == root)
         vHeaderData.remove(sourceRow, count);
     if (destinationItem == root)
@@ -619,8 +652,12 @@ void GenericModelPrivate::moveRowsDifferentParent(const QModelIndex &sourceParen
 void GenericModelPrivate::moveColumnsSameParent(const QModelIndex &sourceParent, int sourceCol, int count, int destinationChild)
 {
     GenericModelItem *item = itemForIndex(sourceParent);
+    releaseInternedChildren(item);
     item->moveChildColumns(sourceCol, count, destinationChild);
     if (item == root) {
+        moveAggregateColumns(sourceCol, count, destinationChild);
+        moveKeepSortedColumns(sourceCol, count, destinationChild);
+        moveInternedColumns(sourceCol, count, destinationChild);
         const auto sourceBegin = hHeaderData.begin() + sourceCol;
         const auto sourceEnd = hHeaderData.begin() + sourceCol + count;
         const auto destination = hHeaderData.begin() + destinationChild;
@@ -629,6 +666,7 @@ void GenericModelPrivate::moveColumnsSameParent(const QModelIndex &sourceParent,
         else
             std::rotate(sourceBegin, sourceEnd, destination);
     }
+    internChildren(item);
 }
 
 void GenericModelPrivate::moveColumnsDifferentParent(const QModelIndex &sourceParent, int sourceRow, int count, const QModelIndex &destinationParent,
@@ -637,6 +675,20 @@ void GenericModelPrivate::moveColumnsDifferentParent(const QModelIndex &sourcePa
     Q_Q(GenericModel);
     GenericModelItem *sourceItem = itemForIndex(sourceParent);
     GenericModelItem *destinationItem = itemForIndex(destinationParent);
+    // the interned values are pooled again once the columns are in place, a parent nested in the other one is covered by the outer one
+    QVector<GenericModelItem *> internScopes;
+    if (sourceItem == root || destinationItem == root) {
+        internScopes.append(root);
+    } else if (GenericModelItem::isAnchestor(sourceItem, destinationItem)) {
+        internScopes.append(sourceItem);
+    } else if (GenericModelItem::isAnchestor(destinationItem, sourceItem)) {
+        internScopes.append(destinationItem);
+    } else {
+        internScopes.append(sourceItem);
+        internScopes.append(destinationItem);
+    }
+    for (int i = 0, maxI = internScopes.size(); i < maxI; ++i)
+        releaseInternedChildren(internScopes.at(i));
     QVector<GenericModelItem *> takenCols = sourceItem->takeCols(sourceRow, count);
     Q_ASSERT(!takenCols.isEmpty());
     if (sourceItem->rowCount() < destinationItem->rowCount()) {
@@ -652,10 +704,20 @@ void GenericModelPrivate::moveColumnsDifferentParent(const QModelIndex &sourcePa
     }
     Q_ASSERT(takenCols.size() == count * destinationItem->rowCount());
     destinationItem->insertCols(destinationChild, takenCols);
-    if (sourceItem == root)
+    if (sourceItem == root) {
         hHeaderData.remove(sourceRow, count);
-    if (destinationItem == root)
+        removeAggregateColumns(sourceRow, count);
+        removeKeepSortedColumns(sourceRow, count);
+        removeInternedColumns(sourceRow, count);
+    }
+    if (destinationItem == root) {
         hHeaderData.insert(destinationChild, count, RolesContainer());
+        insertAggregateColumns(destinationChild, count);
+        insertKeepSortedColumns(destinationChild, count);
+        insertInternedColumns(destinationChild, count);
+    }
+    for (int i = 0, maxI = internScopes.size(); i < maxI; ++i)
+        internChildren(internScopes.at(i));
 }
 
 /*!
@@ -679,6 +741,16 @@ GenericModel::GenericModel(GenericModelPrivate &dptr, QObject *parent)
  * \details Returns true if the data has been stored. Reimplement to support custom types.
  */
 bool GenericModel::mimeForValue(QMimeData *data, const QVariant &value) const
+{
+    return mimeForVariant(data, value);
+}
+
+/*!
+\internal
+\brief Stores \a value in \a data using the conversions of mimeForValue()
+\details Shared with FixedRoleGenericModel
+*/
+bool GenericModel::mimeForVariant(QMimeData *data, const QVariant &value)
 {
     if (!data)
         return false;
@@ -873,6 +945,7 @@ bool GenericModel::insertColumns(int column, int count, const QModelIndex &paren
     Q_D(GenericModel);
     d->insertColumns(column, count, parent);
     endInsertColumns();
+    d->recordOperation(ChangeSet::InsertColumns, parent, column, count);
     return true;
 }
 
@@ -888,6 +961,8 @@ bool GenericModel::insertRows(int row, int count, const QModelIndex &parent)
     Q_D(GenericModel);
     d->insertRows(row, count, parent);
     endInsertRows();
+    d->recordOperation(ChangeSet::InsertRows, parent, row, count);
+    d->keepRowsSorted(parent, row, count);
     return true;
 }
 
@@ -903,6 +978,7 @@ bool GenericModel::removeColumns(int column, int count, const QModelIndex &paren
     Q_D(GenericModel);
     d->removeColumns(column, count, parent);
     endRemoveColumns();
+    d->recordOperation(ChangeSet::RemoveColumns, parent, column, count);
     return true;
 }
 
@@ -918,6 +994,7 @@ bool GenericModel::removeRows(int row, int count, const QModelIndex &parent)
     Q_D(GenericModel);
     d->removeRows(row, count, parent);
     endRemoveRows();
+    d->recordOperation(ChangeSet::RemoveRows, parent, row, count);
     return true;
 }
 
@@ -1018,8 +1095,16 @@ bool GenericModel::clearItemData(const QModelIndex &index)
     Q_D(GenericModel);
     GenericModelItem *const item = d->itemForIndex(index);
     if (!item->data.isEmpty()) {
+        const bool sortedValueChanged = index.column() == d->m_keepSortedColumn && item->data.contains(d->m_keepSortedRole);
+        for (auto i = item->data.constBegin(), iEnd = item->data.constEnd(); i != iEnd; ++i) {
+            d->updateAggregates(item, i.key(), i.value(), QVariant());
+            d->releaseInterned(index.column(), i.key(), i.value());
+        }
         item->data.clear();
+        d->markChanged(item);
         dataChanged(index, index);
+        if (sortedValueChanged)
+            d->keepRowsSorted(index.parent(), index.row(), 1);
     }
     return true;
 }
@@ -1048,6 +1133,7 @@ bool GenericModel::setFlags(const QModelIndex &index, Qt::ItemFlags flags)
     GenericModelItem *const item = d->itemForIndex(index);
     if (item->flags != flags) {
         item->flags = flags;
+        d->markChanged(item);
         dataChanged(index, index);
     }
     return true;
@@ -1193,7 +1279,15 @@ bool GenericModelPrivate::decodeMime(const QMimeData *data, Qt::DropAction actio
         rowsToInsert[i]->m_column = i % cCount;
     q->beginInsertRows(parent, row, row + rCount - 1);
     itemForIndex(parent)->insertRows(row, rowsToInsert);
+    for (int i = 0, maxI = rowsToInsert.size(); i < maxI; ++i) {
+        internItem(rowsToInsert.at(i));
+        addToAggregates(rowsToInsert.at(i));
+        markChanged(rowsToInsert.at(i));
+    }
     q->endInsertRows();
+    recordOperation(GenericModel::ChangeSet::InsertRows, parent, row, rCount);
+    if (m_keepSortedColumn >= 0)
+        q->sort(QVector<GenericModel::SortKey>{GenericModel::SortKey(m_keepSortedColumn, m_keepSortedRole, m_keepSortedOrder)}, parent, false);
     return true;
 }
 
@@ -1233,6 +1327,42 @@ bool GenericModel::dropMimeData(const QMimeData *data, Qt::DropAction action, in
     return QAbstractItemModel::dropMimeData(data, action, row, column, parent);
 }
 
+GenericModelItem *GenericModelItem::clone(GenericModel *model) const
+{
+    GenericModelItem *result = new GenericModelItem(model);
+    result->data = data;
+    result->flags = flags;
+    result->m_colCount = m_colCount;
+    result->m_rowCount = m_rowCount;
+    result->m_row = m_row;
+    result->m_column = m_column;
+    result->m_rowSpan = m_rowSpan;
+    result->m_colSpan = m_colSpan;
+    result->children.reserve(children.size());
+    for (int i = 0, maxI = children.size(); i < maxI; ++i) {
+        GenericModelItem *childClone = children.at(i)->clone(model);
+        childClone->parent = result;
+        result->children.append(childClone);
+    }
+    return result;
+}
+
+bool GenericModelItem::isSameTree(const GenericModelItem *other) const
+{
+    Q_ASSERT(other);
+    if (m_rowCount != other->m_rowCount || m_colCount != other->m_colCount)
+        return false;
+    for (int i = 0, maxI = children.size(); i < maxI; ++i) {
+        const GenericModelItem *child = children.at(i);
+        const GenericModelItem *otherChild = other->children.at(i);
+        if (child->flags != otherChild->flags || child->span() != otherChild->span() || child->data != otherChild->data)
+            return false;
+        if (!child->isSameTree(otherChild))
+            return false;
+    }
+    return true;
+}
+
 bool GenericModelItem::isAnchestor(GenericModelItem *ancestor, GenericModelItem *descendent)
 {
     if (!descendent)
@@ -1312,14 +1442,22 @@ bool GenericModel::moveColumns(const QModelIndex &sourceParent, int sourceColumn
             insertRows(destRowCount, sourceRowCount - destRowCount, destinationParent);
     } else if (destinationChild > colCnt)
         return false;
+    Q_D(GenericModel);
+    ChangeSet::Operation moveOperation(ChangeSet::MoveColumns);
+    if (d->m_trackChanges) {
+        moveOperation = ChangeSet::Operation(ChangeSet::MoveColumns, pathForIndex(sourceParent), sourceColumn, count);
+        moveOperation.destinationParent = pathForIndex(destinationParent);
+        moveOperation.destination = destinationChild;
+    }
     if (!beginMoveColumns(sourceParent, sourceColumn, sourceColumn + count - 1, destinationParent, destinationChild))
         return false;
-    Q_D(GenericModel);
     if (sourceParent != destinationParent)
         d->moveColumnsDifferentParent(sourceParent, sourceColumn, count, destinationParent, destinationChild);
     else
         d->moveColumnsSameParent(sourceParent, sourceColumn, count, destinationChild);
     endMoveColumns();
+    if (d->m_trackChanges)
+        d->m_operations.append(moveOperation);
     return true;
 }
 
@@ -1342,14 +1480,22 @@ bool GenericModel::moveRows(const QModelIndex &sourceParent, int sourceRow, int
             insertColumns(destColCount, sourceColCount - destColCount, destinationParent);
     } else if (destinationChild > rowCnt)
         return false;
+    Q_D(GenericModel);
+    ChangeSet::Operation moveOperation(ChangeSet::MoveRows);
+    if (d->m_trackChanges) {
+        moveOperation = ChangeSet::Operation(ChangeSet::MoveRows, pathForIndex(sourceParent), sourceRow, count);
+        moveOperation.destinationParent = pathForIndex(destinationParent);
+        moveOperation.destination = destinationChild;
+    }
     if (!beginMoveRows(sourceParent, sourceRow, sourceRow + count - 1, destinationParent, destinationChild))
         return false;
-    Q_D(GenericModel);
     if (sourceParent != destinationParent)
         d->moveRowsDifferentParent(sourceParent, sourceRow, count, destinationParent, destinationChild);
     else
         d->moveRowsSameParent(sourceParent, sourceRow, count, destinationChild);
     endMoveRows();
+    if (d->m_trackChanges)
+        d->m_operations.append(moveOperation);
     return true;
 }
 
@@ -1379,17 +1525,20 @@ bool GenericModel::setHeaderData(int section, Qt::Orientation orientation, const
     if (roleIter == sectionContainer->end()) {
         if (value.isValid()) {
             sectionContainer->insert(role, value);
+            d->recordHeaderChange(orientation, section);
             headerDataChanged(orientation, section, section);
         }
         return true;
     }
     if (!value.isValid()) {
         sectionContainer->erase(roleIter);
+        d->recordHeaderChange(orientation, section);
         headerDataChanged(orientation, section, section);
         return true;
     }
     if (roleIter.value() != value) {
         roleIter.value() = value;
+        d->recordHeaderChange(orientation, section);
         headerDataChanged(orientation, section, section);
     }
     return true;
@@ -1422,22 +1571,38 @@ bool GenericModel::setData(const QModelIndex &index, const QVariant &value, int
     QVector<int> rolesToEmit{role};
     if (d->m_mergeDisplayEdit && role == Qt::DisplayRole)
         rolesToEmit.append(Qt::EditRole);
+    const bool sortedValue = index.column() == d->m_keepSortedColumn && d->isKeepSortedRole(role);
+    const bool internedValue = d->isInternedRole(index.column(), role);
     const auto roleIter = item->data.find(role);
     if (roleIter == item->data.end()) {
         if (value.isValid()) {
-            item->data.insert(role, value);
+            d->updateAggregates(item, role, QVariant(), value);
+            item->data.insert(role, internedValue ? d->internValue(value) : value);
+            d->markChanged(item);
             dataChanged(index, index, rolesToEmit);
+            if (sortedValue)
+                d->keepRowsSorted(index.parent(), index.row(), 1);
         }
         return true;
     }
     if (!value.isValid()) {
+        d->updateAggregates(item, role, roleIter.value(), value);
+        d->releaseInterned(index.column(), role, roleIter.value());
         item->data.erase(roleIter);
+        d->markChanged(item);
         dataChanged(index, index, rolesToEmit);
+        if (sortedValue)
+            d->keepRowsSorted(index.parent(), index.row(), 1);
         return true;
     }
     if (value != roleIter.value()) {
-        roleIter.value() = value;
+        d->updateAggregates(item, role, roleIter.value(), value);
+        d->releaseInterned(index.column(), role, roleIter.value());
+        roleIter.value() = internedValue ? d->internValue(value) : value;
+        d->markChanged(item);
         dataChanged(index, index, rolesToEmit);
+        if (sortedValue)
+            d->keepRowsSorted(index.parent(), index.row(), 1);
     }
     return true;
 }
@@ -1476,12 +1641,44 @@ bool GenericModel::setItemData(const QModelIndex &index, const QMap<int, QVarian
         newData.insert(i.key(), i.value());
     }
     if (item->data != newData) {
+        const bool sortedValueChanged =
+                index.column() == d->m_keepSortedColumn && item->data.value(d->m_keepSortedRole) != newData.value(d->m_keepSortedRole);
+        for (auto i = newData.begin(), iEnd = newData.end(); i != iEnd; ++i) {
+            const auto oldIter = item->data.constFind(i.key());
+            if (oldIter != item->data.constEnd()) {
+                if (oldIter.value() == i.value()) {
+                    i.value() = oldIter.value();
+                    continue;
+                }
+                d->updateAggregates(item, i.key(), oldIter.value(), i.value());
+                d->releaseInterned(index.column(), i.key(), oldIter.value());
+            } else {
+                d->updateAggregates(item, i.key(), QVariant(), i.value());
+            }
+            if (d->isInternedRole(index.column(), i.key()))
+                i.value() = d->internValue(i.value());
+        }
         item->data = std::move(newData);
+        d->markChanged(item);
         dataChanged(index, index, changedRoles);
+        if (sortedValueChanged)
+            d->keepRowsSorted(index.parent(), index.row(), 1);
     }
     return true;
 }
 
+/*!
+\class GenericModel::SortKey
+\brief Describes one level of a multi-key sort
+\details Sort \a column using the data stored in \a role in the given \a order.
+\sa GenericModel::sort()
+*/
+GenericModel::SortKey::SortKey(int column, int role, Qt::SortOrder order)
+    : column(column)
+    , role(role)
+    , order(order)
+{ }
+
 /*!
 \reimp
 */
@@ -1497,110 +1694,1598 @@ If \a recursive is set to true the sorting will propagate down the hierarchy of
 */
 void GenericModel::sort(int column, const QModelIndex &parent, Qt::SortOrder order, bool recursive)
 {
-    if (column < 0 || column >= columnCount(parent) || rowCount(parent) == 0)
+    Q_D(const GenericModel);
+    sort(QVector<SortKey>{SortKey(column, d->sortRole, order)}, parent, recursive);
+}
+
+/*!
+\brief Sorts all children of \a parent using all the \a keys at once.
+\details The first element of \a keys is the primary criteria, each following key is only used to break the ties left by the previous ones.
+Compared to calling sort() once per key, the rows are reordered in a single pass and layoutChanged() is only emitted once.
+If any key refers to a column that does not exist in \a parent this method does nothing.
+If \a recursive is set to true the sorting will propagate down the hierarchy of the model, children with fewer columns will ignore the keys
+referring to columns they don't have
+*/
+void GenericModel::sort(const QVector<SortKey> &keys, const QModelIndex &parent, bool recursive)
+{
+    const int colCount = columnCount(parent);
+    if (keys.isEmpty() || rowCount(parent) == 0)
         return;
+    for (const SortKey &key : keys) {
+        if (key.column < 0 || key.column >= colCount)
+            return;
+    }
     QList<QPersistentModelIndex> parents;
     if (parent.isValid())
         parents.append(parent);
     layoutAboutToBeChanged(parents, QAbstractItemModel::VerticalSortHint);
     Q_D(GenericModel);
-    d->itemForIndex(parent)->sortChildren(column, d->sortRole, order, recursive, &(d->vHeaderData));
+    QVector<int> permutation;
+    d->itemForIndex(parent)->sortChildren(keys, recursive, &(d->vHeaderData), d->m_trackChanges ? &permutation : nullptr);
     layoutChanged(parents, QAbstractItemModel::VerticalSortHint);
+    d->recordSort(parent, keys, recursive, permutation);
 }
 
 /*!
-\reimp
-\details At the moment no view provided by Qt supports this
+\internal
+\brief Returns the order of the rows sorted by \a keys
+\details \a keyValues contains, row by row, the value of each key. The element i of the result is the row that should end up in position i.
+The sort is stable. Shared with FixedRoleGenericModel
 */
-QSize GenericModel::span(const QModelIndex &index) const
+QVector<int> GenericModel::sortOrder(const QVector<QVariant> &keyValues, const QVector<SortKey> &keys)
+{
+    const int keyCount = keys.size();
+    Q_ASSERT(keyCount > 0 && keyValues.size() % keyCount == 0);
+    QVector<int> result(keyValues.size() / keyCount);
+    for (int i = 0, maxI = result.size(); i < maxI; ++i)
+        result[i] = i;
+    std::stable_sort(result.begin(), result.end(), [&keys, &keyValues, keyCount](int a, int b) -> bool {
+        for (int i = 0; i < keyCount; ++i) {
+            const QVariant &aValue = keyValues.at((a * keyCount) + i);
+            const QVariant &bValue = keyValues.at((b * keyCount) + i);
+            if (isVariantLessThan(aValue, bValue))
+                return keys.at(i).order == Qt::AscendingOrder;
+            if (isVariantLessThan(bValue, aValue))
+                return keys.at(i).order == Qt::DescendingOrder;
+        }
+        return false;
+    });
+    return result;
+}
+
+/*!
+\brief Keeps the model sorted by \a column using the data stored in \a role in the given \a order.
+\details The whole model is sorted once when this method is called. From then on, every time rows are inserted or the value of \a role
+in \a column changes through setData(), setItemData() or clearItemData(), only the affected row is moved to its new position
+(found via binary search) using moveRows().
+
+This means that the row inserted by insertRows() might not be at the requested position once the method returns.
+Empty rows are placed where the empty values would be sorted (at the bottom for Qt::AscendingOrder, at the top for Qt::DescendingOrder),
+so appending rows in ascending order or prepending them in descending order will never move them.
+
+Rows moved explicitly via moveRows() or moveColumns() are not repositioned, call sort() to restore the order if needed.
+
+Pass a negative \a column to disable this mode.
+\sa keepSortedColumn()
+*/
+void GenericModel::keepSorted(int column, int role, Qt::SortOrder order)
+{
+    Q_D(GenericModel);
+    if (column < 0) {
+        d->m_keepSortedColumn = -1;
+        return;
+    }
+    d->m_keepSortedColumn = column;
+    d->m_keepSortedRole = (d->m_mergeDisplayEdit && role == Qt::EditRole) ? Qt::DisplayRole : role;
+    d->m_keepSortedOrder = order;
+    sort(QVector<SortKey>{SortKey(column, d->m_keepSortedRole, order)});
+}
+
+/*!
+\brief Returns the column the model is kept sorted by or -1 if keepSorted() is not active
+*/
+int GenericModel::keepSortedColumn() const
 {
-    if (!index.isValid())
-        return QSize();
-    Q_ASSERT(index.model() == this);
     Q_D(const GenericModel);
-    return d->itemForIndex(index)->span();
+    return d->m_keepSortedColumn;
 }
 
 /*!
-\brief Set the amount of rows and columns an item should occupy.
-\details At the moment no view provided by Qt supports this
+\brief Enables or disables the deduplication of the string values stored in \a role of \a column.
+\details When enabled, every QString passed to setData() or setItemData() for \a column and \a role is looked up in a pool shared by the whole model.
+If an equal string is already in use the cell will store a copy of the pooled one, sharing its memory, rather than its own allocation.
+This greatly reduces the memory used by columns holding a small number of distinct strings repeated across many rows.
+
+The pool is reference counted: when a value is overwritten or its cell is removed, the pooled string is released as soon as no other cell uses it.
+
+Enabling interning also pools the values already stored in \a column and \a role.
+Disabling it releases them from the pool but does not un-share them.
+Interning follows \a column when columns are inserted, removed or moved at the top level and is dropped when \a column is removed.
+Inserting, removing or moving columns while interning is enabled pools the values under the parent involved again.
+\sa isValueInterned(), internedValuesCount()
 */
-bool GenericModel::setSpan(const QModelIndex &index, const QSize &size)
+void GenericModel::setValueInterning(int column, int role, bool enabled)
 {
-    if (!index.isValid() || size.isEmpty())
-        return false;
-    Q_ASSERT(index.model() == this);
     Q_D(GenericModel);
-    d->itemForIndex(index)->setSpan(size);
-    const QModelIndex parIdx = index.parent();
-    const QModelIndex bottomRight = this->index(qMin(index.row() + size.height(), rowCount(parIdx) - 1),
-                                                qMin(index.column() + size.width(), columnCount(parIdx) - 1), parIdx);
-    dataChanged(index, bottomRight);
-    return true;
+    if (d->m_mergeDisplayEdit && role == Qt::EditRole)
+        role = Qt::DisplayRole;
+    const QPair<int, int> internedRole(column, role);
+    if (enabled == d->m_internedRoles.contains(internedRole))
+        return;
+    if (enabled) {
+        d->m_internedRoles.insert(internedRole);
+        d->setColumnInterning(d->root, column, role, true);
+    } else {
+        d->setColumnInterning(d->root, column, role, false);
+        d->m_internedRoles.remove(internedRole);
+    }
 }
 
 /*!
-\reimp
+\brief Returns true if the string values stored in \a role of \a column are deduplicated
+\sa setValueInterning()
 */
-Qt::DropActions GenericModel::supportedDragActions() const
+bool GenericModel::isValueInterned(int column, int role) const
 {
-    return Qt::CopyAction | Qt::MoveAction;
+    Q_D(const GenericModel);
+    return d->isInternedRole(column, role);
 }
 
 /*!
-\reimp
+\brief Returns the number of distinct values currently stored in the interning pool
+\sa setValueInterning()
 */
-Qt::DropActions GenericModel::supportedDropActions() const
+int GenericModel::internedValuesCount() const
 {
-    return Qt::CopyAction | Qt::MoveAction;
+    Q_D(const GenericModel);
+    return d->m_internPool.size();
 }
 
 /*!
-\property GenericModel::mergeDisplayEdit
-\accessors %mergeDisplayEdit(), setMergeDisplayEdit()
-\notifier mergeDisplayEditChanged()
-\brief This property determines if the Qt::DisplayRole and Qt::EditRole should be merged in the extra row/column
-\details By default the two roles are one and the same you can use this property to separate them.
-If there's any data in the role when you set this property to true it will be duplicated for both roles.
-If there is data both in Qt::DisplayRole and Qt::EditRole when you set this property to false Qt::DisplayRole will prevail.
+\class GenericModel::Aggregate
+\brief Summary statistics of the values stored in a column
+\details \a count is the number of valid values, \a sum and \a mean only consider numeric values,
+\a minimum and \a maximum use the same ordering as sort().
+\sa GenericModel::aggregate()
 */
-bool GenericModel::mergeDisplayEdit() const
+GenericModel::Aggregate::Aggregate()
+    : count(0)
+    , sum(0.0)
+    , mean(0.0)
+{ }
+
+/*!
+\brief Starts keeping statistics about the values stored in \a role of the top level items of \a column.
+\details Once enabled, the statistics are updated every time the values change or rows are inserted, removed or moved
+so that aggregate() can answer without scanning the column.
+The minimum and maximum are recomputed lazily, only when one of them gets removed and aggregate() is called afterwards.
+
+If the column is removed, the statistics for it are disabled.
+\sa disableAggregates(), aggregate()
+*/
+void GenericModel::enableAggregates(int column, int role)
+{
+    if (column < 0)
+        return;
+    Q_D(GenericModel);
+    if (d->m_mergeDisplayEdit && role == Qt::EditRole)
+        role = Qt::DisplayRole;
+    const QPair<int, int> aggregateKey = qMakePair(column, role);
+    if (!d->m_aggregates.contains(aggregateKey))
+        d->m_aggregates.insert(aggregateKey, GenericModelAggregateState());
+}
+
+/*!
+\brief Stops keeping statistics about the values stored in \a role of \a column
+\sa enableAggregates()
+*/
+void GenericModel::disableAggregates(int column, int role)
+{
+    Q_D(GenericModel);
+    if (d->m_mergeDisplayEdit && role == Qt::EditRole)
+        role = Qt::DisplayRole;
+    d->m_aggregates.remove(qMakePair(column, role));
+}
+
+/*!
+\brief Returns the statistics about the values stored in \a role of the top level items of \a column.
+\details If enableAggregates() was not called for \a column and \a role a default constructed Aggregate is returned.
+\sa enableAggregates()
+*/
+GenericModel::Aggregate GenericModel::aggregate(int column, int role) const
 {
     Q_D(const GenericModel);
-    return d->m_mergeDisplayEdit;
+    if (d->m_mergeDisplayEdit && role == Qt::EditRole)
+        role = Qt::DisplayRole;
+    Aggregate result;
+    const auto stateIter = d->m_aggregates.find(qMakePair(column, role));
+    if (stateIter == d->m_aggregates.end())
+        return result;
+    d->refreshAggregate(column, role, stateIter.value());
+    result.count = stateIter->count;
+    result.sum = stateIter->sum;
+    if (stateIter->numericCount > 0)
+        result.mean = stateIter->sum / stateIter->numericCount;
+    result.minimum = stateIter->minimum;
+    result.maximum = stateIter->maximum;
+    return result;
 }
 
-void GenericModel::setMergeDisplayEdit(bool val)
+/*!
+\class GenericModel::ChangeSet
+\brief Everything that changed in the model since the last checkpoint
+\details \a operations lists, in the order they happened, the structural changes applied to the model.
+The parent paths of each operation are expressed as they were just before the operation took place so the list can be replayed on a copy of the model.
+
+\a changedCells maps the path of each parent to a bit mask of the cells under it whose data or flags changed.
+The mask has one bit per cell of the parent, the bit for a cell is at position \c{row * columnCount + column}
+using the dimensions of the parent when takeChangeSet() was called.
+Cells removed before the checkpoint are not reported.
+\sa GenericModel::takeChangeSet()
+*/
+
+/*!
+\class GenericModel::ChangeSet::Operation
+\brief A single structural change to the model
+\details \a type determines how the other members should be read:
+\list
+\li InsertRows, RemoveRows, InsertColumns and RemoveColumns: \a count rows or columns starting from \a first under \a parent
+\li MoveRows and MoveColumns: \a count rows or columns starting from \a first under \a parent moved to \a destination under \a destinationParent
+\li Sort: the children of \a parent were reordered by sort() using \a sortKeys, \a count is the number of rows sorted.
+\a permutation lists, for each row after the sort, the row it occupied before it. If \a recursive is true the descendants of \a parent were
+sorted too, their order is not listed but, since the sort is stable, calling sort() with the same keys on a copy of the model reproduces it
+\li HeaderData: the header \a first in \a orientation changed
+\endlist
+*/
+GenericModel::ChangeSet::Operation::Operation(OperationType type, const IndexPath &parent, int first, int count)
+    : type(type)
+    , parent(parent)
+    , first(first)
+    , count(count)
+    , destination(-1)
+    , orientation(Qt::Horizontal)
+    , recursive(false)
+{ }
+
+/*!
+\brief Returns true if nothing changed since the last checkpoint
+*/
+bool GenericModel::ChangeSet::isEmpty() const
+{
+    return operations.isEmpty() && changedCells.isEmpty();
+}
+
+/*!
+\brief Enables or disables keeping track of the changes made to the model
+\details While enabled, the model records which cells had their data or flags changed and the structural operations applied to it.
+The changes can be retrieved with takeChangeSet() so that a view, a serialiser or a network sync layer can process only what changed
+instead of the whole model.
+
+Enabling the tracking sets a new checkpoint, disabling it discards anything recorded so far.
+\sa takeChangeSet()
+*/
+void GenericModel::setChangeTracking(bool enabled)
 {
     Q_D(GenericModel);
-    if (d->m_mergeDisplayEdit == val)
+    if (d->m_trackChanges == enabled)
         return;
-    d->setMergeDisplayEdit(val);
-    d->m_mergeDisplayEdit = val;
-    mergeDisplayEditChanged(d->m_mergeDisplayEdit);
-    d->signalAllChanged({Qt::DisplayRole, Qt::EditRole});
+    d->m_trackChanges = enabled;
+    d->m_changedItems.clear();
+    d->m_operations.clear();
 }
 
 /*!
-\property GenericModel::sortRole
-\accessors %sortRole(), setSortRole()
-\notifier sortRoleChanged()
-\brief the item role that is used to query the source model's data when sorting items
+\brief Returns true if the model keeps track of the changes made to it
+\sa setChangeTracking()
+*/
+bool GenericModel::isChangeTrackingEnabled() const
+{
+    Q_D(const GenericModel);
+    return d->m_trackChanges;
+}
 
-The default value is Qt::DisplayRole.
+/*!
+\brief Returns the changes recorded since the last checkpoint and sets a new one
+\details If setChangeTracking() was not enabled an empty ChangeSet is returned.
+\sa setChangeTracking(), ChangeSet
 */
-int GenericModel::sortRole() const
+GenericModel::ChangeSet GenericModel::takeChangeSet()
+{
+    Q_D(GenericModel);
+    ChangeSet result;
+    result.operations.swap(d->m_operations);
+    QHash<const GenericModelItem *, QBitArray> changedByParent;
+    for (auto i = d->m_changedItems.cbegin(), iEnd = d->m_changedItems.cend(); i != iEnd; ++i) {
+        const GenericModelItem *parentItem = (*i)->parent;
+        Q_ASSERT(parentItem);
+        const int parentColumns = parentItem->columnCount();
+        auto bitsIter = changedByParent.find(parentItem);
+        if (bitsIter == changedByParent.end())
+            bitsIter = changedByParent.insert(parentItem, QBitArray(parentItem->rowCount() * parentColumns));
+        bitsIter->setBit(((*i)->row() * parentColumns) + (*i)->column());
+    }
+    d->m_changedItems.clear();
+    for (auto i = changedByParent.cbegin(), iEnd = changedByParent.cend(); i != iEnd; ++i)
+        result.changedCells.insert(d->pathForItem(i.key()), i.value());
+    return result;
+}
+
+/*!
+\brief Returns the position of \a index expressed as the row and column of each of its ancestors, starting from the top level
+\details The path does not depend on the model object so it can be used to identify the same cell in a copy of the model.
+An invalid index returns an empty path.
+\sa indexForPath()
+*/
+GenericModel::IndexPath GenericModel::pathForIndex(const QModelIndex &index) const
 {
+    if (!index.isValid())
+        return IndexPath();
+    Q_ASSERT(index.model() == this);
     Q_D(const GenericModel);
-    return d->sortRole;
+    return d->pathForItem(d->itemForIndex(index));
 }
-void GenericModel::setSortRole(int role)
+
+/*!
+\brief Returns the index located at \a path
+\details If \a path does not point to a valid cell an invalid index is returned.
+\sa pathForIndex()
+*/
+QModelIndex GenericModel::indexForPath(const IndexPath &path) const
+{
+    QModelIndex result;
+    for (int i = 0, maxI = path.size(); i < maxI; ++i) {
+        result = index(path.at(i).first, path.at(i).second, result);
+        if (!result.isValid())
+            return QModelIndex();
+    }
+    return result;
+}
+
+/*!
+\brief Updates the top level rows of the model to match \a newData changing only what is different
+\details Rows are matched using the value stored in \a keyRole of \a keyColumn, compared by their string representation.
+The minimal set of rows is then removed, moved and inserted so that the model ends up with the same rows, in the same order, as \a newData.
+For the rows present in both models only the cells whose data, flags or children differ are updated.
+Top level columns are added or removed at the end to match the column count of \a newData, as are the horizontal headers.
+The vertical headers travel with their rows: inserted rows take the header they have in \a newData and matched rows have theirs updated
+when it differs.
+
+Unlike resetting the model, every change is notified with the granular signals so views keep their selection and scroll position
+and proxy models only process what actually changed.
+
+Rows without a key, or whose key is repeated, are not matched and get removed and reinserted.
+If keepSorted() is active the final rows are sorted rather than being in the same order as \a newData.
+
+Returns false if \a keyColumn is not a valid column of \a newData.
+*/
+bool GenericModel::applyDiff(const GenericModel &newData, int keyColumn, int keyRole)
 {
+    if (keyColumn < 0 || keyColumn >= newData.columnCount())
+        return false;
+    if (&newData == this)
+        return true;
     Q_D(GenericModel);
-    if (d->sortRole == role)
-        return;
-    d->sortRole = role;
-    sortRoleChanged(role);
+    const GenericModelPrivate *newD = newData.d_func();
+    const int oldKeepSortedColumn = d->m_keepSortedColumn;
+    d->m_keepSortedColumn = -1;
+    const int newColCount = newData.columnCount();
+    if (columnCount() < newColCount)
+        insertColumns(columnCount(), newColCount - columnCount());
+    else if (columnCount() > newColCount)
+        removeColumns(newColCount, columnCount() - newColCount);
+    for (int i = 0; i < newColCount; ++i) {
+        RolesContainer newHeader = newD->hHeaderData.at(i);
+        if (newD->m_mergeDisplayEdit != d->m_mergeDisplayEdit)
+            GenericModelPrivate::setMergeDisplayEdit(d->m_mergeDisplayEdit, newHeader);
+        if (d->hHeaderData.at(i) != newHeader) {
+            d->hHeaderData[i] = newHeader;
+            d->recordHeaderChange(Qt::Horizontal, i);
+            headerDataChanged(Qt::Horizontal, i, i);
+        }
+    }
+    const GenericModelItem *newRoot = newD->root;
+    const int newRowCount = newRoot->rowCount();
+    const int oldKeyRole = (d->m_mergeDisplayEdit && keyRole == Qt::EditRole) ? int(Qt::DisplayRole) : keyRole;
+    const int newKeyRole = (newD->m_mergeDisplayEdit && keyRole == Qt::EditRole) ? int(Qt::DisplayRole) : keyRole;
+    QHash<QString, int> newRowForKey;
+    QSet<QString> repeatedKeys;
+    for (int i = 0; i < newRowCount; ++i) {
+        const QVariant keyValue = newRoot->childAt(i, keyColumn)->data.value(newKeyRole);
+        if (!keyValue.isValid())
+            continue;
+        const QString key = keyValue.toString();
+        if (newRowForKey.contains(key))
+            repeatedKeys.insert(key);
+        else
+            newRowForKey.insert(key, i);
+    }
+    for (auto i = repeatedKeys.cbegin(), iEnd = repeatedKeys.cend(); i != iEnd; ++i)
+        newRowForKey.remove(*i);
+    // match the old rows, each new row can be claimed only once
+    QVector<int> oldToNew(d->root->rowCount(), -1);
+    QBitArray newMatched(newRowCount);
+    for (int i = 0, maxI = oldToNew.size(); i < maxI; ++i) {
+        const QVariant keyValue = d->root->childAt(i, keyColumn)->data.value(oldKeyRole);
+        if (!keyValue.isValid())
+            continue;
+        const auto newRowIter = newRowForKey.constFind(keyValue.toString());
+        if (newRowIter == newRowForKey.constEnd() || newMatched.testBit(newRowIter.value()))
+            continue;
+        oldToNew[i] = newRowIter.value();
+        newMatched.setBit(newRowIter.value());
+    }
+    // remove the unmatched rows in contiguous blocks starting from the bottom
+    for (int i = oldToNew.size() - 1; i >= 0; --i) {
+        if (oldToNew.at(i) >= 0)
+            continue;
+        int firstRow = i;
+        while (firstRow > 0 && oldToNew.at(firstRow - 1) < 0)
+            --firstRow;
+        removeRows(firstRow, i - firstRow + 1);
+        oldToNew.remove(firstRow, i - firstRow + 1);
+        i = firstRow;
+    }
+    // the rows in the longest increasing subsequence of new positions are already in the right order, only the others need to move
+    QBitArray isStable(newRowCount);
+    {
+        QVector<int> tailRows;
+        QVector<int> previousRow(oldToNew.size(), -1);
+        for (int i = 0, maxI = oldToNew.size(); i < maxI; ++i) {
+            const auto tailIter = std::lower_bound(tailRows.begin(), tailRows.end(), oldToNew.at(i),
+                                                   [&oldToNew](int row, int value) -> bool { return oldToNew.at(row) < value; });
+            if (tailIter != tailRows.begin())
+                previousRow[i] = *(tailIter - 1);
+            if (tailIter == tailRows.end())
+                tailRows.append(i);
+            else
+                *tailIter = i;
+        }
+        for (int i = tailRows.isEmpty() ? -1 : tailRows.last(); i >= 0; i = previousRow.at(i))
+            isStable.setBit(oldToNew.at(i));
+    }
+    // the current row of every matched new row, kept up to date while moving so no row has to be searched for
+    QVector<int> currentRow(newRowCount, -1);
+    for (int i = 0, maxI = oldToNew.size(); i < maxI; ++i)
+        currentRow[oldToNew.at(i)] = i;
+    int lastPlacedRow = -1;
+    for (int i = 0; i < newRowCount; ++i) {
+        if (!newMatched.testBit(i))
+            continue;
+        if (!isStable.testBit(i)) {
+            const int sourceRow = currentRow.at(i);
+            const int destinationRow = lastPlacedRow < 0 ? 0 : currentRow.at(lastPlacedRow) + 1;
+            if (sourceRow != destinationRow && sourceRow + 1 != destinationRow) {
+                moveRows(QModelIndex(), sourceRow, 1, QModelIndex(), destinationRow);
+                // only the rows between the two positions shift, like they did in the model
+                const auto sourceIter = oldToNew.begin() + sourceRow;
+                const int firstShifted = qMin(sourceRow, destinationRow);
+                const int lastShifted = destinationRow > sourceRow ? destinationRow - 1 : sourceRow;
+                if (destinationRow > sourceRow)
+                    std::rotate(sourceIter, sourceIter + 1, oldToNew.begin() + destinationRow);
+                else
+                    std::rotate(oldToNew.begin() + destinationRow, sourceIter, sourceIter + 1);
+                for (int j = firstShifted; j <= lastShifted; ++j)
+                    currentRow[oldToNew.at(j)] = j;
+            }
+        }
+        lastPlacedRow = i;
+    }
+    // the matched rows are now in the final order, insert the new ones and update the others
+    for (int i = 0; i < newRowCount; ++i) {
+        if (!newMatched.testBit(i)) {
+            int lastRow = i;
+            while (lastRow + 1 < newRowCount && !newMatched.testBit(lastRow + 1))
+                ++lastRow;
+            d->insertClonedRows(d->root, i, newRoot, i, lastRow - i + 1, newD->m_mergeDisplayEdit, &newD->vHeaderData);
+            i = lastRow;
+            continue;
+        }
+        RolesContainer newHeader = newD->vHeaderData.at(i);
+        if (newD->m_mergeDisplayEdit != d->m_mergeDisplayEdit)
+            GenericModelPrivate::setMergeDisplayEdit(d->m_mergeDisplayEdit, newHeader);
+        if (d->vHeaderData.at(i) != newHeader) {
+            d->vHeaderData[i] = newHeader;
+            d->recordHeaderChange(Qt::Vertical, i);
+            headerDataChanged(Qt::Vertical, i, i);
+        }
+        for (int j = 0; j < newColCount; ++j) {
+            GenericModelItem *item = d->root->childAt(i, j);
+            const GenericModelItem *newItem = newRoot->childAt(i, j);
+            d->replaceItemData(item, newItem->data, newD->m_mergeDisplayEdit);
+            if (item->flags != newItem->flags)
+                setFlags(d->indexForItem(item), newItem->flags);
+            if (item->span() != newItem->span())
+                setSpan(d->indexForItem(item), newItem->span());
+            if (!item->isSameTree(newItem))
+                d->replaceChildren(item, newItem, newD->m_mergeDisplayEdit);
+        }
+    }
+    d->m_keepSortedColumn = oldKeepSortedColumn;
+    if (oldKeepSortedColumn >= 0)
+        sort(QVector<SortKey>{SortKey(oldKeepSortedColumn, d->m_keepSortedRole, d->m_keepSortedOrder)}, QModelIndex(), false);
+    return true;
+}
+
+/*!
+\reimp
+\details The search runs directly on the internal storage of the model.
+When there are enough items to search they are split among QThread::idealThreadCount() threads,
+the results are returned in the same order QAbstractItemModel::match() would return them.
+*/
+QModelIndexList GenericModel::match(const QModelIndex &start, int role, const QVariant &value, int hits, Qt::MatchFlags flags) const
+{
+    if (!start.isValid() || hits == 0)
+        return QModelIndexList();
+    Q_ASSERT(start.model() == this);
+    const int matchType = static_cast<int>(flags & Qt::MatchTypeMask);
+    const Qt::CaseSensitivity cs = (flags & Qt::MatchCaseSensitive) ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    const QString text = value.toString();
+    MatchPredicate predicate;
+    switch (matchType) {
+    case Qt::MatchExactly:
+        predicate = [value](const QVariant &data) -> bool { return value == data; };
+        break;
+    case Qt::MatchFixedString:
+        predicate = [text, cs](const QVariant &data) -> bool { return data.toString().compare(text, cs) == 0; };
+        break;
+    case Qt::MatchContains:
+        predicate = [text, cs](const QVariant &data) -> bool { return data.toString().contains(text, cs); };
+        break;
+    case Qt::MatchStartsWith:
+        predicate = [text, cs](const QVariant &data) -> bool { return data.toString().startsWith(text, cs); };
+        break;
+    case Qt::MatchEndsWith:
+        predicate = [text, cs](const QVariant &data) -> bool { return data.toString().endsWith(text, cs); };
+        break;
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 12, 0))
+    case Qt::MatchWildcard: {
+        const QRegularExpression wildcardExp(QRegularExpression::anchoredPattern(QRegularExpression::wildcardToRegularExpression(text)),
+                                             cs == Qt::CaseSensitive ? QRegularExpression::NoPatternOption
+                                                                     : QRegularExpression::CaseInsensitiveOption);
+        predicate = [wildcardExp](const QVariant &data) -> bool { return wildcardExp.match(data.toString()).hasMatch(); };
+        break;
+    }
+#endif
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 15, 0))
+    case Qt::MatchRegularExpression: {
+        QRegularExpression regExp;
+        if (value.userType() == QMetaType::QRegularExpression) {
+            regExp = value.toRegularExpression();
+        } else {
+            regExp.setPattern(text);
+            if (cs == Qt::CaseInsensitive)
+                regExp.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+        }
+        predicate = [regExp](const QVariant &data) -> bool { return regExp.match(data.toString()).hasMatch(); };
+        break;
+    }
+#endif
+    default:
+        // match types not supported by QRegularExpression in this version of Qt
+        return QAbstractItemModel::match(start, role, value, hits, flags);
+    }
+    Q_D(const GenericModel);
+    const GenericModelItem *parentItem = d->itemForIndex(start)->parent;
+    const bool recursive = flags & Qt::MatchRecursive;
+    QVector<const GenericModelItem *> items;
+    d->collectColumnItems(parentItem, start.row(), parentItem->rowCount() - 1, start.column(), recursive, items);
+    if ((flags & Qt::MatchWrap) && start.row() > 0)
+        d->collectColumnItems(parentItem, 0, start.row() - 1, start.column(), recursive, items);
+    if (d->m_mergeDisplayEdit && role == Qt::EditRole)
+        role = Qt::DisplayRole;
+    return d->matchItems(items, role, predicate, hits);
+}
+
+/*!
+\brief Returns the indexes of all the descendants of \a parent for which \a predicate returns true
+\details \a predicate is called with the data stored under \a role of each item.
+If \a flags contains Qt::MatchRecursive the children of every item are searched too, other flags are ignored.
+The results are in the same order used by visit().
+
+The items are split among QThread::idealThreadCount() threads so \a predicate must be thread safe.
+\sa match(), visitParallel()
+*/
+QModelIndexList GenericModel::findAll(const MatchPredicate &predicate, int role, Qt::MatchFlags flags, const QModelIndex &parent) const
+{
+    Q_D(const GenericModel);
+    QVector<const GenericModelItem *> items;
+    d->collectItems(d->itemForIndex(parent), flags & Qt::MatchRecursive, items);
+    if (d->m_mergeDisplayEdit && role == Qt::EditRole)
+        role = Qt::DisplayRole;
+    return d->matchItems(items, role, predicate, -1);
+}
+
+/*!
+\fn template <class T> T GenericModel::value(const QModelIndex &index, int role) const
+\brief Returns the data stored under the given \a role for the item referred to by the \a index converted to \a T
+\details This is equivalent to \c{data(index, role).value<T>()} but reads the stored QVariant in place rather than copying it.
+If no data is stored a default constructed \a T is returned.
+\sa data(), setValue()
+*/
+
+/*!
+\fn template <class T> bool GenericModel::setValue(const QModelIndex &index, int role, const T &value)
+\brief Sets the \a role data for the item at \a index to \a value
+\details This is equivalent to \c{setData(index, QVariant::fromValue(value), role)}
+\sa setData(), value()
+*/
+
+/*!
+\fn template <class T> bool GenericModel::readColumn(const QModelIndex &parent, int column, int role, T *out) const
+\brief Copies the data stored under the given \a role for all the children of \a parent in \a column into \a out
+\details \a out must point to a buffer of at least \c{rowCount(parent)} elements.
+The values are read directly from the internal storage, without creating a QModelIndex or copying a QVariant for each row.
+Cells with no data for \a role are set to a default constructed \a T.
+
+Returns false if \a column is not a valid column of \a parent or \a out is null.
+\sa value()
+*/
+
+const QVariant *GenericModel::storedData(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return nullptr;
+    Q_D(const GenericModel);
+    if (d->m_mergeDisplayEdit && role == Qt::EditRole)
+        role = Qt::DisplayRole;
+    const RolesContainer &itemData = d->itemForIndex(index)->data;
+    const auto roleIter = itemData.constFind(role);
+    if (roleIter == itemData.constEnd())
+        return nullptr;
+    return &roleIter.value();
+}
+
+bool GenericModel::storedColumn(const QModelIndex &parent, int column, int role, void *buffer, StoredValueReader reader) const
+{
+    Q_ASSERT(buffer);
+    Q_ASSERT(reader);
+    Q_D(const GenericModel);
+    const GenericModelItem *parentItem = d->itemForIndex(parent);
+    if (column < 0 || column >= parentItem->columnCount())
+        return false;
+    if (d->m_mergeDisplayEdit && role == Qt::EditRole)
+        role = Qt::DisplayRole;
+    // each value is handed to the reader as soon as it is found so no intermediate buffer is needed
+    for (int i = 0, rowCnt = parentItem->rowCount(); i < rowCnt; ++i) {
+        const RolesContainer &itemData = parentItem->childAt(i, column)->data;
+        const auto roleIter = itemData.constFind(role);
+        reader(buffer, i, roleIter == itemData.constEnd() ? nullptr : &roleIter.value());
+    }
+    return true;
+}
+
+/*!
+\class GenericModel::CellView
+\brief A read only view of a cell handed out by GenericModel::visit()
+\details Unlike QModelIndex, it reads directly from the internal storage of the model.
+It is only valid for the duration of the call to the visitor it was passed to.
+\sa GenericModel::visit()
+*/
+GenericModel::CellView::CellView(const GenericModelItem *item, int depth, bool mergeDisplayEdit)
+    : m_item(item)
+    , m_depth(depth)
+    , m_mergeDisplayEdit(mergeDisplayEdit)
+{
+    Q_ASSERT(m_item);
+}
+
+/*!
+\brief Returns the row of the cell
+*/
+int GenericModel::CellView::row() const
+{
+    return m_item->row();
+}
+
+/*!
+\brief Returns the column of the cell
+*/
+int GenericModel::CellView::column() const
+{
+    return m_item->column();
+}
+
+/*!
+\brief Returns the number of ancestors of the cell, top level cells have depth 0
+*/
+int GenericModel::CellView::depth() const
+{
+    return m_depth;
+}
+
+/*!
+\brief Returns the data stored in the cell under the given \a role
+\sa GenericModel::data()
+*/
+QVariant GenericModel::CellView::data(int role) const
+{
+    if (m_mergeDisplayEdit && role == Qt::EditRole)
+        role = Qt::DisplayRole;
+    return m_item->data.value(role);
+}
+
+/*!
+\brief Returns all the data stored in the cell
+\sa GenericModel::itemData()
+*/
+QMap<int, QVariant> GenericModel::CellView::itemData() const
+{
+    if (!m_mergeDisplayEdit)
+        return convertFromContainer<QMap<int, QVariant>>(m_item->data);
+    QMap<int, QVariant> result = convertFromContainer<QMap<int, QVariant>>(m_item->data);
+    const auto displayIter = result.constFind(Qt::DisplayRole);
+    if (displayIter != result.constEnd())
+        result.insert(Qt::EditRole, displayIter.value());
+    return result;
+}
+
+/*!
+\brief Returns the flags of the cell
+*/
+Qt::ItemFlags GenericModel::CellView::flags() const
+{
+    return m_item->flags;
+}
+
+/*!
+\brief Returns the number of rows of the children of the cell
+*/
+int GenericModel::CellView::rowCount() const
+{
+    return m_item->rowCount();
+}
+
+/*!
+\brief Returns the number of columns of the children of the cell
+*/
+int GenericModel::CellView::columnCount() const
+{
+    return m_item->columnCount();
+}
+
+/*!
+\brief Walks all the descendants of \a parent calling \a visitor for each of them
+\details The cells are visited depth first, row by row and column by column within each row.
+Each cell is visited before its children. If \a visitor returns false the children of that cell are skipped.
+
+This is much faster than iterating with index(), rowCount() and data() as it reads the internal storage directly without creating any QModelIndex.
+The model must not be modified while the visit is in progress.
+\sa visitParallel(), CellView
+*/
+void GenericModel::visit(const QModelIndex &parent, const Visitor &visitor) const
+{
+    Q_D(const GenericModel);
+    const GenericModelItem *parentItem = d->itemForIndex(parent);
+    if (parentItem->rowCount() == 0 || parentItem->columnCount() == 0)
+        return;
+    d->visitChildren(parentItem, 0, parentItem->rowCount() - 1, pathForIndex(parent).size(), visitor);
+}
+
+/*!
+\brief Walks all the descendants of \a parent calling \a visitor for each of them using multiple threads
+\details The rows of \a parent are split among QThread::idealThreadCount() threads, each walking its rows and their descendants
+in the same order as visit(). The function returns once all the cells have been visited.
+
+\a visitor is called concurrently so it must be thread safe. This is meant for read only work like computing checksums or exporting.
+The model must not be modified while the visit is in progress.
+\sa visit()
+*/
+void GenericModel::visitParallel(const QModelIndex &parent, const Visitor &visitor) const
+{
+    Q_D(const GenericModel);
+    const GenericModelItem *parentItem = d->itemForIndex(parent);
+    const int rowCnt = parentItem->rowCount();
+    if (rowCnt == 0 || parentItem->columnCount() == 0)
+        return;
+    const int depth = pathForIndex(parent).size();
+    const int chunkCount = qMin(rowCnt, QThread::idealThreadCount());
+    if (chunkCount <= 1) {
+        d->visitChildren(parentItem, 0, rowCnt - 1, depth, visitor);
+        return;
+    }
+    QThreadPool pool;
+    pool.setMaxThreadCount(chunkCount - 1);
+    const int chunkSize = rowCnt / chunkCount;
+    const int chunkRemainder = rowCnt % chunkCount;
+    int firstRow = 0;
+    for (int i = 0; i < chunkCount; ++i) {
+        const int lastRow = firstRow + chunkSize + (i < chunkRemainder ? 1 : 0) - 1;
+        if (i == chunkCount - 1)
+            d->visitChildren(parentItem, firstRow, lastRow, depth, visitor);
+        else
+            pool.start(new GenericModelVisitTask(d, parentItem, firstRow, lastRow, depth, visitor));
+        firstRow = lastRow + 1;
+    }
+    pool.waitForDone();
+}
+
+/*!
+\reimp
+\details At the moment no view provided by Qt supports this
+*/
+QSize GenericModel::span(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return QSize();
+    Q_ASSERT(index.model() == this);
+    Q_D(const GenericModel);
+    return d->itemForIndex(index)->span();
+}
+
+/*!
+\brief Set the amount of rows and columns an item should occupy.
+\details At the moment no view provided by Qt supports this
+*/
+bool GenericModel::setSpan(const QModelIndex &index, const QSize &size)
+{
+    if (!index.isValid() || size.isEmpty())
+        return false;
+    Q_ASSERT(index.model() == this);
+    Q_D(GenericModel);
+    d->itemForIndex(index)->setSpan(size);
+    d->markChanged(d->itemForIndex(index));
+    const QModelIndex parIdx = index.parent();
+    const QModelIndex bottomRight = this->index(qMin(index.row() + size.height(), rowCount(parIdx) - 1),
+                                                qMin(index.column() + size.width(), columnCount(parIdx) - 1), parIdx);
+    dataChanged(index, bottomRight);
+    return true;
+}
+
+/*!
+\reimp
+*/
+Qt::DropActions GenericModel::supportedDragActions() const
+{
+    return Qt::CopyAction | Qt::MoveAction;
+}
+
+/*!
+\reimp
+*/
+Qt::DropActions GenericModel::supportedDropActions() const
+{
+    return Qt::CopyAction | Qt::MoveAction;
+}
+
+/*!
+\property GenericModel::mergeDisplayEdit
+\accessors %mergeDisplayEdit(), setMergeDisplayEdit()
+\notifier mergeDisplayEditChanged()
+\brief This property determines if the Qt::DisplayRole and Qt::EditRole should be merged in the extra row/column
+\details By default the two roles are one and the same you can use this property to separate them.
+If there's any data in the role when you set this property to true it will be duplicated for both roles.
+If there is data both in Qt::DisplayRole and Qt::EditRole when you set this property to false Qt::DisplayRole will prevail.
+*/
+bool GenericModel::mergeDisplayEdit() const
+{
+    Q_D(const GenericModel);
+    return d->m_mergeDisplayEdit;
+}
+
+void GenericModel::setMergeDisplayEdit(bool val)
+{
+    Q_D(GenericModel);
+    if (d->m_mergeDisplayEdit == val)
+        return;
+    d->setMergeDisplayEdit(val);
+    d->m_mergeDisplayEdit = val;
+    mergeDisplayEditChanged(d->m_mergeDisplayEdit);
+    d->signalAllChanged({Qt::DisplayRole, Qt::EditRole});
+}
+
+/*!
+\property GenericModel::sortRole
+\accessors %sortRole(), setSortRole()
+\notifier sortRoleChanged()
+\brief the item role that is used to query the source model's data when sorting items
+
+The default value is Qt::DisplayRole.
+*/
+int GenericModel::sortRole() const
+{
+    Q_D(const GenericModel);
+    return d->sortRole;
+}
+void GenericModel::setSortRole(int role)
+{
+    Q_D(GenericModel);
+    if (d->sortRole == role)
+        return;
+    d->sortRole = role;
+    sortRoleChanged(role);
+}
+
+bool GenericModelPrivate::isInternedRole(int column, int role) const
+{
+    if (m_internedRoles.isEmpty())
+        return false;
+    if (m_mergeDisplayEdit && role == Qt::EditRole)
+        role = Qt::DisplayRole;
+    return m_internedRoles.contains(qMakePair(column, role));
+}
+
+QVariant GenericModelPrivate::internValue(const QVariant &value)
+{
+    if (value.userType() != QMetaType::QString)
+        return value;
+    const QString stringValue = value.toString();
+    if (stringValue.isEmpty())
+        return value;
+    auto poolIter = m_internPool.find(stringValue);
+    if (poolIter == m_internPool.end())
+        poolIter = m_internPool.insert(stringValue, 0);
+    ++poolIter.value();
+    return QVariant(poolIter.key());
+}
+
+void GenericModelPrivate::releaseInterned(int column, int role, const QVariant &value)
+{
+    // values stored outside the interned columns might share the data of a pooled string without being counted
+    if (m_internPool.isEmpty() || value.userType() != QMetaType::QString || !isInternedRole(column, role))
+        return;
+    const QString stringValue = value.toString();
+    const auto poolIter = m_internPool.find(stringValue);
+    // equal strings that were not interned have their own allocation and must not be counted
+    if (poolIter == m_internPool.end() || poolIter.key().constData() != stringValue.constData())
+        return;
+    if (--poolIter.value() == 0)
+        m_internPool.erase(poolIter);
+}
+
+void GenericModelPrivate::releaseInternedChildren(const GenericModelItem *item)
+{
+    if (m_internPool.isEmpty())
+        return;
+    for (int i = 0, maxI = item->children.size(); i < maxI; ++i)
+        releaseInterned(item->children.at(i));
+}
+
+void GenericModelPrivate::internChildren(GenericModelItem *item)
+{
+    if (m_internedRoles.isEmpty())
+        return;
+    for (int i = 0, maxI = item->children.size(); i < maxI; ++i)
+        internItem(item->children.at(i));
+}
+
+void GenericModelPrivate::releaseInterned(const GenericModelItem *item)
+{
+    for (auto i = item->data.constBegin(), iEnd = item->data.constEnd(); i != iEnd; ++i)
+        releaseInterned(item->column(), i.key(), i.value());
+    for (const GenericModelItem *child : item->children)
+        releaseInterned(child);
+}
+
+GenericModelAggregateState::GenericModelAggregateState()
+    : count(0)
+    , numericCount(0)
+    , sum(0.0)
+    , minMaxDirty(false)
+    , dirty(true)
+{ }
+
+void GenericModelAggregateState::reset()
+{
+    count = 0;
+    numericCount = 0;
+    sum = 0.0;
+    minimum = QVariant();
+    maximum = QVariant();
+    minMaxDirty = false;
+    dirty = false;
+}
+
+bool GenericModelAggregateState::isNumeric(const QVariant &value)
+{
+    switch (value.userType()) {
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+    case QMetaType::Short:
+    case QMetaType::UShort:
+    case QMetaType::Long:
+    case QMetaType::ULong:
+    case QMetaType::Float:
+    case QMetaType::Double:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void GenericModelAggregateState::addValue(const QVariant &value)
+{
+    if (dirty || !value.isValid())
+        return;
+    ++count;
+    if (isNumeric(value)) {
+        ++numericCount;
+        sum += value.toDouble();
+    }
+    if (minMaxDirty)
+        return;
+    if (!minimum.isValid() || isVariantLessThan(value, minimum))
+        minimum = value;
+    if (!maximum.isValid() || isVariantLessThan(maximum, value))
+        maximum = value;
+}
+
+void GenericModelAggregateState::removeValue(const QVariant &value)
+{
+    if (dirty || !value.isValid())
+        return;
+    if (--count == 0) {
+        reset();
+        return;
+    }
+    if (isNumeric(value)) {
+        // avoid accumulating rounding errors once all numbers are gone
+        if (--numericCount == 0)
+            sum = 0.0;
+        else
+            sum -= value.toDouble();
+    }
+    if (!minMaxDirty && (value == minimum || value == maximum))
+        minMaxDirty = true;
+}
+
+void GenericModelPrivate::addToAggregates(const GenericModelItem *item)
+{
+    if (m_aggregates.isEmpty() || item->parent != root)
+        return;
+    for (auto i = item->data.constBegin(), iEnd = item->data.constEnd(); i != iEnd; ++i) {
+        const auto stateIter = m_aggregates.find(qMakePair(item->column(), i.key()));
+        if (stateIter != m_aggregates.end())
+            stateIter->addValue(i.value());
+    }
+}
+
+void GenericModelPrivate::removeFromAggregates(const GenericModelItem *item)
+{
+    if (m_aggregates.isEmpty() || item->parent != root)
+        return;
+    for (auto i = item->data.constBegin(), iEnd = item->data.constEnd(); i != iEnd; ++i) {
+        const auto stateIter = m_aggregates.find(qMakePair(item->column(), i.key()));
+        if (stateIter != m_aggregates.end())
+            stateIter->removeValue(i.value());
+    }
+}
+
+void GenericModelPrivate::updateAggregates(const GenericModelItem *item, int role, const QVariant &oldValue, const QVariant &newValue)
+{
+    if (m_aggregates.isEmpty() || item->parent != root)
+        return;
+    const auto stateIter = m_aggregates.find(qMakePair(item->column(), role));
+    if (stateIter == m_aggregates.end())
+        return;
+    stateIter->removeValue(oldValue);
+    stateIter->addValue(newValue);
+}
+
+void GenericModelPrivate::insertAggregateColumns(int column, int count)
+{
+    if (m_aggregates.isEmpty())
+        return;
+    QHash<QPair<int, int>, GenericModelAggregateState> shiftedAggregates;
+    for (auto i = m_aggregates.constBegin(), iEnd = m_aggregates.constEnd(); i != iEnd; ++i) {
+        QPair<int, int> aggregateKey = i.key();
+        if (aggregateKey.first >= column)
+            aggregateKey.first += count;
+        shiftedAggregates.insert(aggregateKey, i.value());
+    }
+    m_aggregates = shiftedAggregates;
+}
+
+void GenericModelPrivate::removeAggregateColumns(int column, int count)
+{
+    if (m_aggregates.isEmpty())
+        return;
+    QHash<QPair<int, int>, GenericModelAggregateState> shiftedAggregates;
+    for (auto i = m_aggregates.constBegin(), iEnd = m_aggregates.constEnd(); i != iEnd; ++i) {
+        QPair<int, int> aggregateKey = i.key();
+        if (aggregateKey.first >= column && aggregateKey.first < column + count)
+            continue;
+        if (aggregateKey.first >= column + count)
+            aggregateKey.first -= count;
+        shiftedAggregates.insert(aggregateKey, i.value());
+    }
+    m_aggregates = shiftedAggregates;
+}
+
+void GenericModelPrivate::moveAggregateColumns(int sourceColumn, int count, int destinationChild)
+{
+    if (m_aggregates.isEmpty())
+        return;
+    QHash<QPair<int, int>, GenericModelAggregateState> shiftedAggregates;
+    for (auto i = m_aggregates.constBegin(), iEnd = m_aggregates.constEnd(); i != iEnd; ++i) {
+        QPair<int, int> aggregateKey = i.key();
+        if (aggregateKey.first >= sourceColumn && aggregateKey.first < sourceColumn + count) {
+            if (destinationChild < sourceColumn)
+                aggregateKey.first -= sourceColumn - destinationChild;
+            else
+                aggregateKey.first += destinationChild - (sourceColumn + count);
+        } else if (destinationChild < sourceColumn && aggregateKey.first >= destinationChild && aggregateKey.first < sourceColumn) {
+            aggregateKey.first += count;
+        } else if (destinationChild > sourceColumn && aggregateKey.first >= sourceColumn + count && aggregateKey.first < destinationChild) {
+            aggregateKey.first -= count;
+        }
+        shiftedAggregates.insert(aggregateKey, i.value());
+    }
+    m_aggregates = shiftedAggregates;
+}
+
+void GenericModelPrivate::insertKeepSortedColumns(int column, int count)
+{
+    if (m_keepSortedColumn >= column)
+        m_keepSortedColumn += count;
+}
+
+void GenericModelPrivate::removeKeepSortedColumns(int column, int count)
+{
+    if (m_keepSortedColumn < column)
+        return;
+    if (m_keepSortedColumn < column + count)
+        m_keepSortedColumn = -1;
+    else
+        m_keepSortedColumn -= count;
+}
+
+void GenericModelPrivate::moveKeepSortedColumns(int sourceColumn, int count, int destinationChild)
+{
+    if (m_keepSortedColumn < 0)
+        return;
+    if (m_keepSortedColumn >= sourceColumn && m_keepSortedColumn < sourceColumn + count) {
+        if (destinationChild < sourceColumn)
+            m_keepSortedColumn -= sourceColumn - destinationChild;
+        else
+            m_keepSortedColumn += destinationChild - (sourceColumn + count);
+    } else if (destinationChild < sourceColumn && m_keepSortedColumn >= destinationChild && m_keepSortedColumn < sourceColumn) {
+        m_keepSortedColumn += count;
+    } else if (destinationChild > sourceColumn && m_keepSortedColumn >= sourceColumn + count && m_keepSortedColumn < destinationChild) {
+        m_keepSortedColumn -= count;
+    }
+}
+
+void GenericModelPrivate::insertInternedColumns(int column, int count)
+{
+    if (m_internedRoles.isEmpty())
+        return;
+    QSet<QPair<int, int>> shiftedRoles;
+    for (auto i = m_internedRoles.constBegin(), iEnd = m_internedRoles.constEnd(); i != iEnd; ++i) {
+        QPair<int, int> internedRole = *i;
+        if (internedRole.first >= column)
+            internedRole.first += count;
+        shiftedRoles.insert(internedRole);
+    }
+    m_internedRoles = shiftedRoles;
+}
+
+void GenericModelPrivate::removeInternedColumns(int column, int count)
+{
+    if (m_internedRoles.isEmpty())
+        return;
+    QSet<QPair<int, int>> shiftedRoles;
+    for (auto i = m_internedRoles.constBegin(), iEnd = m_internedRoles.constEnd(); i != iEnd; ++i) {
+        QPair<int, int> internedRole = *i;
+        if (internedRole.first >= column && internedRole.first < column + count)
+            continue;
+        if (internedRole.first >= column + count)
+            internedRole.first -= count;
+        shiftedRoles.insert(internedRole);
+    }
+    m_internedRoles = shiftedRoles;
+}
+
+void GenericModelPrivate::moveInternedColumns(int sourceColumn, int count, int destinationChild)
+{
+    if (m_internedRoles.isEmpty())
+        return;
+    QSet<QPair<int, int>> shiftedRoles;
+    for (auto i = m_internedRoles.constBegin(), iEnd = m_internedRoles.constEnd(); i != iEnd; ++i) {
+        QPair<int, int> internedRole = *i;
+        if (internedRole.first >= sourceColumn && internedRole.first < sourceColumn + count) {
+            if (destinationChild < sourceColumn)
+                internedRole.first -= sourceColumn - destinationChild;
+            else
+                internedRole.first += destinationChild - (sourceColumn + count);
+        } else if (destinationChild < sourceColumn && internedRole.first >= destinationChild && internedRole.first < sourceColumn) {
+            internedRole.first += count;
+        } else if (destinationChild > sourceColumn && internedRole.first >= sourceColumn + count && internedRole.first < destinationChild) {
+            internedRole.first -= count;
+        }
+        shiftedRoles.insert(internedRole);
+    }
+    m_internedRoles = shiftedRoles;
+}
+
+void GenericModelPrivate::invalidateAggregates()
+{
+    for (auto i = m_aggregates.begin(), iEnd = m_aggregates.end(); i != iEnd; ++i)
+        i->dirty = true;
+}
+
+void GenericModelPrivate::refreshAggregate(int column, int role, GenericModelAggregateState &state) const
+{
+    if (!state.dirty && !state.minMaxDirty)
+        return;
+    const bool fullRefresh = state.dirty;
+    if (fullRefresh) {
+        state.reset();
+    } else {
+        state.minimum = QVariant();
+        state.maximum = QVariant();
+        state.minMaxDirty = false;
+    }
+    if (column >= root->columnCount())
+        return;
+    for (int i = 0, maxI = root->rowCount(); i < maxI; ++i) {
+        const QVariant value = root->childAt(i, column)->data.value(role);
+        if (!value.isValid())
+            continue;
+        if (fullRefresh) {
+            state.addValue(value);
+            continue;
+        }
+        if (!state.minimum.isValid() || isVariantLessThan(value, state.minimum))
+            state.minimum = value;
+        if (!state.maximum.isValid() || isVariantLessThan(state.maximum, value))
+            state.maximum = value;
+    }
+}
+
+GenericModel::IndexPath GenericModelPrivate::pathForItem(const GenericModelItem *item) const
+{
+    GenericModel::IndexPath result;
+    for (; item && item != root; item = item->parent)
+        result.prepend(qMakePair(item->row(), item->column()));
+    return result;
+}
+
+void GenericModelPrivate::markChanged(GenericModelItem *item)
+{
+    if (m_trackChanges)
+        m_changedItems.insert(item);
+}
+
+void GenericModelPrivate::forgetChanged(const GenericModelItem *item)
+{
+    if (m_changedItems.isEmpty())
+        return;
+    m_changedItems.remove(const_cast<GenericModelItem *>(item));
+    for (int i = 0, maxI = item->children.size(); i < maxI; ++i)
+        forgetChanged(item->children.at(i));
+}
+
+void GenericModelPrivate::recordOperation(GenericModel::ChangeSet::OperationType type, const QModelIndex &parent, int first, int count)
+{
+    if (!m_trackChanges)
+        return;
+    Q_Q(const GenericModel);
+    m_operations.append(GenericModel::ChangeSet::Operation(type, q->pathForIndex(parent), first, count));
+}
+
+void GenericModelPrivate::recordSort(const QModelIndex &parent, const QVector<GenericModel::SortKey> &keys, bool recursive,
+                                     const QVector<int> &permutation)
+{
+    if (!m_trackChanges)
+        return;
+    Q_Q(const GenericModel);
+    GenericModel::ChangeSet::Operation sortOperation(GenericModel::ChangeSet::Sort, q->pathForIndex(parent), 0, permutation.size());
+    sortOperation.sortKeys = keys;
+    sortOperation.recursive = recursive;
+    sortOperation.permutation = permutation;
+    m_operations.append(sortOperation);
+}
+
+void GenericModelPrivate::recordHeaderChange(Qt::Orientation orientation, int section)
+{
+    if (!m_trackChanges)
+        return;
+    if (!m_operations.isEmpty()) {
+        const GenericModel::ChangeSet::Operation &lastOperation = m_operations.last();
+        if (lastOperation.type == GenericModel::ChangeSet::HeaderData && lastOperation.orientation == orientation && lastOperation.first == section)
+            return;
+    }
+    GenericModel::ChangeSet::Operation headerOperation(GenericModel::ChangeSet::HeaderData, GenericModel::IndexPath(), section, 1);
+    headerOperation.orientation = orientation;
+    m_operations.append(headerOperation);
+}
+
+void GenericModelPrivate::visitChildren(const GenericModelItem *parent, int firstRow, int lastRow, int depth,
+                                        const GenericModel::Visitor &visitor) const
+{
+    const int colCount = parent->columnCount();
+    for (int i = firstRow; i <= lastRow; ++i) {
+        for (int j = 0; j < colCount; ++j) {
+            const GenericModelItem *item = parent->childAt(i, j);
+            if (!visitor(GenericModel::CellView(item, depth, m_mergeDisplayEdit)))
+                continue;
+            if (item->rowCount() > 0 && item->columnCount() > 0)
+                visitChildren(item, 0, item->rowCount() - 1, depth + 1, visitor);
+        }
+    }
+}
+
+GenericModelVisitTask::GenericModelVisitTask(const GenericModelPrivate *model, const GenericModelItem *parent, int firstRow, int lastRow, int depth,
+                                             const GenericModel::Visitor &visitor)
+    : QRunnable()
+    , m_model(model)
+    , m_parent(parent)
+    , m_firstRow(firstRow)
+    , m_lastRow(lastRow)
+    , m_depth(depth)
+    , m_visitor(visitor)
+{ }
+
+void GenericModelVisitTask::run()
+{
+    m_model->visitChildren(m_parent, m_firstRow, m_lastRow, m_depth, m_visitor);
+}
+
+void GenericModelPrivate::collectColumnItems(const GenericModelItem *parent, int firstRow, int lastRow, int column, bool recursive,
+                                             QVector<const GenericModelItem *> &items) const
+{
+    if (column >= parent->columnCount())
+        return;
+    for (int i = firstRow; i <= lastRow; ++i) {
+        items.append(parent->childAt(i, column));
+        if (!recursive)
+            continue;
+        // like QAbstractItemModel::match, the children are those of the first column
+        const GenericModelItem *rowHead = parent->childAt(i, 0);
+        if (rowHead->rowCount() > 0)
+            collectColumnItems(rowHead, 0, rowHead->rowCount() - 1, column, true, items);
+    }
+}
+
+void GenericModelPrivate::collectItems(const GenericModelItem *parent, bool recursive, QVector<const GenericModelItem *> &items) const
+{
+    for (int i = 0, maxI = parent->children.size(); i < maxI; ++i) {
+        const GenericModelItem *item = parent->children.at(i);
+        items.append(item);
+        if (recursive && item->rowCount() > 0 && item->columnCount() > 0)
+            collectItems(item, true, items);
+    }
+}
+
+QModelIndexList GenericModelPrivate::matchItems(const QVector<const GenericModelItem *> &items, int role,
+                                                const GenericModel::MatchPredicate &predicate, int hits) const
+{
+    // below this size starting the threads costs more than the search itself
+    const int minimumItemsPerThread = 2048;
+    const int itemsCount = items.size();
+    const int chunkCount = qMin(QThread::idealThreadCount(), itemsCount / minimumItemsPerThread);
+    QVector<int> matchingItems;
+    if (chunkCount <= 1) {
+        GenericModelMatchTask::matchRange(items, 0, itemsCount - 1, role, predicate, hits, &matchingItems);
+    } else {
+        QVector<QVector<int>> chunkResults(chunkCount);
+        QThreadPool pool;
+        pool.setMaxThreadCount(chunkCount - 1);
+        const int chunkSize = itemsCount / chunkCount;
+        for (int i = 0; i < chunkCount; ++i) {
+            const int first = i * chunkSize;
+            const int last = i == chunkCount - 1 ? itemsCount - 1 : first + chunkSize - 1;
+            if (i == chunkCount - 1)
+                GenericModelMatchTask::matchRange(items, first, last, role, predicate, -1, &chunkResults[i]);
+            else
+                pool.start(new GenericModelMatchTask(items, first, last, role, predicate, &chunkResults[i]));
+        }
+        pool.waitForDone();
+        for (int i = 0; i < chunkCount; ++i)
+            matchingItems.append(chunkResults.at(i));
+        if (hits >= 0 && matchingItems.size() > hits)
+            matchingItems.resize(hits);
+    }
+    QModelIndexList result;
+    result.reserve(matchingItems.size());
+    for (int i = 0, maxI = matchingItems.size(); i < maxI; ++i)
+        result.append(indexForItem(const_cast<GenericModelItem *>(items.at(matchingItems.at(i)))));
+    return result;
+}
+
+GenericModelMatchTask::GenericModelMatchTask(const QVector<const GenericModelItem *> &items, int first, int last, int role,
+                                             const GenericModel::MatchPredicate &predicate, QVector<int> *result)
+    : QRunnable()
+    , m_items(items)
+    , m_first(first)
+    , m_last(last)
+    , m_role(role)
+    , m_predicate(predicate)
+    , m_result(result)
+{ }
+
+void GenericModelMatchTask::run()
+{
+    matchRange(m_items, m_first, m_last, m_role, m_predicate, -1, m_result);
+}
+
+void GenericModelMatchTask::matchRange(const QVector<const GenericModelItem *> &items, int first, int last, int role,
+                                       const GenericModel::MatchPredicate &predicate, int hits, QVector<int> *result)
+{
+    Q_ASSERT(result);
+    for (int i = first; i <= last && (hits < 0 || result->size() < hits); ++i) {
+        const auto roleIter = items.at(i)->data.constFind(role);
+        if (predicate(roleIter == items.at(i)->data.constEnd() ? QVariant() : roleIter.value()))
+            result->append(i);
+    }
+}
+
+void GenericModelPrivate::internItem(GenericModelItem *item)
+{
+    if (m_internedRoles.isEmpty())
+        return;
+    for (auto i = item->data.begin(), iEnd = item->data.end(); i != iEnd; ++i) {
+        if (isInternedRole(item->column(), i.key()))
+            i.value() = internValue(i.value());
+    }
+    for (int i = 0, maxI = item->children.size(); i < maxI; ++i)
+        internItem(item->children.at(i));
+}
+
+void GenericModelPrivate::setColumnInterning(GenericModelItem *item, int column, int role, bool enabled)
+{
+    if (item->column() == column) {
+        const auto roleIter = item->data.find(role);
+        if (roleIter != item->data.end()) {
+            if (enabled)
+                roleIter.value() = internValue(roleIter.value());
+            else
+                releaseInterned(column, role, roleIter.value());
+        }
+    }
+    for (int i = 0, maxI = item->children.size(); i < maxI; ++i)
+        setColumnInterning(item->children.at(i), column, role, enabled);
+}
+
+void GenericModelPrivate::replaceItemData(GenericModelItem *item, RolesContainer newData, bool sourceMergeDisplayEdit)
+{
+    if (sourceMergeDisplayEdit != m_mergeDisplayEdit)
+        setMergeDisplayEdit(m_mergeDisplayEdit, newData);
+    if (item->data == newData)
+        return;
+    QVector<int> changedRoles;
+    for (auto i = item->data.constBegin(), iEnd = item->data.constEnd(); i != iEnd; ++i) {
+        if (newData.contains(i.key()))
+            continue;
+        changedRoles.append(i.key());
+        updateAggregates(item, i.key(), i.value(), QVariant());
+        releaseInterned(item->column(), i.key(), i.value());
+    }
+    for (auto i = newData.begin(), iEnd = newData.end(); i != iEnd; ++i) {
+        const auto oldIter = item->data.constFind(i.key());
+        if (oldIter != item->data.constEnd()) {
+            if (oldIter.value() == i.value()) {
+                i.value() = oldIter.value();
+                continue;
+            }
+            updateAggregates(item, i.key(), oldIter.value(), i.value());
+            releaseInterned(item->column(), i.key(), oldIter.value());
+        } else {
+            updateAggregates(item, i.key(), QVariant(), i.value());
+        }
+        changedRoles.append(i.key());
+        if (isInternedRole(item->column(), i.key()))
+            i.value() = internValue(i.value());
+    }
+    if (m_mergeDisplayEdit && changedRoles.contains(Qt::DisplayRole))
+        changedRoles.append(Qt::EditRole);
+    item->data = std::move(newData);
+    markChanged(item);
+    Q_Q(GenericModel);
+    const QModelIndex index = indexForItem(item);
+    q->dataChanged(index, index, changedRoles);
+}
+
+void GenericModelPrivate::replaceChildren(GenericModelItem *item, const GenericModelItem *source, bool sourceMergeDisplayEdit)
+{
+    Q_Q(GenericModel);
+    const QModelIndex parent = indexForItem(item);
+    if (item->rowCount() > 0)
+        q->removeRows(0, item->rowCount(), parent);
+    if (item->columnCount() < source->columnCount())
+        q->insertColumns(item->columnCount(), source->columnCount() - item->columnCount(), parent);
+    else if (item->columnCount() > source->columnCount())
+        q->removeColumns(source->columnCount(), item->columnCount() - source->columnCount(), parent);
+    if (source->rowCount() > 0)
+        insertClonedRows(item, 0, source, 0, source->rowCount(), sourceMergeDisplayEdit);
+}
+
+void GenericModelPrivate::insertClonedRows(GenericModelItem *parentItem, int row, const GenericModelItem *sourceParent, int sourceRow, int count,
+                                           bool sourceMergeDisplayEdit, const QVector<RolesContainer> *sourceHeaders)
+{
+    Q_Q(GenericModel);
+    const QModelIndex parent = indexForItem(parentItem);
+    const int colCount = sourceParent->columnCount();
+    Q_ASSERT(colCount == parentItem->columnCount());
+    if (colCount == 0) {
+        q->insertRows(row, count, parent);
+        return;
+    }
+    QVector<GenericModelItem *> rowsToInsert;
+    rowsToInsert.reserve(count * colCount);
+    for (int i = sourceRow; i < sourceRow + count; ++i) {
+        for (int j = 0; j < colCount; ++j) {
+            GenericModelItem *itemClone = sourceParent->childAt(i, j)->clone(q);
+            if (sourceMergeDisplayEdit != m_mergeDisplayEdit)
+                itemClone->setMergeDisplayEdit(m_mergeDisplayEdit);
+            internItem(itemClone);
+            rowsToInsert.append(itemClone);
+        }
+    }
+    q->beginInsertRows(parent, row, row + count - 1);
+    if (parentItem == root) {
+        vHeaderData.insert(row, count, RolesContainer());
+        for (int i = 0; sourceHeaders && i < count; ++i) {
+            RolesContainer &header = vHeaderData[row + i];
+            header = sourceHeaders->at(sourceRow + i);
+            if (sourceMergeDisplayEdit != m_mergeDisplayEdit)
+                setMergeDisplayEdit(m_mergeDisplayEdit, header);
+        }
+    }
+    parentItem->insertRows(row, rowsToInsert);
+    for (int i = 0, maxI = rowsToInsert.size(); i < maxI; ++i) {
+        addToAggregates(rowsToInsert.at(i));
+        markChanged(rowsToInsert.at(i));
+    }
+    q->endInsertRows();
+    recordOperation(GenericModel::ChangeSet::InsertRows, parent, row, count);
+}
+
+bool GenericModelPrivate::isKeepSortedRole(int role) const
+{
+    if (m_keepSortedColumn < 0)
+        return false;
+    if (m_mergeDisplayEdit && role == Qt::EditRole)
+        role = Qt::DisplayRole;
+    return role == m_keepSortedRole;
+}
+
+bool GenericModelPrivate::isKeepSortedLessThan(const QVariant &left, const QVariant &right) const
+{
+    if (m_keepSortedOrder == Qt::AscendingOrder)
+        return isVariantLessThan(left, right);
+    return isVariantLessThan(right, left);
+}
+
+void GenericModelPrivate::keepRowsSorted(const QModelIndex &parent, int row, int count)
+{
+    // assumes all other rows are already sorted and that all the rows in the range have the same value in the sort column
+    if (m_keepSortedColumn < 0)
+        return;
+    Q_Q(GenericModel);
+    const GenericModelItem *const parentItem = itemForIndex(parent);
+    if (m_keepSortedColumn >= parentItem->columnCount())
+        return;
+    const auto valueAt = [this, parentItem](int r) -> QVariant { return parentItem->childAt(r, m_keepSortedColumn)->data.value(m_keepSortedRole); };
+    const QVariant value = valueAt(row);
+    int destination = row;
+    if (row > 0 && isKeepSortedLessThan(value, valueAt(row - 1))) {
+        int low = 0;
+        int high = row - 1;
+        while (low < high) {
+            const int mid = low + ((high - low) / 2);
+            if (isKeepSortedLessThan(value, valueAt(mid)))
+                high = mid;
+            else
+                low = mid + 1;
+        }
+        destination = low;
+    } else if (row + count < parentItem->rowCount() && isKeepSortedLessThan(valueAt(row + count), value)) {
+        int low = row + count + 1;
+        int high = parentItem->rowCount();
+        while (low < high) {
+            const int mid = low + ((high - low) / 2);
+            if (isKeepSortedLessThan(valueAt(mid), value))
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        destination = low;
+    }
+    if (destination != row)
+        q->moveRows(parent, row, count, parent, destination);
 }
 
 void GenericModelPrivate::signalAllChanged(const QVector<int> &roles, const QModelIndex &parent)
@@ -1621,6 +3306,7 @@ void GenericModelPrivate::signalAllChanged(const QVector<int> &roles, const QMod
 void GenericModelPrivate::setMergeDisplayEdit(bool val)
 {
     root->setMergeDisplayEdit(val);
+    invalidateAggregates();
     for (auto i = vHeaderData.begin(), iEnd = vHeaderData.end(); i != iEnd; ++i)
         setMergeDisplayEdit(val, *i);
     for (auto i = hHeaderData.begin(), iEnd = hHeaderData.end(); i != iEnd; ++i)
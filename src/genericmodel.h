@@ -17,7 +17,17 @@
 #include <QAbstractItemModel>
 #include <QVariant>
 #include <QStringList>
+#include <QVector>
+#include <QPair>
+#include <QHash>
+#include <QBitArray>
+#include <functional>
 class GenericModelPrivate;
+class GenericModelItem;
+template <int... Roles>
+class FixedRoleGenericModel;
+template <class T, class... Columns>
+class StructTableModel;
 class MODELUTILITIES_EXPORT GenericModel : public QAbstractItemModel
 {
     Q_OBJECT
@@ -26,8 +36,71 @@ class MODELUTILITIES_EXPORT GenericModel : public QAbstractItemModel
     Q_DISABLE_COPY(GenericModel)
     Q_DECLARE_PRIVATE_D(m_dptr, GenericModel)
     friend class GenericModelItem;
+    template <int... Roles>
+    friend class FixedRoleGenericModel;
+    template <class T, class... Columns>
+    friend class StructTableModel;
 
 public:
+    struct MODELUTILITIES_EXPORT SortKey
+    {
+        SortKey(int column = 0, int role = Qt::DisplayRole, Qt::SortOrder order = Qt::AscendingOrder);
+        int column;
+        int role;
+        Qt::SortOrder order;
+    };
+    struct MODELUTILITIES_EXPORT Aggregate
+    {
+        Aggregate();
+        int count;
+        double sum;
+        double mean;
+        QVariant minimum;
+        QVariant maximum;
+    };
+    typedef QVector<QPair<int, int>> IndexPath;
+    struct MODELUTILITIES_EXPORT ChangeSet
+    {
+        enum OperationType { InsertRows, RemoveRows, MoveRows, InsertColumns, RemoveColumns, MoveColumns, Sort, HeaderData };
+        struct MODELUTILITIES_EXPORT Operation
+        {
+            Operation(OperationType type = InsertRows, const IndexPath &parent = IndexPath(), int first = 0, int count = 0);
+            OperationType type;
+            IndexPath parent;
+            int first;
+            int count;
+            IndexPath destinationParent;
+            int destination;
+            Qt::Orientation orientation;
+            QVector<SortKey> sortKeys;
+            bool recursive;
+            QVector<int> permutation;
+        };
+        bool isEmpty() const;
+        QVector<Operation> operations;
+        QHash<IndexPath, QBitArray> changedCells;
+    };
+    class MODELUTILITIES_EXPORT CellView
+    {
+    public:
+        int row() const;
+        int column() const;
+        int depth() const;
+        QVariant data(int role = Qt::DisplayRole) const;
+        QMap<int, QVariant> itemData() const;
+        Qt::ItemFlags flags() const;
+        int rowCount() const;
+        int columnCount() const;
+
+    private:
+        CellView(const GenericModelItem *item, int depth, bool mergeDisplayEdit);
+        const GenericModelItem *m_item;
+        int m_depth;
+        bool m_mergeDisplayEdit;
+        friend class GenericModelPrivate;
+    };
+    typedef std::function<bool(const CellView &)> Visitor;
+    typedef std::function<bool(const QVariant &)> MatchPredicate;
     explicit GenericModel(QObject *parent = Q_NULLPTR);
     ~GenericModel();
     void setRoleNames(const QHash<int, QByteArray> &rNames);
@@ -57,6 +130,47 @@ public:
     bool setItemData(const QModelIndex &index, const QMap<int, QVariant> &roles) override;
     void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
     void sort(int column, const QModelIndex &parent, Qt::SortOrder order = Qt::AscendingOrder, bool recursive = true);
+    void sort(const QVector<SortKey> &keys, const QModelIndex &parent = QModelIndex(), bool recursive = true);
+    void keepSorted(int column, int role = Qt::DisplayRole, Qt::SortOrder order = Qt::AscendingOrder);
+    int keepSortedColumn() const;
+    void setValueInterning(int column, int role, bool enabled);
+    bool isValueInterned(int column, int role) const;
+    int internedValuesCount() const;
+    void enableAggregates(int column, int role = Qt::DisplayRole);
+    void disableAggregates(int column, int role = Qt::DisplayRole);
+    Aggregate aggregate(int column, int role = Qt::DisplayRole) const;
+    void setChangeTracking(bool enabled);
+    bool isChangeTrackingEnabled() const;
+    ChangeSet takeChangeSet();
+    IndexPath pathForIndex(const QModelIndex &index) const;
+    QModelIndex indexForPath(const IndexPath &path) const;
+    bool applyDiff(const GenericModel &newData, int keyColumn, int keyRole = Qt::DisplayRole);
+    QModelIndexList match(const QModelIndex &start, int role, const QVariant &value, int hits = 1,
+                          Qt::MatchFlags flags = Qt::MatchFlags(Qt::MatchStartsWith | Qt::MatchWrap)) const override;
+    QModelIndexList findAll(const MatchPredicate &predicate, int role = Qt::DisplayRole, Qt::MatchFlags flags = Qt::MatchRecursive,
+                            const QModelIndex &parent = QModelIndex()) const;
+    void visit(const QModelIndex &parent, const Visitor &visitor) const;
+    void visitParallel(const QModelIndex &parent, const Visitor &visitor) const;
+    template <class T>
+    T value(const QModelIndex &index, int role = Qt::DisplayRole) const
+    {
+        const QVariant *storedValue = storedData(index, role);
+        return storedValue ? storedValue->value<T>() : T();
+    }
+    template <class T>
+    bool setValue(const QModelIndex &index, int role, const T &value)
+    {
+        return setData(index, QVariant::fromValue(value), role);
+    }
+    template <class T>
+    bool readColumn(const QModelIndex &parent, int column, int role, T *out) const
+    {
+        if (!out)
+            return false;
+        return storedColumn(parent, column, role, out, [](void *buffer, int row, const QVariant *storedValue) -> void {
+            static_cast<T *>(buffer)[row] = storedValue ? storedValue->value<T>() : T();
+        });
+    }
     QSize span(const QModelIndex &index) const override;
     bool setSpan(const QModelIndex &index, const QSize &size);
     Qt::DropActions supportedDragActions() const override;
@@ -80,5 +194,13 @@ protected:
     GenericModel(GenericModelPrivate &dptr, QObject *parent);
     virtual bool mimeForValue(QMimeData *data, const QVariant &value) const;
     GenericModelPrivate *m_dptr;
+
+private:
+    typedef void (*StoredValueReader)(void *buffer, int row, const QVariant *storedValue);
+    static QVector<int> sortOrder(const QVector<QVariant> &keyValues, const QVector<SortKey> &keys);
+    static bool mimeForVariant(QMimeData *data, const QVariant &value);
+    const QVariant *storedData(const QModelIndex &index, int role) const;
+    bool storedColumn(const QModelIndex &parent, int column, int role, void *buffer, StoredValueReader reader) const;
 };
+Q_DECLARE_TYPEINFO(GenericModel::SortKey, Q_MOVABLE_TYPE);
 #endif // GENERICMODEL_H
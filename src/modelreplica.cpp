@@ -0,0 +1,1028 @@
+/****************************************************************************\
+   Copyright 2021 Luca Beldi
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+       http://www.apache.org/licenses/LICENSE-2.0
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+\****************************************************************************/
+#include "private/modelreplica_p.h"
+#include "modelreplica.h"
+#include <QBitArray>
+#include <QDataStream>
+#include <functional>
+
+ModelReplicaSourcePrivate::ModelReplicaSourcePrivate(ModelReplicaSource *q)
+    : q_ptr(q)
+    , m_model(Q_NULLPTR)
+    , m_resetPending(false)
+    , m_streamVersion(QDataStream().version())
+{
+    Q_ASSERT(q_ptr);
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(0);
+    QObject::connect(&m_flushTimer, &QTimer::timeout, std::bind(&ModelReplicaSourcePrivate::flush, this));
+    QObject::connect(&m_server, &QLocalServer::newConnection, std::bind(&ModelReplicaSourcePrivate::onNewConnection, this));
+}
+
+ModelReplicaSourcePrivate::~ModelReplicaSourcePrivate()
+{
+    for (int i = 0, maxI = m_modelConnections.size(); i < maxI; ++i)
+        QObject::disconnect(m_modelConnections.at(i));
+}
+
+GenericModel::IndexPath ModelReplicaSourcePrivate::pathForIndex(QModelIndex index)
+{
+    GenericModel::IndexPath result;
+    for (; index.isValid(); index = index.parent())
+        result.prepend(qMakePair(index.row(), index.column()));
+    return result;
+}
+
+void ModelReplicaSourcePrivate::writeCell(QDataStream &stream, const QModelIndex &index) const
+{
+    stream << m_model->itemData(index) << qint32(m_model->flags(index));
+}
+
+void ModelReplicaSourcePrivate::writeBranch(QDataStream &stream, const QModelIndex &parent) const
+{
+    const qint32 rowCount = m_model->rowCount(parent);
+    const qint32 colCount = m_model->columnCount(parent);
+    stream << rowCount << colCount;
+    for (qint32 i = 0; i < rowCount; ++i) {
+        for (qint32 j = 0; j < colCount; ++j) {
+            const QModelIndex child = m_model->index(i, j, parent);
+            writeCell(stream, child);
+            const bool hasChildren = m_model->hasChildren(child);
+            stream << hasChildren;
+            if (hasChildren)
+                writeBranch(stream, child);
+        }
+    }
+}
+
+void ModelReplicaSourcePrivate::writeHeaders(QDataStream &stream, Qt::Orientation orientation, int first, int last) const
+{
+    stream << qint32(orientation) << qint32(first) << qint32(last);
+    for (int i = first; i <= last; ++i) {
+        QMap<int, QVariant> headerRoles;
+        for (int role = Qt::DisplayRole; role <= Qt::InitialSortOrderRole; ++role) {
+            if (role == Qt::EditRole)
+                continue;
+            const QVariant roleData = m_model->headerData(i, orientation, role);
+            if (roleData.isValid())
+                headerRoles.insert(role, roleData);
+        }
+        stream << headerRoles;
+    }
+}
+
+void ModelReplicaSourcePrivate::writeShiftedHeaders(QDataStream &stream, Qt::Orientation orientation, int first) const
+{
+    // the replica stores the headers explicitly, sections that moved as a consequence of a structural change need to be refreshed
+    const int sectionCount = orientation == Qt::Vertical ? m_model->rowCount() : m_model->columnCount();
+    if (first >= sectionCount)
+        return;
+    stream << qint32(ReplicaHeaderDataChanged);
+    writeHeaders(stream, orientation, first, sectionCount - 1);
+}
+
+void ModelReplicaSourcePrivate::writeSnapshot(QDataStream &stream) const
+{
+    stream << qint32(ReplicaReset);
+    if (!m_model) {
+        stream << qint32(0) << qint32(0);
+        stream << qint32(Qt::Horizontal) << qint32(0) << qint32(-1);
+        stream << qint32(Qt::Vertical) << qint32(0) << qint32(-1);
+        return;
+    }
+    writeBranch(stream, QModelIndex());
+    writeHeaders(stream, Qt::Horizontal, 0, m_model->columnCount() - 1);
+    writeHeaders(stream, Qt::Vertical, 0, m_model->rowCount() - 1);
+}
+
+bool ModelReplicaSourcePrivate::isRecording() const
+{
+    return !m_replicas.isEmpty() && !m_resetPending;
+}
+
+void ModelReplicaSourcePrivate::scheduleFlush()
+{
+    if (!m_flushTimer.isActive())
+        m_flushTimer.start();
+}
+
+void ModelReplicaSourcePrivate::flush()
+{
+    m_flushTimer.stop();
+    if (m_replicas.isEmpty()) {
+        m_pending.clear();
+        m_resetPending = false;
+        return;
+    }
+    if (m_resetPending) {
+        // a snapshot supersedes all the deltas recorded in this iteration
+        m_pending.clear();
+        QDataStream writer(&m_pending, QIODevice::WriteOnly);
+        writer.setVersion(m_streamVersion);
+        writeSnapshot(writer);
+        m_resetPending = false;
+    }
+    if (m_pending.isEmpty())
+        return;
+    QByteArray frame;
+    QDataStream frameWriter(&frame, QIODevice::WriteOnly);
+    frameWriter << quint32(m_pending.size());
+    frame.append(m_pending);
+    m_pending.clear();
+    for (int i = 0, maxI = m_replicas.size(); i < maxI; ++i)
+        m_replicas.at(i)->write(frame);
+}
+
+void ModelReplicaSourcePrivate::onNewConnection()
+{
+    // bring the existing replicas up to date so the new one starts from the same state
+    flush();
+    while (QLocalSocket *socket = m_server.nextPendingConnection()) {
+        QObject::connect(socket, &QLocalSocket::disconnected, std::bind(&ModelReplicaSourcePrivate::onReplicaDisconnected, this, socket));
+        QByteArray snapshot;
+        QDataStream writer(&snapshot, QIODevice::WriteOnly);
+        writer.setVersion(QDataStream::Qt_5_0);
+        writer << replicaMagic << qint32(m_streamVersion);
+        QByteArray payload;
+        QDataStream payloadWriter(&payload, QIODevice::WriteOnly);
+        payloadWriter.setVersion(m_streamVersion);
+        writeSnapshot(payloadWriter);
+        writer << quint32(payload.size());
+        snapshot.append(payload);
+        socket->write(snapshot);
+        m_replicas.append(socket);
+    }
+}
+
+void ModelReplicaSourcePrivate::onReplicaDisconnected(QLocalSocket *socket)
+{
+    m_replicas.removeAll(socket);
+    socket->deleteLater();
+}
+
+void ModelReplicaSourcePrivate::onModelReset()
+{
+    if (m_replicas.isEmpty())
+        return;
+    m_resetPending = true;
+    scheduleFlush();
+}
+
+void ModelReplicaSourcePrivate::onModelDestroyed()
+{
+    Q_Q(ModelReplicaSource);
+    q->setModel(Q_NULLPTR);
+}
+
+void ModelReplicaSourcePrivate::captureLayout(const QModelIndex &parent, QSet<QModelIndex> &captured)
+{
+    if (captured.contains(parent))
+        return;
+    captured.insert(parent);
+    const int rowCount = m_model->rowCount(parent);
+    const int colCount = m_model->columnCount(parent);
+    // children are captured before their parent so the replica applies the deepest permutations first and the recorded paths stay valid
+    for (int i = 0; i < rowCount; ++i) {
+        for (int j = 0; j < colCount; ++j) {
+            const QModelIndex child = m_model->index(i, j, parent);
+            if (m_model->hasChildren(child))
+                captureLayout(child, captured);
+        }
+    }
+    if (rowCount < 2 || colCount == 0)
+        return;
+    ModelReplicaLayoutParent layoutParent;
+    layoutParent.path = pathForIndex(parent);
+    layoutParent.parent = parent;
+    layoutParent.rows.reserve(rowCount);
+    for (int i = 0; i < rowCount; ++i)
+        layoutParent.rows.append(m_model->index(i, 0, parent));
+    m_layoutParents.append(layoutParent);
+}
+
+void ModelReplicaSourcePrivate::onLayoutAboutToBeChanged(const QList<QPersistentModelIndex> &parents, QAbstractItemModel::LayoutChangeHint hint)
+{
+    m_layoutParents.clear();
+    // only a sort is guaranteed to keep every row under the same parent, any other layout change is sent as a snapshot
+    if (!isRecording() || hint != QAbstractItemModel::VerticalSortHint)
+        return;
+    QSet<QModelIndex> captured;
+    if (parents.isEmpty())
+        captureLayout(QModelIndex(), captured);
+    for (int i = 0, maxI = parents.size(); i < maxI; ++i)
+        captureLayout(parents.at(i), captured);
+}
+
+void ModelReplicaSourcePrivate::onLayoutChanged()
+{
+    const QVector<ModelReplicaLayoutParent> layoutParents = m_layoutParents;
+    m_layoutParents.clear();
+    if (!isRecording())
+        return;
+    if (layoutParents.isEmpty()) {
+        onModelReset();
+        return;
+    }
+    QByteArray messages;
+    QDataStream writer(&messages, QIODevice::WriteOnly);
+    writer.setVersion(m_streamVersion);
+    bool rootSorted = false;
+    for (int i = 0, maxI = layoutParents.size(); i < maxI; ++i) {
+        const ModelReplicaLayoutParent &layoutParent = layoutParents.at(i);
+        const int rowCount = layoutParent.rows.size();
+        if ((!layoutParent.path.isEmpty() && !layoutParent.parent.isValid()) || m_model->rowCount(layoutParent.parent) != rowCount) {
+            onModelReset();
+            return;
+        }
+        QVector<int> sourceRows(rowCount, -1);
+        bool identity = true;
+        for (int oldRow = 0; oldRow < rowCount; ++oldRow) {
+            const QPersistentModelIndex &rowIndex = layoutParent.rows.at(oldRow);
+            if (!rowIndex.isValid() || rowIndex.parent() != layoutParent.parent || sourceRows.at(rowIndex.row()) >= 0) {
+                onModelReset();
+                return;
+            }
+            sourceRows[rowIndex.row()] = oldRow;
+            identity = identity && rowIndex.row() == oldRow;
+        }
+        if (identity)
+            continue;
+        writer << qint32(ReplicaSortRows) << layoutParent.path << sourceRows;
+        rootSorted = rootSorted || layoutParent.path.isEmpty();
+    }
+    if (rootSorted)
+        writeShiftedHeaders(writer, Qt::Vertical, 0);
+    if (messages.isEmpty())
+        return;
+    m_pending.append(messages);
+    scheduleFlush();
+}
+
+void ModelReplicaSourcePrivate::onDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    if (!isRecording() || !topLeft.isValid() || !bottomRight.isValid())
+        return;
+    const QModelIndex parent = topLeft.parent();
+    QDataStream writer(&m_pending, QIODevice::WriteOnly | QIODevice::Append);
+    writer.setVersion(m_streamVersion);
+    writer << qint32(ReplicaDataChanged) << pathForIndex(parent) << qint32(topLeft.row()) << qint32(topLeft.column()) << qint32(bottomRight.row())
+           << qint32(bottomRight.column());
+    for (int i = topLeft.row(); i <= bottomRight.row(); ++i) {
+        for (int j = topLeft.column(); j <= bottomRight.column(); ++j)
+            writeCell(writer, m_model->index(i, j, parent));
+    }
+    scheduleFlush();
+}
+
+void ModelReplicaSourcePrivate::onHeaderDataChanged(Qt::Orientation orientation, int first, int last)
+{
+    if (!isRecording())
+        return;
+    QDataStream writer(&m_pending, QIODevice::WriteOnly | QIODevice::Append);
+    writer.setVersion(m_streamVersion);
+    writer << qint32(ReplicaHeaderDataChanged);
+    writeHeaders(writer, orientation, first, last);
+    scheduleFlush();
+}
+
+void ModelReplicaSourcePrivate::onSectionsInserted(Qt::Orientation orientation, const QModelIndex &parent, int first, int last)
+{
+    if (!isRecording())
+        return;
+    QDataStream writer(&m_pending, QIODevice::WriteOnly | QIODevice::Append);
+    writer.setVersion(m_streamVersion);
+    const bool insertRows = orientation == Qt::Vertical;
+    const qint32 otherCount = insertRows ? m_model->columnCount(parent) : m_model->rowCount(parent);
+    writer << qint32(ReplicaInsertSections) << qint32(orientation) << pathForIndex(parent) << qint32(first) << qint32(last) << otherCount;
+    for (int i = first; i <= last; ++i) {
+        for (int j = 0; j < otherCount; ++j) {
+            const QModelIndex child = insertRows ? m_model->index(i, j, parent) : m_model->index(j, i, parent);
+            writeCell(writer, child);
+            const bool hasChildren = m_model->hasChildren(child);
+            writer << hasChildren;
+            if (hasChildren)
+                writeBranch(writer, child);
+        }
+    }
+    if (!parent.isValid())
+        writeShiftedHeaders(writer, orientation, first);
+    scheduleFlush();
+}
+
+void ModelReplicaSourcePrivate::onSectionsRemoved(Qt::Orientation orientation, const QModelIndex &parent, int first, int last)
+{
+    if (!isRecording())
+        return;
+    QDataStream writer(&m_pending, QIODevice::WriteOnly | QIODevice::Append);
+    writer.setVersion(m_streamVersion);
+    writer << qint32(ReplicaRemoveSections) << qint32(orientation) << pathForIndex(parent) << qint32(first) << qint32(last);
+    if (!parent.isValid())
+        writeShiftedHeaders(writer, orientation, first);
+    scheduleFlush();
+}
+
+void ModelReplicaSourcePrivate::onSectionsAboutToBeMoved(Qt::Orientation orientation, const QModelIndex &sourceParent, int first, int last,
+                                                         const QModelIndex &destinationParent, int destination)
+{
+    // the paths are recorded before the move as this is the state the replica is in when it applies it
+    if (!isRecording())
+        return;
+    QDataStream writer(&m_pending, QIODevice::WriteOnly | QIODevice::Append);
+    writer.setVersion(m_streamVersion);
+    writer << qint32(ReplicaMoveSections) << qint32(orientation) << pathForIndex(sourceParent) << qint32(first) << qint32(last)
+           << pathForIndex(destinationParent) << qint32(destination);
+    scheduleFlush();
+}
+
+void ModelReplicaSourcePrivate::onSectionsMoved(Qt::Orientation orientation, const QModelIndex &sourceParent, const QModelIndex &destinationParent)
+{
+    if (!isRecording() || (sourceParent.isValid() && destinationParent.isValid()))
+        return;
+    QDataStream writer(&m_pending, QIODevice::WriteOnly | QIODevice::Append);
+    writer.setVersion(m_streamVersion);
+    writeShiftedHeaders(writer, orientation, 0);
+    scheduleFlush();
+}
+
+/*!
+\class ModelReplicaSource
+\brief Serves the contents of a model to ModelReplica instances in other processes
+\details The source listens on a QLocalServer. Every replica that connects receives a compact binary snapshot of the whole model,
+after that only the changes are streamed: structural changes and dataChanged() carry just the affected sections.
+All the changes that happen in the same event loop iteration are sent as a single batch.
+
+A sort (a layout change with QAbstractItemModel::VerticalSortHint) is sent as the new order of the rows of every parent that changed.
+To compute it, the source keeps a persistent index for the first column of every row under the sorted parents until the layout change ends.
+Any other layout change, or a reset of the model, is sent as a new snapshot,
+any change recorded in the same iteration is dropped as the snapshot already contains it.
+
+All the roles returned by QAbstractItemModel::itemData() and the flags of every index are replicated.
+For headers, the roles from Qt::DisplayRole to Qt::InitialSortOrderRole are replicated.
+\sa ModelReplica
+*/
+
+/*!
+Constructs a source with the given \a parent.
+*/
+ModelReplicaSource::ModelReplicaSource(QObject *parent)
+    : QObject(parent)
+    , m_dptr(new ModelReplicaSourcePrivate(this))
+{ }
+
+/*!
+Constructs a source that serves \a model with the given \a parent.
+*/
+ModelReplicaSource::ModelReplicaSource(QAbstractItemModel *model, QObject *parent)
+    : QObject(parent)
+    , m_dptr(new ModelReplicaSourcePrivate(this))
+{
+    setModel(model);
+}
+
+/*!
+\internal
+*/
+ModelReplicaSource::ModelReplicaSource(ModelReplicaSourcePrivate &dptr, QObject *parent)
+    : QObject(parent)
+    , m_dptr(&dptr)
+{ }
+
+/*!
+Destructor
+*/
+ModelReplicaSource::~ModelReplicaSource()
+{
+    delete m_dptr;
+}
+
+/*!
+\property ModelReplicaSource::model
+\accessors %model(), setModel()
+\notifier modelChanged()
+\brief This property holds the model served to the replicas
+\details Changing the model sends a new snapshot to all the connected replicas
+*/
+
+//! Getter for model property
+QAbstractItemModel *ModelReplicaSource::model() const
+{
+    Q_D(const ModelReplicaSource);
+    return d->m_model;
+}
+
+//! Setter for model property
+void ModelReplicaSource::setModel(QAbstractItemModel *model)
+{
+    Q_D(ModelReplicaSource);
+    if (d->m_model == model)
+        return;
+    for (int i = 0, maxI = d->m_modelConnections.size(); i < maxI; ++i)
+        QObject::disconnect(d->m_modelConnections.at(i));
+    d->m_modelConnections.clear();
+    d->m_layoutParents.clear();
+    d->m_model = model;
+    if (model) {
+        using namespace std::placeholders;
+        d->m_modelConnections
+                << QObject::connect(model, &QAbstractItemModel::destroyed, std::bind(&ModelReplicaSourcePrivate::onModelDestroyed, d))
+                << QObject::connect(model, &QAbstractItemModel::modelReset, std::bind(&ModelReplicaSourcePrivate::onModelReset, d))
+                << QObject::connect(model, &QAbstractItemModel::layoutAboutToBeChanged,
+                                    std::bind(&ModelReplicaSourcePrivate::onLayoutAboutToBeChanged, d, _1, _2))
+                << QObject::connect(model, &QAbstractItemModel::layoutChanged, std::bind(&ModelReplicaSourcePrivate::onLayoutChanged, d))
+                << QObject::connect(model, &QAbstractItemModel::dataChanged, std::bind(&ModelReplicaSourcePrivate::onDataChanged, d, _1, _2))
+                << QObject::connect(model, &QAbstractItemModel::headerDataChanged,
+                                    std::bind(&ModelReplicaSourcePrivate::onHeaderDataChanged, d, _1, _2, _3))
+                << QObject::connect(model, &QAbstractItemModel::rowsInserted,
+                                    std::bind(&ModelReplicaSourcePrivate::onSectionsInserted, d, Qt::Vertical, _1, _2, _3))
+                << QObject::connect(model, &QAbstractItemModel::columnsInserted,
+                                    std::bind(&ModelReplicaSourcePrivate::onSectionsInserted, d, Qt::Horizontal, _1, _2, _3))
+                << QObject::connect(model, &QAbstractItemModel::rowsRemoved,
+                                    std::bind(&ModelReplicaSourcePrivate::onSectionsRemoved, d, Qt::Vertical, _1, _2, _3))
+                << QObject::connect(model, &QAbstractItemModel::columnsRemoved,
+                                    std::bind(&ModelReplicaSourcePrivate::onSectionsRemoved, d, Qt::Horizontal, _1, _2, _3))
+                << QObject::connect(model, &QAbstractItemModel::rowsAboutToBeMoved,
+                                    std::bind(&ModelReplicaSourcePrivate::onSectionsAboutToBeMoved, d, Qt::Vertical, _1, _2, _3, _4, _5))
+                << QObject::connect(model, &QAbstractItemModel::columnsAboutToBeMoved,
+                                    std::bind(&ModelReplicaSourcePrivate::onSectionsAboutToBeMoved, d, Qt::Horizontal, _1, _2, _3, _4, _5))
+                << QObject::connect(model, &QAbstractItemModel::rowsMoved,
+                                    std::bind(&ModelReplicaSourcePrivate::onSectionsMoved, d, Qt::Vertical, _1, _4))
+                << QObject::connect(model, &QAbstractItemModel::columnsMoved,
+                                    std::bind(&ModelReplicaSourcePrivate::onSectionsMoved, d, Qt::Horizontal, _1, _4));
+    }
+    d->onModelReset();
+    modelChanged(model);
+}
+
+/*!
+\brief Starts accepting replicas on the local server \a serverName
+\details If a stale server with the same name is left behind by a crashed process it is removed.
+Returns false if the server could not be started, errorString() will contain the reason.
+*/
+bool ModelReplicaSource::listen(const QString &serverName)
+{
+    Q_D(ModelReplicaSource);
+    if (d->m_server.isListening())
+        close();
+    if (d->m_server.listen(serverName))
+        return true;
+    if (d->m_server.serverError() == QAbstractSocket::AddressInUseError && QLocalServer::removeServer(serverName))
+        return d->m_server.listen(serverName);
+    return false;
+}
+
+/*!
+\brief Stops accepting replicas and disconnects all the connected ones
+*/
+void ModelReplicaSource::close()
+{
+    Q_D(ModelReplicaSource);
+    d->m_server.close();
+    const QVector<QLocalSocket *> replicas = d->m_replicas;
+    d->m_replicas.clear();
+    for (int i = 0, maxI = replicas.size(); i < maxI; ++i) {
+        replicas.at(i)->disconnect();
+        replicas.at(i)->disconnectFromServer();
+        replicas.at(i)->deleteLater();
+    }
+    d->m_pending.clear();
+    d->m_resetPending = false;
+    d->m_layoutParents.clear();
+    d->m_flushTimer.stop();
+}
+
+/*!
+\brief Returns true if the source is accepting replicas
+*/
+bool ModelReplicaSource::isListening() const
+{
+    Q_D(const ModelReplicaSource);
+    return d->m_server.isListening();
+}
+
+/*!
+\brief Returns the name of the local server the source is listening on
+*/
+QString ModelReplicaSource::serverName() const
+{
+    Q_D(const ModelReplicaSource);
+    return d->m_server.serverName();
+}
+
+/*!
+\brief Returns a description of the last error encountered by listen()
+*/
+QString ModelReplicaSource::errorString() const
+{
+    Q_D(const ModelReplicaSource);
+    return d->m_server.errorString();
+}
+
+/*!
+\brief Returns the number of replicas currently connected
+*/
+int ModelReplicaSource::replicaCount() const
+{
+    Q_D(const ModelReplicaSource);
+    return d->m_replicas.size();
+}
+
+ModelReplicaPrivate::ModelReplicaPrivate(ModelReplica *q)
+    : GenericModelPrivate(q)
+    , m_streamVersion(-1)
+{ }
+
+ModelReplicaPrivate::~ModelReplicaPrivate()
+{
+    delete m_socket.data();
+}
+
+bool ModelReplicaPrivate::readCell(QDataStream &stream, const QModelIndex &index)
+{
+    Q_Q(ModelReplica);
+    QMap<int, QVariant> roles;
+    qint32 flags;
+    stream >> roles >> flags;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+    const QMap<int, QVariant> currentRoles = q->itemData(index);
+    if (currentRoles != roles) {
+        bool roleRemoved = false;
+        for (auto i = currentRoles.cbegin(), iEnd = currentRoles.cend(); !roleRemoved && i != iEnd; ++i) {
+            if (i.key() == Qt::EditRole && m_mergeDisplayEdit && roles.contains(Qt::DisplayRole))
+                continue;
+            roleRemoved = !roles.contains(i.key());
+        }
+        if (roleRemoved)
+            q->clearItemData(index);
+        q->setItemData(index, roles);
+    }
+    const Qt::ItemFlags newFlags = Qt::ItemFlags(QFlag(flags));
+    if (q->flags(index) != newFlags)
+        q->setFlags(index, newFlags);
+    return true;
+}
+
+bool ModelReplicaPrivate::readBranch(QDataStream &stream, const QModelIndex &parent)
+{
+    Q_Q(ModelReplica);
+    qint32 rowCount;
+    qint32 colCount;
+    stream >> rowCount >> colCount;
+    if (stream.status() != QDataStream::Ok || rowCount < 0 || colCount < 0)
+        return false;
+    if (colCount > 0)
+        q->insertColumns(0, colCount, parent);
+    if (rowCount > 0)
+        q->insertRows(0, rowCount, parent);
+    for (qint32 i = 0; i < rowCount; ++i) {
+        for (qint32 j = 0; j < colCount; ++j) {
+            const QModelIndex child = q->index(i, j, parent);
+            if (!readCell(stream, child))
+                return false;
+            bool hasChildren;
+            stream >> hasChildren;
+            if (hasChildren && !readBranch(stream, child))
+                return false;
+        }
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+bool ModelReplicaPrivate::readItemCell(QDataStream &stream, GenericModelItem *item)
+{
+    QMap<int, QVariant> roles;
+    qint32 flags;
+    stream >> roles >> flags;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+    item->data = convertToContainer(roles);
+    setMergeDisplayEdit(m_mergeDisplayEdit, item->data);
+    item->flags = Qt::ItemFlags(QFlag(flags));
+    internItem(item);
+    addToAggregates(item);
+    markChanged(item);
+    return true;
+}
+
+bool ModelReplicaPrivate::readItemBranch(QDataStream &stream, GenericModelItem *parentItem)
+{
+    qint32 rowCount;
+    qint32 colCount;
+    stream >> rowCount >> colCount;
+    if (stream.status() != QDataStream::Ok || rowCount < 0 || colCount < 0)
+        return false;
+    const QModelIndex parent = indexForItem(parentItem);
+    if (colCount > 0) {
+        insertColumns(0, colCount, parent);
+        recordOperation(GenericModel::ChangeSet::InsertColumns, parent, 0, colCount);
+    }
+    if (rowCount > 0) {
+        insertRows(0, rowCount, parent);
+        recordOperation(GenericModel::ChangeSet::InsertRows, parent, 0, rowCount);
+    }
+    for (qint32 i = 0; i < rowCount; ++i) {
+        for (qint32 j = 0; j < colCount; ++j) {
+            GenericModelItem *child = parentItem->childAt(i, j);
+            if (!readItemCell(stream, child))
+                return false;
+            bool hasChildren;
+            stream >> hasChildren;
+            if (hasChildren && !readItemBranch(stream, child))
+                return false;
+        }
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+bool ModelReplicaPrivate::readHeaders(QDataStream &stream, bool notify)
+{
+    Q_Q(ModelReplica);
+    qint32 orientation;
+    qint32 first;
+    qint32 last;
+    stream >> orientation >> first >> last;
+    if (stream.status() != QDataStream::Ok || (orientation != Qt::Horizontal && orientation != Qt::Vertical))
+        return false;
+    const int sectionCount = orientation == Qt::Horizontal ? q->columnCount() : q->rowCount();
+    if (first < 0 || last >= sectionCount)
+        return false;
+    for (qint32 i = first; i <= last; ++i) {
+        QMap<int, QVariant> headerRoles;
+        stream >> headerRoles;
+        if (stream.status() != QDataStream::Ok)
+            return false;
+        // the source sends every role it has so any role missing from the message was removed
+        RolesContainer newRoles = convertToContainer(headerRoles);
+        setMergeDisplayEdit(m_mergeDisplayEdit, newRoles);
+        RolesContainer &currentRoles = orientation == Qt::Horizontal ? hHeaderData[i] : vHeaderData[i];
+        if (currentRoles == newRoles)
+            continue;
+        currentRoles = std::move(newRoles);
+        recordHeaderChange(Qt::Orientation(orientation), i);
+        if (notify)
+            q->headerDataChanged(Qt::Orientation(orientation), i, i);
+    }
+    return true;
+}
+
+bool ModelReplicaPrivate::readParent(QDataStream &stream, QModelIndex &parent) const
+{
+    Q_Q(const ModelReplica);
+    GenericModel::IndexPath path;
+    stream >> path;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+    parent = q->indexForPath(path);
+    return path.isEmpty() || parent.isValid();
+}
+
+bool ModelReplicaPrivate::readReset(QDataStream &stream)
+{
+    Q_Q(ModelReplica);
+    q->beginResetModel();
+    // the item tree is rebuilt directly, views only need the final reset notification
+    const int oldRowCount = root->rowCount();
+    const int oldColCount = root->columnCount();
+    if (oldRowCount > 0) {
+        removeRows(0, oldRowCount);
+        recordOperation(GenericModel::ChangeSet::RemoveRows, QModelIndex(), 0, oldRowCount);
+    }
+    if (oldColCount > 0) {
+        removeColumns(0, oldColCount);
+        recordOperation(GenericModel::ChangeSet::RemoveColumns, QModelIndex(), 0, oldColCount);
+    }
+    const bool result = readItemBranch(stream, root) && readHeaders(stream, false) && readHeaders(stream, false);
+    q->endResetModel();
+    return result;
+}
+
+bool ModelReplicaPrivate::readDataChanged(QDataStream &stream)
+{
+    Q_Q(ModelReplica);
+    QModelIndex parent;
+    if (!readParent(stream, parent))
+        return false;
+    qint32 top;
+    qint32 left;
+    qint32 bottom;
+    qint32 right;
+    stream >> top >> left >> bottom >> right;
+    if (stream.status() != QDataStream::Ok || top < 0 || left < 0 || bottom >= q->rowCount(parent) || right >= q->columnCount(parent))
+        return false;
+    for (qint32 i = top; i <= bottom; ++i) {
+        for (qint32 j = left; j <= right; ++j) {
+            if (!readCell(stream, q->index(i, j, parent)))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool ModelReplicaPrivate::readInsertSections(QDataStream &stream)
+{
+    Q_Q(ModelReplica);
+    qint32 orientation;
+    stream >> orientation;
+    QModelIndex parent;
+    if (!readParent(stream, parent))
+        return false;
+    qint32 first;
+    qint32 last;
+    qint32 otherCount;
+    stream >> first >> last >> otherCount;
+    if (stream.status() != QDataStream::Ok || first < 0 || last < first || otherCount < 0)
+        return false;
+    const bool insertRows = orientation == Qt::Vertical;
+    // models like QStringListModel report columns even when they have no rows, align the other dimension first
+    const int currentOtherCount = insertRows ? q->columnCount(parent) : q->rowCount(parent);
+    if (currentOtherCount < otherCount) {
+        if (insertRows)
+            q->insertColumns(currentOtherCount, otherCount - currentOtherCount, parent);
+        else
+            q->insertRows(currentOtherCount, otherCount - currentOtherCount, parent);
+    }
+    const bool inserted = insertRows ? q->insertRows(first, last - first + 1, parent) : q->insertColumns(first, last - first + 1, parent);
+    if (!inserted)
+        return false;
+    for (qint32 i = first; i <= last; ++i) {
+        for (qint32 j = 0; j < otherCount; ++j) {
+            const QModelIndex child = insertRows ? q->index(i, j, parent) : q->index(j, i, parent);
+            if (!readCell(stream, child))
+                return false;
+            bool hasChildren;
+            stream >> hasChildren;
+            if (hasChildren && !readBranch(stream, child))
+                return false;
+        }
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+bool ModelReplicaPrivate::readRemoveSections(QDataStream &stream)
+{
+    Q_Q(ModelReplica);
+    qint32 orientation;
+    stream >> orientation;
+    QModelIndex parent;
+    if (!readParent(stream, parent))
+        return false;
+    qint32 first;
+    qint32 last;
+    stream >> first >> last;
+    if (stream.status() != QDataStream::Ok || last < first)
+        return false;
+    if (orientation == Qt::Vertical)
+        return q->removeRows(first, last - first + 1, parent);
+    return q->removeColumns(first, last - first + 1, parent);
+}
+
+bool ModelReplicaPrivate::readMoveSections(QDataStream &stream)
+{
+    Q_Q(ModelReplica);
+    qint32 orientation;
+    stream >> orientation;
+    QModelIndex sourceParent;
+    if (!readParent(stream, sourceParent))
+        return false;
+    qint32 first;
+    qint32 last;
+    stream >> first >> last;
+    QModelIndex destinationParent;
+    if (!readParent(stream, destinationParent))
+        return false;
+    qint32 destination;
+    stream >> destination;
+    if (stream.status() != QDataStream::Ok || last < first)
+        return false;
+    if (orientation == Qt::Vertical)
+        return q->moveRows(sourceParent, first, last - first + 1, destinationParent, destination);
+    return q->moveColumns(sourceParent, first, last - first + 1, destinationParent, destination);
+}
+
+bool ModelReplicaPrivate::readSortRows(QDataStream &stream)
+{
+    Q_Q(ModelReplica);
+    QModelIndex parent;
+    if (!readParent(stream, parent))
+        return false;
+    QVector<int> sourceRows;
+    stream >> sourceRows;
+    const int rowCount = q->rowCount(parent);
+    if (stream.status() != QDataStream::Ok || sourceRows.size() != rowCount)
+        return false;
+    QBitArray usedRows(rowCount);
+    for (int i = 0; i < rowCount; ++i) {
+        const int sourceRow = sourceRows.at(i);
+        if (sourceRow < 0 || sourceRow >= rowCount || usedRows.testBit(sourceRow))
+            return false;
+        usedRows.setBit(sourceRow);
+    }
+    QList<QPersistentModelIndex> parents;
+    if (parent.isValid())
+        parents.append(parent);
+    q->layoutAboutToBeChanged(parents, QAbstractItemModel::VerticalSortHint);
+    GenericModelItem *parentItem = itemForIndex(parent);
+    parentItem->permuteChildren(sourceRows, parentItem == root ? &vHeaderData : nullptr);
+    q->layoutChanged(parents, QAbstractItemModel::VerticalSortHint);
+    recordSort(parent, QVector<GenericModel::SortKey>(), false, sourceRows);
+    return true;
+}
+
+bool ModelReplicaPrivate::processFrame(const QByteArray &frame)
+{
+    Q_Q(ModelReplica);
+    QDataStream reader(frame);
+    reader.setVersion(m_streamVersion);
+    while (!reader.atEnd()) {
+        qint32 messageType;
+        reader >> messageType;
+        bool result = false;
+        switch (messageType) {
+        case ReplicaReset:
+            result = readReset(reader);
+            if (result)
+                q->synchronised();
+            break;
+        case ReplicaDataChanged:
+            result = readDataChanged(reader);
+            break;
+        case ReplicaHeaderDataChanged:
+            result = readHeaders(reader, true);
+            break;
+        case ReplicaInsertSections:
+            result = readInsertSections(reader);
+            break;
+        case ReplicaRemoveSections:
+            result = readRemoveSections(reader);
+            break;
+        case ReplicaMoveSections:
+            result = readMoveSections(reader);
+            break;
+        case ReplicaSortRows:
+            result = readSortRows(reader);
+            break;
+        default:
+            break;
+        }
+        if (!result)
+            return false;
+    }
+    return true;
+}
+
+void ModelReplicaPrivate::onReadyRead()
+{
+    Q_ASSERT(m_socket);
+    m_buffer.append(m_socket->readAll());
+    if (m_streamVersion < 0) {
+        if (m_buffer.size() < 2 * int(sizeof(qint32)))
+            return;
+        QDataStream reader(m_buffer);
+        reader.setVersion(QDataStream::Qt_5_0);
+        quint32 magic;
+        qint32 streamVersion;
+        reader >> magic >> streamVersion;
+        if (magic != ModelReplicaSourcePrivate::replicaMagic || streamVersion > QDataStream().version()) {
+            m_socket->abort();
+            return;
+        }
+        m_streamVersion = streamVersion;
+        m_buffer.remove(0, 2 * int(sizeof(qint32)));
+    }
+    while (m_buffer.size() >= int(sizeof(quint32))) {
+        QDataStream sizeReader(m_buffer);
+        quint32 frameSize;
+        sizeReader >> frameSize;
+        if (quint32(m_buffer.size()) - sizeof(quint32) < frameSize)
+            return;
+        const QByteArray frame = m_buffer.mid(sizeof(quint32), frameSize);
+        m_buffer.remove(0, sizeof(quint32) + frameSize);
+        if (!processFrame(frame)) {
+            // the replica went out of sync with the source, drop the connection rather than showing wrong data
+            m_socket->abort();
+            return;
+        }
+    }
+}
+
+void ModelReplicaPrivate::onSocketDisconnected()
+{
+    Q_Q(ModelReplica);
+    m_buffer.clear();
+    m_streamVersion = -1;
+    if (m_socket)
+        m_socket->deleteLater();
+    m_socket.clear();
+    q->disconnected();
+}
+
+/*!
+\class ModelReplica
+\brief A GenericModel that mirrors the model served by a ModelReplicaSource in another process
+\details After connectToSource() the replica receives a snapshot of the source model and then applies the changes
+streamed by the source as they happen, one batch per event loop iteration of the source process.
+
+The replica is meant to be read-only, any local change is overwritten by the next snapshot and might
+cause the replica to go out of sync. If a change can't be applied the connection is dropped and disconnected() is emitted.
+\sa ModelReplicaSource
+*/
+
+/*!
+Constructs a new replica with the given \a parent.
+*/
+ModelReplica::ModelReplica(QObject *parent)
+    : GenericModel(*new ModelReplicaPrivate(this), parent)
+{ }
+
+/*!
+\internal
+*/
+ModelReplica::ModelReplica(ModelReplicaPrivate &dptr, QObject *parent)
+    : GenericModel(dptr, parent)
+{ }
+
+/*!
+Destructor
+*/
+ModelReplica::~ModelReplica()
+{
+    Q_D(ModelReplica);
+    if (d->m_socket)
+        d->m_socket->disconnect();
+}
+
+/*!
+\brief Connects to the ModelReplicaSource listening on \a serverName
+\details The contents of the replica are replaced as soon as the snapshot is received, synchronised() is emitted at that point.
+*/
+void ModelReplica::connectToSource(const QString &serverName)
+{
+    Q_D(ModelReplica);
+    disconnectFromSource();
+    d->m_serverName = serverName;
+    d->m_socket = new QLocalSocket(this);
+    QObject::connect(d->m_socket.data(), &QLocalSocket::readyRead, std::bind(&ModelReplicaPrivate::onReadyRead, d));
+    QObject::connect(d->m_socket.data(), &QLocalSocket::disconnected, std::bind(&ModelReplicaPrivate::onSocketDisconnected, d));
+    d->m_socket->connectToServer(serverName, QIODevice::ReadOnly);
+}
+
+/*!
+\brief Closes the connection with the source
+\details The contents of the replica are left untouched
+*/
+void ModelReplica::disconnectFromSource()
+{
+    Q_D(ModelReplica);
+    if (!d->m_socket)
+        return;
+    QLocalSocket *socket = d->m_socket.data();
+    socket->disconnect();
+    socket->abort();
+    socket->deleteLater();
+    d->m_socket.clear();
+    d->m_buffer.clear();
+    d->m_streamVersion = -1;
+}
+
+/*!
+\brief Returns true if the replica is connected to a source
+*/
+bool ModelReplica::isConnected() const
+{
+    Q_D(const ModelReplica);
+    return d->m_socket && d->m_socket->state() == QLocalSocket::ConnectedState;
+}
+
+/*!
+\brief Returns the name of the server passed to connectToSource()
+*/
+QString ModelReplica::serverName() const
+{
+    Q_D(const ModelReplica);
+    return d->m_serverName;
+}
+
+/*!
+\fn void ModelReplicaSource::modelChanged(QAbstractItemModel *model)
+\brief This signal is emitted when the \a model property changes
+*/
+
+/*!
+\fn void ModelReplica::synchronised()
+\brief This signal is emitted every time a full snapshot of the source model has been applied to the replica
+*/
+
+/*!
+\fn void ModelReplica::disconnected()
+\brief This signal is emitted when the connection with the source is lost
+*/
@@ -0,0 +1,65 @@
+/****************************************************************************\
+   Copyright 2021 Luca Beldi
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+       http://www.apache.org/licenses/LICENSE-2.0
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+\****************************************************************************/
+
+#ifndef MODELREPLICA_H
+#define MODELREPLICA_H
+#include <modelutilities_global.h>
+#include <genericmodel.h>
+class ModelReplicaPrivate;
+class ModelReplicaSourcePrivate;
+class MODELUTILITIES_EXPORT ModelReplicaSource : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QAbstractItemModel *model READ model WRITE setModel NOTIFY modelChanged)
+    Q_DISABLE_COPY(ModelReplicaSource)
+    Q_DECLARE_PRIVATE_D(m_dptr, ModelReplicaSource)
+public:
+    explicit ModelReplicaSource(QObject *parent = Q_NULLPTR);
+    explicit ModelReplicaSource(QAbstractItemModel *model, QObject *parent = Q_NULLPTR);
+    ~ModelReplicaSource();
+    QAbstractItemModel *model() const;
+    void setModel(QAbstractItemModel *model);
+    bool listen(const QString &serverName);
+    void close();
+    bool isListening() const;
+    QString serverName() const;
+    QString errorString() const;
+    int replicaCount() const;
+Q_SIGNALS:
+    void modelChanged(QAbstractItemModel *model);
+
+protected:
+    ModelReplicaSource(ModelReplicaSourcePrivate &dptr, QObject *parent);
+    ModelReplicaSourcePrivate *m_dptr;
+};
+
+class MODELUTILITIES_EXPORT ModelReplica : public GenericModel
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(ModelReplica)
+    Q_DECLARE_PRIVATE_D(m_dptr, ModelReplica)
+public:
+    explicit ModelReplica(QObject *parent = Q_NULLPTR);
+    ~ModelReplica();
+    void connectToSource(const QString &serverName);
+    void disconnectFromSource();
+    bool isConnected() const;
+    QString serverName() const;
+Q_SIGNALS:
+    void synchronised();
+    void disconnected();
+
+protected:
+    ModelReplica(ModelReplicaPrivate &dptr, QObject *parent);
+};
+#endif // MODELREPLICA_H
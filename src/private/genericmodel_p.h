@@ -17,6 +17,9 @@
 #include <QVector>
 #include <QSize>
 #include <QDataStream>
+#include <QSet>
+#include <QPair>
+#include <QRunnable>
 class GenericModelPrivate;
 class GenericModelItem;
 QDataStream &operator<<(QDataStream &stream, const GenericModelItem &item);
@@ -46,12 +49,16 @@ public:
     void setMergeDisplayEdit(bool val);
     QSize span() const;
     void setSpan(const QSize &sz);
-    void sortChildren(int column, int role, Qt::SortOrder order, bool recursive, QVector<RolesContainer> *headersToSort);
+    void sortChildren(const QVector<GenericModel::SortKey> &keys, bool recursive, QVector<RolesContainer> *headersToSort,
+                      QVector<int> *permutation = nullptr);
+    void permuteChildren(const QVector<int> &sourceRows, QVector<RolesContainer> *headersToSort);
     void moveChildRows(int sourceRow, int count, int destinationChild);
     void moveChildColumns(int sourceCol, int count, int destinationChild);
     void setRow(int r);
     void setColumn(int c);
     static bool isAnchestor(GenericModelItem *ancestor, GenericModelItem *descendent);
+    GenericModelItem *clone(GenericModel *model) const;
+    bool isSameTree(const GenericModelItem *other) const;
 
 private:
     int m_colCount;
@@ -62,17 +69,71 @@ private:
     int m_colSpan;
     GenericModel *m_model;
     QVector<GenericModelItem *> children;
-    void sortChildren(int column, int role, Qt::SortOrder order, bool recursive, const QModelIndexList &persistentIndexes,
-                      QVector<RolesContainer> *headersToSort);
+    void sortChildren(const QVector<GenericModel::SortKey> &keys, bool recursive, const QSet<QModelIndex> &persistentIndexes,
+                      QVector<RolesContainer> *headersToSort, QVector<int> *permutation);
+    void permuteChildren(const QVector<int> &sourceRows, const QSet<QModelIndex> &persistentIndexes, QVector<RolesContainer> *headersToSort);
     friend QDataStream &operator<<(QDataStream &stream, const GenericModelItem &item);
     friend QDataStream &operator>>(QDataStream &stream, GenericModelItem &item);
     friend class GenericModelPrivate;
 };
 
+class GenericModelVisitTask : public QRunnable
+{
+public:
+    GenericModelVisitTask(const GenericModelPrivate *model, const GenericModelItem *parent, int firstRow, int lastRow, int depth,
+                          const GenericModel::Visitor &visitor);
+    void run() override;
+
+private:
+    const GenericModelPrivate *m_model;
+    const GenericModelItem *m_parent;
+    int m_firstRow;
+    int m_lastRow;
+    int m_depth;
+    const GenericModel::Visitor &m_visitor;
+};
+
+class GenericModelMatchTask : public QRunnable
+{
+public:
+    GenericModelMatchTask(const QVector<const GenericModelItem *> &items, int first, int last, int role,
+                          const GenericModel::MatchPredicate &predicate, QVector<int> *result);
+    void run() override;
+    static void matchRange(const QVector<const GenericModelItem *> &items, int first, int last, int role,
+                           const GenericModel::MatchPredicate &predicate, int hits, QVector<int> *result);
+
+private:
+    const QVector<const GenericModelItem *> &m_items;
+    int m_first;
+    int m_last;
+    int m_role;
+    GenericModel::MatchPredicate m_predicate;
+    QVector<int> *m_result;
+};
+
+class GenericModelAggregateState
+{
+public:
+    GenericModelAggregateState();
+    void reset();
+    void addValue(const QVariant &value);
+    void removeValue(const QVariant &value);
+    static bool isNumeric(const QVariant &value);
+    int count;
+    int numericCount;
+    double sum;
+    QVariant minimum;
+    QVariant maximum;
+    bool minMaxDirty;
+    bool dirty;
+};
+
 class GenericModelPrivate
 {
     Q_DECLARE_PUBLIC(GenericModel)
     Q_DISABLE_COPY(GenericModelPrivate)
+    friend class GenericModelVisitTask;
+    friend class ModelReplicaPrivate;
     GenericModelPrivate(GenericModel *q);
     virtual ~GenericModelPrivate();
     QString mimeDataName() const;
@@ -92,6 +153,47 @@ class GenericModelPrivate
     void signalAllChanged(const QVector<int> &roles = QVector<int>(), const QModelIndex &parent = QModelIndex());
     void encodeMime(QMimeData *data, const QModelIndexList &indexes) const;
     bool decodeMime(const QMimeData *data, Qt::DropAction action, int row, int column, const QModelIndex &parent);
+    bool isKeepSortedRole(int role) const;
+    bool isKeepSortedLessThan(const QVariant &left, const QVariant &right) const;
+    void keepRowsSorted(const QModelIndex &parent, int row, int count);
+    bool isInternedRole(int column, int role) const;
+    QVariant internValue(const QVariant &value);
+    void releaseInterned(int column, int role, const QVariant &value);
+    void releaseInterned(const GenericModelItem *item);
+    void releaseInternedChildren(const GenericModelItem *item);
+    void internChildren(GenericModelItem *item);
+    void addToAggregates(const GenericModelItem *item);
+    void removeFromAggregates(const GenericModelItem *item);
+    void updateAggregates(const GenericModelItem *item, int role, const QVariant &oldValue, const QVariant &newValue);
+    void insertAggregateColumns(int column, int count);
+    void removeAggregateColumns(int column, int count);
+    void moveAggregateColumns(int sourceColumn, int count, int destinationChild);
+    void insertKeepSortedColumns(int column, int count);
+    void removeKeepSortedColumns(int column, int count);
+    void moveKeepSortedColumns(int sourceColumn, int count, int destinationChild);
+    void insertInternedColumns(int column, int count);
+    void removeInternedColumns(int column, int count);
+    void moveInternedColumns(int sourceColumn, int count, int destinationChild);
+    void invalidateAggregates();
+    void refreshAggregate(int column, int role, GenericModelAggregateState &state) const;
+    GenericModel::IndexPath pathForItem(const GenericModelItem *item) const;
+    void markChanged(GenericModelItem *item);
+    void forgetChanged(const GenericModelItem *item);
+    void recordOperation(GenericModel::ChangeSet::OperationType type, const QModelIndex &parent, int first, int count);
+    void recordSort(const QModelIndex &parent, const QVector<GenericModel::SortKey> &keys, bool recursive, const QVector<int> &permutation);
+    void recordHeaderChange(Qt::Orientation orientation, int section);
+    void visitChildren(const GenericModelItem *parent, int firstRow, int lastRow, int depth, const GenericModel::Visitor &visitor) const;
+    void collectColumnItems(const GenericModelItem *parent, int firstRow, int lastRow, int column, bool recursive,
+                            QVector<const GenericModelItem *> &items) const;
+    void collectItems(const GenericModelItem *parent, bool recursive, QVector<const GenericModelItem *> &items) const;
+    QModelIndexList matchItems(const QVector<const GenericModelItem *> &items, int role, const GenericModel::MatchPredicate &predicate,
+                               int hits) const;
+    void internItem(GenericModelItem *item);
+    void setColumnInterning(GenericModelItem *item, int column, int role, bool enabled);
+    void replaceItemData(GenericModelItem *item, RolesContainer newData, bool sourceMergeDisplayEdit);
+    void replaceChildren(GenericModelItem *item, const GenericModelItem *source, bool sourceMergeDisplayEdit);
+    void insertClonedRows(GenericModelItem *parentItem, int row, const GenericModelItem *sourceParent, int sourceRow, int count,
+                          bool sourceMergeDisplayEdit, const QVector<RolesContainer> *sourceHeaders = nullptr);
     GenericModel *q_ptr;
     GenericModelItem *root;
     QVector<RolesContainer> vHeaderData;
@@ -99,10 +201,18 @@ class GenericModelPrivate
     bool m_mergeDisplayEdit;
     int sortRole;
     QHash<int, QByteArray> m_roleNames;
+    int m_keepSortedColumn;
+    int m_keepSortedRole;
+    Qt::SortOrder m_keepSortedOrder;
+    QSet<QPair<int, int>> m_internedRoles;
+    QHash<QString, int> m_internPool;
+    mutable QHash<QPair<int, int>, GenericModelAggregateState> m_aggregates;
+    bool m_trackChanges;
+    QSet<GenericModelItem *> m_changedItems;
+    QVector<GenericModel::ChangeSet::Operation> m_operations;
 
 public:
     static void setMergeDisplayEdit(bool val, RolesContainer &container);
-    static bool isVariantLessThan(const QVariant &left, const QVariant &right);
 };
 
 #endif // GENERICMODEL_P_H
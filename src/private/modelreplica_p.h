@@ -0,0 +1,114 @@
+/****************************************************************************\
+   Copyright 2021 Luca Beldi
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+       http://www.apache.org/licenses/LICENSE-2.0
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+\****************************************************************************/
+#ifndef MODELREPLICA_P_H
+#define MODELREPLICA_P_H
+#include "modelreplica.h"
+#include "private/genericmodel_p.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QPointer>
+#include <QTimer>
+// Wire format.
+// On connection the source sends quint32 magic and qint32 QDataStream version, both serialised with QDataStream::Qt_5_0.
+// Everything after that is a sequence of frames: quint32 payload size followed by the payload.
+// Every frame holds all the messages generated in one event loop iteration and is applied by the replica in one go.
+// Each message starts with a qint32 ModelReplicaMessage, parents are sent as GenericModel::IndexPath.
+enum ModelReplicaMessage : qint32 {
+    ReplicaReset,
+    ReplicaDataChanged,
+    ReplicaHeaderDataChanged,
+    ReplicaInsertSections,
+    ReplicaRemoveSections,
+    ReplicaMoveSections,
+    ReplicaSortRows
+};
+
+struct ModelReplicaLayoutParent
+{
+    GenericModel::IndexPath path;
+    QPersistentModelIndex parent;
+    QVector<QPersistentModelIndex> rows;
+};
+
+class ModelReplicaSourcePrivate
+{
+    Q_DECLARE_PUBLIC(ModelReplicaSource)
+    Q_DISABLE_COPY(ModelReplicaSourcePrivate)
+    ModelReplicaSourcePrivate(ModelReplicaSource *q);
+    virtual ~ModelReplicaSourcePrivate();
+    static GenericModel::IndexPath pathForIndex(QModelIndex index);
+    void writeCell(QDataStream &stream, const QModelIndex &index) const;
+    void writeBranch(QDataStream &stream, const QModelIndex &parent) const;
+    void writeHeaders(QDataStream &stream, Qt::Orientation orientation, int first, int last) const;
+    void writeShiftedHeaders(QDataStream &stream, Qt::Orientation orientation, int first) const;
+    void writeSnapshot(QDataStream &stream) const;
+    bool isRecording() const;
+    void scheduleFlush();
+    void flush();
+    void onNewConnection();
+    void onReplicaDisconnected(QLocalSocket *socket);
+    void onModelReset();
+    void onModelDestroyed();
+    void captureLayout(const QModelIndex &parent, QSet<QModelIndex> &captured);
+    void onLayoutAboutToBeChanged(const QList<QPersistentModelIndex> &parents, QAbstractItemModel::LayoutChangeHint hint);
+    void onLayoutChanged();
+    void onDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void onHeaderDataChanged(Qt::Orientation orientation, int first, int last);
+    void onSectionsInserted(Qt::Orientation orientation, const QModelIndex &parent, int first, int last);
+    void onSectionsRemoved(Qt::Orientation orientation, const QModelIndex &parent, int first, int last);
+    void onSectionsAboutToBeMoved(Qt::Orientation orientation, const QModelIndex &sourceParent, int first, int last,
+                                  const QModelIndex &destinationParent, int destination);
+    void onSectionsMoved(Qt::Orientation orientation, const QModelIndex &sourceParent, const QModelIndex &destinationParent);
+    ModelReplicaSource *q_ptr;
+    QAbstractItemModel *m_model;
+    QLocalServer m_server;
+    QVector<QLocalSocket *> m_replicas;
+    QVector<QMetaObject::Connection> m_modelConnections;
+    QByteArray m_pending;
+    bool m_resetPending;
+    QVector<ModelReplicaLayoutParent> m_layoutParents;
+    QTimer m_flushTimer;
+    int m_streamVersion;
+
+public:
+    static const quint32 replicaMagic = 0x4D524550;
+};
+
+class ModelReplicaPrivate : public GenericModelPrivate
+{
+    Q_DECLARE_PUBLIC(ModelReplica)
+    Q_DISABLE_COPY(ModelReplicaPrivate)
+    ModelReplicaPrivate(ModelReplica *q);
+    ~ModelReplicaPrivate();
+    bool readCell(QDataStream &stream, const QModelIndex &index);
+    bool readBranch(QDataStream &stream, const QModelIndex &parent);
+    bool readItemCell(QDataStream &stream, GenericModelItem *item);
+    bool readItemBranch(QDataStream &stream, GenericModelItem *parentItem);
+    bool readHeaders(QDataStream &stream, bool notify);
+    bool readParent(QDataStream &stream, QModelIndex &parent) const;
+    bool readReset(QDataStream &stream);
+    bool readDataChanged(QDataStream &stream);
+    bool readInsertSections(QDataStream &stream);
+    bool readRemoveSections(QDataStream &stream);
+    bool readMoveSections(QDataStream &stream);
+    bool readSortRows(QDataStream &stream);
+    bool processFrame(const QByteArray &frame);
+    void onReadyRead();
+    void onSocketDisconnected();
+    QPointer<QLocalSocket> m_socket;
+    QByteArray m_buffer;
+    QString m_serverName;
+    int m_streamVersion;
+};
+
+#endif // MODELREPLICA_P_H
@@ -14,6 +14,7 @@
 #define MODELUTILITIES_COMMON_P_H
 
 #include <QVariant>
+#include <QDateTime>
 #include <QVector>
 #include <QList>
 #ifdef OPTIMISE_FOR_MANY_ROLES
@@ -59,4 +60,36 @@ QVector<T> listToVector(const QList<T> &list)
     return list.toVector();
 #endif
 }
+inline bool isVariantLessThan(const QVariant &left, const QVariant &right)
+{
+    if (left.userType() == QMetaType::UnknownType)
+        return false;
+    if (right.userType() == QMetaType::UnknownType)
+        return true;
+    switch (left.userType()) {
+    case QMetaType::Int:
+        return left.toInt() < right.toInt();
+    case QMetaType::UInt:
+        return left.toUInt() < right.toUInt();
+    case QMetaType::LongLong:
+        return left.toLongLong() < right.toLongLong();
+    case QMetaType::ULongLong:
+        return left.toULongLong() < right.toULongLong();
+    case QMetaType::Float:
+        return left.toFloat() < right.toFloat();
+    case QMetaType::Double:
+        return left.toDouble() < right.toDouble();
+    case QMetaType::Char:
+        return left.toChar() < right.toChar();
+    case QMetaType::QDate:
+        return left.toDate() < right.toDate();
+    case QMetaType::QTime:
+        return left.toTime() < right.toTime();
+    case QMetaType::QDateTime:
+        return left.toDateTime() < right.toDateTime();
+    case QMetaType::QString:
+    default:
+        return left.toString().compare(right.toString()) < 0;
+    }
+}
 #endif // MODELUTILITIES_COMMON_P_H
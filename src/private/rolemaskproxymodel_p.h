@@ -12,14 +12,18 @@
 \****************************************************************************/
 #ifndef ROLEMASKPROXYMODEL_P_H
 #define ROLEMASKPROXYMODEL_P_H
+#include <QBitArray>
+#include <QDataStream>
 #include <QPersistentModelIndex>
 #include <QHash>
 #include <QSet>
+#include <QString>
 #include <QMetaObject>
 #include <QVector>
 #include "private/modelutilities_common_p.h"
 #include "rolemaskproxymodel.h"
 #include <memory>
+#define Magic_Masked_Data_Header QStringLiteral("755F3866-95B5-4B69-93C9-F2B995B97A43") // magic string to mark saved masked data
 
 struct FlaggedRolesContainer
 {
@@ -31,15 +35,130 @@ struct FlaggedRolesContainer
     FlaggedRolesContainer &operator=(const FlaggedRolesContainer &other);
 };
 
+struct LayerValues
+{
+    RolesContainer m_roles;
+    int m_layer;
+    LayerValues();
+    explicit LayerValues(int layer);
+};
+
 struct MaskedItem
 {
     FlaggedRolesContainer m_data;
-    QPersistentModelIndex m_index;
-    MaskedItem() = default;
-    MaskedItem(const FlaggedRolesContainer &data, const QModelIndex &index);
-    MaskedItem(const FlaggedRolesContainer &data, const QPersistentModelIndex &index);
+    // the values of the overlay layers, sorted by layer id
+    QVector<LayerValues> m_layers;
+    int m_column;
+    MaskedItem();
+    MaskedItem(const FlaggedRolesContainer &data, int column);
     MaskedItem(const MaskedItem &other) = default;
     MaskedItem &operator=(const MaskedItem &other) = default;
+    bool isEmpty() const;
+    QVector<LayerValues>::iterator findLayer(int layer);
+    QVector<LayerValues>::const_iterator findLayer(int layer) const;
+};
+
+struct MaskedRow
+{
+    // sorted by column
+    QVector<MaskedItem> m_items;
+    int m_row;
+    MaskedRow();
+    explicit MaskedRow(int row);
+    QVector<MaskedItem>::iterator findColumn(int column);
+    QVector<MaskedItem>::const_iterator findColumn(int column) const;
+};
+
+struct MaskedRule
+{
+    FlaggedRolesContainer m_data;
+    // a last row/column of -1 means the rule extends to the end of the parent
+    int m_firstRow;
+    int m_lastRow;
+    int m_firstColumn;
+    int m_lastColumn;
+    MaskedRule();
+    MaskedRule(int firstRow, int lastRow, int firstColumn, int lastColumn);
+    int &first(Qt::Orientation orientation);
+    int &last(Qt::Orientation orientation);
+    int first(Qt::Orientation orientation) const;
+    int last(Qt::Orientation orientation) const;
+    bool isFullSpan(Qt::Orientation orientation) const;
+    bool sameRange(const MaskedRule &other) const;
+    bool contains(int row, int column) const;
+    bool sameData(const MaskedRule &other) const;
+};
+
+struct MaskedParent
+{
+    // sorted by row
+    QVector<MaskedRow> m_rows;
+    // the last rule takes precedence
+    QVector<MaskedRule> m_rules;
+    // the children of this parent that have masked data in their own subtree
+    QVector<QPersistentModelIndex> m_children;
+    // the ids of the overlay layers with values in the cells of this parent. A layer is only dropped when its values are removed so it
+    // might still be listed after its last value was cleared
+    QSet<int> m_overlayLayers;
+    // only populated while the source model changes its layout
+    QVector<QPersistentModelIndex> m_sortItems;
+    QVector<QVector<QPersistentModelIndex>> m_sortRuleRows;
+    QVector<QVector<QPersistentModelIndex>> m_sortRuleColumns;
+    // the check states stored in the first column below this parent, partial states count as both
+    int m_checkedStates;
+    int m_uncheckedStates;
+    // the same counters restricted to the cells of the children, rules excluded
+    int m_checkedRows;
+    int m_uncheckedRows;
+    // the first row of each band of rows covered by the same rules and the indexes of those rules, the last rule first.
+    // Rebuilt on the first lookup after m_rules changed
+    mutable QVector<int> m_ruleBands;
+    mutable QVector<QVector<int>> m_bandRules;
+    mutable bool m_ruleIndexDirty;
+    MaskedParent();
+    bool isEmpty() const;
+    void invalidateRuleIndex();
+    const QVector<int> &rulesForRow(int row) const;
+    QVector<int> maskedColumns() const;
+    QVector<MaskedRow>::iterator findRow(int row);
+    QVector<MaskedRow>::const_iterator findRow(int row) const;
+    int findRule(const MaskedRule &rule) const;
+};
+
+struct ComputedRole
+{
+    RoleMaskProxyModel::RoleFunction m_function;
+    // empty means any change invalidates the role
+    QVector<int> m_dependsOn;
+};
+
+struct OverlayLayer
+{
+    QString m_name;
+    // the key of the values in MaskedItem::m_layers, never reused
+    int m_id;
+    int m_priority;
+    bool m_enabled;
+};
+
+struct ChangedCells
+{
+    QPersistentModelIndex m_parent;
+    // source rows in ascending order
+    QVector<int> m_rows;
+    QVector<int> m_roles;
+    int m_firstColumn;
+    int m_lastColumn;
+    ChangedCells();
+    explicit ChangedCells(const QPersistentModelIndex &parent);
+    void addCell(int row, int column, const RolesContainer &roles);
+};
+
+struct SortedRows
+{
+    QVector<int> m_proxyToSource;
+    QVector<int> m_sourceToProxy;
+    void mapSourceRows();
 };
 
 class RoleMaskProxyModelPrivate
@@ -48,24 +167,124 @@ class RoleMaskProxyModelPrivate
     RoleMaskProxyModel *q_ptr;
     RoleMaskProxyModelPrivate(RoleMaskProxyModel *q);
     QSet<int> m_maskedRoles;
-    QMultiHash<QPair<int, int>, MaskedItem> m_masked;
+    QHash<QPersistentModelIndex, MaskedParent> m_masked;
     QVector<RolesContainer> m_hHeaderData;
     QVector<RolesContainer> m_vHeaderData;
     QVector<QPersistentModelIndex> m_sortVHeaders;
     QVector<QPersistentModelIndex> m_sortHHeaders;
+    // the masked parents affected by the layout change in progress
+    QVector<QPersistentModelIndex> m_layoutParents;
     RolesContainer m_defaultValues;
     bool m_transparentIfEmpty;
     bool m_mergeDisplayEdit;
     bool m_maskHeaderData;
+    bool m_propagateCheckState;
+    // set by every change to the stored check states but the propagated ones, the counters are rebuilt when next read
+    mutable bool m_checkCountersDirty;
+    QHash<int, ComputedRole> m_computedRoles;
+    // memoised computed values by source parent, the cell key is built by computedCellKey()
+    QHash<QPersistentModelIndex, QHash<quint64, RolesContainer>> m_computedCache;
+    // sorted by precedence: highest priority first, the most recently added first among equal priorities
+    QVector<OverlayLayer> m_layers;
+    int m_enabledLayers;
+    int m_nextLayerId;
+    int m_sortRole;
+    // the order of the rows by source parent, parents shown in the source order have no entry
+    QHash<QPersistentModelIndex, SortedRows> m_sortedRows;
+    QModelIndexList m_sortProxyIndexes;
+    QModelIndexList m_sortSourceIndexes;
     QVector<QMetaObject::Connection> m_sourceConnections;
+    // the keys of m_masked, m_sortedRows and m_computedCache by plain index so looking a parent up does not register a temporary
+    // persistent index with the source model. Rebuilt on the first lookup after the source changed its structure
+    mutable QHash<QModelIndex, QPersistentModelIndex> m_parentKeys;
+    mutable bool m_parentKeysDirty;
+    bool findParentKey(const QModelIndex &sourceParent, QPersistentModelIndex &key) const;
+    QPersistentModelIndex ensureParentKey(const QModelIndex &sourceParent);
+    void rebuildParentKeys() const;
+    void invalidateParentKeys();
+    const MaskedParent *parentNode(const QModelIndex &parent) const;
+    MaskedParent *parentNode(const QModelIndex &parent);
+    MaskedParent &ensureParentNode(const QModelIndex &parent);
+    void removeParentNode(const QPersistentModelIndex &parent);
+    void removeChildNodes(const QModelIndex &parent, Qt::Orientation orientation, int start, int end);
+    void pruneParentNode(const QModelIndex &parent);
     void clearUnusedMaskedRoles(const QSet<int> &roles);
     bool removeRole(const QModelIndex &idx, int role);
     bool removeIndex(const QModelIndex &idx);
     void signalAllChanged(const QVector<int> &roles = QVector<int>(), const QModelIndex &parent = QModelIndex());
     void interceptDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
+    void interceptHeaderDataChanged(Qt::Orientation orientation, int first, int last);
+    void signalSourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
+    const SortedRows *sortedRows(const QModelIndex &sourceParent) const;
+    int sourceRow(const QModelIndex &sourceParent, int proxyRow) const;
+    QVector<QPair<int, int>> sourceRowSpans(const QModelIndex &sourceParent, int firstRow, int lastRow) const;
+    QVector<QPair<int, int>> proxyRowSpans(const QModelIndex &sourceParent, int firstRow, int lastRow) const;
+    void sortRows(const QModelIndex &parent, int column, Qt::SortOrder order);
+    void sortedRowsAboutToBeChanged(const QList<QPersistentModelIndex> &parents);
+    void sortedRowsChanged(const QList<QPersistentModelIndex> &parents);
+    void removeStaleSortedRows();
+    const MaskedItem *maskedItem(const QModelIndex &index) const;
+    MaskedItem *maskedItem(const QModelIndex &index);
     const FlaggedRolesContainer *dataForIndex(const QModelIndex &index) const;
     FlaggedRolesContainer *dataForIndex(const QModelIndex &index);
     void insertData(const QModelIndex &index, const FlaggedRolesContainer &data);
+    const QVariant *ruleData(const QModelIndex &index, int role) const;
+    const Qt::ItemFlags *ruleFlags(const QModelIndex &index) const;
+    void mergeRuleData(const QModelIndex &index, RolesContainer &result) const;
+    bool setRuleData(const QModelIndex &parent, int firstRow, int lastRow, int firstColumn, int lastColumn, int role, const QVariant &value);
+    bool setRuleFlags(const QModelIndex &parent, int firstRow, int lastRow, int firstColumn, int lastColumn, Qt::ItemFlags flags);
+    void signalRuleChanged(const QModelIndex &parent, const MaskedRule &rule, const QVector<int> &roles);
+    void rulesInserted(MaskedParent *node, Qt::Orientation orientation, int start, int end);
+    void rulesRemoved(MaskedParent *node, Qt::Orientation orientation, int start, int end);
+    void rulesMoved(Qt::Orientation orientation, const QModelIndex &sourceParent, int sourceStart, int sourceEnd,
+                    const QModelIndex &destinationParent, int destination);
+    static void mergeRules(QVector<MaskedRule> &rules);
+    void rulesAboutToBeLaidOut(QAbstractItemModel::LayoutChangeHint hint);
+    void rulesLaidOut();
+    void itemsAboutToBeLaidOut(QAbstractItemModel::LayoutChangeHint hint);
+    void itemsLaidOut(QAbstractItemModel::LayoutChangeHint hint);
+    QVariant computedData(const QModelIndex &index, int role);
+    void invalidateComputedRoles(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
+    static quint64 computedCellKey(int row, int column);
+    int findLayer(const QString &name) const;
+    void insertLayer(const OverlayLayer &layer);
+    const QVariant *layerData(const MaskedItem *item, int role) const;
+    void mergeLayerData(const MaskedItem *item, RolesContainer &result) const;
+    void removeLayerValues(int layer);
+    void signalLayerChanged(int layer);
+    void signalCellsChanged(const QVector<ChangedCells> &changes);
+    void writeMaskedData(QDataStream &writer) const;
+    bool readMaskedData(QDataStream &reader);
+    static QVector<QPair<int, int>> pathForIndex(QModelIndex index);
+    static void writeRoles(QDataStream &writer, const RolesContainer &roles);
+    static bool readRoles(QDataStream &reader, RolesContainer &roles);
+    static void writeFlaggedRoles(QDataStream &writer, const FlaggedRolesContainer &data);
+    static bool readFlaggedRoles(QDataStream &reader, FlaggedRolesContainer &data);
+    enum DescendantCheckState { CheckedDescendants = 0x1, UncheckedDescendants = 0x2 };
+    const QVariant *explicitCheckState(const QModelIndex &index) const;
+    const QVariant *inheritedCheckState(const QModelIndex &index) const;
+    static void countCheckState(const QVariant &state, int delta, int &checked, int &unchecked);
+    void countCheckStates(const QPersistentModelIndex &parent);
+    void ensureCheckCounters() const;
+    void updateCheckCounters(const QModelIndex &index, int checkedDelta, int uncheckedDelta, bool ownState);
+    int descendantCheckStates(const QModelIndex &parent) const;
+    QVariant propagatedCheckState(const QModelIndex &index) const;
+    bool childrenShareCheckState(const QModelIndex &parent, int changedRow, Qt::CheckState state) const;
+    void clearDescendantCheckStates(const QModelIndex &parent);
+    void setPropagatedCheckState(const QModelIndex &index, Qt::CheckState state);
+    void signalCheckStateChanged(const QModelIndex &parent);
+    static QBitArray opaqueRoles(const MaskedRow *maskedRow, const QVector<const MaskedRule *> &rules, int row, int firstColumn, int lastColumn,
+                                 const QVector<int> &roles);
+    static bool removeSpan(int &first, int &last, int start, int end);
+    static int movePosition(int position, int sourceStart, int sourceEnd, int destination);
+    static QVector<QPair<int, int>> moveSpan(int first, int last, int sourceStart, int sourceEnd, int destination);
+    static QVector<QPair<int, int>> spansFromIndexes(const QVector<QPersistentModelIndex> &indexes, Qt::Orientation orientation);
+    static QVector<QPair<int, int>> spansFromPositions(QVector<int> positions);
+    void onSortedRowsInserted(const QModelIndex &parent, int start, int end);
+    void onSortedRowsAboutToBeRemoved(const QModelIndex &parent, int start, int end);
+    void onSortedRowsRemoved(const QModelIndex &parent, int start, int end);
+    void onSortedRowsAboutToBeMoved(const QModelIndex &sourceParent, const QModelIndex &destinationParent);
+    void onSortedLayoutChanged(const QList<QPersistentModelIndex> &parents);
     void onRowsAboutToBeInserted(const QModelIndex &parent, int start, int end);
     void onColumnsAboutToBeInserted(const QModelIndex &parent, int start, int end);
     void onRowsAboutToBeRemoved(const QModelIndex &parent, int start, int end);
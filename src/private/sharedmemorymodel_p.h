@@ -0,0 +1,107 @@
+/****************************************************************************\
+   Copyright 2021 Luca Beldi
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+       http://www.apache.org/licenses/LICENSE-2.0
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+\****************************************************************************/
+#ifndef SHAREDMEMORYMODEL_P_H
+#define SHAREDMEMORYMODEL_P_H
+#include "sharedmemorymodel.h"
+#include "private/modelutilities_common_p.h"
+#include <QSharedMemory>
+// Layout of the shared segments.
+// The control segment, named after the key, only holds the current generation.
+// Each generation is published in its own data segment that is never modified after creation:
+// SharedMemoryImageHeader | SharedMemoryImageNode[nodeCount] | qint32[horizontal + vertical headers] | data blob
+// Every node points to a role table in the blob: qint32 count followed by count SharedMemoryImageRole entries.
+// Each value is a QVariant serialised with QDataStream.
+struct SharedMemoryControl
+{
+    quint32 magic;
+    quint32 reserved;
+    qint64 generation;
+};
+struct SharedMemoryImageHeader
+{
+    quint32 magic;
+    qint32 version;
+    qint32 streamVersion;
+    qint32 nodeCount;
+    qint32 horizontalHeaderCount;
+    qint32 verticalHeaderCount;
+    qint32 blobOffset;
+    qint32 blobSize;
+};
+struct SharedMemoryImageNode
+{
+    qint32 parent;
+    qint32 row;
+    qint32 column;
+    qint32 rowCount;
+    qint32 columnCount;
+    qint32 firstChild;
+    qint32 flags;
+    qint32 rolesOffset;
+};
+struct SharedMemoryImageRole
+{
+    qint32 role;
+    qint32 offset;
+    qint32 size;
+};
+
+class SharedMemoryModelPublisherPrivate
+{
+    Q_DECLARE_PUBLIC(SharedMemoryModelPublisher)
+    Q_DISABLE_COPY(SharedMemoryModelPublisherPrivate)
+    SharedMemoryModelPublisherPrivate(const QString &key, SharedMemoryModelPublisher *q);
+    virtual ~SharedMemoryModelPublisherPrivate();
+    bool attachControl();
+    QByteArray createImage(const QAbstractItemModel *model, const QModelIndex &parent) const;
+    static qint32 appendRoles(QByteArray &blob, const QMap<int, QVariant> &roles, int streamVersion);
+    SharedMemoryModelPublisher *q_ptr;
+    QString m_key;
+    qint64 m_generation;
+    QString m_errorString;
+    QSharedMemory m_control;
+    QSharedMemory *m_currentData;
+    QSharedMemory *m_previousData;
+
+public:
+    static const quint32 controlMagic = 0x534D4D43;
+    static const quint32 imageMagic = 0x534D4D49;
+    static const qint32 imageVersion = 1;
+    static QString dataKey(const QString &key, qint64 generation);
+};
+
+class SharedMemoryModelPrivate
+{
+    Q_DECLARE_PUBLIC(SharedMemoryModel)
+    Q_DISABLE_COPY(SharedMemoryModelPrivate)
+    SharedMemoryModelPrivate(SharedMemoryModel *q);
+    virtual ~SharedMemoryModelPrivate();
+    void clear();
+    static bool isValidImage(const QSharedMemory *memory, SharedMemoryImageHeader &imageHeader);
+    static bool isValidRoleTable(const char *blob, qint32 blobSize, qint32 rolesOffset);
+    const char *imageData() const;
+    const SharedMemoryImageHeader &header() const;
+    SharedMemoryImageNode node(qint32 nodeIndex) const;
+    qint32 headerRolesOffset(int section, Qt::Orientation orientation) const;
+    const char *roleTable(qint32 rolesOffset, qint32 &roleCount) const;
+    QVariant roleValue(qint32 rolesOffset, int role) const;
+    QMap<int, QVariant> roleValues(qint32 rolesOffset) const;
+    SharedMemoryModel *q_ptr;
+    QString m_key;
+    qint64 m_generation;
+    QSharedMemory m_control;
+    QSharedMemory *m_data;
+    SharedMemoryImageHeader m_header;
+};
+
+#endif // SHAREDMEMORYMODEL_P_H
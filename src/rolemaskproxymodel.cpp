@@ -12,7 +12,11 @@
 \****************************************************************************/
 #include "rolemaskproxymodel.h"
 #include "private/rolemaskproxymodel_p.h"
+#include <QIODevice>
+#include <QItemSelection>
 #include <QVector>
+#include <algorithm>
+#include <limits>
 
 FlaggedRolesContainer::FlaggedRolesContainer()
     : flags(nullptr)
@@ -44,192 +48,2239 @@ FlaggedRolesContainer &FlaggedRolesContainer::operator=(const FlaggedRolesContai
     return *this;
 }
 
-MaskedItem::MaskedItem(const FlaggedRolesContainer &data, const QModelIndex &index)
-    : m_data(data)
-    , m_index(index)
+LayerValues::LayerValues()
+    : m_layer(-1)
+{ }
+
+LayerValues::LayerValues(int layer)
+    : m_layer(layer)
+{ }
+
+MaskedItem::MaskedItem()
+    : m_column(-1)
 { }
 
-MaskedItem::MaskedItem(const FlaggedRolesContainer &data, const QPersistentModelIndex &index)
+MaskedItem::MaskedItem(const FlaggedRolesContainer &data, int column)
     : m_data(data)
-    , m_index(index)
+    , m_column(column)
+{ }
+
+bool MaskedItem::isEmpty() const
+{
+    return m_data.roles.isEmpty() && !m_data.flags && m_layers.isEmpty();
+}
+
+QVector<LayerValues>::iterator MaskedItem::findLayer(int layer)
+{
+    return std::lower_bound(m_layers.begin(), m_layers.end(), layer, [](const LayerValues &values, int l) -> bool { return values.m_layer < l; });
+}
+
+QVector<LayerValues>::const_iterator MaskedItem::findLayer(int layer) const
+{
+    return std::lower_bound(m_layers.cbegin(), m_layers.cend(), layer,
+                            [](const LayerValues &values, int l) -> bool { return values.m_layer < l; });
+}
+
+MaskedRow::MaskedRow()
+    : m_row(-1)
+{ }
+
+MaskedRow::MaskedRow(int row)
+    : m_row(row)
+{ }
+
+QVector<MaskedItem>::iterator MaskedRow::findColumn(int column)
+{
+    return std::lower_bound(m_items.begin(), m_items.end(), column, [](const MaskedItem &item, int col) -> bool { return item.m_column < col; });
+}
+
+QVector<MaskedItem>::const_iterator MaskedRow::findColumn(int column) const
+{
+    return std::lower_bound(m_items.cbegin(), m_items.cend(), column, [](const MaskedItem &item, int col) -> bool { return item.m_column < col; });
+}
+
+MaskedRule::MaskedRule()
+    : m_firstRow(0)
+    , m_lastRow(-1)
+    , m_firstColumn(0)
+    , m_lastColumn(-1)
+{ }
+
+MaskedRule::MaskedRule(int firstRow, int lastRow, int firstColumn, int lastColumn)
+    : m_firstRow(firstRow)
+    , m_lastRow(lastRow)
+    , m_firstColumn(firstColumn)
+    , m_lastColumn(lastColumn)
+{ }
+
+int &MaskedRule::first(Qt::Orientation orientation)
+{
+    return orientation == Qt::Vertical ? m_firstRow : m_firstColumn;
+}
+
+int &MaskedRule::last(Qt::Orientation orientation)
+{
+    return orientation == Qt::Vertical ? m_lastRow : m_lastColumn;
+}
+
+int MaskedRule::first(Qt::Orientation orientation) const
+{
+    return orientation == Qt::Vertical ? m_firstRow : m_firstColumn;
+}
+
+int MaskedRule::last(Qt::Orientation orientation) const
+{
+    return orientation == Qt::Vertical ? m_lastRow : m_lastColumn;
+}
+
+bool MaskedRule::isFullSpan(Qt::Orientation orientation) const
+{
+    if (orientation == Qt::Vertical)
+        return m_firstRow == 0 && m_lastRow < 0;
+    return m_firstColumn == 0 && m_lastColumn < 0;
+}
+
+bool MaskedRule::sameRange(const MaskedRule &other) const
+{
+    return m_firstRow == other.m_firstRow && m_lastRow == other.m_lastRow && m_firstColumn == other.m_firstColumn
+            && m_lastColumn == other.m_lastColumn;
+}
+
+bool MaskedRule::sameData(const MaskedRule &other) const
+{
+    if (m_data.roles != other.m_data.roles || bool(m_data.flags) != bool(other.m_data.flags))
+        return false;
+    return !m_data.flags || *m_data.flags == *other.m_data.flags;
+}
+
+bool MaskedRule::contains(int row, int column) const
+{
+    return row >= m_firstRow && (m_lastRow < 0 || row <= m_lastRow) && column >= m_firstColumn && (m_lastColumn < 0 || column <= m_lastColumn);
+}
+
+MaskedParent::MaskedParent()
+    : m_checkedStates(0)
+    , m_uncheckedStates(0)
+    , m_checkedRows(0)
+    , m_uncheckedRows(0)
+    , m_ruleIndexDirty(true)
+{ }
+
+bool MaskedParent::isEmpty() const
+{
+    return m_rows.isEmpty() && m_rules.isEmpty() && m_children.isEmpty();
+}
+
+QVector<int> MaskedParent::maskedColumns() const
+{
+    QVector<int> result;
+    for (int i = 0, maxI = m_rows.size(); i < maxI; ++i) {
+        const QVector<MaskedItem> &items = m_rows.at(i).m_items;
+        for (int j = 0, maxJ = items.size(); j < maxJ; ++j)
+            result.append(items.at(j).m_column);
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+QVector<MaskedRow>::iterator MaskedParent::findRow(int row)
+{
+    return std::lower_bound(m_rows.begin(), m_rows.end(), row, [](const MaskedRow &maskedRow, int r) -> bool { return maskedRow.m_row < r; });
+}
+
+QVector<MaskedRow>::const_iterator MaskedParent::findRow(int row) const
+{
+    return std::lower_bound(m_rows.cbegin(), m_rows.cend(), row, [](const MaskedRow &maskedRow, int r) -> bool { return maskedRow.m_row < r; });
+}
+
+void MaskedParent::invalidateRuleIndex()
+{
+    m_ruleIndexDirty = true;
+}
+
+const QVector<int> &MaskedParent::rulesForRow(int row) const
+{
+    Q_ASSERT(row >= 0);
+    if (m_ruleIndexDirty) {
+        m_ruleBands = QVector<int>(1, 0);
+        for (int i = 0, maxI = m_rules.size(); i < maxI; ++i) {
+            m_ruleBands.append(m_rules.at(i).m_firstRow);
+            if (m_rules.at(i).m_lastRow >= 0)
+                m_ruleBands.append(m_rules.at(i).m_lastRow + 1);
+        }
+        std::sort(m_ruleBands.begin(), m_ruleBands.end());
+        m_ruleBands.erase(std::unique(m_ruleBands.begin(), m_ruleBands.end()), m_ruleBands.end());
+        m_bandRules = QVector<QVector<int>>(m_ruleBands.size());
+        for (int i = m_rules.size() - 1; i >= 0; --i) {
+            const MaskedRule &rule = m_rules.at(i);
+            const int firstBand = std::lower_bound(m_ruleBands.cbegin(), m_ruleBands.cend(), rule.m_firstRow) - m_ruleBands.cbegin();
+            const int endBand = rule.m_lastRow < 0
+                    ? m_ruleBands.size()
+                    : std::lower_bound(m_ruleBands.cbegin(), m_ruleBands.cend(), rule.m_lastRow + 1) - m_ruleBands.cbegin();
+            for (int j = firstBand; j < endBand; ++j)
+                m_bandRules[j].append(i);
+        }
+        m_ruleIndexDirty = false;
+    }
+    const int band = std::upper_bound(m_ruleBands.cbegin(), m_ruleBands.cend(), row) - m_ruleBands.cbegin() - 1;
+    return m_bandRules.at(band);
+}
+
+int MaskedParent::findRule(const MaskedRule &rule) const
+{
+    for (int i = 0, maxI = m_rules.size(); i < maxI; ++i) {
+        if (m_rules.at(i).sameRange(rule))
+            return i;
+    }
+    return -1;
+}
+
+ChangedCells::ChangedCells()
+    : m_firstColumn(std::numeric_limits<int>::max())
+    , m_lastColumn(-1)
+{ }
+
+ChangedCells::ChangedCells(const QPersistentModelIndex &parent)
+    : m_parent(parent)
+    , m_firstColumn(std::numeric_limits<int>::max())
+    , m_lastColumn(-1)
 { }
 
+void ChangedCells::addCell(int row, int column, const RolesContainer &roles)
+{
+    if (m_rows.isEmpty() || m_rows.last() != row)
+        m_rows.append(row);
+    m_firstColumn = qMin(m_firstColumn, column);
+    m_lastColumn = qMax(m_lastColumn, column);
+    for (auto roleIter = roles.cbegin(), roleEnd = roles.cend(); roleIter != roleEnd; ++roleIter) {
+        if (!m_roles.contains(roleIter.key()))
+            m_roles.append(roleIter.key());
+    }
+}
+
+void SortedRows::mapSourceRows()
+{
+    m_sourceToProxy.resize(m_proxyToSource.size());
+    for (int i = 0, maxI = m_proxyToSource.size(); i < maxI; ++i)
+        m_sourceToProxy[m_proxyToSource.at(i)] = i;
+}
+
 RoleMaskProxyModelPrivate::RoleMaskProxyModelPrivate(RoleMaskProxyModel *q)
     : q_ptr(q)
     , m_transparentIfEmpty(true)
     , m_mergeDisplayEdit(true)
     , m_maskHeaderData(false)
+    , m_propagateCheckState(false)
+    , m_checkCountersDirty(false)
+    , m_enabledLayers(0)
+    , m_nextLayerId(0)
+    , m_sortRole(Qt::DisplayRole)
+    , m_parentKeysDirty(false)
 {
     Q_ASSERT(q_ptr);
 }
 
 void RoleMaskProxyModelPrivate::interceptDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles)
 {
-    Q_Q(RoleMaskProxyModel);
-    Q_ASSERT(topLeft.isValid() ? topLeft.model() == q->sourceModel() : true);
-    Q_ASSERT(bottomRight.isValid() ? bottomRight.model() == q->sourceModel() : true);
+    Q_ASSERT(topLeft.isValid() ? topLeft.model() == q_func()->sourceModel() : true);
+    Q_ASSERT(bottomRight.isValid() ? bottomRight.model() == q_func()->sourceModel() : true);
     if (roles.isEmpty()) {
-        q->dataChanged(q->mapFromSource(topLeft), q->mapFromSource(bottomRight), roles);
+        signalSourceDataChanged(topLeft, bottomRight, roles);
         return;
     }
-    QVector<int> filteredRoles;
-    filteredRoles.reserve(roles.size());
+    QVector<int> candidateRoles;
+    candidateRoles.reserve(roles.size());
+    // the roles that are hidden in the cells where a masked value exists
+    QVector<int> hideableRoles;
     for (int singleRole : roles) {
-        if (m_mergeDisplayEdit && singleRole == Qt::EditRole) {
-            if (filteredRoles.contains(Qt::DisplayRole))
-                continue;
+        if (m_mergeDisplayEdit && singleRole == Qt::EditRole)
             singleRole = Qt::DisplayRole;
-        }
+        if (candidateRoles.contains(singleRole))
+            continue;
         if (m_maskedRoles.contains(singleRole)) {
-            if (m_transparentIfEmpty) {
-                bool allOpaque = true;
-                for (int i = topLeft.row(); allOpaque && i <= bottomRight.row(); ++i) {
-                    for (int j = topLeft.column(); allOpaque && j <= bottomRight.column(); ++j) {
-                        const FlaggedRolesContainer *data = dataForIndex(q->sourceModel()->index(i, j, topLeft.parent()));
-                        if (data)
-                            allOpaque = data->roles.value(singleRole).isValid();
-                        else
-                            allOpaque = false;
-                    }
-                }
-                if (allOpaque)
-                    continue;
-            } else {
+            if (!m_transparentIfEmpty)
                 continue;
-            }
+            hideableRoles << singleRole;
+        }
+        candidateRoles << singleRole;
+    }
+    if (candidateRoles.isEmpty())
+        return;
+    const auto signalRange = [this, &candidateRoles, &hideableRoles, &topLeft, &bottomRight](int firstRow, int lastRow,
+                                                                                          const QBitArray &opaqueRoles) -> void {
+        QVector<int> filteredRoles;
+        filteredRoles.reserve(candidateRoles.size() + 1);
+        for (int i = 0, maxI = candidateRoles.size(); i < maxI; ++i) {
+            const int hideableIdx = hideableRoles.indexOf(candidateRoles.at(i));
+            if (hideableIdx >= 0 && opaqueRoles.testBit(hideableIdx))
+                continue;
+            filteredRoles << candidateRoles.at(i);
+            if (m_mergeDisplayEdit && candidateRoles.at(i) == Qt::DisplayRole)
+                filteredRoles << Qt::EditRole;
+        }
+        if (filteredRoles.isEmpty())
+            return;
+        signalSourceDataChanged(topLeft.sibling(firstRow, topLeft.column()), bottomRight.sibling(lastRow, bottomRight.column()), filteredRoles);
+    };
+    const QBitArray transparentRoles(hideableRoles.size());
+    const MaskedParent *node = hideableRoles.isEmpty() ? nullptr : parentNode(topLeft.parent());
+    if (!node) {
+        signalRange(topLeft.row(), bottomRight.row(), transparentRoles);
+        return;
+    }
+    QVector<const MaskedRule *> rules;
+    for (int i = 0, maxI = node->m_rules.size(); i < maxI; ++i) {
+        const MaskedRule &rule = node->m_rules.at(i);
+        if (rule.m_firstRow <= bottomRight.row() && (rule.m_lastRow < 0 || rule.m_lastRow >= topLeft.row())
+            && rule.m_firstColumn <= bottomRight.column() && (rule.m_lastColumn < 0 || rule.m_lastColumn >= topLeft.column()))
+            rules.append(&rule);
+    }
+    // consecutive rows that hide the same roles are signalled together
+    auto rowIter = node->findRow(topLeft.row());
+    const auto rowEnd = node->m_rows.cend();
+    int rangeStart = topLeft.row();
+    QBitArray rangeOpaqueRoles = transparentRoles;
+    for (int i = topLeft.row(); i <= bottomRight.row();) {
+        const MaskedRow *maskedRow = (rowIter != rowEnd && rowIter->m_row == i) ? &(*rowIter) : nullptr;
+        int lastRow = i;
+        QBitArray rowOpaqueRoles;
+        if (maskedRow || !rules.isEmpty()) {
+            rowOpaqueRoles = opaqueRoles(maskedRow, rules, i, topLeft.column(), bottomRight.column(), hideableRoles);
+        } else {
+            // nothing can hide the roles up to the next masked row
+            rowOpaqueRoles = transparentRoles;
+            lastRow = rowIter == rowEnd ? bottomRight.row() : qMin(bottomRight.row(), rowIter->m_row - 1);
+        }
+        if (maskedRow)
+            ++rowIter;
+        if (rowOpaqueRoles != rangeOpaqueRoles) {
+            if (i > rangeStart)
+                signalRange(rangeStart, i - 1, rangeOpaqueRoles);
+            rangeStart = i;
+            rangeOpaqueRoles = rowOpaqueRoles;
+        }
+        i = lastRow + 1;
+    }
+    signalRange(rangeStart, bottomRight.row(), rangeOpaqueRoles);
+}
+
+void RoleMaskProxyModelPrivate::interceptHeaderDataChanged(Qt::Orientation orientation, int first, int last)
+{
+    Q_Q(RoleMaskProxyModel);
+    if (orientation == Qt::Vertical && sortedRows(QModelIndex())) {
+        const QVector<QPair<int, int>> spans = proxyRowSpans(QModelIndex(), first, last);
+        if (!spans.isEmpty()) {
+            first = spans.first().first;
+            last = spans.last().second;
         }
-        filteredRoles << singleRole;
-        if (m_mergeDisplayEdit && singleRole == Qt::DisplayRole)
-            filteredRoles << Qt::EditRole;
     }
-    if (filteredRoles.isEmpty())
+    q->headerDataChanged(orientation, first, last);
+}
+
+void RoleMaskProxyModelPrivate::signalSourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles)
+{
+    Q_Q(RoleMaskProxyModel);
+    const QModelIndex sourceParent = topLeft.parent();
+    if (!topLeft.isValid() || !sortedRows(sourceParent)) {
+        q->dataChanged(q->mapFromSource(topLeft), q->mapFromSource(bottomRight), roles);
         return;
-    q->dataChanged(q->mapFromSource(topLeft), q->mapFromSource(bottomRight), filteredRoles);
+    }
+    // the source rows are scattered in the proxy, the signal covers every proxy row between them
+    const QVector<QPair<int, int>> spans = proxyRowSpans(sourceParent, topLeft.row(), bottomRight.row());
+    const QModelIndex proxyParent = q->mapFromSource(sourceParent);
+    q->dataChanged(q->index(spans.first().first, topLeft.column(), proxyParent), q->index(spans.last().second, bottomRight.column(), proxyParent),
+                   roles);
 }
 
-const FlaggedRolesContainer *RoleMaskProxyModelPrivate::dataForIndex(const QModelIndex &index) const
+const SortedRows *RoleMaskProxyModelPrivate::sortedRows(const QModelIndex &sourceParent) const
 {
-    if (!index.isValid())
+    if (m_sortedRows.isEmpty())
         return nullptr;
-    Q_ASSERT(index.model() == q_func()->sourceModel());
-    const QPair<int, int> hashKey = qMakePair(index.row(), index.column());
-    for (auto i = m_masked.constFind(hashKey), iEnd = m_masked.constEnd(); i != iEnd && i.key() == hashKey; ++i) {
-        if (i->m_index == index)
-            return &(i->m_data);
+    QPersistentModelIndex key;
+    if (!findParentKey(sourceParent, key))
+        return nullptr;
+    const auto sortedIter = m_sortedRows.constFind(key);
+    if (sortedIter == m_sortedRows.constEnd())
+        return nullptr;
+    return &sortedIter.value();
+}
+
+int RoleMaskProxyModelPrivate::sourceRow(const QModelIndex &sourceParent, int proxyRow) const
+{
+    const SortedRows *sorted = sortedRows(sourceParent);
+    if (!sorted || proxyRow < 0 || proxyRow >= sorted->m_proxyToSource.size())
+        return proxyRow;
+    return sorted->m_proxyToSource.at(proxyRow);
+}
+
+QVector<QPair<int, int>> RoleMaskProxyModelPrivate::sourceRowSpans(const QModelIndex &sourceParent, int firstRow, int lastRow) const
+{
+    const SortedRows *sorted = sortedRows(sourceParent);
+    if (!sorted)
+        return QVector<QPair<int, int>>(1, qMakePair(firstRow, lastRow));
+    return spansFromPositions(sorted->m_proxyToSource.mid(firstRow, lastRow - firstRow + 1));
+}
+
+QVector<QPair<int, int>> RoleMaskProxyModelPrivate::proxyRowSpans(const QModelIndex &sourceParent, int firstRow, int lastRow) const
+{
+    const SortedRows *sorted = sortedRows(sourceParent);
+    if (!sorted)
+        return QVector<QPair<int, int>>(1, qMakePair(firstRow, lastRow));
+    return spansFromPositions(sorted->m_sourceToProxy.mid(firstRow, lastRow - firstRow + 1));
+}
+
+void RoleMaskProxyModelPrivate::sortRows(const QModelIndex &parent, int column, Qt::SortOrder order)
+{
+    Q_Q(RoleMaskProxyModel);
+    const QAbstractItemModel *model = q->sourceModel();
+    const int rowCount = model->rowCount(parent);
+    if (rowCount > 1 && column < model->columnCount(parent)) {
+        // every key is read once through the proxy so masked values are compared, the sort only touches the cached keys
+        QVector<QVariant> keys;
+        keys.reserve(rowCount);
+        for (int i = 0; i < rowCount; ++i)
+            keys.append(q->data(q->mapFromSource(model->index(i, column, parent)), m_sortRole));
+        SortedRows sorted;
+        sorted.m_proxyToSource.resize(rowCount);
+        for (int i = 0; i < rowCount; ++i)
+            sorted.m_proxyToSource[i] = i;
+        std::stable_sort(sorted.m_proxyToSource.begin(), sorted.m_proxyToSource.end(), [&keys, order](int left, int right) -> bool {
+            if (order == Qt::AscendingOrder)
+                return isVariantLessThan(keys.at(left), keys.at(right));
+            return isVariantLessThan(keys.at(right), keys.at(left));
+        });
+        for (int i = 0; i < rowCount; ++i) {
+            if (sorted.m_proxyToSource.at(i) != i) {
+                sorted.mapSourceRows();
+                m_sortedRows.insert(ensureParentKey(parent), sorted);
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < rowCount; ++i) {
+        const QModelIndex child = model->index(i, 0, parent);
+        if (model->hasChildren(child))
+            sortRows(child, column, order);
     }
-    return nullptr;
 }
 
-FlaggedRolesContainer *RoleMaskProxyModelPrivate::dataForIndex(const QModelIndex &index)
+void RoleMaskProxyModelPrivate::sortedRowsAboutToBeChanged(const QList<QPersistentModelIndex> &parents)
 {
-    if (!index.isValid())
+    Q_Q(RoleMaskProxyModel);
+    q->layoutAboutToBeChanged(parents, QAbstractItemModel::VerticalSortHint);
+    // the source does not change so plain indexes are enough to find the persistent indexes again
+    m_sortProxyIndexes = q->persistentIndexList();
+    m_sortSourceIndexes.clear();
+    m_sortSourceIndexes.reserve(m_sortProxyIndexes.size());
+    for (int i = 0, maxI = m_sortProxyIndexes.size(); i < maxI; ++i)
+        m_sortSourceIndexes.append(q->mapToSource(m_sortProxyIndexes.at(i)));
+}
+
+void RoleMaskProxyModelPrivate::sortedRowsChanged(const QList<QPersistentModelIndex> &parents)
+{
+    Q_Q(RoleMaskProxyModel);
+    QModelIndexList toList;
+    toList.reserve(m_sortSourceIndexes.size());
+    for (int i = 0, maxI = m_sortSourceIndexes.size(); i < maxI; ++i)
+        toList.append(q->mapFromSource(m_sortSourceIndexes.at(i)));
+    q->changePersistentIndexList(m_sortProxyIndexes, toList);
+    m_sortProxyIndexes.clear();
+    m_sortSourceIndexes.clear();
+    q->layoutChanged(parents, QAbstractItemModel::VerticalSortHint);
+}
+
+void RoleMaskProxyModelPrivate::removeStaleSortedRows()
+{
+    // parents removed from the source leave an invalid key behind, the root is the only legitimately invalid one
+    for (auto sortedIter = m_sortedRows.begin(); sortedIter != m_sortedRows.end();) {
+        if (!sortedIter.key().isValid() && sortedIter.key() != QPersistentModelIndex())
+            sortedIter = m_sortedRows.erase(sortedIter);
+        else
+            ++sortedIter;
+    }
+}
+
+quint64 RoleMaskProxyModelPrivate::computedCellKey(int row, int column)
+{
+    return (quint64(quint32(row)) << 32) | quint32(column);
+}
+
+QVariant RoleMaskProxyModelPrivate::computedData(const QModelIndex &index, int role)
+{
+    Q_ASSERT(m_computedRoles.contains(role));
+    const QModelIndex parent = index.parent();
+    const quint64 cellKey = computedCellKey(index.row(), index.column());
+    QPersistentModelIndex key;
+    const auto parentIter = findParentKey(parent, key) ? m_computedCache.constFind(key) : m_computedCache.constEnd();
+    if (parentIter != m_computedCache.constEnd()) {
+        const auto cellIter = parentIter->constFind(cellKey);
+        if (cellIter != parentIter->constEnd()) {
+            const auto valueIter = cellIter->constFind(role);
+            if (valueIter != cellIter->constEnd())
+                return valueIter.value();
+        }
+    }
+    // the function might read other computed values so the cache is only written once it returns
+    const QVariant result = m_computedRoles.constFind(role)->m_function(q_func()->mapFromSource(index));
+    m_computedCache[ensureParentKey(parent)][cellKey].insert(role, result);
+    return result;
+}
+
+void RoleMaskProxyModelPrivate::invalidateComputedRoles(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles)
+{
+    if (m_computedCache.isEmpty() || !topLeft.isValid() || !bottomRight.isValid())
+        return;
+    Q_Q(RoleMaskProxyModel);
+    QVector<int> staleRoles;
+    for (auto roleIter = m_computedRoles.cbegin(), roleEnd = m_computedRoles.cend(); roleIter != roleEnd; ++roleIter) {
+        bool stale = roles.isEmpty() || roleIter->m_dependsOn.isEmpty();
+        for (int i = 0, maxI = roles.size(); !stale && i < maxI; ++i)
+            stale = roleIter->m_dependsOn.contains(roles.at(i));
+        if (stale)
+            staleRoles.append(roleIter.key());
+    }
+    if (staleRoles.isEmpty())
+        return;
+    const QModelIndex sourceParent = q->mapToSource(topLeft).parent();
+    QPersistentModelIndex key;
+    if (!findParentKey(sourceParent, key))
+        return;
+    const auto parentIter = m_computedCache.find(key);
+    if (parentIter == m_computedCache.end())
+        return;
+    const SortedRows *sorted = sortedRows(sourceParent);
+    QHash<quint64, RolesContainer> &cells = parentIter.value();
+    QVector<int> removedRoles;
+    const auto removeStaleRoles = [&staleRoles, &removedRoles](RolesContainer &cell) -> void {
+        for (int i = 0, maxI = staleRoles.size(); i < maxI; ++i) {
+            if (cell.remove(staleRoles.at(i)) > 0 && !removedRoles.contains(staleRoles.at(i)))
+                removedRoles.append(staleRoles.at(i));
+        }
+    };
+    const qint64 area = qint64(bottomRight.row() - topLeft.row() + 1) * (bottomRight.column() - topLeft.column() + 1);
+    if (sorted || area < cells.size()) {
+        for (int i = topLeft.row(); i <= bottomRight.row(); ++i) {
+            const int cellRow = sorted ? sorted->m_proxyToSource.at(i) : i;
+            for (int j = topLeft.column(); j <= bottomRight.column(); ++j) {
+                const auto cellIter = cells.find(computedCellKey(cellRow, j));
+                if (cellIter == cells.end())
+                    continue;
+                removeStaleRoles(cellIter.value());
+                if (cellIter->isEmpty())
+                    cells.erase(cellIter);
+            }
+        }
+    } else {
+        for (auto cellIter = cells.begin(); cellIter != cells.end();) {
+            const int row = int(cellIter.key() >> 32);
+            const int column = int(cellIter.key() & 0xFFFFFFFF);
+            if (row >= topLeft.row() && row <= bottomRight.row() && column >= topLeft.column() && column <= bottomRight.column()) {
+                removeStaleRoles(cellIter.value());
+                if (cellIter->isEmpty()) {
+                    cellIter = cells.erase(cellIter);
+                    continue;
+                }
+            }
+            ++cellIter;
+        }
+    }
+    if (cells.isEmpty())
+        m_computedCache.erase(parentIter);
+    // only values somebody already read need to be signalled, this also stops roles that depend on each other from looping
+    if (!removedRoles.isEmpty())
+        q->dataChanged(topLeft, bottomRight, removedRoles);
+}
+
+int RoleMaskProxyModelPrivate::findLayer(const QString &name) const
+{
+    for (int i = 0, maxI = m_layers.size(); i < maxI; ++i) {
+        if (m_layers.at(i).m_name == name)
+            return i;
+    }
+    return -1;
+}
+
+void RoleMaskProxyModelPrivate::insertLayer(const OverlayLayer &layer)
+{
+    const auto position = std::find_if(m_layers.begin(), m_layers.end(),
+                                       [&layer](const OverlayLayer &other) -> bool { return other.m_priority <= layer.m_priority; });
+    m_layers.insert(position, layer);
+}
+
+const QVariant *RoleMaskProxyModelPrivate::layerData(const MaskedItem *item, int role) const
+{
+    if (!item || item->m_layers.isEmpty() || m_enabledLayers == 0)
         return nullptr;
-    Q_ASSERT(index.model() == q_func()->sourceModel());
-    const QPair<int, int> hashKey = qMakePair(index.row(), index.column());
-    for (auto i = m_masked.find(hashKey), iEnd = m_masked.end(); i != iEnd && i.key() == hashKey; ++i) {
-        if (i->m_index == index)
-            return &(i->m_data);
+    for (int i = 0, maxI = m_layers.size(); i < maxI; ++i) {
+        const OverlayLayer &layer = m_layers.at(i);
+        if (!layer.m_enabled)
+            continue;
+        const auto layerIter = item->findLayer(layer.m_id);
+        if (layerIter == item->m_layers.cend() || layerIter->m_layer != layer.m_id)
+            continue;
+        const auto roleIter = layerIter->m_roles.constFind(role);
+        if (roleIter != layerIter->m_roles.constEnd())
+            return &roleIter.value();
     }
     return nullptr;
 }
 
-void RoleMaskProxyModelPrivate::insertData(const QModelIndex &index, const FlaggedRolesContainer &data)
+void RoleMaskProxyModelPrivate::mergeLayerData(const MaskedItem *item, RolesContainer &result) const
+{
+    if (!item || item->m_layers.isEmpty() || m_enabledLayers == 0)
+        return;
+    for (int i = 0, maxI = m_layers.size(); i < maxI; ++i) {
+        const OverlayLayer &layer = m_layers.at(i);
+        if (!layer.m_enabled)
+            continue;
+        const auto layerIter = item->findLayer(layer.m_id);
+        if (layerIter == item->m_layers.cend() || layerIter->m_layer != layer.m_id)
+            continue;
+        for (auto roleIter = layerIter->m_roles.cbegin(), roleEnd = layerIter->m_roles.cend(); roleIter != roleEnd; ++roleIter) {
+            if (!result.contains(roleIter.key()))
+                result.insert(roleIter.key(), roleIter.value());
+        }
+    }
+}
+
+void RoleMaskProxyModelPrivate::removeLayerValues(int layer)
+{
+    QVector<QPersistentModelIndex> emptyNodes;
+    for (auto nodeIter = m_masked.begin(), nodeEnd = m_masked.end(); nodeIter != nodeEnd; ++nodeIter) {
+        MaskedParent &node = nodeIter.value();
+        if (!node.m_overlayLayers.remove(layer))
+            continue;
+        for (int i = 0; i < node.m_rows.size();) {
+            QVector<MaskedItem> &items = node.m_rows[i].m_items;
+            for (int j = 0; j < items.size();) {
+                MaskedItem &item = items[j];
+                const auto layerIter = item.findLayer(layer);
+                if (layerIter != item.m_layers.end() && layerIter->m_layer == layer) {
+                    item.m_layers.erase(layerIter);
+                    if (item.isEmpty()) {
+                        items.remove(j);
+                        continue;
+                    }
+                }
+                ++j;
+            }
+            if (items.isEmpty())
+                node.m_rows.remove(i);
+            else
+                ++i;
+        }
+        if (node.isEmpty())
+            emptyNodes.append(nodeIter.key());
+    }
+    for (int i = 0, maxI = emptyNodes.size(); i < maxI; ++i)
+        pruneParentNode(emptyNodes.at(i));
+}
+
+void RoleMaskProxyModelPrivate::signalLayerChanged(int layer)
+{
+    // the parents without values in the layer are skipped, the masked cells of the others are all visited
+    QVector<ChangedCells> changes;
+    for (auto nodeIter = m_masked.cbegin(), nodeEnd = m_masked.cend(); nodeIter != nodeEnd; ++nodeIter) {
+        if (!nodeIter->m_overlayLayers.contains(layer))
+            continue;
+        const QVector<MaskedRow> &rows = nodeIter.value().m_rows;
+        ChangedCells nodeChanges(nodeIter.key());
+        for (int i = 0, maxI = rows.size(); i < maxI; ++i) {
+            const QVector<MaskedItem> &items = rows.at(i).m_items;
+            for (int j = 0, maxJ = items.size(); j < maxJ; ++j) {
+                const auto layerIter = items.at(j).findLayer(layer);
+                if (layerIter != items.at(j).m_layers.cend() && layerIter->m_layer == layer)
+                    nodeChanges.addCell(rows.at(i).m_row, items.at(j).m_column, layerIter->m_roles);
+            }
+        }
+        if (!nodeChanges.m_rows.isEmpty())
+            changes.append(nodeChanges);
+    }
+    signalCellsChanged(changes);
+}
+
+void RoleMaskProxyModelPrivate::signalCellsChanged(const QVector<ChangedCells> &changes)
+{
+    Q_Q(RoleMaskProxyModel);
+    // the receivers might change the masked data so the signals are sent once the callers are done walking it
+    for (int i = 0, maxI = changes.size(); i < maxI; ++i) {
+        const ChangedCells &nodeChanges = changes.at(i);
+        QVector<int> changedRoles = nodeChanges.m_roles;
+        if (m_mergeDisplayEdit && changedRoles.contains(Qt::DisplayRole))
+            changedRoles << Qt::EditRole;
+        QVector<int> proxyRows = nodeChanges.m_rows;
+        const SortedRows *sorted = sortedRows(nodeChanges.m_parent);
+        if (sorted) {
+            for (int j = 0, maxJ = proxyRows.size(); j < maxJ; ++j)
+                proxyRows[j] = sorted->m_sourceToProxy.at(proxyRows.at(j));
+        }
+        const QVector<QPair<int, int>> spans = spansFromPositions(proxyRows);
+        const QModelIndex proxyParent = q->mapFromSource(nodeChanges.m_parent);
+        for (int j = 0, maxJ = spans.size(); j < maxJ; ++j) {
+            const QModelIndex topLeft = q->index(spans.at(j).first, nodeChanges.m_firstColumn, proxyParent);
+            const QModelIndex bottomRight = q->index(spans.at(j).second, nodeChanges.m_lastColumn, proxyParent);
+            q->maskedDataChanged(topLeft, bottomRight, changedRoles);
+            q->dataChanged(topLeft, bottomRight, changedRoles);
+        }
+    }
+}
+
+QVector<QPair<int, int>> RoleMaskProxyModelPrivate::pathForIndex(QModelIndex index)
+{
+    QVector<QPair<int, int>> result;
+    for (; index.isValid(); index = index.parent())
+        result.prepend(qMakePair(index.row(), index.column()));
+    return result;
+}
+
+void RoleMaskProxyModelPrivate::writeRoles(QDataStream &writer, const RolesContainer &roles)
+{
+    for (auto roleIter = roles.cbegin(), roleEnd = roles.cend(); roleIter != roleEnd; ++roleIter)
+        writer << static_cast<qint32>(roleIter.key()) << roleIter.value();
+    writer << static_cast<qint32>(-1);
+}
+
+bool RoleMaskProxyModelPrivate::readRoles(QDataStream &reader, RolesContainer &roles)
+{
+    qint32 tempRole = -1;
+    QVariant tempData;
+    for (reader >> tempRole; tempRole != -1 && reader.status() == QDataStream::Ok; reader >> tempRole) {
+        reader >> tempData;
+        if (reader.status() != QDataStream::Ok)
+            break;
+        roles.insert(tempRole, tempData);
+    }
+    return reader.status() == QDataStream::Ok;
+}
+
+void RoleMaskProxyModelPrivate::writeFlaggedRoles(QDataStream &writer, const FlaggedRolesContainer &data)
+{
+    writeRoles(writer, data.roles);
+    writer << bool(data.flags);
+    if (data.flags)
+        writer << qint32(*data.flags);
+}
+
+bool RoleMaskProxyModelPrivate::readFlaggedRoles(QDataStream &reader, FlaggedRolesContainer &data)
+{
+    if (!readRoles(reader, data.roles))
+        return false;
+    bool hasFlags = false;
+    reader >> hasFlags;
+    if (hasFlags) {
+        qint32 flags;
+        reader >> flags;
+        data.flags.reset(new Qt::ItemFlags(QFlag(flags)));
+    }
+    return reader.status() == QDataStream::Ok;
+}
+
+void RoleMaskProxyModelPrivate::writeMaskedData(QDataStream &writer) const
+{
+    const qint32 writerVersion = writer.version();
+    writer.setVersion(QDataStream::Qt_5_0);
+    writer << writerVersion;
+    writer.setVersion(writerVersion);
+    writer << Magic_Masked_Data_Header;
+    writer << static_cast<qint32>(m_maskedRoles.size());
+    for (auto roleIter = m_maskedRoles.cbegin(), roleEnd = m_maskedRoles.cend(); roleIter != roleEnd; ++roleIter)
+        writer << static_cast<qint32>(*roleIter);
+    writeRoles(writer, m_defaultValues);
+    // only the header sections that have masked data are written
+    for (const QVector<RolesContainer> *headerData : {&m_hHeaderData, &m_vHeaderData}) {
+        QVector<int> sections;
+        for (int i = 0, maxI = headerData->size(); i < maxI; ++i) {
+            if (!headerData->at(i).isEmpty())
+                sections.append(i);
+        }
+        writer << static_cast<qint32>(sections.size());
+        for (int i = 0, maxI = sections.size(); i < maxI; ++i) {
+            writer << static_cast<qint32>(sections.at(i));
+            writeRoles(writer, headerData->at(sections.at(i)));
+        }
+    }
+    QHash<int, int> layerIndexes;
+    writer << static_cast<qint32>(m_layers.size());
+    for (int i = 0, maxI = m_layers.size(); i < maxI; ++i) {
+        const OverlayLayer &layer = m_layers.at(i);
+        writer << layer.m_name << static_cast<qint32>(layer.m_priority) << layer.m_enabled;
+        layerIndexes.insert(layer.m_id, i);
+    }
+    // the nodes that only link to masked children are rebuilt from the paths of the children
+    qint32 nodeCount = 0;
+    for (auto nodeIter = m_masked.cbegin(), nodeEnd = m_masked.cend(); nodeIter != nodeEnd; ++nodeIter) {
+        if (!nodeIter->m_rows.isEmpty() || !nodeIter->m_rules.isEmpty())
+            ++nodeCount;
+    }
+    writer << nodeCount;
+    for (auto nodeIter = m_masked.cbegin(), nodeEnd = m_masked.cend(); nodeIter != nodeEnd; ++nodeIter) {
+        const MaskedParent &node = nodeIter.value();
+        if (node.m_rows.isEmpty() && node.m_rules.isEmpty())
+            continue;
+        writer << pathForIndex(nodeIter.key());
+        writer << static_cast<qint32>(node.m_rows.size());
+        for (int i = 0, maxI = node.m_rows.size(); i < maxI; ++i) {
+            const MaskedRow &row = node.m_rows.at(i);
+            writer << static_cast<qint32>(row.m_row) << static_cast<qint32>(row.m_items.size());
+            for (int j = 0, maxJ = row.m_items.size(); j < maxJ; ++j) {
+                const MaskedItem &item = row.m_items.at(j);
+                writer << static_cast<qint32>(item.m_column);
+                writeFlaggedRoles(writer, item.m_data);
+                writer << static_cast<qint32>(item.m_layers.size());
+                for (int k = 0, maxK = item.m_layers.size(); k < maxK; ++k) {
+                    writer << static_cast<qint32>(layerIndexes.value(item.m_layers.at(k).m_layer));
+                    writeRoles(writer, item.m_layers.at(k).m_roles);
+                }
+            }
+        }
+        writer << static_cast<qint32>(node.m_rules.size());
+        for (int i = 0, maxI = node.m_rules.size(); i < maxI; ++i) {
+            const MaskedRule &rule = node.m_rules.at(i);
+            writer << static_cast<qint32>(rule.m_firstRow) << static_cast<qint32>(rule.m_lastRow) << static_cast<qint32>(rule.m_firstColumn)
+                   << static_cast<qint32>(rule.m_lastColumn);
+            writeFlaggedRoles(writer, rule.m_data);
+        }
+    }
+}
+
+bool RoleMaskProxyModelPrivate::readMaskedData(QDataStream &reader)
+{
+    Q_Q(RoleMaskProxyModel);
+    reader.setVersion(QDataStream::Qt_5_0);
+    qint32 streamVersion;
+    reader >> streamVersion;
+    if (reader.status() != QDataStream::Ok || streamVersion > QDataStream().version())
+        return false;
+    reader.setVersion(streamVersion);
+    QString header;
+    reader >> header;
+    if (header != Magic_Masked_Data_Header)
+        return false;
+    // everything is read before the proxy is touched so a corrupted stream leaves it unchanged
+    qint32 count;
+    reader >> count;
+    QSet<int> loadedRoles;
+    for (qint32 i = 0; i < count && reader.status() == QDataStream::Ok; ++i) {
+        qint32 role;
+        reader >> role;
+        loadedRoles.insert(role);
+    }
+    RolesContainer loadedDefaults;
+    if (!readRoles(reader, loadedDefaults))
+        return false;
+    QVector<QPair<int, RolesContainer>> loadedHeaders[2];
+    for (int h = 0; h < 2; ++h) {
+        reader >> count;
+        for (qint32 i = 0; i < count && reader.status() == QDataStream::Ok; ++i) {
+            qint32 section;
+            reader >> section;
+            RolesContainer sectionData;
+            if (!readRoles(reader, sectionData))
+                return false;
+            loadedHeaders[h].append(qMakePair(int(section), sectionData));
+        }
+    }
+    reader >> count;
+    QVector<OverlayLayer> loadedLayers;
+    for (qint32 i = 0; i < count && reader.status() == QDataStream::Ok; ++i) {
+        OverlayLayer layer;
+        qint32 priority;
+        reader >> layer.m_name >> priority >> layer.m_enabled;
+        layer.m_priority = priority;
+        layer.m_id = -1;
+        loadedLayers.append(layer);
+    }
+    struct LoadedParent
+    {
+        QVector<QPair<int, int>> m_path;
+        QVector<MaskedRow> m_rows;
+        QVector<MaskedRule> m_rules;
+    };
+    QVector<LoadedParent> loadedParents;
+    qint32 nodeCount = 0;
+    reader >> nodeCount;
+    for (qint32 h = 0; h < nodeCount && reader.status() == QDataStream::Ok; ++h) {
+        LoadedParent loadedParent;
+        qint32 rowCount = 0;
+        reader >> loadedParent.m_path >> rowCount;
+        for (qint32 i = 0; i < rowCount && reader.status() == QDataStream::Ok; ++i) {
+            qint32 row, itemCount = 0;
+            reader >> row >> itemCount;
+            MaskedRow maskedRow(row);
+            for (qint32 j = 0; j < itemCount && reader.status() == QDataStream::Ok; ++j) {
+                qint32 column, layerCount = 0;
+                reader >> column;
+                MaskedItem item;
+                item.m_column = column;
+                if (!readFlaggedRoles(reader, item.m_data))
+                    return false;
+                reader >> layerCount;
+                for (qint32 k = 0; k < layerCount && reader.status() == QDataStream::Ok; ++k) {
+                    qint32 layerIdx;
+                    reader >> layerIdx;
+                    LayerValues values(layerIdx);
+                    if (!readRoles(reader, values.m_roles))
+                        return false;
+                    item.m_layers.append(values);
+                }
+                maskedRow.m_items.append(item);
+            }
+            loadedParent.m_rows.append(maskedRow);
+        }
+        reader >> rowCount;
+        for (qint32 i = 0; i < rowCount && reader.status() == QDataStream::Ok; ++i) {
+            qint32 firstRow, lastRow, firstColumn, lastColumn;
+            reader >> firstRow >> lastRow >> firstColumn >> lastColumn;
+            MaskedRule rule(firstRow, lastRow, firstColumn, lastColumn);
+            if (!readFlaggedRoles(reader, rule.m_data))
+                return false;
+            loadedParent.m_rules.append(rule);
+        }
+        loadedParents.append(loadedParent);
+    }
+    if (reader.status() != QDataStream::Ok)
+        return false;
+
+    bool rolesAdded = false;
+    for (auto roleIter = loadedRoles.cbegin(), roleEnd = loadedRoles.cend(); roleIter != roleEnd; ++roleIter) {
+        if (!m_maskedRoles.contains(*roleIter)) {
+            m_maskedRoles.insert(*roleIter);
+            rolesAdded = true;
+        }
+    }
+    m_defaultValues = loadedDefaults;
+    QVector<RolesContainer> *headerData[2] = {&m_hHeaderData, &m_vHeaderData};
+    for (int h = 0; h < 2; ++h) {
+        for (int i = 0, maxI = headerData[h]->size(); i < maxI; ++i)
+            (*headerData[h])[i].clear();
+        for (int i = 0, maxI = loadedHeaders[h].size(); i < maxI; ++i) {
+            const int section = loadedHeaders[h].at(i).first;
+            if (section >= 0 && section < headerData[h]->size())
+                (*headerData[h])[section] = loadedHeaders[h].at(i).second;
+        }
+    }
+    // the saved layers are matched by name, the ones missing from the proxy are added
+    QVector<int> layerIds;
+    for (int i = 0, maxI = loadedLayers.size(); i < maxI; ++i) {
+        OverlayLayer layer = loadedLayers.at(i);
+        const int layerIdx = findLayer(layer.m_name);
+        if (layerIdx >= 0) {
+            const OverlayLayer oldLayer = m_layers.takeAt(layerIdx);
+            layer.m_id = oldLayer.m_id;
+            if (oldLayer.m_enabled)
+                --m_enabledLayers;
+        } else {
+            layer.m_id = m_nextLayerId++;
+        }
+        if (layer.m_enabled)
+            ++m_enabledLayers;
+        insertLayer(layer);
+        layerIds.append(layer.m_id);
+    }
+    m_masked.clear();
+    m_computedCache.clear();
+    invalidateParentKeys();
+    m_checkCountersDirty = true;
+    for (int h = 0, maxH = loadedParents.size(); h < maxH; ++h) {
+        LoadedParent &loadedParent = loadedParents[h];
+        QModelIndex parent;
+        for (int i = 0, maxI = loadedParent.m_path.size(); i < maxI && (i == 0 || parent.isValid()); ++i)
+            parent = q->sourceModel()->index(loadedParent.m_path.at(i).first, loadedParent.m_path.at(i).second, parent);
+        if (!loadedParent.m_path.isEmpty() && !parent.isValid())
+            continue;
+        const int rowCount = q->sourceModel()->rowCount(parent);
+        const int columnCount = q->sourceModel()->columnCount(parent);
+        QVector<MaskedRow> &rows = loadedParent.m_rows;
+        QSet<int> nodeLayers;
+        for (int i = 0; i < rows.size();) {
+            QVector<MaskedItem> &items = rows[i].m_items;
+            for (int j = 0; j < items.size();) {
+                QVector<LayerValues> &layers = items[j].m_layers;
+                for (int k = 0; k < layers.size();) {
+                    if (layers.at(k).m_layer < 0 || layers.at(k).m_layer >= layerIds.size()) {
+                        layers.remove(k);
+                        continue;
+                    }
+                    layers[k].m_layer = layerIds.at(layers.at(k).m_layer);
+                    nodeLayers.insert(layers.at(k).m_layer);
+                    ++k;
+                }
+                std::sort(layers.begin(), layers.end(), [](const LayerValues &a, const LayerValues &b) -> bool { return a.m_layer < b.m_layer; });
+                if (items.at(j).m_column < 0 || items.at(j).m_column >= columnCount || items.at(j).isEmpty())
+                    items.remove(j);
+                else
+                    ++j;
+            }
+            std::sort(items.begin(), items.end(), [](const MaskedItem &a, const MaskedItem &b) -> bool { return a.m_column < b.m_column; });
+            if (rows.at(i).m_row < 0 || rows.at(i).m_row >= rowCount || items.isEmpty())
+                rows.remove(i);
+            else
+                ++i;
+        }
+        std::sort(rows.begin(), rows.end(), [](const MaskedRow &a, const MaskedRow &b) -> bool { return a.m_row < b.m_row; });
+        if (rows.isEmpty() && loadedParent.m_rules.isEmpty())
+            continue;
+        MaskedParent &node = ensureParentNode(parent);
+        node.m_rows = rows;
+        node.m_overlayLayers = nodeLayers;
+        node.m_rules = loadedParent.m_rules;
+        node.invalidateRuleIndex();
+    }
+    if (rolesAdded)
+        q->maskedRolesChanged();
+    signalAllChanged();
+    return true;
+}
+
+const QVariant *RoleMaskProxyModelPrivate::explicitCheckState(const QModelIndex &index) const
+{
+    const FlaggedRolesContainer *data = dataForIndex(index);
+    if (data) {
+        const auto roleIter = data->roles.constFind(Qt::CheckStateRole);
+        if (roleIter != data->roles.constEnd())
+            return &roleIter.value();
+    }
+    return ruleData(index, Qt::CheckStateRole);
+}
+
+const QVariant *RoleMaskProxyModelPrivate::inheritedCheckState(const QModelIndex &index) const
+{
+    for (QModelIndex ancestor = index.parent(); ancestor.isValid() && ancestor.column() == 0; ancestor = ancestor.parent()) {
+        const QVariant *state = explicitCheckState(ancestor);
+        if (state)
+            return state;
+    }
+    return nullptr;
+}
+
+void RoleMaskProxyModelPrivate::countCheckState(const QVariant &state, int delta, int &checked, int &unchecked)
+{
+    switch (state.toInt()) {
+    case Qt::Checked:
+        checked += delta;
+        break;
+    case Qt::Unchecked:
+        unchecked += delta;
+        break;
+    default:
+        checked += delta;
+        unchecked += delta;
+        break;
+    }
+}
+
+void RoleMaskProxyModelPrivate::countCheckStates(const QPersistentModelIndex &parent)
+{
+    const auto nodeIter = m_masked.find(parent);
+    if (nodeIter == m_masked.end())
+        return;
+    MaskedParent &node = nodeIter.value();
+    node.m_checkedRows = 0;
+    node.m_uncheckedRows = 0;
+    for (int i = 0, maxI = node.m_rows.size(); i < maxI; ++i) {
+        const MaskedItem &item = node.m_rows.at(i).m_items.first();
+        if (item.m_column != 0)
+            continue;
+        const auto roleIter = item.m_data.roles.constFind(Qt::CheckStateRole);
+        if (roleIter != item.m_data.roles.constEnd())
+            countCheckState(roleIter.value(), 1, node.m_checkedRows, node.m_uncheckedRows);
+    }
+    node.m_checkedStates = node.m_checkedRows;
+    node.m_uncheckedStates = node.m_uncheckedRows;
+    for (int i = 0, maxI = node.m_rules.size(); i < maxI; ++i) {
+        const MaskedRule &rule = node.m_rules.at(i);
+        const auto roleIter = rule.m_data.roles.constFind(Qt::CheckStateRole);
+        if (rule.m_firstColumn == 0 && roleIter != rule.m_data.roles.constEnd())
+            countCheckState(roleIter.value(), 1, node.m_checkedStates, node.m_uncheckedStates);
+    }
+    for (int i = 0, maxI = node.m_children.size(); i < maxI; ++i) {
+        const QPersistentModelIndex child = node.m_children.at(i);
+        if (child.column() != 0)
+            continue;
+        countCheckStates(child);
+        const auto childIter = m_masked.constFind(child);
+        Q_ASSERT(childIter != m_masked.constEnd());
+        node.m_checkedStates += childIter->m_checkedStates;
+        node.m_uncheckedStates += childIter->m_uncheckedStates;
+    }
+}
+
+void RoleMaskProxyModelPrivate::ensureCheckCounters() const
+{
+    if (!m_checkCountersDirty)
+        return;
+    // the nodes are only reached from the root so the ones below a parent in a column other than the first are left as they are
+    RoleMaskProxyModelPrivate *self = const_cast<RoleMaskProxyModelPrivate *>(this);
+    for (auto nodeIter = self->m_masked.begin(), nodeEnd = self->m_masked.end(); nodeIter != nodeEnd; ++nodeIter) {
+        if (!nodeIter.key().isValid() || nodeIter.key().column() != 0)
+            self->countCheckStates(nodeIter.key());
+    }
+    m_checkCountersDirty = false;
+}
+
+void RoleMaskProxyModelPrivate::updateCheckCounters(const QModelIndex &index, int checkedDelta, int uncheckedDelta, bool ownState)
+{
+    Q_ASSERT(index.column() == 0);
+    // only the ancestors reached through the first column count the states of index
+    for (QModelIndex child = index;; child = child.parent()) {
+        MaskedParent *node = parentNode(child.parent());
+        if (node) {
+            node->m_checkedStates += checkedDelta;
+            node->m_uncheckedStates += uncheckedDelta;
+            if (ownState && child == index) {
+                node->m_checkedRows += checkedDelta;
+                node->m_uncheckedRows += uncheckedDelta;
+            }
+        }
+        if (!child.parent().isValid() || child.parent().column() != 0)
+            break;
+    }
+}
+
+int RoleMaskProxyModelPrivate::descendantCheckStates(const QModelIndex &parent) const
+{
+    ensureCheckCounters();
+    const MaskedParent *node = parentNode(parent);
+    if (!node)
+        return 0;
+    int result = 0;
+    if (node->m_checkedStates > 0)
+        result |= CheckedDescendants;
+    if (node->m_uncheckedStates > 0)
+        result |= UncheckedDescendants;
+    return result;
+}
+
+QVariant RoleMaskProxyModelPrivate::propagatedCheckState(const QModelIndex &index) const
+{
+    Q_ASSERT(index.column() == 0);
+    const QVariant *state = explicitCheckState(index);
+    if (!state)
+        state = inheritedCheckState(index);
+    QVariant result;
+    if (state)
+        result = *state;
+    else if (m_transparentIfEmpty)
+        result = q_func()->sourceModel()->data(index, Qt::CheckStateRole);
+    else
+        result = m_defaultValues.value(Qt::CheckStateRole);
+    const int descendants = descendantCheckStates(index);
+    const int oppositeDescendants = (result.isValid() && result.toInt() == Qt::Checked) ? UncheckedDescendants : CheckedDescendants;
+    if (descendants & oppositeDescendants)
+        return QVariant(int(Qt::PartiallyChecked));
+    return result;
+}
+
+bool RoleMaskProxyModelPrivate::childrenShareCheckState(const QModelIndex &parent, int changedRow, Qt::CheckState state) const
+{
+    // children without a state of their own take the one of the parent
+    const QVariant *parentState = explicitCheckState(parent);
+    if (!parentState)
+        parentState = inheritedCheckState(parent);
+    const bool implicitShares = parentState && parentState->toInt() == state;
+    const int siblingCount = q_func()->sourceModel()->rowCount(parent) - 1;
+    const MaskedParent *node = parentNode(parent);
+    if (!node)
+        return implicitShares || siblingCount == 0;
+    for (int i = 0, maxI = node->m_rules.size(); i < maxI; ++i) {
+        if (node->m_rules.at(i).m_firstColumn == 0 && node->m_rules.at(i).m_data.roles.contains(Qt::CheckStateRole))
+            return false;
+    }
+    ensureCheckCounters();
+    int checkedStates = node->m_checkedStates;
+    int uncheckedStates = node->m_uncheckedStates;
+    int checkedRows = node->m_checkedRows;
+    int uncheckedRows = node->m_uncheckedRows;
+    // the changed row and its subtree are about to be replaced so take them out of the counters
+    const QModelIndex changedIdx = q_func()->sourceModel()->index(changedRow, 0, parent);
+    const FlaggedRolesContainer *changedData = dataForIndex(changedIdx);
+    if (changedData) {
+        const auto roleIter = changedData->roles.constFind(Qt::CheckStateRole);
+        if (roleIter != changedData->roles.constEnd()) {
+            countCheckState(roleIter.value(), -1, checkedStates, uncheckedStates);
+            countCheckState(roleIter.value(), -1, checkedRows, uncheckedRows);
+        }
+    }
+    const MaskedParent *changedNode = parentNode(changedIdx);
+    if (changedNode) {
+        checkedStates -= changedNode->m_checkedStates;
+        uncheckedStates -= changedNode->m_uncheckedStates;
+    }
+    if ((state == Qt::Checked ? uncheckedStates : checkedStates) > 0)
+        return false;
+    return implicitShares || (state == Qt::Checked ? checkedRows : uncheckedRows) == siblingCount;
+}
+
+void RoleMaskProxyModelPrivate::clearDescendantCheckStates(const QModelIndex &parent)
+{
+    if (!parentNode(parent))
+        return;
+    QVector<QPersistentModelIndex> parents{QPersistentModelIndex(parent)};
+    for (int h = 0; h < parents.size(); ++h) {
+        MaskedParent *node = parentNode(parents.at(h));
+        Q_ASSERT(node);
+        node->m_checkedStates = 0;
+        node->m_uncheckedStates = 0;
+        node->m_checkedRows = 0;
+        node->m_uncheckedRows = 0;
+        for (int i = 0; i < node->m_rows.size();) {
+            QVector<MaskedItem> &items = node->m_rows[i].m_items;
+            if (items.first().m_column == 0 && items.first().m_data.roles.remove(Qt::CheckStateRole) > 0 && items.first().isEmpty())
+                items.removeFirst();
+            if (items.isEmpty())
+                node->m_rows.remove(i);
+            else
+                ++i;
+        }
+        for (int i = 0; i < node->m_rules.size();) {
+            MaskedRule &rule = node->m_rules[i];
+            if (rule.m_firstColumn == 0 && rule.m_data.roles.remove(Qt::CheckStateRole) > 0 && rule.m_data.roles.isEmpty() && !rule.m_data.flags)
+                node->m_rules.remove(i);
+            else
+                ++i;
+        }
+        node->invalidateRuleIndex();
+        for (int i = 0, maxI = node->m_children.size(); i < maxI; ++i) {
+            if (node->m_children.at(i).column() == 0)
+                parents.append(node->m_children.at(i));
+        }
+    }
+    for (int h = parents.size() - 1; h >= 0; --h)
+        pruneParentNode(parents.at(h));
+}
+
+void RoleMaskProxyModelPrivate::setPropagatedCheckState(const QModelIndex &index, Qt::CheckState state)
+{
+    Q_Q(RoleMaskProxyModel);
+    Q_ASSERT(index.column() == 0);
+    ensureCheckCounters();
+    // a parent whose children all end up in the same state takes that state itself
+    QModelIndex root = index;
+    for (QModelIndex ancestor = index.parent(); ancestor.isValid() && ancestor.column() == 0; ancestor = ancestor.parent()) {
+        if (!childrenShareCheckState(ancestor, root.row(), state))
+            break;
+        root = ancestor;
+    }
+    // the states below the root and the one of the root are replaced so only the counters of its ancestors change
+    const MaskedParent *rootNode = parentNode(root);
+    if (rootNode)
+        updateCheckCounters(root, -rootNode->m_checkedStates, -rootNode->m_uncheckedStates, false);
+    const FlaggedRolesContainer *oldRootData = dataForIndex(root);
+    if (oldRootData) {
+        const auto roleIter = oldRootData->roles.constFind(Qt::CheckStateRole);
+        if (roleIter != oldRootData->roles.constEnd()) {
+            int checkedDelta = 0;
+            int uncheckedDelta = 0;
+            countCheckState(roleIter.value(), -1, checkedDelta, uncheckedDelta);
+            updateCheckCounters(root, checkedDelta, uncheckedDelta, true);
+        }
+    }
+    clearDescendantCheckStates(root);
+    const QVariant *inheritedState = inheritedCheckState(root);
+    if (inheritedState && inheritedState->toInt() == state) {
+        removeRole(root, Qt::CheckStateRole);
+    } else {
+        FlaggedRolesContainer *rootData = dataForIndex(root);
+        if (rootData) {
+            rootData->roles.insert(Qt::CheckStateRole, int(state));
+        } else {
+            RolesContainer newData;
+            newData.insert(Qt::CheckStateRole, int(state));
+            insertData(root, FlaggedRolesContainer(newData, nullptr));
+        }
+        updateCheckCounters(root, state == Qt::Checked ? 1 : 0, state == Qt::Unchecked ? 1 : 0, true);
+    }
+    // every change above was accounted for
+    m_checkCountersDirty = false;
+    const QVector<int> changedRoles(1, Qt::CheckStateRole);
+    signalCheckStateChanged(q->mapFromSource(root));
+    for (QModelIndex changedIdx = index; changedIdx.isValid(); changedIdx = changedIdx.parent()) {
+        const QModelIndex proxyIdx = q->mapFromSource(changedIdx);
+        q->maskedDataChanged(proxyIdx, proxyIdx, changedRoles);
+        q->dataChanged(proxyIdx, proxyIdx, changedRoles);
+    }
+}
+
+void RoleMaskProxyModelPrivate::signalCheckStateChanged(const QModelIndex &parent)
+{
+    Q_Q(RoleMaskProxyModel);
+    const int rowCnt = q->rowCount(parent);
+    if (rowCnt == 0)
+        return;
+    for (int i = 0; i < rowCnt; ++i) {
+        const QModelIndex currPar = q->index(i, 0, parent);
+        if (q->hasChildren(currPar))
+            signalCheckStateChanged(currPar);
+    }
+    const QVector<int> changedRoles(1, Qt::CheckStateRole);
+    const QModelIndex topLeft = q->index(0, 0, parent);
+    const QModelIndex bottomRight = q->index(rowCnt - 1, 0, parent);
+    q->maskedDataChanged(topLeft, bottomRight, changedRoles);
+    q->dataChanged(topLeft, bottomRight, changedRoles);
+}
+
+QBitArray RoleMaskProxyModelPrivate::opaqueRoles(const MaskedRow *maskedRow, const QVector<const MaskedRule *> &rules, int row, int firstColumn,
+                                                 int lastColumn, const QVector<int> &roles)
+{
+    QBitArray result(roles.size());
+    QVector<QPair<int, int>> ruleSpans;
+    QVector<QPair<int, int>> mergedSpans;
+    for (int i = 0, maxI = roles.size(); i < maxI; ++i) {
+        const int role = roles.at(i);
+        ruleSpans.clear();
+        for (int j = 0, maxJ = rules.size(); j < maxJ; ++j) {
+            const MaskedRule *rule = rules.at(j);
+            if (row < rule->m_firstRow || (rule->m_lastRow >= 0 && row > rule->m_lastRow) || !rule->m_data.roles.contains(role))
+                continue;
+            const int spanEnd = rule->m_lastColumn < 0 ? lastColumn : qMin(lastColumn, rule->m_lastColumn);
+            ruleSpans.append(qMakePair(qMax(firstColumn, rule->m_firstColumn), spanEnd));
+        }
+        std::sort(ruleSpans.begin(), ruleSpans.end());
+        mergedSpans.clear();
+        int opaqueCount = 0;
+        for (int j = 0, maxJ = ruleSpans.size(); j < maxJ; ++j) {
+            if (!mergedSpans.isEmpty() && ruleSpans.at(j).first <= mergedSpans.last().second + 1)
+                mergedSpans.last().second = qMax(mergedSpans.last().second, ruleSpans.at(j).second);
+            else
+                mergedSpans.append(ruleSpans.at(j));
+        }
+        for (int j = 0, maxJ = mergedSpans.size(); j < maxJ; ++j)
+            opaqueCount += mergedSpans.at(j).second - mergedSpans.at(j).first + 1;
+        if (maskedRow) {
+            int spanIdx = 0;
+            for (auto itemIter = maskedRow->findColumn(firstColumn), itemEnd = maskedRow->m_items.cend();
+                 itemIter != itemEnd && itemIter->m_column <= lastColumn; ++itemIter) {
+                while (spanIdx < mergedSpans.size() && mergedSpans.at(spanIdx).second < itemIter->m_column)
+                    ++spanIdx;
+                if (spanIdx < mergedSpans.size() && mergedSpans.at(spanIdx).first <= itemIter->m_column)
+                    continue;
+                if (itemIter->m_data.roles.value(role).isValid())
+                    ++opaqueCount;
+            }
+        }
+        result.setBit(i, opaqueCount == lastColumn - firstColumn + 1);
+    }
+    return result;
+}
+
+bool RoleMaskProxyModelPrivate::findParentKey(const QModelIndex &sourceParent, QPersistentModelIndex &key) const
+{
+    if (!sourceParent.isValid()) {
+        key = QPersistentModelIndex();
+        return true;
+    }
+    if (m_parentKeysDirty)
+        rebuildParentKeys();
+    auto keyIter = m_parentKeys.constFind(sourceParent);
+    if (keyIter != m_parentKeys.constEnd() && keyIter.value() != sourceParent) {
+        // a structural change the lookup was not told about moved the parent away from its entry
+        rebuildParentKeys();
+        keyIter = m_parentKeys.constFind(sourceParent);
+    }
+    if (keyIter == m_parentKeys.constEnd())
+        return false;
+    key = keyIter.value();
+    return true;
+}
+
+QPersistentModelIndex RoleMaskProxyModelPrivate::ensureParentKey(const QModelIndex &sourceParent)
+{
+    QPersistentModelIndex key;
+    if (findParentKey(sourceParent, key))
+        return key;
+    key = QPersistentModelIndex(sourceParent);
+    m_parentKeys.insert(sourceParent, key);
+    return key;
+}
+
+void RoleMaskProxyModelPrivate::rebuildParentKeys() const
+{
+    m_parentKeys.clear();
+    for (auto nodeIter = m_masked.cbegin(), nodeEnd = m_masked.cend(); nodeIter != nodeEnd; ++nodeIter) {
+        if (nodeIter.key().isValid())
+            m_parentKeys.insert(nodeIter.key(), nodeIter.key());
+    }
+    for (auto sortedIter = m_sortedRows.cbegin(), sortedEnd = m_sortedRows.cend(); sortedIter != sortedEnd; ++sortedIter) {
+        if (sortedIter.key().isValid())
+            m_parentKeys.insert(sortedIter.key(), sortedIter.key());
+    }
+    for (auto cacheIter = m_computedCache.cbegin(), cacheEnd = m_computedCache.cend(); cacheIter != cacheEnd; ++cacheIter) {
+        if (cacheIter.key().isValid())
+            m_parentKeys.insert(cacheIter.key(), cacheIter.key());
+    }
+    m_parentKeysDirty = false;
+}
+
+void RoleMaskProxyModelPrivate::invalidateParentKeys()
+{
+    // dropping the entries also releases the persistent indexes of parents that lost their node
+    m_parentKeys.clear();
+    m_parentKeysDirty = true;
+}
+
+const MaskedParent *RoleMaskProxyModelPrivate::parentNode(const QModelIndex &parent) const
+{
+    if (m_masked.isEmpty())
+        return nullptr;
+    Q_ASSERT(!parent.isValid() || parent.model() == q_func()->sourceModel());
+    QPersistentModelIndex key;
+    if (!findParentKey(parent, key))
+        return nullptr;
+    const auto nodeIter = m_masked.constFind(key);
+    if (nodeIter == m_masked.constEnd())
+        return nullptr;
+    return &nodeIter.value();
+}
+
+MaskedParent *RoleMaskProxyModelPrivate::parentNode(const QModelIndex &parent)
+{
+    return const_cast<MaskedParent *>(static_cast<const RoleMaskProxyModelPrivate *>(this)->parentNode(parent));
+}
+
+MaskedParent &RoleMaskProxyModelPrivate::ensureParentNode(const QModelIndex &parent)
+{
+    if (MaskedParent *node = parentNode(parent))
+        return *node;
+    const QPersistentModelIndex anchor = ensureParentKey(parent);
+    if (parent.isValid())
+        ensureParentNode(parent.parent()).m_children.append(anchor);
+    return m_masked[anchor];
+}
+
+void RoleMaskProxyModelPrivate::removeParentNode(const QPersistentModelIndex &parent)
+{
+    const auto nodeIter = m_masked.find(parent);
+    if (nodeIter == m_masked.end())
+        return;
+    const QVector<QPersistentModelIndex> children = nodeIter->m_children;
+    m_masked.erase(nodeIter);
+    for (int i = 0, maxI = children.size(); i < maxI; ++i)
+        removeParentNode(children.at(i));
+}
+
+void RoleMaskProxyModelPrivate::removeChildNodes(const QModelIndex &parent, Qt::Orientation orientation, int start, int end)
+{
+    MaskedParent *node = parentNode(parent);
+    if (!node)
+        return;
+    QVector<QPersistentModelIndex> removedChildren;
+    for (int i = 0; i < node->m_children.size();) {
+        const QPersistentModelIndex &child = node->m_children.at(i);
+        const int position = orientation == Qt::Vertical ? child.row() : child.column();
+        if (position >= start && position <= end) {
+            removedChildren.append(child);
+            node->m_children.remove(i);
+        } else {
+            ++i;
+        }
+    }
+    for (int i = 0, maxI = removedChildren.size(); i < maxI; ++i)
+        removeParentNode(removedChildren.at(i));
+}
+
+void RoleMaskProxyModelPrivate::pruneParentNode(const QModelIndex &parent)
+{
+    QModelIndex current = parent;
+    for (;;) {
+        QPersistentModelIndex anchor;
+        if (!findParentKey(current, anchor))
+            return;
+        const auto nodeIter = m_masked.find(anchor);
+        if (nodeIter == m_masked.end() || !nodeIter->isEmpty())
+            return;
+        m_masked.erase(nodeIter);
+        if (!current.isValid())
+            return;
+        current = current.parent();
+        MaskedParent *ancestor = parentNode(current);
+        Q_ASSERT(ancestor);
+        const int childIdx = ancestor->m_children.indexOf(anchor);
+        Q_ASSERT(childIdx >= 0);
+        ancestor->m_children.remove(childIdx);
+    }
+}
+
+const MaskedItem *RoleMaskProxyModelPrivate::maskedItem(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return nullptr;
+    Q_ASSERT(index.model() == q_func()->sourceModel());
+    const MaskedParent *node = parentNode(index.parent());
+    if (!node)
+        return nullptr;
+    const auto rowIter = node->findRow(index.row());
+    if (rowIter == node->m_rows.cend() || rowIter->m_row != index.row())
+        return nullptr;
+    const auto itemIter = rowIter->findColumn(index.column());
+    if (itemIter == rowIter->m_items.cend() || itemIter->m_column != index.column())
+        return nullptr;
+    return &(*itemIter);
+}
+
+MaskedItem *RoleMaskProxyModelPrivate::maskedItem(const QModelIndex &index)
+{
+    if (!index.isValid())
+        return nullptr;
+    Q_ASSERT(index.model() == q_func()->sourceModel());
+    MaskedParent *node = parentNode(index.parent());
+    if (!node)
+        return nullptr;
+    const auto rowIter = node->findRow(index.row());
+    if (rowIter == node->m_rows.end() || rowIter->m_row != index.row())
+        return nullptr;
+    const auto itemIter = rowIter->findColumn(index.column());
+    if (itemIter == rowIter->m_items.end() || itemIter->m_column != index.column())
+        return nullptr;
+    return &(*itemIter);
+}
+
+const FlaggedRolesContainer *RoleMaskProxyModelPrivate::dataForIndex(const QModelIndex &index) const
+{
+    const MaskedItem *item = maskedItem(index);
+    return item ? &(item->m_data) : nullptr;
+}
+
+FlaggedRolesContainer *RoleMaskProxyModelPrivate::dataForIndex(const QModelIndex &index)
+{
+    MaskedItem *item = maskedItem(index);
+    return item ? &(item->m_data) : nullptr;
+}
+
+void RoleMaskProxyModelPrivate::insertData(const QModelIndex &index, const FlaggedRolesContainer &data)
+{
+    Q_ASSERT(index.isValid());
+    Q_ASSERT(index.model() == q_func()->sourceModel());
+    // the counters only track the check states of the first column, writing the other roles leaves them valid
+    if (index.column() == 0 && data.roles.contains(Qt::CheckStateRole))
+        m_checkCountersDirty = true;
+    MaskedParent &node = ensureParentNode(index.parent());
+    auto rowIter = node.findRow(index.row());
+    if (rowIter == node.m_rows.end() || rowIter->m_row != index.row())
+        rowIter = node.m_rows.insert(rowIter, MaskedRow(index.row()));
+    const auto itemIter = rowIter->findColumn(index.column());
+    if (itemIter != rowIter->m_items.end() && itemIter->m_column == index.column()) {
+        if (index.column() == 0 && itemIter->m_data.roles.contains(Qt::CheckStateRole))
+            m_checkCountersDirty = true;
+        itemIter->m_data = data;
+    } else {
+        rowIter->m_items.insert(itemIter, MaskedItem(data, index.column()));
+    }
+}
+
+const QVariant *RoleMaskProxyModelPrivate::ruleData(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return nullptr;
+    const MaskedParent *node = parentNode(index.parent());
+    if (!node || node->m_rules.isEmpty())
+        return nullptr;
+    const QVector<int> &rowRules = node->rulesForRow(index.row());
+    for (int i = 0, maxI = rowRules.size(); i < maxI; ++i) {
+        const MaskedRule &rule = node->m_rules.at(rowRules.at(i));
+        if (!rule.contains(index.row(), index.column()))
+            continue;
+        const auto roleIter = rule.m_data.roles.constFind(role);
+        if (roleIter != rule.m_data.roles.constEnd())
+            return &roleIter.value();
+    }
+    return nullptr;
+}
+
+const Qt::ItemFlags *RoleMaskProxyModelPrivate::ruleFlags(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return nullptr;
+    const MaskedParent *node = parentNode(index.parent());
+    if (!node || node->m_rules.isEmpty())
+        return nullptr;
+    const QVector<int> &rowRules = node->rulesForRow(index.row());
+    for (int i = 0, maxI = rowRules.size(); i < maxI; ++i) {
+        const MaskedRule &rule = node->m_rules.at(rowRules.at(i));
+        if (rule.m_data.flags && rule.contains(index.row(), index.column()))
+            return rule.m_data.flags.get();
+    }
+    return nullptr;
+}
+
+void RoleMaskProxyModelPrivate::mergeRuleData(const QModelIndex &index, RolesContainer &result) const
+{
+    if (!index.isValid())
+        return;
+    const MaskedParent *node = parentNode(index.parent());
+    if (!node || node->m_rules.isEmpty())
+        return;
+    const QVector<int> &rowRules = node->rulesForRow(index.row());
+    for (int i = 0, maxI = rowRules.size(); i < maxI; ++i) {
+        const MaskedRule &rule = node->m_rules.at(rowRules.at(i));
+        if (!rule.contains(index.row(), index.column()))
+            continue;
+        for (auto roleIter = rule.m_data.roles.cbegin(), roleEnd = rule.m_data.roles.cend(); roleIter != roleEnd; ++roleIter) {
+            if (!result.contains(roleIter.key()))
+                result.insert(roleIter.key(), roleIter.value());
+        }
+    }
+}
+
+bool RoleMaskProxyModelPrivate::setRuleData(const QModelIndex &parent, int firstRow, int lastRow, int firstColumn, int lastColumn, int role,
+                                            const QVariant &value)
+{
+    if (m_mergeDisplayEdit && role == Qt::EditRole)
+        role = Qt::DisplayRole;
+    if (!m_maskedRoles.contains(role))
+        return false;
+    MaskedRule newRule(firstRow, lastRow, firstColumn, lastColumn);
+    if (role == Qt::CheckStateRole)
+        m_checkCountersDirty = true;
+    MaskedParent *node = parentNode(parent);
+    const int ruleIdx = node ? node->findRule(newRule) : -1;
+    if (ruleIdx < 0) {
+        if (!value.isValid())
+            return true;
+        newRule.m_data.roles.insert(role, value);
+        MaskedParent &newNode = ensureParentNode(parent);
+        newNode.m_rules.append(newRule);
+        newNode.invalidateRuleIndex();
+    } else {
+        newRule = node->m_rules.at(ruleIdx);
+        if (value.isValid())
+            newRule.m_data.roles.insert(role, value);
+        else if (newRule.m_data.roles.remove(role) == 0)
+            return true;
+        // the rule that was set last takes precedence so move it to the back
+        node->m_rules.remove(ruleIdx);
+        node->invalidateRuleIndex();
+        if (!newRule.m_data.roles.isEmpty() || newRule.m_data.flags)
+            node->m_rules.append(newRule);
+        else
+            pruneParentNode(parent);
+    }
+    signalRuleChanged(parent, newRule,
+                      (m_mergeDisplayEdit && role == Qt::DisplayRole) ? QVector<int>{{Qt::EditRole, Qt::DisplayRole}} : QVector<int>(1, role));
+    return true;
+}
+
+bool RoleMaskProxyModelPrivate::setRuleFlags(const QModelIndex &parent, int firstRow, int lastRow, int firstColumn, int lastColumn,
+                                             Qt::ItemFlags flags)
+{
+    MaskedRule newRule(firstRow, lastRow, firstColumn, lastColumn);
+    MaskedParent &node = ensureParentNode(parent);
+    const int ruleIdx = node.findRule(newRule);
+    if (ruleIdx >= 0) {
+        newRule = node.m_rules.at(ruleIdx);
+        node.m_rules.remove(ruleIdx);
+    }
+    newRule.m_data.flags.reset(new Qt::ItemFlags(flags));
+    node.m_rules.append(newRule);
+    node.invalidateRuleIndex();
+    signalRuleChanged(parent, newRule, QVector<int>()); // Dirty way to signal the flag changed
+    return true;
+}
+
+void RoleMaskProxyModelPrivate::signalRuleChanged(const QModelIndex &parent, const MaskedRule &rule, const QVector<int> &roles)
+{
+    Q_Q(RoleMaskProxyModel);
+    const QModelIndex proxyParent = q->mapFromSource(parent);
+    const int lastRow = rule.m_lastRow < 0 ? q->rowCount(proxyParent) - 1 : rule.m_lastRow;
+    const int lastColumn = rule.m_lastColumn < 0 ? q->columnCount(proxyParent) - 1 : rule.m_lastColumn;
+    if (lastRow < rule.m_firstRow || lastColumn < rule.m_firstColumn)
+        return;
+    const QVector<QPair<int, int>> rowSpans = proxyRowSpans(parent, rule.m_firstRow, lastRow);
+    const QModelIndex topLeft = q->index(rowSpans.first().first, rule.m_firstColumn, proxyParent);
+    const QModelIndex bottomRight = q->index(rowSpans.last().second, lastColumn, proxyParent);
+    if (!roles.isEmpty())
+        q->maskedDataChanged(topLeft, bottomRight, roles);
+    q->dataChanged(topLeft, bottomRight, roles);
+}
+
+bool RoleMaskProxyModelPrivate::removeSpan(int &first, int &last, int start, int end)
+{
+    const int count = end - start + 1;
+    if (first > end)
+        first -= count;
+    else if (first >= start)
+        first = start;
+    if (last < 0)
+        return true;
+    if (last > end)
+        last -= count;
+    else if (last >= start)
+        last = start - 1;
+    return last >= first;
+}
+
+int RoleMaskProxyModelPrivate::movePosition(int position, int sourceStart, int sourceEnd, int destination)
+{
+    const int count = sourceEnd - sourceStart + 1;
+    if (destination < sourceStart) {
+        if (position >= destination && position < sourceStart)
+            return position + count;
+        if (position >= sourceStart && position <= sourceEnd)
+            return position - (sourceStart - destination);
+        return position;
+    }
+    Q_ASSERT(destination > sourceEnd);
+    if (position > sourceEnd && position < destination)
+        return position - count;
+    if (position >= sourceStart && position <= sourceEnd)
+        return position + (destination - sourceEnd - 1);
+    return position;
+}
+
+QVector<QPair<int, int>> RoleMaskProxyModelPrivate::moveSpan(int first, int last, int sourceStart, int sourceEnd, int destination)
+{
+    const int maxPos = std::numeric_limits<int>::max();
+    const int count = sourceEnd - sourceStart + 1;
+    struct Segment
+    {
+        int first;
+        int last;
+        int offset;
+    };
+    const bool backwards = destination < sourceStart;
+    // positions before the first segment and after the last one are not affected by the move
+    const Segment segments[] = {
+        backwards ? Segment{0, destination - 1, 0} : Segment{0, sourceStart - 1, 0},
+        backwards ? Segment{destination, sourceStart - 1, count} : Segment{sourceStart, sourceEnd, destination - sourceEnd - 1},
+        backwards ? Segment{sourceStart, sourceEnd, destination - sourceStart} : Segment{sourceEnd + 1, destination - 1, -count},
+        backwards ? Segment{sourceEnd + 1, maxPos, 0} : Segment{destination, maxPos, 0}};
+    const int spanLast = last < 0 ? maxPos : last;
+    QVector<QPair<int, int>> result;
+    for (const Segment &segment : segments) {
+        const int segFirst = qMax(first, segment.first);
+        const int segLast = qMin(spanLast, segment.last);
+        if (segFirst <= segLast)
+            result.append(qMakePair(segFirst + segment.offset, segLast + segment.offset));
+    }
+    std::sort(result.begin(), result.end());
+    QVector<QPair<int, int>> merged;
+    for (int i = 0, maxI = result.size(); i < maxI; ++i) {
+        if (!merged.isEmpty() && merged.last().second != maxPos && merged.last().second + 1 == result.at(i).first)
+            merged.last().second = result.at(i).second;
+        else
+            merged.append(result.at(i));
+    }
+    if (!merged.isEmpty() && merged.last().second == maxPos)
+        merged.last().second = -1;
+    return merged;
+}
+
+QVector<QPair<int, int>> RoleMaskProxyModelPrivate::spansFromIndexes(const QVector<QPersistentModelIndex> &indexes, Qt::Orientation orientation)
+{
+    QVector<int> positions;
+    positions.reserve(indexes.size());
+    for (int i = 0, maxI = indexes.size(); i < maxI; ++i) {
+        const QPersistentModelIndex &idx = indexes.at(i);
+        if (idx.isValid())
+            positions.append(orientation == Qt::Vertical ? idx.row() : idx.column());
+    }
+    return spansFromPositions(positions);
+}
+
+QVector<QPair<int, int>> RoleMaskProxyModelPrivate::spansFromPositions(QVector<int> positions)
+{
+    std::sort(positions.begin(), positions.end());
+    QVector<QPair<int, int>> result;
+    for (int i = 0, maxI = positions.size(); i < maxI; ++i) {
+        if (!result.isEmpty() && result.last().second + 1 == positions.at(i))
+            result.last().second = positions.at(i);
+        else
+            result.append(qMakePair(positions.at(i), positions.at(i)));
+    }
+    return result;
+}
+
+void RoleMaskProxyModelPrivate::rulesInserted(MaskedParent *node, Qt::Orientation orientation, int start, int end)
+{
+    const int count = end - start + 1;
+    node->invalidateRuleIndex();
+    for (int i = 0, maxI = node->m_rules.size(); i < maxI; ++i) {
+        MaskedRule &rule = node->m_rules[i];
+        if (rule.isFullSpan(orientation))
+            continue;
+        if (rule.first(orientation) >= start)
+            rule.first(orientation) += count;
+        if (rule.last(orientation) >= start)
+            rule.last(orientation) += count;
+    }
+}
+
+void RoleMaskProxyModelPrivate::rulesRemoved(MaskedParent *node, Qt::Orientation orientation, int start, int end)
+{
+    node->invalidateRuleIndex();
+    for (int i = 0; i < node->m_rules.size();) {
+        MaskedRule &rule = node->m_rules[i];
+        if (!rule.isFullSpan(orientation) && !removeSpan(rule.first(orientation), rule.last(orientation), start, end))
+            node->m_rules.remove(i);
+        else
+            ++i;
+    }
+}
+
+void RoleMaskProxyModelPrivate::rulesMoved(Qt::Orientation orientation, const QModelIndex &sourceParent, int sourceStart, int sourceEnd,
+                                           const QModelIndex &destinationParent, int destination)
+{
+    MaskedParent *sourceNode = parentNode(sourceParent);
+    if (sourceParent == destinationParent) {
+        if (!sourceNode)
+            return;
+        QVector<MaskedRule> &rules = sourceNode->m_rules;
+        for (int i = 0; i < rules.size(); ++i) {
+            if (rules.at(i).isFullSpan(orientation))
+                continue;
+            const MaskedRule rule = rules.at(i);
+            const QVector<QPair<int, int>> spans =
+                    moveSpan(rules[i].first(orientation), rules[i].last(orientation), sourceStart, sourceEnd, destination);
+            Q_ASSERT(!spans.isEmpty());
+            rules[i].first(orientation) = spans.first().first;
+            rules[i].last(orientation) = spans.first().second;
+            for (int j = 1, maxJ = spans.size(); j < maxJ; ++j) {
+                MaskedRule piece = rule;
+                piece.first(orientation) = spans.at(j).first;
+                piece.last(orientation) = spans.at(j).second;
+                rules.insert(++i, piece);
+            }
+        }
+        mergeRules(rules);
+        sourceNode->invalidateRuleIndex();
+        return;
+    }
+    QVector<MaskedRule> movedRules;
+    if (sourceNode) {
+        for (int i = 0; i < sourceNode->m_rules.size();) {
+            MaskedRule &rule = sourceNode->m_rules[i];
+            // the moved sections keep their overlay in the new parent
+            const int movedFirst = qMax(rule.first(orientation), sourceStart);
+            const int movedLast = rule.last(orientation) < 0 ? sourceEnd : qMin(rule.last(orientation), sourceEnd);
+            if (movedFirst <= movedLast) {
+                MaskedRule piece = rule;
+                piece.first(orientation) = destination + movedFirst - sourceStart;
+                piece.last(orientation) = destination + movedLast - sourceStart;
+                movedRules.append(piece);
+            }
+            if (!rule.isFullSpan(orientation) && !removeSpan(rule.first(orientation), rule.last(orientation), sourceStart, sourceEnd))
+                sourceNode->m_rules.remove(i);
+            else
+                ++i;
+        }
+        sourceNode->invalidateRuleIndex();
+    }
+    MaskedParent *destinationNode = parentNode(destinationParent);
+    if (destinationNode)
+        rulesInserted(destinationNode, orientation, destination, destination + sourceEnd - sourceStart);
+    if (!movedRules.isEmpty()) {
+        MaskedParent &newDestinationNode = ensureParentNode(destinationParent);
+        newDestinationNode.m_rules << movedRules;
+        newDestinationNode.invalidateRuleIndex();
+    }
+}
+
+void RoleMaskProxyModelPrivate::mergeRules(QVector<MaskedRule> &rules)
+{
+    // the order of consecutive rules with the same data does not matter so they can be merged when their ranges touch
+    const auto mergeRun = [](QVector<MaskedRule> &run, Qt::Orientation orientation) {
+        const Qt::Orientation other = orientation == Qt::Vertical ? Qt::Horizontal : Qt::Vertical;
+        std::sort(run.begin(), run.end(), [orientation, other](const MaskedRule &a, const MaskedRule &b) -> bool {
+            if (a.first(other) != b.first(other))
+                return a.first(other) < b.first(other);
+            if (a.last(other) != b.last(other))
+                return a.last(other) < b.last(other);
+            return a.first(orientation) < b.first(orientation);
+        });
+        QVector<MaskedRule> merged;
+        merged.reserve(run.size());
+        for (int i = 0, maxI = run.size(); i < maxI; ++i) {
+            const MaskedRule &current = run.at(i);
+            if (!merged.isEmpty()) {
+                MaskedRule &previous = merged.last();
+                if (previous.first(other) == current.first(other) && previous.last(other) == current.last(other)
+                    && previous.last(orientation) >= 0 && current.first(orientation) <= previous.last(orientation) + 1) {
+                    if (current.last(orientation) < 0)
+                        previous.last(orientation) = -1;
+                    else
+                        previous.last(orientation) = qMax(previous.last(orientation), current.last(orientation));
+                    continue;
+                }
+            }
+            merged.append(current);
+        }
+        run = std::move(merged);
+    };
+    QVector<MaskedRule> result;
+    result.reserve(rules.size());
+    for (int i = 0, maxI = rules.size(); i < maxI;) {
+        int runEnd = i + 1;
+        while (runEnd < maxI && rules.at(runEnd).sameData(rules.at(i)))
+            ++runEnd;
+        if (runEnd - i == 1) {
+            result.append(rules.at(i));
+        } else {
+            QVector<MaskedRule> run = rules.mid(i, runEnd - i);
+            mergeRun(run, Qt::Vertical);
+            mergeRun(run, Qt::Horizontal);
+            result << run;
+        }
+        i = runEnd;
+    }
+    rules = std::move(result);
+}
+
+void RoleMaskProxyModelPrivate::rulesAboutToBeLaidOut(QAbstractItemModel::LayoutChangeHint hint)
+{
+    Q_Q(RoleMaskProxyModel);
+    const QAbstractItemModel *model = q->sourceModel();
+    for (int h = 0, maxH = m_layoutParents.size(); h < maxH; ++h) {
+        const QPersistentModelIndex &parent = m_layoutParents.at(h);
+        MaskedParent &node = m_masked[parent];
+        Q_ASSERT(node.m_sortRuleRows.isEmpty());
+        Q_ASSERT(node.m_sortRuleColumns.isEmpty());
+        if (node.m_rules.isEmpty())
+            continue;
+        const int rowCnt = model->rowCount(parent);
+        const int colCnt = model->columnCount(parent);
+        if (rowCnt == 0 || colCnt == 0)
+            continue;
+        node.m_sortRuleRows.resize(node.m_rules.size());
+        node.m_sortRuleColumns.resize(node.m_rules.size());
+        for (int i = 0, maxI = node.m_rules.size(); i < maxI; ++i) {
+            const MaskedRule &rule = node.m_rules.at(i);
+            if (hint != QAbstractItemModel::HorizontalSortHint && !rule.isFullSpan(Qt::Vertical)) {
+                const int lastRow = rule.m_lastRow < 0 ? rowCnt - 1 : qMin(rule.m_lastRow, rowCnt - 1);
+                for (int j = rule.m_firstRow; j <= lastRow; ++j)
+                    node.m_sortRuleRows[i].append(model->index(j, 0, parent));
+            }
+            if (hint != QAbstractItemModel::VerticalSortHint && !rule.isFullSpan(Qt::Horizontal)) {
+                const int lastColumn = rule.m_lastColumn < 0 ? colCnt - 1 : qMin(rule.m_lastColumn, colCnt - 1);
+                for (int j = rule.m_firstColumn; j <= lastColumn; ++j)
+                    node.m_sortRuleColumns[i].append(model->index(0, j, parent));
+            }
+        }
+    }
+}
+
+void RoleMaskProxyModelPrivate::rulesLaidOut()
+{
+    for (int h = 0, maxH = m_layoutParents.size(); h < maxH; ++h) {
+        const auto nodeIter = m_masked.find(m_layoutParents.at(h));
+        if (nodeIter == m_masked.end())
+            continue;
+        MaskedParent &node = nodeIter.value();
+        if (node.m_sortRuleRows.isEmpty())
+            continue;
+        Q_ASSERT(node.m_sortRuleRows.size() == node.m_rules.size());
+        Q_ASSERT(node.m_sortRuleColumns.size() == node.m_rules.size());
+        QVector<MaskedRule> updatedRules;
+        updatedRules.reserve(node.m_rules.size());
+        for (int i = 0, maxI = node.m_rules.size(); i < maxI; ++i) {
+            const MaskedRule &rule = node.m_rules.at(i);
+            const QVector<QPair<int, int>> rowSpans = node.m_sortRuleRows.at(i).isEmpty()
+                    ? QVector<QPair<int, int>>(1, qMakePair(rule.m_firstRow, rule.m_lastRow))
+                    : spansFromIndexes(node.m_sortRuleRows.at(i), Qt::Vertical);
+            const QVector<QPair<int, int>> columnSpans = node.m_sortRuleColumns.at(i).isEmpty()
+                    ? QVector<QPair<int, int>>(1, qMakePair(rule.m_firstColumn, rule.m_lastColumn))
+                    : spansFromIndexes(node.m_sortRuleColumns.at(i), Qt::Horizontal);
+            for (int j = 0, maxJ = rowSpans.size(); j < maxJ; ++j) {
+                for (int k = 0, maxK = columnSpans.size(); k < maxK; ++k) {
+                    MaskedRule piece = rule;
+                    piece.m_firstRow = rowSpans.at(j).first;
+                    piece.m_lastRow = rowSpans.at(j).second;
+                    piece.m_firstColumn = columnSpans.at(k).first;
+                    piece.m_lastColumn = columnSpans.at(k).second;
+                    updatedRules.append(piece);
+                }
+            }
+        }
+        // rows that end up next to each other again after being split by an earlier layout change go back to a single rule
+        mergeRules(updatedRules);
+        node.m_rules = std::move(updatedRules);
+        node.invalidateRuleIndex();
+        node.m_sortRuleRows.clear();
+        node.m_sortRuleColumns.clear();
+    }
+}
+
+void RoleMaskProxyModelPrivate::itemsAboutToBeLaidOut(QAbstractItemModel::LayoutChangeHint hint)
+{
+    Q_Q(RoleMaskProxyModel);
+    const QAbstractItemModel *model = q->sourceModel();
+    for (int h = 0, maxH = m_layoutParents.size(); h < maxH; ++h) {
+        const QPersistentModelIndex &parent = m_layoutParents.at(h);
+        MaskedParent &node = m_masked[parent];
+        Q_ASSERT(node.m_sortItems.isEmpty());
+        if (node.m_rows.isEmpty())
+            continue;
+        switch (hint) {
+        case QAbstractItemModel::VerticalSortHint:
+            // columns stay where they are so tracking one cell per masked row is enough
+            node.m_sortItems.reserve(node.m_rows.size());
+            for (int i = 0, maxI = node.m_rows.size(); i < maxI; ++i)
+                node.m_sortItems.append(model->index(node.m_rows.at(i).m_row, node.m_rows.at(i).m_items.first().m_column, parent));
+            break;
+        case QAbstractItemModel::HorizontalSortHint: {
+            const QVector<int> columns = node.maskedColumns();
+            node.m_sortItems.reserve(columns.size());
+            for (int i = 0, maxI = columns.size(); i < maxI; ++i)
+                node.m_sortItems.append(model->index(node.m_rows.first().m_row, columns.at(i), parent));
+            break;
+        }
+        default:
+            for (int i = 0, maxI = node.m_rows.size(); i < maxI; ++i) {
+                const MaskedRow &row = node.m_rows.at(i);
+                for (int j = 0, maxJ = row.m_items.size(); j < maxJ; ++j)
+                    node.m_sortItems.append(model->index(row.m_row, row.m_items.at(j).m_column, parent));
+            }
+            break;
+        }
+    }
+}
+
+void RoleMaskProxyModelPrivate::itemsLaidOut(QAbstractItemModel::LayoutChangeHint hint)
+{
+    for (int h = 0, maxH = m_layoutParents.size(); h < maxH; ++h) {
+        const auto nodeIter = m_masked.find(m_layoutParents.at(h));
+        if (nodeIter == m_masked.end())
+            continue;
+        MaskedParent &node = nodeIter.value();
+        if (node.m_sortItems.isEmpty())
+            continue;
+        if (hint == QAbstractItemModel::VerticalSortHint) {
+            Q_ASSERT(node.m_sortItems.size() == node.m_rows.size());
+            for (int i = 0, maxI = node.m_rows.size(); i < maxI; ++i)
+                node.m_rows[i].m_row = node.m_sortItems.at(i).row();
+            node.m_rows.erase(std::remove_if(node.m_rows.begin(), node.m_rows.end(), [](const MaskedRow &row) -> bool { return row.m_row < 0; }),
+                              node.m_rows.end());
+            std::sort(node.m_rows.begin(), node.m_rows.end(), [](const MaskedRow &a, const MaskedRow &b) -> bool { return a.m_row < b.m_row; });
+        } else if (hint == QAbstractItemModel::HorizontalSortHint) {
+            const QVector<int> columns = node.maskedColumns();
+            Q_ASSERT(node.m_sortItems.size() == columns.size());
+            for (int i = 0; i < node.m_rows.size();) {
+                QVector<MaskedItem> &items = node.m_rows[i].m_items;
+                for (int j = 0, maxJ = items.size(); j < maxJ; ++j) {
+                    const int columnIdx = std::lower_bound(columns.cbegin(), columns.cend(), items.at(j).m_column) - columns.cbegin();
+                    items[j].m_column = node.m_sortItems.at(columnIdx).column();
+                }
+                items.erase(std::remove_if(items.begin(), items.end(), [](const MaskedItem &item) -> bool { return item.m_column < 0; }),
+                            items.end());
+                std::sort(items.begin(), items.end(), [](const MaskedItem &a, const MaskedItem &b) -> bool { return a.m_column < b.m_column; });
+                if (items.isEmpty())
+                    node.m_rows.remove(i);
+                else
+                    ++i;
+            }
+        } else {
+            QVector<QPair<QPersistentModelIndex, MaskedItem>> items;
+            items.reserve(node.m_sortItems.size());
+            int sortIdx = 0;
+            for (int i = 0, maxI = node.m_rows.size(); i < maxI; ++i) {
+                const QVector<MaskedItem> &rowItems = node.m_rows.at(i).m_items;
+                for (int j = 0, maxJ = rowItems.size(); j < maxJ; ++j, ++sortIdx) {
+                    if (node.m_sortItems.at(sortIdx).isValid())
+                        items.append(qMakePair(node.m_sortItems.at(sortIdx), rowItems.at(j)));
+                }
+            }
+            Q_ASSERT(sortIdx == node.m_sortItems.size());
+            std::sort(items.begin(), items.end(),
+                      [](const QPair<QPersistentModelIndex, MaskedItem> &a, const QPair<QPersistentModelIndex, MaskedItem> &b) -> bool {
+                          return a.first.row() < b.first.row() || (a.first.row() == b.first.row() && a.first.column() < b.first.column());
+                      });
+            node.m_rows.clear();
+            for (int i = 0, maxI = items.size(); i < maxI; ++i) {
+                const int row = items.at(i).first.row();
+                if (node.m_rows.isEmpty() || node.m_rows.last().m_row != row)
+                    node.m_rows.append(MaskedRow(row));
+                node.m_rows.last().m_items.append(items.at(i).second);
+                node.m_rows.last().m_items.last().m_column = items.at(i).first.column();
+            }
+        }
+        node.m_sortItems.clear();
+    }
+}
+
+void RoleMaskProxyModelPrivate::onSortedRowsInserted(const QModelIndex &parent, int start, int end)
+{
+    QPersistentModelIndex key;
+    if (m_sortedRows.isEmpty() || !findParentKey(parent, key))
+        return;
+    const auto sortedIter = m_sortedRows.find(key);
+    if (sortedIter == m_sortedRows.end())
+        return;
+    // the new rows are shown where the source put them, the proxy announces them with the same numbers
+    const int count = end - start + 1;
+    QVector<int> &proxyToSource = sortedIter->m_proxyToSource;
+    for (int i = 0, maxI = proxyToSource.size(); i < maxI; ++i) {
+        if (proxyToSource.at(i) >= start)
+            proxyToSource[i] += count;
+    }
+    proxyToSource.insert(start, count, 0);
+    for (int i = start; i <= end; ++i)
+        proxyToSource[i] = i;
+    sortedIter->mapSourceRows();
+}
+
+void RoleMaskProxyModelPrivate::onSortedRowsAboutToBeRemoved(const QModelIndex &parent, int start, int end)
+{
+    const SortedRows *sorted = sortedRows(parent);
+    if (!sorted)
+        return;
+    Q_Q(RoleMaskProxyModel);
+    // the proxy announces the removal of the same rows as the source so they are gathered there first, the other rows keep their order
+    QVector<int> proxyToSource;
+    proxyToSource.reserve(sorted->m_proxyToSource.size());
+    for (int i = 0, maxI = sorted->m_proxyToSource.size(); i < maxI; ++i) {
+        const int row = sorted->m_proxyToSource.at(i);
+        if (row < start || row > end)
+            proxyToSource.append(row);
+    }
+    proxyToSource.insert(start, end - start + 1, 0);
+    for (int i = start; i <= end; ++i)
+        proxyToSource[i] = i;
+    if (proxyToSource == sorted->m_proxyToSource)
+        return;
+    const QList<QPersistentModelIndex> proxyParents{QPersistentModelIndex(q->mapFromSource(parent))};
+    sortedRowsAboutToBeChanged(proxyParents);
+    SortedRows &changedRows = m_sortedRows[ensureParentKey(parent)];
+    changedRows.m_proxyToSource = proxyToSource;
+    changedRows.mapSourceRows();
+    sortedRowsChanged(proxyParents);
+}
+
+void RoleMaskProxyModelPrivate::onSortedRowsRemoved(const QModelIndex &parent, int start, int end)
+{
+    if (m_sortedRows.isEmpty())
+        return;
+    QPersistentModelIndex key;
+    const auto sortedIter = findParentKey(parent, key) ? m_sortedRows.find(key) : m_sortedRows.end();
+    if (sortedIter != m_sortedRows.end()) {
+        const int count = end - start + 1;
+        QVector<int> &proxyToSource = sortedIter->m_proxyToSource;
+        Q_ASSERT(proxyToSource.at(start) == start);
+        proxyToSource.remove(start, count);
+        if (proxyToSource.isEmpty()) {
+            m_sortedRows.erase(sortedIter);
+        } else {
+            for (int i = 0, maxI = proxyToSource.size(); i < maxI; ++i) {
+                if (proxyToSource.at(i) > end)
+                    proxyToSource[i] -= count;
+            }
+            sortedIter->mapSourceRows();
+        }
+    }
+    removeStaleSortedRows();
+}
+
+void RoleMaskProxyModelPrivate::onSortedRowsAboutToBeMoved(const QModelIndex &sourceParent, const QModelIndex &destinationParent)
+{
+    if (!sortedRows(sourceParent) && !sortedRows(destinationParent))
+        return;
+    Q_Q(RoleMaskProxyModel);
+    // moved rows can't be announced with the source numbers in a sorted parent so both parents go back to the source order
+    QList<QPersistentModelIndex> proxyParents{QPersistentModelIndex(q->mapFromSource(sourceParent))};
+    if (destinationParent != sourceParent)
+        proxyParents.append(QPersistentModelIndex(q->mapFromSource(destinationParent)));
+    sortedRowsAboutToBeChanged(proxyParents);
+    m_sortedRows.remove(QPersistentModelIndex(sourceParent));
+    m_sortedRows.remove(QPersistentModelIndex(destinationParent));
+    sortedRowsChanged(proxyParents);
+}
+
+void RoleMaskProxyModelPrivate::onSortedLayoutChanged(const QList<QPersistentModelIndex> &parents)
 {
-    Q_ASSERT(index.isValid());
-    Q_ASSERT(index.model() == q_func()->sourceModel());
-    const QPair<int, int> hashKey = qMakePair(index.row(), index.column());
-    m_masked.insert(hashKey, MaskedItem(data, index));
+    // the source reordered its rows, the parents involved go back to the source order
+    if (parents.isEmpty()) {
+        m_sortedRows.clear();
+        return;
+    }
+    for (int i = 0, maxI = parents.size(); i < maxI && !m_sortedRows.isEmpty(); ++i)
+        m_sortedRows.remove(parents.at(i));
 }
 
 void RoleMaskProxyModelPrivate::onRowsAboutToBeInserted(const QModelIndex &parent, int start, int end)
 {
-    const int count = end - start + 1;
     Q_ASSERT(!parent.isValid() || parent.model() == q_func()->sourceModel());
-    decltype(m_masked) maskedToAdd;
-    for (auto i = m_masked.begin(), iEnd = m_masked.end(); i != iEnd;) {
-        if (i->m_index.parent() == parent) {
-            if (i.key().first >= start) {
-                maskedToAdd.insert(qMakePair(i.key().first + count, i.key().second), i.value());
-                i = m_masked.erase(i);
-                continue;
-            }
-        }
-        ++i;
-    }
-    for (auto i = maskedToAdd.begin(), iEnd = maskedToAdd.end(); i != iEnd; ++i)
-        m_masked.insert(i.key(), i.value());
+    // every masked position is before the end so appending (e.g. QSqlTableModel::fetchMore) leaves the overlay untouched
+    if (start >= q_func()->sourceModel()->rowCount(parent))
+        return;
+    m_computedCache.clear();
+    MaskedParent *node = parentNode(parent);
+    if (!node)
+        return;
+    const int count = end - start + 1;
+    rulesInserted(node, Qt::Vertical, start, end);
+    for (auto rowIter = node->findRow(start), rowEnd = node->m_rows.end(); rowIter != rowEnd; ++rowIter)
+        rowIter->m_row += count;
 }
 
 void RoleMaskProxyModelPrivate::onColumnsAboutToBeInserted(const QModelIndex &parent, int start, int end)
 {
-    const int count = end - start + 1;
+    m_checkCountersDirty = true;
     Q_ASSERT(!parent.isValid() || parent.model() == q_func()->sourceModel());
-    decltype(m_masked) maskedToAdd;
-    for (auto i = m_masked.begin(), iEnd = m_masked.end(); i != iEnd;) {
-        if (i->m_index.parent() == parent) {
-            if (i.key().second >= start) {
-                maskedToAdd.insert(qMakePair(i.key().first, i.key().second + count), i.value());
-                i = m_masked.erase(i);
-                continue;
-            }
-        }
-        ++i;
+    // every masked position is before the end so appending leaves the overlay untouched
+    if (start >= q_func()->sourceModel()->columnCount(parent))
+        return;
+    m_computedCache.clear();
+    MaskedParent *node = parentNode(parent);
+    if (!node)
+        return;
+    const int count = end - start + 1;
+    rulesInserted(node, Qt::Horizontal, start, end);
+    for (int i = 0, maxI = node->m_rows.size(); i < maxI; ++i) {
+        MaskedRow &row = node->m_rows[i];
+        for (auto itemIter = row.findColumn(start), itemEnd = row.m_items.end(); itemIter != itemEnd; ++itemIter)
+            itemIter->m_column += count;
     }
-    for (auto i = maskedToAdd.begin(), iEnd = maskedToAdd.end(); i != iEnd; ++i)
-        m_masked.insert(i.key(), i.value());
 }
 
 void RoleMaskProxyModelPrivate::onRowsAboutToBeRemoved(const QModelIndex &parent, int start, int end)
 {
-    const int count = end - start + 1;
+    m_checkCountersDirty = true;
     Q_ASSERT(!parent.isValid() || parent.model() == q_func()->sourceModel());
-    decltype(m_masked) maskedToAdd;
-    for (auto i = m_masked.begin(), iEnd = m_masked.end(); i != iEnd;) {
-        if (i->m_index.parent() == parent) {
-            if (i.key().first >= start) {
-                if (i.key().first > end)
-                    maskedToAdd.insert(qMakePair(i.key().first - count, i.key().second), i.value());
-                i = m_masked.erase(i);
-                continue;
-            }
-        }
-        ++i;
-    }
-    for (auto i = maskedToAdd.begin(), iEnd = maskedToAdd.end(); i != iEnd; ++i)
-        m_masked.insert(i.key(), i.value());
+    m_computedCache.clear();
+    removeChildNodes(parent, Qt::Vertical, start, end);
+    MaskedParent *node = parentNode(parent);
+    if (!node)
+        return;
+    const int count = end - start + 1;
+    rulesRemoved(node, Qt::Vertical, start, end);
+    const auto removeBegin = node->findRow(start);
+    const auto removeEnd = node->findRow(end + 1);
+    for (auto rowIter = node->m_rows.erase(removeBegin, removeEnd), rowEnd = node->m_rows.end(); rowIter != rowEnd; ++rowIter)
+        rowIter->m_row -= count;
+    pruneParentNode(parent);
 }
 
 void RoleMaskProxyModelPrivate::onColumnsAboutToBeRemoved(const QModelIndex &parent, int start, int end)
 {
-    const int count = end - start + 1;
+    m_checkCountersDirty = true;
     Q_ASSERT(!parent.isValid() || parent.model() == q_func()->sourceModel());
-    decltype(m_masked) maskedToAdd;
-    for (auto i = m_masked.begin(), iEnd = m_masked.end(); i != iEnd;) {
-        if (i->m_index.parent() == parent) {
-            if (i.key().second >= start) {
-                if (i.key().second > end)
-                    maskedToAdd.insert(qMakePair(i.key().first, i.key().second - count), i.value());
-                i = m_masked.erase(i);
-                continue;
-            }
-        }
-        ++i;
+    m_computedCache.clear();
+    removeChildNodes(parent, Qt::Horizontal, start, end);
+    MaskedParent *node = parentNode(parent);
+    if (!node)
+        return;
+    const int count = end - start + 1;
+    rulesRemoved(node, Qt::Horizontal, start, end);
+    for (int i = 0; i < node->m_rows.size();) {
+        MaskedRow &row = node->m_rows[i];
+        const auto removeBegin = row.findColumn(start);
+        const auto removeEnd = row.findColumn(end + 1);
+        for (auto itemIter = row.m_items.erase(removeBegin, removeEnd), itemEnd = row.m_items.end(); itemIter != itemEnd; ++itemIter)
+            itemIter->m_column -= count;
+        if (row.m_items.isEmpty())
+            node->m_rows.remove(i);
+        else
+            ++i;
     }
-    for (auto i = maskedToAdd.begin(), iEnd = maskedToAdd.end(); i != iEnd; ++i)
-        m_masked.insert(i.key(), i.value());
+    pruneParentNode(parent);
 }
 
 void RoleMaskProxyModelPrivate::onLayoutChanged(const QList<QPersistentModelIndex> &parents, QAbstractItemModel::LayoutChangeHint hint)
 {
     Q_UNUSED(parents)
-    Q_UNUSED(hint)
-    decltype(m_masked) updatedMasked;
-    for (auto i = m_masked.constBegin(), iMax = m_masked.constEnd(); i != iMax; ++i) {
-        const auto newKey = qMakePair(i->m_index.row(), i->m_index.column());
-        updatedMasked.insert(newKey, i.value());
-    }
-    m_masked = std::move(updatedMasked);
-    if (hint != QAbstractItemModel::HorizontalSortHint) {
+    m_checkCountersDirty = true;
+    itemsLaidOut(hint);
+    rulesLaidOut();
+    m_layoutParents.clear();
+    if (!m_sortVHeaders.isEmpty()) {
         if (m_vHeaderData.size() == m_sortVHeaders.size()) {
             QVector<RolesContainer> updatedvHeaderData(m_vHeaderData.size());
             for (int i = 0; i < m_sortVHeaders.size(); ++i) {
@@ -239,11 +2290,11 @@ void RoleMaskProxyModelPrivate::onLayoutChanged(const QList<QPersistentModelInde
         }
         m_sortVHeaders.clear();
     }
-    if (hint != QAbstractItemModel::VerticalSortHint) {
+    if (!m_sortHHeaders.isEmpty()) {
         if (m_hHeaderData.size() == m_sortHHeaders.size()) {
             QVector<RolesContainer> updatedhHeaderData(m_hHeaderData.size());
             for (int i = 0; i < m_sortHHeaders.size(); ++i) {
-                updatedhHeaderData[m_sortHHeaders.at(i).row()] = m_hHeaderData.at(i);
+                updatedhHeaderData[m_sortHHeaders.at(i).column()] = m_hHeaderData.at(i);
             }
             m_hHeaderData = std::move(updatedhHeaderData);
         }
@@ -253,143 +2304,193 @@ void RoleMaskProxyModelPrivate::onLayoutChanged(const QList<QPersistentModelInde
 
 void RoleMaskProxyModelPrivate::onLayoutAboutToBeChanged(const QList<QPersistentModelIndex> &parents, QAbstractItemModel::LayoutChangeHint hint)
 {
+    m_checkCountersDirty = true;
     Q_Q(RoleMaskProxyModel);
-    if (hint != QAbstractItemModel::VerticalSortHint) {
-        Q_ASSERT(m_sortHHeaders.isEmpty());
-        const int colC = q->sourceModel()->columnCount();
-        for (int i = 0; i < colC; ++i)
-            m_sortHHeaders.append(q->sourceModel()->index(0, i));
+    Q_ASSERT(m_sortHHeaders.isEmpty());
+    Q_ASSERT(m_sortVHeaders.isEmpty());
+    Q_ASSERT(m_layoutParents.isEmpty());
+    m_computedCache.clear();
+    // the headers only move when the top level items are laid out again
+    if (m_maskHeaderData && (parents.isEmpty() || parents.contains(QPersistentModelIndex()))) {
+        if (hint != QAbstractItemModel::VerticalSortHint) {
+            const int colC = q->sourceModel()->columnCount();
+            for (int i = 0; i < colC; ++i)
+                m_sortHHeaders.append(q->sourceModel()->index(0, i));
+        }
+        if (hint != QAbstractItemModel::HorizontalSortHint) {
+            const int rowC = q->sourceModel()->rowCount();
+            for (int i = 0; i < rowC; ++i)
+                m_sortVHeaders.append(q->sourceModel()->index(i, 0));
+        }
     }
-    if (hint != QAbstractItemModel::HorizontalSortHint) {
-        Q_ASSERT(m_sortVHeaders.isEmpty());
-        const int rowC = q->sourceModel()->rowCount();
-        for (int i = 0; i < rowC; ++i)
-            m_sortVHeaders.append(q->sourceModel()->index(i, 0));
+    if (parents.isEmpty()) {
+        m_layoutParents.reserve(m_masked.size());
+        for (auto nodeIter = m_masked.cbegin(), nodeEnd = m_masked.cend(); nodeIter != nodeEnd; ++nodeIter)
+            m_layoutParents.append(nodeIter.key());
+    } else {
+        // the masked descendants of the parents are laid out with them
+        QSet<QPersistentModelIndex> visited;
+        for (int i = 0, maxI = parents.size(); i < maxI; ++i) {
+            if (!visited.contains(parents.at(i)) && m_masked.contains(parents.at(i))) {
+                visited.insert(parents.at(i));
+                m_layoutParents.append(parents.at(i));
+            }
+        }
+        for (int i = 0; i < m_layoutParents.size(); ++i) {
+            const QVector<QPersistentModelIndex> &children = m_masked.constFind(m_layoutParents.at(i))->m_children;
+            for (int j = 0, maxJ = children.size(); j < maxJ; ++j) {
+                if (!visited.contains(children.at(j))) {
+                    visited.insert(children.at(j));
+                    m_layoutParents.append(children.at(j));
+                }
+            }
+        }
     }
+    itemsAboutToBeLaidOut(hint);
+    rulesAboutToBeLaidOut(hint);
 }
 
 void RoleMaskProxyModelPrivate::onRowsAboutToBeMoved(const QModelIndex &sourceParent, int sourceStart, int sourceEnd,
                                                      const QModelIndex &destinationParent, int destinationRow)
 {
+    m_checkCountersDirty = true;
     Q_ASSERT(!sourceParent.isValid() || sourceParent.model() == q_func()->sourceModel());
     Q_ASSERT(!destinationParent.isValid() || destinationParent.model() == q_func()->sourceModel());
-    decltype(m_masked) maskedToAdd;
+    m_computedCache.clear();
+    rulesMoved(Qt::Vertical, sourceParent, sourceStart, sourceEnd, destinationParent, destinationRow);
     const int count = sourceEnd - sourceStart + 1;
-    if (sourceParent != destinationParent) {
-        for (auto i = m_masked.begin(), iEnd = m_masked.end(); i != iEnd;) {
-            if (i->m_index.parent() == sourceParent) {
-                if (i.key().first >= sourceStart && i.key().first <= sourceEnd) {
-                    maskedToAdd.insert(qMakePair(destinationRow + i.key().first - sourceStart, i.key().second), i.value());
-                    i = m_masked.erase(i);
-                    continue;
-                }
-                if (i.key().first > sourceEnd) {
-                    maskedToAdd.insert(qMakePair(i.key().first - count, i.key().second), i.value());
-                    i = m_masked.erase(i);
-                    continue;
-                }
-            } else if (i->m_index.parent() == destinationParent) {
-                if (i.key().first >= destinationRow) {
-                    maskedToAdd.insert(qMakePair(i.key().first + count, i.key().second), i.value());
-                    i = m_masked.erase(i);
-                    continue;
-                }
-            }
-            ++i;
+    MaskedParent *sourceNode = parentNode(sourceParent);
+    if (sourceParent == destinationParent) {
+        if (!sourceNode)
+            return;
+        for (int i = 0, maxI = sourceNode->m_rows.size(); i < maxI; ++i) {
+            MaskedRow &row = sourceNode->m_rows[i];
+            row.m_row = movePosition(row.m_row, sourceStart, sourceEnd, destinationRow);
         }
-    } else {
-        for (auto i = m_masked.begin(), iEnd = m_masked.end(); i != iEnd;) {
-            if (i->m_index.parent() == sourceParent) {
-                if (destinationRow < sourceStart) {
-                    if (i.key().first >= destinationRow && i.key().first < sourceStart) {
-                        maskedToAdd.insert(qMakePair(i.key().first + count, i.key().second), i.value());
-                        i = m_masked.erase(i);
-                        continue;
-                    } else if (i.key().first >= sourceStart && i.key().first <= sourceEnd) {
-                        maskedToAdd.insert(qMakePair(i.key().first - (sourceStart - destinationRow), i.key().second), i.value());
-                        i = m_masked.erase(i);
-                        continue;
-                    }
-                } else {
-                    Q_ASSERT(destinationRow > sourceEnd);
-                    if (i.key().first > sourceEnd && i.key().first < destinationRow) {
-                        maskedToAdd.insert(qMakePair(i.key().first - count, i.key().second), i.value());
-                        i = m_masked.erase(i);
-                        continue;
-                    } else if (i.key().first >= sourceStart && i.key().first <= sourceEnd) {
-                        maskedToAdd.insert(qMakePair(i.key().first + (destinationRow - sourceEnd - 1), i.key().second), i.value());
-                        i = m_masked.erase(i);
-                        continue;
-                    }
-                }
+        std::sort(sourceNode->m_rows.begin(), sourceNode->m_rows.end(),
+                  [](const MaskedRow &a, const MaskedRow &b) -> bool { return a.m_row < b.m_row; });
+        return;
+    }
+    QVector<MaskedRow> movedRows;
+    QVector<QPersistentModelIndex> movedChildren;
+    QSet<int> movedLayers;
+    if (sourceNode) {
+        movedLayers = sourceNode->m_overlayLayers;
+        for (int i = 0; i < sourceNode->m_children.size();) {
+            const int childRow = sourceNode->m_children.at(i).row();
+            if (childRow >= sourceStart && childRow <= sourceEnd) {
+                movedChildren.append(sourceNode->m_children.at(i));
+                sourceNode->m_children.remove(i);
+            } else {
+                ++i;
             }
-            ++i;
         }
+        const auto moveBegin = sourceNode->findRow(sourceStart);
+        const auto moveEnd = sourceNode->findRow(sourceEnd + 1);
+        for (auto rowIter = moveBegin; rowIter != moveEnd; ++rowIter) {
+            movedRows.append(*rowIter);
+            movedRows.last().m_row += destinationRow - sourceStart;
+        }
+        for (auto rowIter = sourceNode->m_rows.erase(moveBegin, moveEnd), rowEnd = sourceNode->m_rows.end(); rowIter != rowEnd; ++rowIter)
+            rowIter->m_row -= count;
     }
-    for (auto i = maskedToAdd.begin(), iEnd = maskedToAdd.end(); i != iEnd; ++i)
-        m_masked.insert(i.key(), i.value());
+    MaskedParent *destinationNode = parentNode(destinationParent);
+    if (destinationNode) {
+        for (auto rowIter = destinationNode->findRow(destinationRow), rowEnd = destinationNode->m_rows.end(); rowIter != rowEnd; ++rowIter)
+            rowIter->m_row += count;
+    }
+    if (!movedRows.isEmpty() || !movedChildren.isEmpty()) {
+        MaskedParent &node = ensureParentNode(destinationParent);
+        const int insertIdx = node.findRow(destinationRow) - node.m_rows.begin();
+        node.m_rows.insert(insertIdx, movedRows.size(), MaskedRow());
+        for (int i = 0, maxI = movedRows.size(); i < maxI; ++i)
+            node.m_rows[insertIdx + i] = movedRows.at(i);
+        node.m_children << movedChildren;
+        if (!movedRows.isEmpty())
+            node.m_overlayLayers.unite(movedLayers);
+    }
+    pruneParentNode(sourceParent);
 }
 
 void RoleMaskProxyModelPrivate::onColumnsAboutToBeMoved(const QModelIndex &sourceParent, int sourceStart, int sourceEnd,
                                                         const QModelIndex &destinationParent, int destinationColumn)
 {
+    m_checkCountersDirty = true;
     Q_ASSERT(!sourceParent.isValid() || sourceParent.model() == q_func()->sourceModel());
     Q_ASSERT(!destinationParent.isValid() || destinationParent.model() == q_func()->sourceModel());
-    decltype(m_masked) maskedToAdd;
+    m_computedCache.clear();
+    rulesMoved(Qt::Horizontal, sourceParent, sourceStart, sourceEnd, destinationParent, destinationColumn);
     const int count = sourceEnd - sourceStart + 1;
-    if (sourceParent != destinationParent) {
-        for (auto i = m_masked.begin(), iEnd = m_masked.end(); i != iEnd;) {
-            if (i->m_index.parent() == sourceParent) {
-                if (i.key().second >= sourceStart && i.key().second <= sourceEnd) {
-                    maskedToAdd.insert(qMakePair(i.key().first, destinationColumn + i.key().second - sourceStart), i.value());
-                    i = m_masked.erase(i);
-                    continue;
-                }
-                if (i.key().second > sourceEnd) {
-                    maskedToAdd.insert(qMakePair(i.key().first, i.key().second - count), i.value());
-                    i = m_masked.erase(i);
-                    continue;
-                }
-            } else if (i->m_index.parent() == destinationParent) {
-                if (i.key().second >= destinationColumn) {
-                    maskedToAdd.insert(qMakePair(i.key().first, i.key().second + count), i.value());
-                    i = m_masked.erase(i);
-                    continue;
-                }
+    MaskedParent *sourceNode = parentNode(sourceParent);
+    if (sourceParent == destinationParent) {
+        if (!sourceNode)
+            return;
+        for (int i = 0, maxI = sourceNode->m_rows.size(); i < maxI; ++i) {
+            QVector<MaskedItem> &items = sourceNode->m_rows[i].m_items;
+            for (int j = 0, maxJ = items.size(); j < maxJ; ++j)
+                items[j].m_column = movePosition(items.at(j).m_column, sourceStart, sourceEnd, destinationColumn);
+            std::sort(items.begin(), items.end(), [](const MaskedItem &a, const MaskedItem &b) -> bool { return a.m_column < b.m_column; });
+        }
+        return;
+    }
+    QVector<MaskedRow> movedRows;
+    QVector<QPersistentModelIndex> movedChildren;
+    QSet<int> movedLayers;
+    if (sourceNode) {
+        movedLayers = sourceNode->m_overlayLayers;
+        for (int i = 0; i < sourceNode->m_children.size();) {
+            const int childColumn = sourceNode->m_children.at(i).column();
+            if (childColumn >= sourceStart && childColumn <= sourceEnd) {
+                movedChildren.append(sourceNode->m_children.at(i));
+                sourceNode->m_children.remove(i);
+            } else {
+                ++i;
             }
-            ++i;
         }
-    } else {
-        for (auto i = m_masked.begin(), iEnd = m_masked.end(); i != iEnd;) {
-            if (i->m_index.parent() == sourceParent) {
-                if (destinationColumn < sourceStart) {
-                    if (i.key().second >= destinationColumn && i.key().second < sourceStart) {
-                        maskedToAdd.insert(qMakePair(i.key().first, i.key().second + count), i.value());
-                        i = m_masked.erase(i);
-                        continue;
-                    } else if (i.key().second >= sourceStart && i.key().second <= sourceEnd) {
-                        maskedToAdd.insert(qMakePair(i.key().first, i.key().second - (sourceStart - destinationColumn)), i.value());
-                        i = m_masked.erase(i);
-                        continue;
-                    }
-                } else {
-                    Q_ASSERT(destinationColumn > sourceEnd);
-                    if (i.key().second > sourceEnd && i.key().second < destinationColumn) {
-                        maskedToAdd.insert(qMakePair(i.key().first, i.key().second - count), i.value());
-                        i = m_masked.erase(i);
-                        continue;
-                    } else if (i.key().second >= sourceStart && i.key().second <= sourceEnd) {
-                        maskedToAdd.insert(qMakePair(i.key().first, i.key().second + (destinationColumn - sourceEnd - 1)), i.value());
-                        i = m_masked.erase(i);
-                        continue;
-                    }
+        for (int i = 0; i < sourceNode->m_rows.size();) {
+            MaskedRow &row = sourceNode->m_rows[i];
+            const auto moveBegin = row.findColumn(sourceStart);
+            const auto moveEnd = row.findColumn(sourceEnd + 1);
+            if (moveBegin != moveEnd) {
+                movedRows.append(MaskedRow(row.m_row));
+                for (auto itemIter = moveBegin; itemIter != moveEnd; ++itemIter) {
+                    movedRows.last().m_items.append(*itemIter);
+                    movedRows.last().m_items.last().m_column += destinationColumn - sourceStart;
                 }
             }
-            ++i;
+            for (auto itemIter = row.m_items.erase(moveBegin, moveEnd), itemEnd = row.m_items.end(); itemIter != itemEnd; ++itemIter)
+                itemIter->m_column -= count;
+            if (row.m_items.isEmpty())
+                sourceNode->m_rows.remove(i);
+            else
+                ++i;
+        }
+    }
+    MaskedParent *destinationNode = parentNode(destinationParent);
+    if (destinationNode) {
+        for (int i = 0, maxI = destinationNode->m_rows.size(); i < maxI; ++i) {
+            MaskedRow &row = destinationNode->m_rows[i];
+            for (auto itemIter = row.findColumn(destinationColumn), itemEnd = row.m_items.end(); itemIter != itemEnd; ++itemIter)
+                itemIter->m_column += count;
+        }
+    }
+    if (!movedRows.isEmpty() || !movedChildren.isEmpty()) {
+        MaskedParent &node = ensureParentNode(destinationParent);
+        for (int i = 0, maxI = movedRows.size(); i < maxI; ++i) {
+            const MaskedRow &movedRow = movedRows.at(i);
+            auto rowIter = node.findRow(movedRow.m_row);
+            if (rowIter == node.m_rows.end() || rowIter->m_row != movedRow.m_row)
+                rowIter = node.m_rows.insert(rowIter, MaskedRow(movedRow.m_row));
+            const int insertIdx = rowIter->findColumn(destinationColumn) - rowIter->m_items.begin();
+            rowIter->m_items.insert(insertIdx, movedRow.m_items.size(), MaskedItem());
+            for (int j = 0, maxJ = movedRow.m_items.size(); j < maxJ; ++j)
+                rowIter->m_items[insertIdx + j] = movedRow.m_items.at(j);
         }
+        node.m_children << movedChildren;
+        if (!movedRows.isEmpty())
+            node.m_overlayLayers.unite(movedLayers);
     }
-    for (auto i = maskedToAdd.begin(), iEnd = maskedToAdd.end(); i != iEnd; ++i)
-        m_masked.insert(i.key(), i.value());
+    pruneParentNode(sourceParent);
 }
 
 void RoleMaskProxyModelPrivate::onRowsInserted(const QModelIndex &parent, int start, int end)
@@ -460,49 +2561,76 @@ void RoleMaskProxyModelPrivate::onColumnsMoved(const QModelIndex &sourceParent,
 
 void RoleMaskProxyModelPrivate::clearUnusedMaskedRoles(const QSet<int> &newRoles)
 {
-    if (newRoles.isEmpty()) {
-        m_defaultValues.clear();
-        m_masked.clear();
-        return;
-    }
-    for (auto i = m_defaultValues.begin(); i != m_defaultValues.end();) {
-        if (!newRoles.contains(i.key()))
-            i = m_defaultValues.erase(i);
-        else
-            ++i;
-    }
-    const auto idxEnd = m_masked.end();
-    for (auto idxIter = m_masked.begin(); idxIter != idxEnd;) {
-        const auto roleEnd = idxIter->m_data.roles.end();
-        for (auto roleIter = idxIter->m_data.roles.begin(); roleIter != roleEnd;) {
+    const auto clearUnusedRoles = [&newRoles](RolesContainer &roles) {
+        for (auto roleIter = roles.begin(); roleIter != roles.end();) {
             if (!newRoles.contains(roleIter.key()))
-                roleIter = idxIter->m_data.roles.erase(roleIter);
+                roleIter = roles.erase(roleIter);
             else
                 ++roleIter;
         }
-        if (idxIter->m_data.roles.isEmpty())
-            idxIter = m_masked.erase(idxIter);
+    };
+    if (newRoles.isEmpty())
+        m_defaultValues.clear();
+    else
+        clearUnusedRoles(m_defaultValues);
+    for (auto roleIter = m_computedRoles.begin(); roleIter != m_computedRoles.end();) {
+        if (!newRoles.contains(roleIter.key()))
+            roleIter = m_computedRoles.erase(roleIter);
         else
-            ++idxIter;
+            ++roleIter;
     }
+    m_computedCache.clear();
+    m_checkCountersDirty = true;
+    QVector<QPersistentModelIndex> emptyNodes;
+    for (auto nodeIter = m_masked.begin(), nodeEnd = m_masked.end(); nodeIter != nodeEnd; ++nodeIter) {
+        MaskedParent &node = nodeIter.value();
+        for (int i = 0; i < node.m_rows.size();) {
+            QVector<MaskedItem> &items = node.m_rows[i].m_items;
+            for (int j = 0; j < items.size();) {
+                clearUnusedRoles(items[j].m_data.roles);
+                QVector<LayerValues> &layers = items[j].m_layers;
+                for (int k = 0; k < layers.size();) {
+                    clearUnusedRoles(layers[k].m_roles);
+                    if (layers.at(k).m_roles.isEmpty())
+                        layers.remove(k);
+                    else
+                        ++k;
+                }
+                if (items.at(j).m_data.roles.isEmpty() && layers.isEmpty())
+                    items.remove(j);
+                else
+                    ++j;
+            }
+            if (items.isEmpty())
+                node.m_rows.remove(i);
+            else
+                ++i;
+        }
+        for (int i = 0; i < node.m_rules.size();) {
+            clearUnusedRoles(node.m_rules[i].m_data.roles);
+            if (node.m_rules.at(i).m_data.roles.isEmpty() && !node.m_rules.at(i).m_data.flags)
+                node.m_rules.remove(i);
+            else
+                ++i;
+        }
+        node.invalidateRuleIndex();
+        if (node.isEmpty())
+            emptyNodes.append(nodeIter.key());
+    }
+    for (int i = 0, maxI = emptyNodes.size(); i < maxI; ++i)
+        pruneParentNode(emptyNodes.at(i));
 }
 
 bool RoleMaskProxyModelPrivate::removeRole(const QModelIndex &idx, int role)
 {
-    if (!idx.isValid())
+    MaskedItem *item = maskedItem(idx);
+    if (!item || item->m_data.roles.remove(role) == 0)
         return false;
-    Q_ASSERT(idx.model() == q_func()->sourceModel());
-    const QPair<int, int> hashKey = qMakePair(idx.row(), idx.column());
-    for (auto i = m_masked.find(hashKey), iEnd = m_masked.end(); i != iEnd && i.key() == hashKey; ++i) {
-        if (i->m_index == idx) {
-            if (i->m_data.roles.remove(role) > 0) {
-                if (i->m_data.roles.isEmpty())
-                    m_masked.erase(i);
-                return true;
-            }
-        }
-    }
-    return false;
+    if (idx.column() == 0)
+        m_checkCountersDirty = true;
+    if (item->m_data.roles.isEmpty() && item->m_layers.isEmpty())
+        removeIndex(idx);
+    return true;
 }
 
 bool RoleMaskProxyModelPrivate::removeIndex(const QModelIndex &idx)
@@ -510,14 +2638,23 @@ bool RoleMaskProxyModelPrivate::removeIndex(const QModelIndex &idx)
     if (!idx.isValid())
         return false;
     Q_ASSERT(idx.model() == q_func()->sourceModel());
-    const QPair<int, int> hashKey = qMakePair(idx.row(), idx.column());
-    for (auto i = m_masked.find(hashKey), iEnd = m_masked.end(); i != iEnd && i.key() == hashKey; ++i) {
-        if (i->m_index == idx) {
-            m_masked.erase(i);
-            return true;
-        }
+    MaskedParent *node = parentNode(idx.parent());
+    if (!node)
+        return false;
+    const auto rowIter = node->findRow(idx.row());
+    if (rowIter == node->m_rows.end() || rowIter->m_row != idx.row())
+        return false;
+    const auto itemIter = rowIter->findColumn(idx.column());
+    if (itemIter == rowIter->m_items.end() || itemIter->m_column != idx.column())
+        return false;
+    if (idx.column() == 0)
+        m_checkCountersDirty = true;
+    rowIter->m_items.erase(itemIter);
+    if (rowIter->m_items.isEmpty()) {
+        node->m_rows.erase(rowIter);
+        pruneParentNode(idx.parent());
     }
-    return false;
+    return true;
 }
 
 void RoleMaskProxyModelPrivate::signalAllChanged(const QVector<int> &roles, const QModelIndex &parent)
@@ -550,7 +2687,12 @@ Constructs a new proxy model with the given \a parent.
 RoleMaskProxyModel::RoleMaskProxyModel(QObject *parent)
     : QIdentityProxyModel(parent)
     , d_ptr(new RoleMaskProxyModelPrivate(this))
-{ }
+{
+    connect(this, &RoleMaskProxyModel::dataChanged, this,
+            [this](const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles) -> void {
+                d_func()->invalidateComputedRoles(topLeft, bottomRight, roles);
+            });
+}
 
 /*!
 Constructor used only while subclassing the private class.
@@ -559,7 +2701,12 @@ Not part of the public API
 RoleMaskProxyModel::RoleMaskProxyModel(RoleMaskProxyModelPrivate &dptr, QObject *parent)
     : QIdentityProxyModel(parent)
     , d_ptr(&dptr)
-{ }
+{
+    connect(this, &RoleMaskProxyModel::dataChanged, this,
+            [this](const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles) -> void {
+                d_func()->invalidateComputedRoles(topLeft, bottomRight, roles);
+            });
+}
 
 /*!
 Destructor
@@ -682,22 +2829,301 @@ void RoleMaskProxyModel::removeMaskedRole(int role)
 Returns the default value for the \a role when the proxy is not transparent
 \sa transparentIfEmpty
 */
-QVariant RoleMaskProxyModel::maskedRoleDefaultValue(int role) const
+QVariant RoleMaskProxyModel::maskedRoleDefaultValue(int role) const
+{
+    Q_D(const RoleMaskProxyModel);
+    return d->m_defaultValues.value(role, QVariant());
+}
+
+bool RoleMaskProxyModel::setMaskedRoleDefaultValue(int role, const QVariant &value)
+{
+    Q_D(RoleMaskProxyModel);
+    if (!d->m_maskedRoles.contains(role))
+        return false;
+    if (value.isValid())
+        d->m_defaultValues[role] = value;
+    else
+        d->m_defaultValues.remove(role);
+    return true;
+}
+
+/*!
+Uses \a function to provide the value of \a role for every cell that has no masked value for it.
+
+The function receives the index of this model and is only called when the value is read.
+The result is cached for each cell until a dataChanged() signal of this model covers the cell with one of the \a dependsOnRoles.
+An empty \a dependsOnRoles means any change to the cell invalidates the value. Inserting, removing or moving sections in the source
+model clears the whole cache.
+
+\a role is added to the masked roles if it was not already. Passing an empty \a function removes the computed role.
+\sa removeComputedRole(), computedRoles()
+*/
+void RoleMaskProxyModel::setComputedRole(int role, const RoleFunction &function, const QList<int> &dependsOnRoles)
+{
+    if (!function) {
+        removeComputedRole(role);
+        return;
+    }
+    Q_D(RoleMaskProxyModel);
+    if (d->m_mergeDisplayEdit && role == Qt::EditRole)
+        role = Qt::DisplayRole;
+    ComputedRole computedRole;
+    computedRole.m_function = function;
+    computedRole.m_dependsOn = dependsOnRoles.toVector();
+    d->m_computedRoles.insert(role, computedRole);
+    d->m_computedCache.clear();
+    if (d->m_maskedRoles.contains(role))
+        d->signalAllChanged(QVector<int>(1, role));
+    else
+        addMaskedRole(role);
+}
+
+/*!
+Stops computing the values of \a role. The role remains masked.
+\sa setComputedRole()
+*/
+void RoleMaskProxyModel::removeComputedRole(int role)
+{
+    Q_D(RoleMaskProxyModel);
+    if (d->m_mergeDisplayEdit && role == Qt::EditRole)
+        role = Qt::DisplayRole;
+    if (d->m_computedRoles.remove(role) == 0)
+        return;
+    d->m_computedCache.clear();
+    d->signalAllChanged(QVector<int>(1, role));
+}
+
+/*!
+Returns the roles whose values are provided by a function set with setComputedRole()
+*/
+QList<int> RoleMaskProxyModel::computedRoles() const
+{
+    Q_D(const RoleMaskProxyModel);
+    return d->m_computedRoles.keys();
+}
+
+/*!
+Adds an overlay layer called \a name with the given \a priority. The layer starts enabled and empty.
+
+Overlay layers hold masked values that sit on top of every other value provided by the proxy.
+When several enabled layers have a value for the same cell and role, the one with the highest priority is shown.
+Among layers with the same priority, the one added last takes precedence.
+
+Returns false if \a name is empty or a layer with the same name already exists.
+\sa setOverlayData(), setOverlayLayerEnabled(), removeOverlayLayer()
+*/
+bool RoleMaskProxyModel::addOverlayLayer(const QString &name, int priority)
+{
+    Q_D(RoleMaskProxyModel);
+    if (name.isEmpty() || d->findLayer(name) >= 0)
+        return false;
+    OverlayLayer layer;
+    layer.m_name = name;
+    layer.m_id = d->m_nextLayerId++;
+    layer.m_priority = priority;
+    layer.m_enabled = true;
+    d->insertLayer(layer);
+    ++d->m_enabledLayers;
+    return true;
+}
+
+/*!
+Removes the overlay layer called \a name and all the values stored in it.
+\sa addOverlayLayer(), clearOverlayLayer()
+*/
+void RoleMaskProxyModel::removeOverlayLayer(const QString &name)
+{
+    Q_D(RoleMaskProxyModel);
+    const int layerIdx = d->findLayer(name);
+    if (layerIdx < 0)
+        return;
+    const OverlayLayer layer = d->m_layers.takeAt(layerIdx);
+    if (layer.m_enabled) {
+        --d->m_enabledLayers;
+        d->signalLayerChanged(layer.m_id);
+    }
+    d->removeLayerValues(layer.m_id);
+}
+
+/*!
+Returns the names of the overlay layers, the one that takes precedence first
+*/
+QStringList RoleMaskProxyModel::overlayLayers() const
+{
+    Q_D(const RoleMaskProxyModel);
+    QStringList result;
+    result.reserve(d->m_layers.size());
+    for (int i = 0, maxI = d->m_layers.size(); i < maxI; ++i)
+        result.append(d->m_layers.at(i).m_name);
+    return result;
+}
+
+/*!
+Returns true if the overlay layer called \a name exists and its values are shown
+*/
+bool RoleMaskProxyModel::isOverlayLayerEnabled(const QString &name) const
+{
+    Q_D(const RoleMaskProxyModel);
+    const int layerIdx = d->findLayer(name);
+    return layerIdx >= 0 && d->m_layers.at(layerIdx).m_enabled;
+}
+
+/*!
+Shows or hides the values of the overlay layer called \a name.
+
+The values of the layer are kept while it is disabled so toggling it never rewrites the stored data.
+The change is signalled with one dataChanged() for each block of contiguous rows under the same parent that has values in the layer.
+Finding those rows skips the parents that never stored a value in the layer but visits every masked cell of the others.
+*/
+void RoleMaskProxyModel::setOverlayLayerEnabled(const QString &name, bool enabled)
+{
+    Q_D(RoleMaskProxyModel);
+    const int layerIdx = d->findLayer(name);
+    if (layerIdx < 0 || d->m_layers.at(layerIdx).m_enabled == enabled)
+        return;
+    d->m_layers[layerIdx].m_enabled = enabled;
+    if (enabled)
+        ++d->m_enabledLayers;
+    else
+        --d->m_enabledLayers;
+    d->signalLayerChanged(d->m_layers.at(layerIdx).m_id);
+}
+
+/*!
+Returns the priority of the overlay layer called \a name or 0 if no such layer exists
+*/
+int RoleMaskProxyModel::overlayLayerPriority(const QString &name) const
+{
+    Q_D(const RoleMaskProxyModel);
+    const int layerIdx = d->findLayer(name);
+    return layerIdx < 0 ? 0 : d->m_layers.at(layerIdx).m_priority;
+}
+
+/*!
+Changes the priority of the overlay layer called \a name.
+The layer takes precedence over the other layers with the same \a priority.
+*/
+void RoleMaskProxyModel::setOverlayLayerPriority(const QString &name, int priority)
+{
+    Q_D(RoleMaskProxyModel);
+    const int layerIdx = d->findLayer(name);
+    if (layerIdx < 0 || d->m_layers.at(layerIdx).m_priority == priority)
+        return;
+    OverlayLayer layer = d->m_layers.takeAt(layerIdx);
+    layer.m_priority = priority;
+    d->insertLayer(layer);
+    if (layer.m_enabled && d->m_enabledLayers > 1)
+        d->signalLayerChanged(layer.m_id);
+}
+
+/*!
+Sets the \a value of \a role for \a index in the overlay layer called \a layer.
+Passing an invalid \a value removes the \a role from the layer.
+
+Returns false if the layer does not exist or \a role is not managed by the proxy.
+\sa overlayData(), clearOverlayLayer()
+*/
+bool RoleMaskProxyModel::setOverlayData(const QString &layer, const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!index.isValid())
+        return false;
+    Q_ASSERT(index.model() == this);
+    Q_D(RoleMaskProxyModel);
+    const int layerIdx = d->findLayer(layer);
+    if (layerIdx < 0)
+        return false;
+    if (d->m_mergeDisplayEdit && role == Qt::EditRole)
+        role = Qt::DisplayRole;
+    if (!d->m_maskedRoles.contains(role))
+        return false;
+    const int layerId = d->m_layers.at(layerIdx).m_id;
+    const QModelIndex sourceIndex = mapToSource(index);
+    MaskedItem *item = d->maskedItem(sourceIndex);
+    if (value.isValid()) {
+        if (!item) {
+            d->insertData(sourceIndex, FlaggedRolesContainer());
+            item = d->maskedItem(sourceIndex);
+            Q_ASSERT(item);
+        }
+        auto layerIter = item->findLayer(layerId);
+        if (layerIter == item->m_layers.end() || layerIter->m_layer != layerId) {
+            layerIter = item->m_layers.insert(layerIter, LayerValues(layerId));
+            d->parentNode(sourceIndex.parent())->m_overlayLayers.insert(layerId);
+        }
+        const auto roleIter = layerIter->m_roles.find(role);
+        if (roleIter == layerIter->m_roles.end())
+            layerIter->m_roles.insert(role, value);
+        else if (roleIter.value() != value)
+            roleIter.value() = value;
+        else
+            return true;
+    } else {
+        if (!item)
+            return true;
+        const auto layerIter = item->findLayer(layerId);
+        if (layerIter == item->m_layers.end() || layerIter->m_layer != layerId || layerIter->m_roles.remove(role) == 0)
+            return true;
+        if (layerIter->m_roles.isEmpty())
+            item->m_layers.erase(layerIter);
+        if (item->isEmpty())
+            d->removeIndex(sourceIndex);
+    }
+    if (d->m_layers.at(layerIdx).m_enabled) {
+        const QVector<int> changedRoles =
+                ((d->m_mergeDisplayEdit && role == Qt::DisplayRole) ? QVector<int>{{Qt::EditRole, Qt::DisplayRole}} : QVector<int>(1, role));
+        maskedDataChanged(index, index, changedRoles);
+        dataChanged(index, index, changedRoles);
+    }
+    return true;
+}
+
+/*!
+Returns the value of \a role for \a index stored in the overlay layer called \a layer, even if the layer is disabled
+*/
+QVariant RoleMaskProxyModel::overlayData(const QString &layer, const QModelIndex &index, int role) const
 {
+    if (!index.isValid())
+        return QVariant();
+    Q_ASSERT(index.model() == this);
     Q_D(const RoleMaskProxyModel);
-    return d->m_defaultValues.value(role, QVariant());
+    const int layerIdx = d->findLayer(layer);
+    if (layerIdx < 0)
+        return QVariant();
+    if (d->m_mergeDisplayEdit && role == Qt::EditRole)
+        role = Qt::DisplayRole;
+    const int layerId = d->m_layers.at(layerIdx).m_id;
+    const MaskedItem *item = d->maskedItem(mapToSource(index));
+    if (!item)
+        return QVariant();
+    const auto layerIter = item->findLayer(layerId);
+    if (layerIter == item->m_layers.cend() || layerIter->m_layer != layerId)
+        return QVariant();
+    return layerIter->m_roles.value(role, QVariant());
 }
 
-bool RoleMaskProxyModel::setMaskedRoleDefaultValue(int role, const QVariant &value)
+/*!
+Removes all the values stored in the overlay layer called \a layer. The layer itself is kept.
+\sa removeOverlayLayer()
+*/
+void RoleMaskProxyModel::clearOverlayLayer(const QString &layer)
 {
     Q_D(RoleMaskProxyModel);
-    if (!d->m_maskedRoles.contains(role))
-        return false;
-    if (value.isValid())
-        d->m_defaultValues[role] = value;
-    else
-        d->m_defaultValues.remove(role);
-    return true;
+    const int layerIdx = d->findLayer(layer);
+    if (layerIdx < 0)
+        return;
+    const int layerId = d->m_layers.at(layerIdx).m_id;
+    if (d->m_layers.at(layerIdx).m_enabled) {
+        // the layer is hidden while the change is signalled so the receivers already read the cleared values
+        d->m_layers[layerIdx].m_enabled = false;
+        --d->m_enabledLayers;
+        d->signalLayerChanged(layerId);
+        const int currentIdx = d->findLayer(layer);
+        if (currentIdx >= 0 && d->m_layers.at(currentIdx).m_id == layerId && !d->m_layers.at(currentIdx).m_enabled) {
+            d->m_layers[currentIdx].m_enabled = true;
+            ++d->m_enabledLayers;
+        }
+    }
+    d->removeLayerValues(layerId);
 }
 
 /*!
@@ -712,15 +3138,54 @@ void RoleMaskProxyModel::setSourceModel(QAbstractItemModel *sourceMdl)
         QObject::disconnect(*discIter);
     d->m_sourceConnections.clear();
     d->m_masked.clear();
+    d->m_computedCache.clear();
+    d->m_sortedRows.clear();
+    d->invalidateParentKeys();
+    if (sourceMdl) {
+        // connected before the ones of QIdentityProxyModel so the sorted rows and the parent keys are up to date when the proxy forwards
+        // the signals
+        const auto invalidateParentKeys = [d]() -> void { d->invalidateParentKeys(); };
+        d->m_sourceConnections
+                << QObject::connect(sourceMdl, &QAbstractItemModel::rowsInserted, invalidateParentKeys)
+                << QObject::connect(sourceMdl, &QAbstractItemModel::columnsInserted, invalidateParentKeys)
+                << QObject::connect(sourceMdl, &QAbstractItemModel::rowsRemoved, invalidateParentKeys)
+                << QObject::connect(sourceMdl, &QAbstractItemModel::columnsRemoved, invalidateParentKeys)
+                << QObject::connect(sourceMdl, &QAbstractItemModel::rowsMoved, invalidateParentKeys)
+                << QObject::connect(sourceMdl, &QAbstractItemModel::columnsMoved, invalidateParentKeys)
+                << QObject::connect(sourceMdl, &QAbstractItemModel::layoutChanged, invalidateParentKeys)
+                << QObject::connect(sourceMdl, &QAbstractItemModel::modelReset, invalidateParentKeys)
+                << QObject::connect(sourceMdl, &QAbstractItemModel::rowsInserted,
+                                    [d](const QModelIndex &parent, int start, int end) { d->onSortedRowsInserted(parent, start, end); })
+                << QObject::connect(sourceMdl, &QAbstractItemModel::rowsAboutToBeRemoved,
+                                    [d](const QModelIndex &parent, int start, int end) { d->onSortedRowsAboutToBeRemoved(parent, start, end); })
+                << QObject::connect(sourceMdl, &QAbstractItemModel::rowsRemoved,
+                                    [d](const QModelIndex &parent, int start, int end) { d->onSortedRowsRemoved(parent, start, end); })
+                << QObject::connect(sourceMdl, &QAbstractItemModel::columnsRemoved, [d]() -> void { d->removeStaleSortedRows(); })
+                << QObject::connect(sourceMdl, &QAbstractItemModel::rowsAboutToBeMoved,
+                                    [d](const QModelIndex &sourceParent, int, int, const QModelIndex &destinationParent, int) {
+                                        d->onSortedRowsAboutToBeMoved(sourceParent, destinationParent);
+                                    })
+                << QObject::connect(sourceMdl, &QAbstractItemModel::layoutChanged,
+                                    [d](const QList<QPersistentModelIndex> &parents) { d->onSortedLayoutChanged(parents); })
+                << QObject::connect(sourceMdl, &QAbstractItemModel::modelReset, [d]() -> void { d->m_sortedRows.clear(); });
+    }
     QIdentityProxyModel::setSourceModel(sourceMdl);
     if (sourceModel()) {
         Q_ASSUME(sourceModel()->disconnect(SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)), this));
+        Q_ASSUME(sourceModel()->disconnect(SIGNAL(headerDataChanged(Qt::Orientation, int, int)), this));
         d->m_sourceConnections
+                << QObject::connect(sourceModel(), &QAbstractItemModel::headerDataChanged,
+                                    [d](Qt::Orientation orientation, int first, int last) -> void {
+                                        d->interceptHeaderDataChanged(orientation, first, last);
+                                    })
                 << QObject::connect(sourceModel(), &QAbstractItemModel::dataChanged,
                                     [d](const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles) -> void {
                                         d->interceptDataChanged(topLeft, bottomRight, roles);
                                     })
-                << QObject::connect(sourceModel(), &QAbstractItemModel::modelReset, [d]() -> void { d->m_masked.clear(); })
+                << QObject::connect(sourceModel(), &QAbstractItemModel::modelReset, [d]() -> void {
+                                        d->m_masked.clear();
+                                        d->m_computedCache.clear();
+                                    })
                 << QObject::connect(sourceModel(), &QAbstractItemModel::destroyed, [this]() -> void { setSourceModel(Q_NULLPTR); })
                 << QObject::connect(sourceModel(), &QAbstractItemModel::rowsAboutToBeInserted,
                                     [d](const QModelIndex &parent, int start, int end) { d->onRowsAboutToBeInserted(parent, start, end); })
@@ -779,16 +3244,31 @@ void RoleMaskProxyModel::multiData(const QModelIndex &index, QModelRoleDataSpan
     const QModelIndex sourceIndex = mapToSource(index);
     sourceModel()->multiData(sourceIndex, roleDataSpan);
     const FlaggedRolesContainer emptyData;
-    const FlaggedRolesContainer *idxData = d->dataForIndex(sourceIndex);
-    if (!idxData)
-        idxData = &emptyData;
+    const MaskedItem *item = d->maskedItem(sourceIndex);
+    const FlaggedRolesContainer *idxData = item ? &(item->m_data) : &emptyData;
     for (QModelRoleData &roleData : roleDataSpan) {
         int role = roleData.role();
         if (d->m_mergeDisplayEdit && role == Qt::EditRole)
             role = Qt::DisplayRole;
+        const QVariant *layerValue = d->m_maskedRoles.contains(role) ? d->layerData(item, role) : nullptr;
+        if (layerValue) {
+            roleData.setData(*layerValue);
+            continue;
+        }
+        if (d->m_propagateCheckState && role == Qt::CheckStateRole && sourceIndex.column() == 0 && d->m_maskedRoles.contains(role)) {
+            roleData.setData(d->propagatedCheckState(sourceIndex));
+            continue;
+        }
         const auto roleIter = idxData->roles.constFind(role);
-        if (roleIter != idxData->roles.constEnd())
+        if (roleIter != idxData->roles.constEnd()) {
             roleData.setData(roleIter.value());
+            continue;
+        }
+        const QVariant *ruleValue = d->ruleData(sourceIndex, role);
+        if (ruleValue)
+            roleData.setData(*ruleValue);
+        else if (d->m_computedRoles.contains(role))
+            roleData.setData(const_cast<RoleMaskProxyModelPrivate *>(d)->computedData(sourceIndex, role));
         else if (!d->m_transparentIfEmpty && d->m_maskedRoles.contains(role))
             roleData.setData(d->m_defaultValues.value(role, QVariant()));
     }
@@ -807,12 +3287,22 @@ QVariant RoleMaskProxyModel::data(const QModelIndex &proxyIndex, int role) const
     if (!d->m_maskedRoles.contains(adjRole))
         return QIdentityProxyModel::data(proxyIndex, role);
     const QModelIndex sourceIndex = mapToSource(proxyIndex);
-    const FlaggedRolesContainer *idxData = d->dataForIndex(sourceIndex);
-    if (idxData) {
-        const auto roleIter = idxData->roles.constFind(adjRole);
-        if (roleIter != idxData->roles.constEnd())
+    const MaskedItem *item = d->maskedItem(sourceIndex);
+    const QVariant *layerValue = d->layerData(item, adjRole);
+    if (layerValue)
+        return *layerValue;
+    if (d->m_propagateCheckState && role == Qt::CheckStateRole && sourceIndex.column() == 0)
+        return d->propagatedCheckState(sourceIndex);
+    if (item) {
+        const auto roleIter = item->m_data.roles.constFind(adjRole);
+        if (roleIter != item->m_data.roles.constEnd())
             return roleIter.value();
     }
+    const QVariant *ruleValue = d->ruleData(sourceIndex, adjRole);
+    if (ruleValue)
+        return *ruleValue;
+    if (d->m_computedRoles.contains(adjRole))
+        return const_cast<RoleMaskProxyModelPrivate *>(d)->computedData(sourceIndex, adjRole);
     if (d->m_transparentIfEmpty)
         return QIdentityProxyModel::data(proxyIndex, role);
     return d->m_defaultValues.value(role, QVariant());
@@ -828,11 +3318,12 @@ Qt::ItemFlags RoleMaskProxyModel::flags(const QModelIndex &index) const
     Q_D(const RoleMaskProxyModel);
     const QModelIndex sourceIndex = mapToSource(index);
     const FlaggedRolesContainer *idxData = d->dataForIndex(sourceIndex);
-    if (!idxData)
-        return QIdentityProxyModel::flags(index);
-    if (!idxData->flags)
-        return QIdentityProxyModel::flags(index);
-    return *idxData->flags;
+    if (idxData && idxData->flags)
+        return *idxData->flags;
+    const Qt::ItemFlags *ruleFlags = d->ruleFlags(sourceIndex);
+    if (ruleFlags)
+        return *ruleFlags;
+    return QIdentityProxyModel::flags(index);
 }
 
 /*!
@@ -851,6 +3342,13 @@ bool RoleMaskProxyModel::setData(const QModelIndex &proxyIndex, const QVariant &
         return QIdentityProxyModel::setData(proxyIndex, value, role);
     const QModelIndex sourceIndex = mapToSource(proxyIndex);
     Q_ASSERT(sourceIndex.isValid());
+    if (d->m_propagateCheckState && role == Qt::CheckStateRole && sourceIndex.column() == 0 && value.isValid()
+        && (value.toInt() == Qt::Checked || value.toInt() == Qt::Unchecked)) {
+        d->setPropagatedCheckState(sourceIndex, static_cast<Qt::CheckState>(value.toInt()));
+        return true;
+    }
+    if (role == Qt::CheckStateRole && sourceIndex.column() == 0)
+        d->m_checkCountersDirty = true;
     FlaggedRolesContainer *idxData = d->dataForIndex(sourceIndex);
     if (!idxData) {
         if (value.isValid()) {
@@ -902,17 +3400,131 @@ bool RoleMaskProxyModel::setMaskedFlags(const QModelIndex &index, Qt::ItemFlags
     return true;
 }
 
+/*!
+Sets the masked \a value for the \a role on every cell in \a row under \a parent.
+
+The value is stored once for the whole row rather than once per cell and also applies to columns inserted later.
+Data set on an individual cell via setData() takes precedence over row, column and range masks.
+When several masks overlap, the one set last takes precedence.
+Passing an invalid \a value removes the \a role from the row mask.
+
+Returns false if \a role is not managed by the proxy or \a row is out of range.
+\sa setMaskedColumnData(), setMaskedRangeData(), clearMaskedRanges()
+*/
+bool RoleMaskProxyModel::setMaskedRowData(int row, int role, const QVariant &value, const QModelIndex &parent)
+{
+    if (!sourceModel() || row < 0 || row >= rowCount(parent))
+        return false;
+    Q_ASSERT(!parent.isValid() || parent.model() == this);
+    Q_D(RoleMaskProxyModel);
+    const QModelIndex sourceParent = mapToSource(parent);
+    const int sourceRow = d->sourceRow(sourceParent, row);
+    return d->setRuleData(sourceParent, sourceRow, sourceRow, 0, -1, role, value);
+}
+
+/*!
+Sets the masked \a value for the \a role on every cell in \a column under \a parent.
+
+The value is stored once for the whole column rather than once per cell and also applies to rows inserted later.
+\sa setMaskedRowData()
+*/
+bool RoleMaskProxyModel::setMaskedColumnData(int column, int role, const QVariant &value, const QModelIndex &parent)
+{
+    if (!sourceModel() || column < 0 || column >= columnCount(parent))
+        return false;
+    Q_ASSERT(!parent.isValid() || parent.model() == this);
+    Q_D(RoleMaskProxyModel);
+    return d->setRuleData(mapToSource(parent), 0, -1, column, column, role, value);
+}
+
+/*!
+Sets the masked \a value for the \a role on every cell in the rectangle between \a topLeft and \a bottomRight.
+
+The two indexes must share the same parent.
+\sa setMaskedRowData()
+*/
+bool RoleMaskProxyModel::setMaskedRangeData(const QModelIndex &topLeft, const QModelIndex &bottomRight, int role, const QVariant &value)
+{
+    if (!topLeft.isValid() || !bottomRight.isValid() || topLeft.parent() != bottomRight.parent())
+        return false;
+    if (topLeft.row() > bottomRight.row() || topLeft.column() > bottomRight.column())
+        return false;
+    Q_ASSERT(topLeft.model() == this);
+    Q_ASSERT(bottomRight.model() == this);
+    Q_D(RoleMaskProxyModel);
+    const QModelIndex sourceParent = mapToSource(topLeft.parent());
+    // a sorted rectangle covers scattered source rows, every contiguous block becomes a mask of its own
+    const QVector<QPair<int, int>> rowSpans = d->sourceRowSpans(sourceParent, topLeft.row(), bottomRight.row());
+    bool result = true;
+    for (int i = 0, maxI = rowSpans.size(); i < maxI; ++i) {
+        result = d->setRuleData(sourceParent, rowSpans.at(i).first, rowSpans.at(i).second, topLeft.column(), bottomRight.column(), role, value)
+                && result;
+    }
+    return result;
+}
+
+/*!
+Sets custom \a flags for every cell in \a row under \a parent that override the ones from the source model
+\sa setMaskedRowData()
+*/
+bool RoleMaskProxyModel::setMaskedRowFlags(int row, Qt::ItemFlags flags, const QModelIndex &parent)
+{
+    if (!sourceModel() || row < 0 || row >= rowCount(parent))
+        return false;
+    Q_ASSERT(!parent.isValid() || parent.model() == this);
+    Q_D(RoleMaskProxyModel);
+    const QModelIndex sourceParent = mapToSource(parent);
+    const int sourceRow = d->sourceRow(sourceParent, row);
+    return d->setRuleFlags(sourceParent, sourceRow, sourceRow, 0, -1, flags);
+}
+
+/*!
+Sets custom \a flags for every cell in \a column under \a parent that override the ones from the source model
+\sa setMaskedColumnData()
+*/
+bool RoleMaskProxyModel::setMaskedColumnFlags(int column, Qt::ItemFlags flags, const QModelIndex &parent)
+{
+    if (!sourceModel() || column < 0 || column >= columnCount(parent))
+        return false;
+    Q_ASSERT(!parent.isValid() || parent.model() == this);
+    Q_D(RoleMaskProxyModel);
+    return d->setRuleFlags(mapToSource(parent), 0, -1, column, column, flags);
+}
+
+/*!
+Sets custom \a flags for every cell in the rectangle between \a topLeft and \a bottomRight that override the ones from the source model
+\sa setMaskedRangeData()
+*/
+bool RoleMaskProxyModel::setMaskedRangeFlags(const QModelIndex &topLeft, const QModelIndex &bottomRight, Qt::ItemFlags flags)
+{
+    if (!topLeft.isValid() || !bottomRight.isValid() || topLeft.parent() != bottomRight.parent())
+        return false;
+    if (topLeft.row() > bottomRight.row() || topLeft.column() > bottomRight.column())
+        return false;
+    Q_ASSERT(topLeft.model() == this);
+    Q_ASSERT(bottomRight.model() == this);
+    Q_D(RoleMaskProxyModel);
+    const QModelIndex sourceParent = mapToSource(topLeft.parent());
+    const QVector<QPair<int, int>> rowSpans = d->sourceRowSpans(sourceParent, topLeft.row(), bottomRight.row());
+    bool result = true;
+    for (int i = 0, maxI = rowSpans.size(); i < maxI; ++i)
+        result = d->setRuleFlags(sourceParent, rowSpans.at(i).first, rowSpans.at(i).second, topLeft.column(), bottomRight.column(), flags) && result;
+    return result;
+}
+
 /*!
 \reimp
 */
 bool RoleMaskProxyModel::setHeaderData(int section, Qt::Orientation orientation, const QVariant &value, int role)
 {
     Q_D(RoleMaskProxyModel);
+    // the vertical headers follow the rows when they are sorted
+    const int sourceSection = orientation == Qt::Vertical ? d->sourceRow(QModelIndex(), section) : section;
     if (d->m_maskHeaderData && d->m_maskedRoles.contains(role)) {
         QVector<RolesContainer> &dataContainerVect = orientation == Qt::Horizontal ? d->m_hHeaderData : d->m_vHeaderData;
-        if (section < 0 || section >= dataContainerVect.size())
+        if (sourceSection < 0 || sourceSection >= dataContainerVect.size())
             return false;
-        RolesContainer &dataContainer = dataContainerVect[section];
+        RolesContainer &dataContainer = dataContainerVect[sourceSection];
         auto dataIter = dataContainer.find(role);
         if (dataIter == dataContainer.end()) {
             if (value.isValid()) {
@@ -930,20 +3542,183 @@ bool RoleMaskProxyModel::setHeaderData(int section, Qt::Orientation orientation,
         }
         return true;
     }
+    if (sourceSection != section)
+        return sourceModel()->setHeaderData(sourceSection, orientation, value, role);
     return QIdentityProxyModel::setHeaderData(section, orientation, value, role);
 }
 
 /*!
 \reimp
-\details This method will do nothing.
+\details Sorts the rows under every parent by the value of sortRole() in \a column, masked values included.
+
+The source model is not touched: the proxy reads every key once and keeps its own order of the rows on top of the source one.
+Masked data stays attached to the source rows so it follows them without being moved.
+The order is not kept up to date when the data changes. Rows inserted in the source appear where they were inserted,
+removing rows keeps the order of the others while moving rows or a layout change in the source restores the source order of the parents involved.
+
+Passing a negative \a column restores the source order everywhere.
+\sa sortRole
+*/
+void RoleMaskProxyModel::sort(int column, Qt::SortOrder order)
+{
+    if (!sourceModel())
+        return;
+    Q_D(RoleMaskProxyModel);
+    if (column < 0 && d->m_sortedRows.isEmpty())
+        return;
+    d->sortedRowsAboutToBeChanged(QList<QPersistentModelIndex>());
+    d->m_sortedRows.clear();
+    if (column >= 0)
+        d->sortRows(QModelIndex(), column, order);
+    d->sortedRowsChanged(QList<QPersistentModelIndex>());
+}
+
+/*!
+\reimp
+*/
+QModelIndex RoleMaskProxyModel::index(int row, int column, const QModelIndex &parent) const
+{
+    Q_D(const RoleMaskProxyModel);
+    if (d->m_sortedRows.isEmpty())
+        return QIdentityProxyModel::index(row, column, parent);
+    Q_ASSERT(!parent.isValid() || parent.model() == this);
+    const QModelIndex sourceParent = mapToSource(parent);
+    const SortedRows *sorted = d->sortedRows(sourceParent);
+    if (!sorted)
+        return QIdentityProxyModel::index(row, column, parent);
+    if (row < 0 || row >= sorted->m_proxyToSource.size())
+        return QModelIndex();
+    const QModelIndex sourceIndex = sourceModel()->index(sorted->m_proxyToSource.at(row), column, sourceParent);
+    if (!sourceIndex.isValid())
+        return QModelIndex();
+    return createIndex(row, column, sourceIndex.internalPointer());
+}
+
+/*!
+\reimp
+*/
+QModelIndex RoleMaskProxyModel::sibling(int row, int column, const QModelIndex &idx) const
+{
+    Q_D(const RoleMaskProxyModel);
+    if (d->m_sortedRows.isEmpty() || !idx.isValid())
+        return QIdentityProxyModel::sibling(row, column, idx);
+    return index(row, column, idx.parent());
+}
+
+/*!
+\reimp
+*/
+QModelIndex RoleMaskProxyModel::mapToSource(const QModelIndex &proxyIndex) const
+{
+    Q_D(const RoleMaskProxyModel);
+    const QModelIndex sourceIndex = QIdentityProxyModel::mapToSource(proxyIndex);
+    if (d->m_sortedRows.isEmpty() || !sourceIndex.isValid())
+        return sourceIndex;
+    // the row of the proxy might not be the one in the source but the parent is the same
+    const QModelIndex sourceParent = sourceIndex.parent();
+    const SortedRows *sorted = d->sortedRows(sourceParent);
+    if (!sorted || proxyIndex.row() >= sorted->m_proxyToSource.size())
+        return sourceIndex;
+    return sourceModel()->index(sorted->m_proxyToSource.at(proxyIndex.row()), proxyIndex.column(), sourceParent);
+}
+
+/*!
+\reimp
+*/
+QModelIndex RoleMaskProxyModel::mapFromSource(const QModelIndex &sourceIndex) const
+{
+    Q_D(const RoleMaskProxyModel);
+    if (d->m_sortedRows.isEmpty() || !sourceIndex.isValid())
+        return QIdentityProxyModel::mapFromSource(sourceIndex);
+    const SortedRows *sorted = d->sortedRows(sourceIndex.parent());
+    if (!sorted || sourceIndex.row() >= sorted->m_sourceToProxy.size())
+        return QIdentityProxyModel::mapFromSource(sourceIndex);
+    return createIndex(sorted->m_sourceToProxy.at(sourceIndex.row()), sourceIndex.column(), sourceIndex.internalPointer());
+}
+
+/*!
+\reimp
+*/
+QItemSelection RoleMaskProxyModel::mapSelectionToSource(const QItemSelection &selection) const
+{
+    Q_D(const RoleMaskProxyModel);
+    if (d->m_sortedRows.isEmpty())
+        return QIdentityProxyModel::mapSelectionToSource(selection);
+    QItemSelection sourceSelection;
+    for (int i = 0, maxI = selection.size(); i < maxI; ++i) {
+        const QItemSelectionRange &range = selection.at(i);
+        if (!range.isValid())
+            continue;
+        const QModelIndex sourceParent = mapToSource(range.parent());
+        const QVector<QPair<int, int>> rowSpans = d->sourceRowSpans(sourceParent, range.top(), range.bottom());
+        for (int j = 0, maxJ = rowSpans.size(); j < maxJ; ++j) {
+            sourceSelection.append(QItemSelectionRange(sourceModel()->index(rowSpans.at(j).first, range.left(), sourceParent),
+                                                       sourceModel()->index(rowSpans.at(j).second, range.right(), sourceParent)));
+        }
+    }
+    return sourceSelection;
+}
+
+/*!
+\reimp
+*/
+QItemSelection RoleMaskProxyModel::mapSelectionFromSource(const QItemSelection &selection) const
+{
+    Q_D(const RoleMaskProxyModel);
+    if (d->m_sortedRows.isEmpty())
+        return QIdentityProxyModel::mapSelectionFromSource(selection);
+    QItemSelection proxySelection;
+    for (int i = 0, maxI = selection.size(); i < maxI; ++i) {
+        const QItemSelectionRange &range = selection.at(i);
+        if (!range.isValid())
+            continue;
+        const QModelIndex proxyParent = mapFromSource(range.parent());
+        const QVector<QPair<int, int>> rowSpans = d->proxyRowSpans(range.parent(), range.top(), range.bottom());
+        for (int j = 0, maxJ = rowSpans.size(); j < maxJ; ++j) {
+            proxySelection.append(QItemSelectionRange(index(rowSpans.at(j).first, range.left(), proxyParent),
+                                                      index(rowSpans.at(j).second, range.right(), proxyParent)));
+        }
+    }
+    return proxySelection;
+}
+
+/*!
+\reimp
+\details If the rows under \a parent are sorted, the rows are removed from the source in contiguous blocks
+*/
+bool RoleMaskProxyModel::removeRows(int row, int count, const QModelIndex &parent)
+{
+    Q_D(RoleMaskProxyModel);
+    if (!sourceModel())
+        return false;
+    const QModelIndex sourceParent = mapToSource(parent);
+    if (!d->sortedRows(sourceParent))
+        return QIdentityProxyModel::removeRows(row, count, parent);
+    if (row < 0 || count <= 0 || row + count > rowCount(parent))
+        return false;
+    const QVector<QPair<int, int>> rowSpans = d->sourceRowSpans(sourceParent, row, row + count - 1);
+    bool result = true;
+    // removing from the bottom keeps the blocks still to remove where they are
+    for (int i = rowSpans.size() - 1; i >= 0; --i)
+        result = sourceModel()->removeRows(rowSpans.at(i).first, rowSpans.at(i).second - rowSpans.at(i).first + 1, sourceParent) && result;
+    return result;
+}
 
-If you want to sort based on the marked data use a QSortFilterProxyModel
-on top of this proxy.
+/*!
+\reimp
+\details Moving rows is not supported if the rows under either parent are sorted
 */
-void RoleMaskProxyModel::sort(int column, Qt::SortOrder order) { }
+bool RoleMaskProxyModel::moveRows(const QModelIndex &sourceParent, int sourceRow, int count, const QModelIndex &destinationParent,
+                                  int destinationChild)
+{
+    Q_D(const RoleMaskProxyModel);
+    if (d->sortedRows(mapToSource(sourceParent)) || d->sortedRows(mapToSource(destinationParent)))
+        return false;
+    return QIdentityProxyModel::moveRows(sourceParent, sourceRow, count, destinationParent, destinationChild);
+}
 
 /*!
-Removes all the data managed by the proxy model for a certain \a index.
+Removes all the data managed by the proxy model for a certain \a index, including the values of the overlay layers.
 */
 void RoleMaskProxyModel::clearMaskedData(const QModelIndex &index)
 {
@@ -952,13 +3727,18 @@ void RoleMaskProxyModel::clearMaskedData(const QModelIndex &index)
     Q_ASSERT(index.model() == this);
     Q_D(RoleMaskProxyModel);
     const QModelIndex sourceIndex = mapToSource(index);
-    const FlaggedRolesContainer *maskedIter = d->dataForIndex(sourceIndex);
-    if (!maskedIter)
+    const MaskedItem *item = d->maskedItem(sourceIndex);
+    if (!item)
         return;
-    Q_ASSERT(!maskedIter->roles.isEmpty());
-    const QList<int> changedRolesList = maskedIter->roles.keys();
+    RolesContainer changedData = item->m_data.roles;
+    d->mergeLayerData(item, changedData);
+    Q_ASSERT(!changedData.isEmpty() || !item->m_layers.isEmpty());
+    const QList<int> changedRolesList = changedData.keys();
     const QVector<int> changedRoles = changedRolesList.toVector();
     Q_ASSUME(d->removeIndex(sourceIndex));
+    // only disabled layers had values for this index
+    if (changedRoles.isEmpty())
+        return;
     maskedDataChanged(index, index, changedRoles);
     dataChanged(index, index, changedRoles);
 }
@@ -982,6 +3762,189 @@ void RoleMaskProxyModel::clearMaskedFlags(const QModelIndex &index)
     dataChanged(index, index); // Dirty way to signal the flag changed
 }
 
+/*!
+Removes all the row, column and range masks set on the children of \a parent.
+\sa setMaskedRowData(), setMaskedColumnData(), setMaskedRangeData()
+*/
+void RoleMaskProxyModel::clearMaskedRanges(const QModelIndex &parent)
+{
+    Q_ASSERT(!parent.isValid() || parent.model() == this);
+    Q_D(RoleMaskProxyModel);
+    const QModelIndex sourceParent = mapToSource(parent);
+    MaskedParent *node = d->parentNode(sourceParent);
+    if (!node || node->m_rules.isEmpty())
+        return;
+    const QVector<MaskedRule> rules = node->m_rules;
+    node->m_rules.clear();
+    node->invalidateRuleIndex();
+    d->m_checkCountersDirty = true;
+    d->pruneParentNode(sourceParent);
+    for (int i = 0, maxI = rules.size(); i < maxI; ++i) {
+        QVector<int> changedRoles = rules.at(i).m_data.roles.keys().toVector();
+        if (d->m_mergeDisplayEdit && changedRoles.contains(Qt::DisplayRole))
+            changedRoles << Qt::EditRole;
+        d->signalRuleChanged(sourceParent, rules.at(i), changedRoles);
+    }
+}
+
+/*!
+Writes the masked values stored for the children of \a parent into the source model and removes them from the proxy.
+
+Only the values set on individual cells are written, row, column and range masks and overlay layers are left untouched.
+If \a roles is empty every masked role is written. If \a recursive is true the whole subtree of \a parent is written.
+
+Every cell is written with a single QAbstractItemModel::setItemData() call. The values of the cells the source model rejects stay in the proxy.
+Once all the cells are written the proxy emits one dataChanged() for each block of contiguous rows under the same parent.
+
+Returns false if the source model rejected any of the values.
+\sa clearMaskedData()
+*/
+bool RoleMaskProxyModel::commitToSource(const QList<int> &roles, const QModelIndex &parent, bool recursive)
+{
+    if (!sourceModel())
+        return false;
+    Q_ASSERT(!parent.isValid() || parent.model() == this);
+    Q_D(RoleMaskProxyModel);
+    QSet<int> committedRoles;
+    for (int i = 0, maxI = roles.size(); i < maxI; ++i) {
+        const int role = (d->m_mergeDisplayEdit && roles.at(i) == Qt::EditRole) ? int(Qt::DisplayRole) : roles.at(i);
+        if (d->m_maskedRoles.contains(role))
+            committedRoles.insert(role);
+    }
+    if (roles.isEmpty())
+        committedRoles = d->m_maskedRoles;
+    if (committedRoles.contains(Qt::CheckStateRole))
+        d->m_checkCountersDirty = true;
+    if (committedRoles.isEmpty())
+        return true;
+    struct PendingCell
+    {
+        QPersistentModelIndex m_index;
+        RolesContainer m_roles;
+    };
+    // the values are copied out first as writing to the source triggers signals that read the masked data
+    QVector<PendingCell> pendingCells;
+    QVector<QPersistentModelIndex> parents{QPersistentModelIndex(mapToSource(parent))};
+    for (int h = 0; h < parents.size(); ++h) {
+        const MaskedParent *node = d->parentNode(parents.at(h));
+        if (!node)
+            continue;
+        for (int i = 0, maxI = node->m_rows.size(); i < maxI; ++i) {
+            const MaskedRow &row = node->m_rows.at(i);
+            for (int j = 0, maxJ = row.m_items.size(); j < maxJ; ++j) {
+                PendingCell cell;
+                const RolesContainer &itemRoles = row.m_items.at(j).m_data.roles;
+                for (auto roleIter = itemRoles.cbegin(), roleEnd = itemRoles.cend(); roleIter != roleEnd; ++roleIter) {
+                    if (committedRoles.contains(roleIter.key()))
+                        cell.m_roles.insert(roleIter.key(), roleIter.value());
+                }
+                if (cell.m_roles.isEmpty())
+                    continue;
+                cell.m_index = sourceModel()->index(row.m_row, row.m_items.at(j).m_column, parents.at(h));
+                pendingCells.append(cell);
+            }
+        }
+        if (recursive)
+            parents << node->m_children;
+    }
+    bool result = true;
+    for (int i = 0; i < pendingCells.size();) {
+        const PendingCell &cell = pendingCells.at(i);
+        if (cell.m_index.isValid() && sourceModel()->setItemData(cell.m_index, convertFromContainer<QMap<int, QVariant>>(cell.m_roles))) {
+            ++i;
+            continue;
+        }
+        result = false;
+        pendingCells.remove(i);
+    }
+    QVector<ChangedCells> changes;
+    for (int i = 0, maxI = pendingCells.size(); i < maxI; ++i) {
+        const PendingCell &cell = pendingCells.at(i);
+        MaskedItem *item = d->maskedItem(cell.m_index);
+        if (!item)
+            continue;
+        RolesContainer removedRoles;
+        for (auto roleIter = cell.m_roles.cbegin(), roleEnd = cell.m_roles.cend(); roleIter != roleEnd; ++roleIter) {
+            // a value changed while the source was written is newer than the one committed
+            const auto itemIter = item->m_data.roles.find(roleIter.key());
+            if (itemIter == item->m_data.roles.end() || itemIter.value() != roleIter.value())
+                continue;
+            item->m_data.roles.erase(itemIter);
+            removedRoles.insert(roleIter.key(), roleIter.value());
+        }
+        if (item->isEmpty())
+            d->removeIndex(cell.m_index);
+        if (removedRoles.isEmpty())
+            continue;
+        const QPersistentModelIndex cellParent(cell.m_index.parent());
+        if (changes.isEmpty() || changes.last().m_parent != cellParent)
+            changes.append(ChangedCells(cellParent));
+        changes.last().addCell(cell.m_index.row(), cell.m_index.column(), removedRoles);
+    }
+    d->signalCellsChanged(changes);
+    return result;
+}
+
+/*!
+Saves the data managed by the proxy model to \a destination.
+
+Only the stored values are written: the data and flags set on individual cells, the row, column and range masks, the overlay layers,
+the masked header data, the default values and the masked roles. Cells are identified by their position in the source model.
+The stream starts with the QDataStream version used to write it, like the one produced by BinaryModelSerialiser.
+
+If \a destination is not open it will be opened in write only mode.
+\sa loadMaskedData()
+*/
+bool RoleMaskProxyModel::saveMaskedData(QIODevice *destination) const
+{
+    if (!destination)
+        return false;
+    if (!destination->isOpen()) {
+        if (!destination->open(QIODevice::WriteOnly))
+            return false;
+    }
+    if (!destination->isWritable())
+        return false;
+    Q_D(const RoleMaskProxyModel);
+    QDataStream writer(destination);
+    d->writeMaskedData(writer);
+    return writer.status() == QDataStream::Ok;
+}
+
+/*!
+Replaces the data managed by the proxy model with the one saved by saveMaskedData() in \a source.
+
+The roles saved are added to the masked roles and the overlay layers are matched by name.
+Values saved for cells that do not exist in the current source model are discarded.
+If the data can not be read the proxy model is left unchanged and false is returned.
+
+If \a source is not open it will be opened in read only mode.
+\sa saveMaskedData()
+*/
+bool RoleMaskProxyModel::loadMaskedData(QIODevice *source)
+{
+    if (!source || !sourceModel())
+        return false;
+    if (!source->isOpen()) {
+        if (!source->open(QIODevice::ReadOnly))
+            return false;
+    }
+    if (!source->isReadable())
+        return false;
+    Q_D(RoleMaskProxyModel);
+    QDataStream reader(source);
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 7, 0))
+    reader.startTransaction();
+    if (!d->readMaskedData(reader)) {
+        reader.rollbackTransaction();
+        return false;
+    }
+    return reader.commitTransaction();
+#else
+    return d->readMaskedData(reader);
+#endif
+}
+
 #if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
 /*!
 \reimp
@@ -1021,6 +3984,8 @@ bool RoleMaskProxyModel::setItemData(const QModelIndex &index, const QMap<int, Q
     }
     const QModelIndex sourceIndex = mapToSource(index);
     Q_ASSERT(sourceIndex.isValid());
+    if (sourceIndex.column() == 0 && adjustedRoles.contains(Qt::CheckStateRole))
+        d->m_checkCountersDirty = true;
     QMap<int, QVariant> rolesForSource;
     QVector<int> changedRoles;
     changedRoles.reserve(adjustedRoles.size());
@@ -1074,13 +4039,18 @@ QMap<int, QVariant> RoleMaskProxyModel::itemData(const QModelIndex &index) const
     Q_D(const RoleMaskProxyModel);
     RolesContainer result;
     const QModelIndex sourceIdx = mapToSource(index);
-    const FlaggedRolesContainer *maskedData = d->dataForIndex(sourceIdx);
-    if (maskedData) {
-        result = maskedData->roles;
-        const auto displayIter = result.constFind(Qt::DisplayRole);
-        if (d->m_mergeDisplayEdit && displayIter != result.cend())
-            result.insert(Qt::EditRole, displayIter.value());
+    const MaskedItem *item = d->maskedItem(sourceIdx);
+    if (item)
+        result = item->m_data.roles;
+    d->mergeLayerData(item, result);
+    d->mergeRuleData(sourceIdx, result);
+    for (auto roleIter = d->m_computedRoles.cbegin(), roleEnd = d->m_computedRoles.cend(); roleIter != roleEnd; ++roleIter) {
+        if (!result.contains(roleIter.key()))
+            result.insert(roleIter.key(), const_cast<RoleMaskProxyModelPrivate *>(d)->computedData(sourceIdx, roleIter.key()));
     }
+    const auto displayIter = result.constFind(Qt::DisplayRole);
+    if (d->m_mergeDisplayEdit && displayIter != result.cend())
+        result.insert(Qt::EditRole, displayIter.value());
     const QMap<int, QVariant> baseData = sourceModel()->itemData(sourceIdx);
     for (auto i = baseData.cbegin(), baseEnd = baseData.cend(); i != baseEnd; ++i) {
         if (!result.contains(i.key()) && (!d->m_maskedRoles.contains(i.key()) || d->m_transparentIfEmpty))
@@ -1092,6 +4062,13 @@ QMap<int, QVariant> RoleMaskProxyModel::itemData(const QModelIndex &index) const
                 result.insert(i.key(), i.value());
         }
     }
+    if (d->m_propagateCheckState && sourceIdx.column() == 0 && d->m_maskedRoles.contains(Qt::CheckStateRole)) {
+        const QVariant checkState = d->propagatedCheckState(sourceIdx);
+        if (checkState.isValid())
+            result.insert(Qt::CheckStateRole, checkState);
+        else
+            result.remove(Qt::CheckStateRole);
+    }
     return convertFromContainer<QMap<int, QVariant>>(result);
 }
 
@@ -1101,17 +4078,20 @@ QMap<int, QVariant> RoleMaskProxyModel::itemData(const QModelIndex &index) const
 QVariant RoleMaskProxyModel::headerData(int section, Qt::Orientation orientation, int role) const
 {
     Q_D(const RoleMaskProxyModel);
+    const int sourceSection = orientation == Qt::Vertical ? d->sourceRow(QModelIndex(), section) : section;
     if (d->m_maskHeaderData && d->m_maskedRoles.contains(role)) {
         const QVector<RolesContainer> &dataContainerVect = orientation == Qt::Horizontal ? d->m_hHeaderData : d->m_vHeaderData;
-        if (section < 0 || section >= dataContainerVect.size())
+        if (sourceSection < 0 || sourceSection >= dataContainerVect.size())
             return QVariant();
-        const RolesContainer &dataContainer = dataContainerVect.at(section);
+        const RolesContainer &dataContainer = dataContainerVect.at(sourceSection);
         const auto roleIter = dataContainer.constFind(role);
         if (roleIter != dataContainer.constEnd())
             return *roleIter;
         if (!d->m_transparentIfEmpty)
             return QVariant();
     }
+    if (sourceSection != section)
+        return sourceModel()->headerData(sourceSection, orientation, role);
     return QIdentityProxyModel::headerData(section, orientation, role);
 }
 
@@ -1121,10 +4101,14 @@ Returns all the data managed by the proxy model for a certain \a index. The key
 QMap<int, QVariant> RoleMaskProxyModel::maskedItemData(const QModelIndex &index) const
 {
     Q_D(const RoleMaskProxyModel);
-    const FlaggedRolesContainer *maskedData = d->dataForIndex(mapToSource(index));
-    if (!maskedData)
-        return QMap<int, QVariant>();
-    return convertFromContainer<QMap<int, QVariant>>(maskedData->roles);
+    const QModelIndex sourceIndex = mapToSource(index);
+    const MaskedItem *item = d->maskedItem(sourceIndex);
+    RolesContainer result;
+    if (item)
+        result = item->m_data.roles;
+    d->mergeLayerData(item, result);
+    d->mergeRuleData(sourceIndex, result);
+    return convertFromContainer<QMap<int, QVariant>>(result);
 }
 
 /*!
@@ -1133,10 +4117,11 @@ Returns the flags managed by the proxy model for a certain \a index or nullptr i
 const Qt::ItemFlags *RoleMaskProxyModel::maskedFlags(const QModelIndex &index) const
 {
     Q_D(const RoleMaskProxyModel);
-    const FlaggedRolesContainer *maskedData = d->dataForIndex(mapToSource(index));
-    if (!maskedData)
-        return nullptr;
-    return maskedData->flags.get();
+    const QModelIndex sourceIndex = mapToSource(index);
+    const FlaggedRolesContainer *maskedData = d->dataForIndex(sourceIndex);
+    if (maskedData && maskedData->flags)
+        return maskedData->flags.get();
+    return d->ruleFlags(sourceIndex);
 }
 
 /*!
@@ -1199,6 +4184,60 @@ void RoleMaskProxyModel::setMaskHeaderData(bool val)
         headerDataChanged(Qt::Vertical, 0, rowCnt - 1);
 }
 
+/*!
+\property RoleMaskProxyModel::propagateCheckState
+\accessors %propagateCheckState(), setPropagateCheckState()
+\notifier propagateCheckStateChanged()
+\brief This property determines if Qt::CheckStateRole should propagate through the hierarchy of the model
+\details When this property is set to true, setting Qt::Checked or Qt::Unchecked on an item of the first column stores the state
+on that item only and every descendant without a state of its own inherits it when read.
+Items whose descendants hold a different state report Qt::PartiallyChecked and a parent whose children all end up in the same state takes
+that state itself. Every masked parent keeps a count of the checked and unchecked states stored below it and setting a state only updates
+the counters of the ancestors of the item, so the stored data changes in time proportional to the depth of the item.
+The notification still emits one dataChanged() for every populated level below the item.
+
+Enabling this property adds Qt::CheckStateRole to the masked roles. By default this property is set to false
+*/
+bool RoleMaskProxyModel::propagateCheckState() const
+{
+    Q_D(const RoleMaskProxyModel);
+    return d->m_propagateCheckState;
+}
+
+void RoleMaskProxyModel::setPropagateCheckState(bool val)
+{
+    Q_D(RoleMaskProxyModel);
+    if (d->m_propagateCheckState == val)
+        return;
+    d->m_propagateCheckState = val;
+    if (val)
+        addMaskedRole(Qt::CheckStateRole);
+    propagateCheckStateChanged(d->m_propagateCheckState);
+    d->signalAllChanged(QVector<int>(1, Qt::CheckStateRole));
+}
+
+/*!
+\property RoleMaskProxyModel::sortRole
+\accessors %sortRole(), setSortRole()
+\notifier sortRoleChanged()
+\brief This property holds the role whose data is compared by sort()
+\details Changing this property does not sort the model again. By default this property is set to Qt::DisplayRole
+*/
+int RoleMaskProxyModel::sortRole() const
+{
+    Q_D(const RoleMaskProxyModel);
+    return d->m_sortRole;
+}
+
+void RoleMaskProxyModel::setSortRole(int role)
+{
+    Q_D(RoleMaskProxyModel);
+    if (d->m_sortRole == role)
+        return;
+    d->m_sortRole = role;
+    sortRoleChanged(d->m_sortRole);
+}
+
 /*!
 \property RoleMaskProxyModel::mergeDisplayEdit
 \accessors %mergeDisplayEdit(), setMergeDisplayEdit()
@@ -1239,8 +4278,15 @@ void RoleMaskProxyModel::setMergeDisplayEdit(bool val)
     if (d->m_mergeDisplayEdit != val) {
         QVector<int> changedRoles({Qt::DisplayRole, Qt::EditRole});
         d->m_mergeDisplayEdit = val;
-        for (auto idxIter = d->m_masked.begin(), idxEnd = d->m_masked.end(); idxIter != idxEnd; ++idxIter)
-            setMergeDisplayEditContainer(idxIter->m_data.roles);
+        for (auto nodeIter = d->m_masked.begin(), nodeEnd = d->m_masked.end(); nodeIter != nodeEnd; ++nodeIter) {
+            for (int i = 0, maxI = nodeIter->m_rows.size(); i < maxI; ++i) {
+                QVector<MaskedItem> &items = nodeIter->m_rows[i].m_items;
+                for (int j = 0, maxJ = items.size(); j < maxJ; ++j)
+                    setMergeDisplayEditContainer(items[j].m_data.roles);
+            }
+            for (int i = 0, maxI = nodeIter->m_rules.size(); i < maxI; ++i)
+                setMergeDisplayEditContainer(nodeIter->m_rules[i].m_data.roles);
+        }
         if (val)
             d->m_maskedRoles.remove(Qt::EditRole);
         else if (d->m_maskedRoles.contains(Qt::DisplayRole))
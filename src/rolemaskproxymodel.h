@@ -16,17 +16,23 @@
 #include <QIdentityProxyModel>
 #include <QList>
 #include <QSet>
+#include <QStringList>
+#include <functional>
 class RoleMaskProxyModelPrivate;
+class QIODevice;
 class MODELUTILITIES_EXPORT RoleMaskProxyModel : public QIdentityProxyModel
 {
     Q_OBJECT
     Q_PROPERTY(bool transparentIfEmpty READ transparentIfEmpty WRITE setTransparentIfEmpty NOTIFY transparentIfEmptyChanged)
     Q_PROPERTY(bool mergeDisplayEdit READ mergeDisplayEdit WRITE setMergeDisplayEdit NOTIFY mergeDisplayEditChanged)
     Q_PROPERTY(bool maskHeaderData READ maskHeaderData WRITE setMaskHeaderData NOTIFY maskHeaderDataChanged)
+    Q_PROPERTY(bool propagateCheckState READ propagateCheckState WRITE setPropagateCheckState NOTIFY propagateCheckStateChanged)
+    Q_PROPERTY(int sortRole READ sortRole WRITE setSortRole NOTIFY sortRoleChanged)
     Q_PROPERTY(QList<int> maskedRoles READ maskedRoles WRITE setMaskedRoles NOTIFY maskedRolesChanged RESET clearMaskedRoles)
     Q_DISABLE_COPY(RoleMaskProxyModel)
     Q_DECLARE_PRIVATE(RoleMaskProxyModel)
 public:
+    typedef std::function<QVariant(const QModelIndex &)> RoleFunction;
     explicit RoleMaskProxyModel(QObject *parent = Q_NULLPTR);
     ~RoleMaskProxyModel();
     QList<int> maskedRoles() const;
@@ -36,11 +42,38 @@ public:
     void removeMaskedRole(int role);
     QVariant maskedRoleDefaultValue(int role) const;
     bool setMaskedRoleDefaultValue(int role, const QVariant &value);
+    void setComputedRole(int role, const RoleFunction &function, const QList<int> &dependsOnRoles = QList<int>());
+    void removeComputedRole(int role);
+    QList<int> computedRoles() const;
+    bool addOverlayLayer(const QString &name, int priority = 0);
+    void removeOverlayLayer(const QString &name);
+    QStringList overlayLayers() const;
+    bool isOverlayLayerEnabled(const QString &name) const;
+    void setOverlayLayerEnabled(const QString &name, bool enabled);
+    int overlayLayerPriority(const QString &name) const;
+    void setOverlayLayerPriority(const QString &name, int priority);
+    bool setOverlayData(const QString &layer, const QModelIndex &index, const QVariant &value, int role = Qt::EditRole);
+    QVariant overlayData(const QString &layer, const QModelIndex &index, int role = Qt::DisplayRole) const;
+    void clearOverlayLayer(const QString &layer);
     void setSourceModel(QAbstractItemModel *sourceModel) override;
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex sibling(int row, int column, const QModelIndex &idx) const override;
+    QModelIndex mapToSource(const QModelIndex &proxyIndex) const override;
+    QModelIndex mapFromSource(const QModelIndex &sourceIndex) const override;
+    QItemSelection mapSelectionToSource(const QItemSelection &selection) const override;
+    QItemSelection mapSelectionFromSource(const QItemSelection &selection) const override;
+    bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex()) override;
+    bool moveRows(const QModelIndex &sourceParent, int sourceRow, int count, const QModelIndex &destinationParent, int destinationChild) override;
     QVariant data(const QModelIndex &proxyIndex, int role = Qt::DisplayRole) const override;
     Qt::ItemFlags flags(const QModelIndex &index) const override;
     bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
     bool setMaskedFlags(const QModelIndex &index, Qt::ItemFlags flags);
+    bool setMaskedRowData(int row, int role, const QVariant &value, const QModelIndex &parent = QModelIndex());
+    bool setMaskedColumnData(int column, int role, const QVariant &value, const QModelIndex &parent = QModelIndex());
+    bool setMaskedRangeData(const QModelIndex &topLeft, const QModelIndex &bottomRight, int role, const QVariant &value);
+    bool setMaskedRowFlags(int row, Qt::ItemFlags flags, const QModelIndex &parent = QModelIndex());
+    bool setMaskedColumnFlags(int column, Qt::ItemFlags flags, const QModelIndex &parent = QModelIndex());
+    bool setMaskedRangeFlags(const QModelIndex &topLeft, const QModelIndex &bottomRight, Qt::ItemFlags flags);
     bool setItemData(const QModelIndex &index, const QMap<int, QVariant> &roles) override;
     QMap<int, QVariant> itemData(const QModelIndex &index) const override;
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
@@ -54,16 +87,26 @@ public:
     const Qt::ItemFlags *maskedFlags(const QModelIndex &index) const;
     void clearMaskedData(const QModelIndex &index);
     void clearMaskedFlags(const QModelIndex &index);
+    void clearMaskedRanges(const QModelIndex &parent = QModelIndex());
+    bool commitToSource(const QList<int> &roles = QList<int>(), const QModelIndex &parent = QModelIndex(), bool recursive = true);
+    bool saveMaskedData(QIODevice *destination) const;
+    bool loadMaskedData(QIODevice *source);
     bool transparentIfEmpty() const;
     void setTransparentIfEmpty(bool val);
     bool mergeDisplayEdit() const;
     void setMergeDisplayEdit(bool val);
     bool maskHeaderData() const;
     void setMaskHeaderData(bool val);
+    bool propagateCheckState() const;
+    void setPropagateCheckState(bool val);
+    int sortRole() const;
+    void setSortRole(int role);
 Q_SIGNALS:
     void mergeDisplayEditChanged(bool val);
     void transparentIfEmptyChanged(bool val);
     void maskHeaderDataChanged(bool val);
+    void propagateCheckStateChanged(bool val);
+    void sortRoleChanged(int role);
     void maskedRolesChanged();
     void maskedDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
 
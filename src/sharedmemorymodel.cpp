@@ -0,0 +1,763 @@
+/****************************************************************************\
+   Copyright 2021 Luca Beldi
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+       http://www.apache.org/licenses/LICENSE-2.0
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+\****************************************************************************/
+#include "private/sharedmemorymodel_p.h"
+#include "sharedmemorymodel.h"
+#include <QDataStream>
+#include <cstring>
+
+SharedMemoryModelPublisherPrivate::SharedMemoryModelPublisherPrivate(const QString &key, SharedMemoryModelPublisher *q)
+    : q_ptr(q)
+    , m_key(key)
+    , m_generation(0)
+    , m_control(key)
+    , m_currentData(Q_NULLPTR)
+    , m_previousData(Q_NULLPTR)
+{
+    Q_ASSERT(q_ptr);
+}
+
+SharedMemoryModelPublisherPrivate::~SharedMemoryModelPublisherPrivate()
+{
+    delete m_previousData;
+    delete m_currentData;
+}
+
+QString SharedMemoryModelPublisherPrivate::dataKey(const QString &key, qint64 generation)
+{
+    return key + QLatin1Char('_') + QString::number(generation);
+}
+
+bool SharedMemoryModelPublisherPrivate::attachControl()
+{
+    if (m_control.isAttached())
+        return true;
+    if (m_control.create(sizeof(SharedMemoryControl))) {
+        SharedMemoryControl control;
+        control.magic = controlMagic;
+        control.reserved = 0;
+        control.generation = 0;
+        m_control.lock();
+        std::memcpy(m_control.data(), &control, sizeof(SharedMemoryControl));
+        m_control.unlock();
+        return true;
+    }
+    if (m_control.error() == QSharedMemory::AlreadyExists && m_control.attach() && m_control.size() >= int(sizeof(SharedMemoryControl)))
+        return true;
+    m_errorString = m_control.errorString();
+    return false;
+}
+
+qint32 SharedMemoryModelPublisherPrivate::appendRoles(QByteArray &blob, const QMap<int, QVariant> &roles, int streamVersion)
+{
+    if (roles.isEmpty())
+        return -1;
+    const qint32 tableOffset = blob.size();
+    const qint32 roleCount = roles.size();
+    QVector<SharedMemoryImageRole> table;
+    table.reserve(roleCount);
+    QByteArray values;
+    for (auto i = roles.cbegin(), iEnd = roles.cend(); i != iEnd; ++i) {
+        QByteArray serialised;
+        QDataStream writer(&serialised, QIODevice::WriteOnly);
+        writer.setVersion(streamVersion);
+        writer << i.value();
+        SharedMemoryImageRole entry;
+        entry.role = i.key();
+        entry.offset = tableOffset + qint32(sizeof(qint32)) + roleCount * qint32(sizeof(SharedMemoryImageRole)) + values.size();
+        entry.size = serialised.size();
+        table.append(entry);
+        values.append(serialised);
+    }
+    blob.append(reinterpret_cast<const char *>(&roleCount), sizeof(qint32));
+    blob.append(reinterpret_cast<const char *>(table.constData()), roleCount * int(sizeof(SharedMemoryImageRole)));
+    blob.append(values);
+    return tableOffset;
+}
+
+QByteArray SharedMemoryModelPublisherPrivate::createImage(const QAbstractItemModel *model, const QModelIndex &parent) const
+{
+    Q_ASSERT(model);
+    const int streamVersion = QDataStream().version();
+    QVector<SharedMemoryImageNode> nodes;
+    QVector<QModelIndex> nodeIndexes;
+    QByteArray blob;
+    SharedMemoryImageNode rootNode;
+    rootNode.parent = -1;
+    rootNode.row = -1;
+    rootNode.column = -1;
+    rootNode.flags = 0;
+    rootNode.rolesOffset = -1;
+    nodes.append(rootNode);
+    nodeIndexes.append(parent);
+    // breadth first so the children of every node occupy a contiguous, row-major block of the node array
+    for (qint32 nodeIndex = 0; nodeIndex < nodes.size(); ++nodeIndex) {
+        const QModelIndex current = nodeIndexes.at(nodeIndex);
+        const qint32 rowCount = model->rowCount(current);
+        const qint32 colCount = model->columnCount(current);
+        nodes[nodeIndex].rowCount = rowCount;
+        nodes[nodeIndex].columnCount = colCount;
+        nodes[nodeIndex].firstChild = rowCount > 0 && colCount > 0 ? nodes.size() : -1;
+        for (qint32 i = 0; i < rowCount; ++i) {
+            for (qint32 j = 0; j < colCount; ++j) {
+                const QModelIndex child = model->index(i, j, current);
+                SharedMemoryImageNode childNode;
+                childNode.parent = nodeIndex;
+                childNode.row = i;
+                childNode.column = j;
+                childNode.flags = int(model->flags(child));
+                childNode.rolesOffset = appendRoles(blob, model->itemData(child), streamVersion);
+                nodes.append(childNode);
+                nodeIndexes.append(child);
+            }
+        }
+    }
+    const qint32 horizontalHeaderCount = nodes.first().columnCount;
+    const qint32 verticalHeaderCount = nodes.first().rowCount;
+    QVector<qint32> headerOffsets;
+    headerOffsets.reserve(horizontalHeaderCount + verticalHeaderCount);
+    for (qint32 i = 0; i < horizontalHeaderCount; ++i) {
+        QMap<int, QVariant> headerRoles;
+        headerRoles.insert(Qt::DisplayRole, model->headerData(i, Qt::Horizontal, Qt::DisplayRole));
+        headerOffsets.append(appendRoles(blob, headerRoles, streamVersion));
+    }
+    for (qint32 i = 0; i < verticalHeaderCount; ++i) {
+        QMap<int, QVariant> headerRoles;
+        headerRoles.insert(Qt::DisplayRole, model->headerData(i, Qt::Vertical, Qt::DisplayRole));
+        headerOffsets.append(appendRoles(blob, headerRoles, streamVersion));
+    }
+    SharedMemoryImageHeader header;
+    header.magic = imageMagic;
+    header.version = imageVersion;
+    header.streamVersion = streamVersion;
+    header.nodeCount = nodes.size();
+    header.horizontalHeaderCount = horizontalHeaderCount;
+    header.verticalHeaderCount = verticalHeaderCount;
+    header.blobOffset = qint32(sizeof(SharedMemoryImageHeader)) + nodes.size() * qint32(sizeof(SharedMemoryImageNode))
+            + headerOffsets.size() * qint32(sizeof(qint32));
+    header.blobSize = blob.size();
+    QByteArray image;
+    image.reserve(header.blobOffset + header.blobSize);
+    image.append(reinterpret_cast<const char *>(&header), sizeof(SharedMemoryImageHeader));
+    image.append(reinterpret_cast<const char *>(nodes.constData()), nodes.size() * int(sizeof(SharedMemoryImageNode)));
+    image.append(reinterpret_cast<const char *>(headerOffsets.constData()), headerOffsets.size() * int(sizeof(qint32)));
+    image.append(blob);
+    return image;
+}
+
+/*!
+\class SharedMemoryModelPublisher
+\brief Publishes a read-only image of a model in shared memory so that other processes can display it
+\details Every call to publish() flattens the given subtree into a new shared memory segment and
+then atomically advances the generation stored in a small control segment named after key().
+Published segments are never modified after they are created so readers can use them without locking.
+The publisher keeps the previous generation alive until the next publish() so that a reader that read the
+generation just before it was replaced can still attach to it.
+
+Only one publisher should be active for a given key at any time.
+\sa SharedMemoryModel
+*/
+
+/*!
+Constructs a publisher for the shared memory \a key with the given \a parent.
+*/
+SharedMemoryModelPublisher::SharedMemoryModelPublisher(const QString &key, QObject *parent)
+    : QObject(parent)
+    , m_dptr(new SharedMemoryModelPublisherPrivate(key, this))
+{ }
+
+/*!
+\internal
+*/
+SharedMemoryModelPublisher::SharedMemoryModelPublisher(SharedMemoryModelPublisherPrivate &dptr, QObject *parent)
+    : QObject(parent)
+    , m_dptr(&dptr)
+{ }
+
+/*!
+Destructor
+\details The last published generation stays available as long as at least one reader is attached to it
+*/
+SharedMemoryModelPublisher::~SharedMemoryModelPublisher()
+{
+    delete m_dptr;
+}
+
+/*!
+\brief Returns the key used to identify the shared memory
+*/
+QString SharedMemoryModelPublisher::key() const
+{
+    Q_D(const SharedMemoryModelPublisher);
+    return d->m_key;
+}
+
+/*!
+\property SharedMemoryModelPublisher::generation
+\accessors %generation()
+\notifier generationChanged()
+\brief This property holds the generation of the last image published
+\details The generation is 0 until publish() succeeds for the first time
+*/
+
+//! Getter for generation property
+qint64 SharedMemoryModelPublisher::generation() const
+{
+    Q_D(const SharedMemoryModelPublisher);
+    return d->m_generation;
+}
+
+/*!
+\brief Returns a description of the last error encountered by publish()
+*/
+QString SharedMemoryModelPublisher::errorString() const
+{
+    Q_D(const SharedMemoryModelPublisher);
+    return d->m_errorString;
+}
+
+/*!
+\brief Publishes the contents of \a model under \a parent
+\details All the roles returned by QAbstractItemModel::itemData() and the flags of every index are stored.
+For headers only Qt::DisplayRole is stored.
+
+Returns false if the image could not be published, errorString() will contain the reason.
+*/
+bool SharedMemoryModelPublisher::publish(const QAbstractItemModel *model, const QModelIndex &parent)
+{
+    Q_ASSERT_X(!parent.isValid() || parent.model() == model, "SharedMemoryModelPublisher::publish", "parent must be an index of model");
+    Q_D(SharedMemoryModelPublisher);
+    if (!model) {
+        d->m_errorString = tr("No model to publish");
+        return false;
+    }
+    if (!d->attachControl())
+        return false;
+    const QByteArray image = d->createImage(model, parent);
+    SharedMemoryControl control;
+    d->m_control.lock();
+    std::memcpy(&control, d->m_control.constData(), sizeof(SharedMemoryControl));
+    d->m_control.unlock();
+    const qint64 newGeneration = qMax(control.generation, d->m_generation) + 1;
+    QSharedMemory *newData = new QSharedMemory(SharedMemoryModelPublisherPrivate::dataKey(d->m_key, newGeneration));
+    if (!newData->create(image.size())) {
+        d->m_errorString = newData->errorString();
+        delete newData;
+        return false;
+    }
+    newData->lock();
+    std::memcpy(newData->data(), image.constData(), image.size());
+    newData->unlock();
+    control.magic = SharedMemoryModelPublisherPrivate::controlMagic;
+    control.generation = newGeneration;
+    d->m_control.lock();
+    std::memcpy(d->m_control.data(), &control, sizeof(SharedMemoryControl));
+    d->m_control.unlock();
+    // a reader might have read the old generation just before the swap, keep it until the next publish
+    delete d->m_previousData;
+    d->m_previousData = d->m_currentData;
+    d->m_currentData = newData;
+    d->m_generation = newGeneration;
+    d->m_errorString.clear();
+    generationChanged(newGeneration);
+    return true;
+}
+
+SharedMemoryModelPrivate::SharedMemoryModelPrivate(SharedMemoryModel *q)
+    : q_ptr(q)
+    , m_generation(0)
+    , m_data(Q_NULLPTR)
+{
+    Q_ASSERT(q_ptr);
+    std::memset(&m_header, 0, sizeof(SharedMemoryImageHeader));
+}
+
+SharedMemoryModelPrivate::~SharedMemoryModelPrivate()
+{
+    delete m_data;
+}
+
+void SharedMemoryModelPrivate::clear()
+{
+    delete m_data;
+    m_data = Q_NULLPTR;
+    m_generation = 0;
+    std::memset(&m_header, 0, sizeof(SharedMemoryImageHeader));
+    if (m_control.isAttached())
+        m_control.detach();
+}
+
+bool SharedMemoryModelPrivate::isValidRoleTable(const char *blob, qint32 blobSize, qint32 rolesOffset)
+{
+    if (rolesOffset < 0)
+        return true;
+    if (qint64(rolesOffset) + qint64(sizeof(qint32)) > blobSize)
+        return false;
+    qint32 roleCount;
+    std::memcpy(&roleCount, blob + rolesOffset, sizeof(qint32));
+    const qint64 tableEnd = qint64(rolesOffset) + qint64(sizeof(qint32)) + qint64(roleCount) * qint64(sizeof(SharedMemoryImageRole));
+    if (roleCount < 0 || tableEnd > blobSize)
+        return false;
+    const char *table = blob + rolesOffset + sizeof(qint32);
+    for (qint32 i = 0; i < roleCount; ++i) {
+        SharedMemoryImageRole entry;
+        std::memcpy(&entry, table + i * sizeof(SharedMemoryImageRole), sizeof(SharedMemoryImageRole));
+        if (entry.offset < 0 || entry.size < 0 || qint64(entry.offset) + entry.size > blobSize)
+            return false;
+    }
+    return true;
+}
+
+// the whole segment is checked once when it's loaded, a foreign or corrupt image is rejected before any index is created on it
+bool SharedMemoryModelPrivate::isValidImage(const QSharedMemory *memory, SharedMemoryImageHeader &imageHeader)
+{
+    if (!memory->constData() || memory->size() < int(sizeof(SharedMemoryImageHeader)))
+        return false;
+    const char *image = static_cast<const char *>(memory->constData());
+    std::memcpy(&imageHeader, image, sizeof(SharedMemoryImageHeader));
+    if (imageHeader.magic != SharedMemoryModelPublisherPrivate::imageMagic || imageHeader.version != SharedMemoryModelPublisherPrivate::imageVersion)
+        return false;
+    if (imageHeader.streamVersion > QDataStream().version() || imageHeader.nodeCount <= 0 || imageHeader.horizontalHeaderCount < 0
+        || imageHeader.verticalHeaderCount < 0)
+        return false;
+    const qint64 expectedBlobOffset = qint64(sizeof(SharedMemoryImageHeader)) + qint64(imageHeader.nodeCount) * qint64(sizeof(SharedMemoryImageNode))
+            + (qint64(imageHeader.horizontalHeaderCount) + imageHeader.verticalHeaderCount) * qint64(sizeof(qint32));
+    if (imageHeader.blobOffset != expectedBlobOffset || imageHeader.blobSize < 0
+        || qint64(imageHeader.blobOffset) + imageHeader.blobSize > memory->size())
+        return false;
+    const char *blob = image + imageHeader.blobOffset;
+    const char *nodes = image + sizeof(SharedMemoryImageHeader);
+    for (qint32 nodeIndex = 0; nodeIndex < imageHeader.nodeCount; ++nodeIndex) {
+        SharedMemoryImageNode current;
+        std::memcpy(&current, nodes + nodeIndex * sizeof(SharedMemoryImageNode), sizeof(SharedMemoryImageNode));
+        if (current.rowCount < 0 || current.columnCount < 0 || !isValidRoleTable(blob, imageHeader.blobSize, current.rolesOffset))
+            return false;
+        if (nodeIndex == 0) {
+            if (current.parent != -1 || current.rowCount != imageHeader.verticalHeaderCount
+                || current.columnCount != imageHeader.horizontalHeaderCount)
+                return false;
+        } else if (current.parent < 0 || current.parent >= nodeIndex) {
+            return false;
+        }
+        const qint64 childCount = qint64(current.rowCount) * current.columnCount;
+        if (childCount == 0) {
+            if (current.firstChild != -1)
+                return false;
+            continue;
+        }
+        // children are stored after their parent in a row-major block, check each one points back to its slot
+        if (current.firstChild <= nodeIndex || current.firstChild + childCount > imageHeader.nodeCount)
+            return false;
+        for (qint64 i = 0; i < childCount; ++i) {
+            SharedMemoryImageNode child;
+            std::memcpy(&child, nodes + (current.firstChild + i) * sizeof(SharedMemoryImageNode), sizeof(SharedMemoryImageNode));
+            if (child.parent != nodeIndex || child.row != i / current.columnCount || child.column != i % current.columnCount)
+                return false;
+        }
+    }
+    const char *headerOffsets = nodes + imageHeader.nodeCount * sizeof(SharedMemoryImageNode);
+    for (qint32 i = 0, maxI = imageHeader.horizontalHeaderCount + imageHeader.verticalHeaderCount; i < maxI; ++i) {
+        qint32 rolesOffset;
+        std::memcpy(&rolesOffset, headerOffsets + i * sizeof(qint32), sizeof(qint32));
+        if (!isValidRoleTable(blob, imageHeader.blobSize, rolesOffset))
+            return false;
+    }
+    return true;
+}
+
+const char *SharedMemoryModelPrivate::imageData() const
+{
+    Q_ASSERT(m_data);
+    return static_cast<const char *>(m_data->constData());
+}
+
+const SharedMemoryImageHeader &SharedMemoryModelPrivate::header() const
+{
+    return m_header;
+}
+
+SharedMemoryImageNode SharedMemoryModelPrivate::node(qint32 nodeIndex) const
+{
+    SharedMemoryImageNode result;
+    if (nodeIndex < 0 || nodeIndex >= m_header.nodeCount) {
+        result.parent = -1;
+        result.row = -1;
+        result.column = -1;
+        result.rowCount = 0;
+        result.columnCount = 0;
+        result.firstChild = -1;
+        result.flags = 0;
+        result.rolesOffset = -1;
+        return result;
+    }
+    std::memcpy(&result, imageData() + sizeof(SharedMemoryImageHeader) + nodeIndex * sizeof(SharedMemoryImageNode), sizeof(SharedMemoryImageNode));
+    return result;
+}
+
+qint32 SharedMemoryModelPrivate::headerRolesOffset(int section, Qt::Orientation orientation) const
+{
+    const SharedMemoryImageHeader &imageHeader = header();
+    qint32 headerIndex = section;
+    if (orientation == Qt::Horizontal) {
+        if (section < 0 || section >= imageHeader.horizontalHeaderCount)
+            return -1;
+    } else {
+        if (section < 0 || section >= imageHeader.verticalHeaderCount)
+            return -1;
+        headerIndex += imageHeader.horizontalHeaderCount;
+    }
+    qint32 result;
+    std::memcpy(&result,
+                imageData() + sizeof(SharedMemoryImageHeader) + imageHeader.nodeCount * sizeof(SharedMemoryImageNode) + headerIndex * sizeof(qint32),
+                sizeof(qint32));
+    return result;
+}
+
+// returns the first entry of the role table at rolesOffset or null if the table does not fit in the blob
+const char *SharedMemoryModelPrivate::roleTable(qint32 rolesOffset, qint32 &roleCount) const
+{
+    roleCount = 0;
+    const SharedMemoryImageHeader &imageHeader = header();
+    if (rolesOffset < 0 || qint64(rolesOffset) + qint64(sizeof(qint32)) > imageHeader.blobSize)
+        return Q_NULLPTR;
+    const char *blob = imageData() + imageHeader.blobOffset;
+    std::memcpy(&roleCount, blob + rolesOffset, sizeof(qint32));
+    if (roleCount < 0
+        || qint64(rolesOffset) + qint64(sizeof(qint32)) + qint64(roleCount) * qint64(sizeof(SharedMemoryImageRole)) > imageHeader.blobSize) {
+        roleCount = 0;
+        return Q_NULLPTR;
+    }
+    return blob + rolesOffset + sizeof(qint32);
+}
+
+QVariant SharedMemoryModelPrivate::roleValue(qint32 rolesOffset, int role) const
+{
+    qint32 roleCount;
+    const char *table = roleTable(rolesOffset, roleCount);
+    if (!table)
+        return QVariant();
+    const SharedMemoryImageHeader &imageHeader = header();
+    const char *blob = imageData() + imageHeader.blobOffset;
+    for (qint32 i = 0; i < roleCount; ++i) {
+        SharedMemoryImageRole entry;
+        std::memcpy(&entry, table + i * sizeof(SharedMemoryImageRole), sizeof(SharedMemoryImageRole));
+        if (entry.role != role)
+            continue;
+        if (entry.offset < 0 || entry.size < 0 || qint64(entry.offset) + entry.size > imageHeader.blobSize)
+            return QVariant();
+        QDataStream reader(QByteArray::fromRawData(blob + entry.offset, entry.size));
+        reader.setVersion(imageHeader.streamVersion);
+        QVariant result;
+        reader >> result;
+        if (reader.status() != QDataStream::Ok)
+            return QVariant();
+        return result;
+    }
+    return QVariant();
+}
+
+QMap<int, QVariant> SharedMemoryModelPrivate::roleValues(qint32 rolesOffset) const
+{
+    QMap<int, QVariant> result;
+    qint32 roleCount;
+    const char *table = roleTable(rolesOffset, roleCount);
+    if (!table)
+        return result;
+    const SharedMemoryImageHeader &imageHeader = header();
+    const char *blob = imageData() + imageHeader.blobOffset;
+    for (qint32 i = 0; i < roleCount; ++i) {
+        SharedMemoryImageRole entry;
+        std::memcpy(&entry, table + i * sizeof(SharedMemoryImageRole), sizeof(SharedMemoryImageRole));
+        if (entry.offset < 0 || entry.size < 0 || qint64(entry.offset) + entry.size > imageHeader.blobSize)
+            continue;
+        QDataStream reader(QByteArray::fromRawData(blob + entry.offset, entry.size));
+        reader.setVersion(imageHeader.streamVersion);
+        QVariant value;
+        reader >> value;
+        if (reader.status() == QDataStream::Ok)
+            result.insert(entry.role, value);
+    }
+    return result;
+}
+
+/*!
+\class SharedMemoryModel
+\brief A read-only model that displays an image published by SharedMemoryModelPublisher in another process
+\details The model maps the shared memory published under key() and reads it in place.
+No data is copied when a new generation is loaded, each value is decoded only when it's requested by data().
+
+The model does not poll the shared memory, call refresh() (for example from a QTimer) to load the latest generation.
+A refresh that finds a new generation resets the model.
+Every new generation is validated before it's loaded, a truncated, corrupt or foreign segment is rejected and the model
+keeps displaying the previous one.
+\sa SharedMemoryModelPublisher
+*/
+
+/*!
+Constructs a new model with the given \a parent.
+*/
+SharedMemoryModel::SharedMemoryModel(QObject *parent)
+    : QAbstractItemModel(parent)
+    , m_dptr(new SharedMemoryModelPrivate(this))
+{ }
+
+/*!
+Constructs a new model attached to \a key with the given \a parent.
+\details The current generation, if any, is loaded immediately
+*/
+SharedMemoryModel::SharedMemoryModel(const QString &key, QObject *parent)
+    : QAbstractItemModel(parent)
+    , m_dptr(new SharedMemoryModelPrivate(this))
+{
+    m_dptr->m_key = key;
+    refresh();
+}
+
+/*!
+\internal
+*/
+SharedMemoryModel::SharedMemoryModel(SharedMemoryModelPrivate &dptr, QObject *parent)
+    : QAbstractItemModel(parent)
+    , m_dptr(&dptr)
+{ }
+
+/*!
+Destructor
+*/
+SharedMemoryModel::~SharedMemoryModel()
+{
+    delete m_dptr;
+}
+
+/*!
+\property SharedMemoryModel::key
+\accessors %key(), setKey()
+\notifier keyChanged()
+\brief This property holds the key used to identify the shared memory
+\details Changing the key resets the model and loads the current generation published under the new key
+*/
+
+//! Getter for key property
+QString SharedMemoryModel::key() const
+{
+    Q_D(const SharedMemoryModel);
+    return d->m_key;
+}
+
+//! Setter for key property
+void SharedMemoryModel::setKey(const QString &key)
+{
+    Q_D(SharedMemoryModel);
+    if (d->m_key == key)
+        return;
+    const bool hadData = d->m_data;
+    if (hadData)
+        beginResetModel();
+    d->clear();
+    d->m_key = key;
+    if (hadData)
+        endResetModel();
+    keyChanged(key);
+    refresh();
+}
+
+/*!
+\property SharedMemoryModel::generation
+\accessors %generation()
+\notifier generationChanged()
+\brief This property holds the generation currently displayed by the model
+\details The generation is 0 if no image has been loaded
+*/
+
+//! Getter for generation property
+qint64 SharedMemoryModel::generation() const
+{
+    Q_D(const SharedMemoryModel);
+    return d->m_generation;
+}
+
+/*!
+\brief Loads the latest generation published under key()
+\details If a newer generation is available the model is reset to display it.
+Returns true if the model displays the latest generation after the call.
+*/
+bool SharedMemoryModel::refresh()
+{
+    Q_D(SharedMemoryModel);
+    if (d->m_key.isEmpty())
+        return false;
+    if (!d->m_control.isAttached()) {
+        d->m_control.setKey(d->m_key);
+        if (!d->m_control.attach(QSharedMemory::ReadOnly))
+            return false;
+        if (d->m_control.size() < int(sizeof(SharedMemoryControl))) {
+            d->m_control.detach();
+            return false;
+        }
+    }
+    SharedMemoryControl control;
+    d->m_control.lock();
+    std::memcpy(&control, d->m_control.constData(), sizeof(SharedMemoryControl));
+    d->m_control.unlock();
+    if (control.magic != SharedMemoryModelPublisherPrivate::controlMagic || control.generation <= 0)
+        return false;
+    if (d->m_data && control.generation == d->m_generation)
+        return true;
+    QSharedMemory *newData = new QSharedMemory(SharedMemoryModelPublisherPrivate::dataKey(d->m_key, control.generation));
+    SharedMemoryImageHeader newHeader;
+    if (!newData->attach(QSharedMemory::ReadOnly) || !SharedMemoryModelPrivate::isValidImage(newData, newHeader)) {
+        delete newData;
+        return false;
+    }
+    beginResetModel();
+    delete d->m_data;
+    d->m_data = newData;
+    d->m_header = newHeader;
+    d->m_generation = control.generation;
+    endResetModel();
+    generationChanged(d->m_generation);
+    return true;
+}
+
+/*!
+\reimp
+*/
+QModelIndex SharedMemoryModel::index(int row, int column, const QModelIndex &parent) const
+{
+    Q_D(const SharedMemoryModel);
+    if (!d->m_data || row < 0 || column < 0)
+        return QModelIndex();
+    Q_ASSERT(!parent.isValid() || parent.model() == this);
+    const SharedMemoryImageNode parentNode = d->node(parent.isValid() ? qint32(parent.internalId()) : 0);
+    if (row >= parentNode.rowCount || column >= parentNode.columnCount)
+        return QModelIndex();
+    return createIndex(row, column, quintptr(parentNode.firstChild + row * parentNode.columnCount + column));
+}
+
+/*!
+\reimp
+*/
+QModelIndex SharedMemoryModel::parent(const QModelIndex &index) const
+{
+    Q_D(const SharedMemoryModel);
+    if (!d->m_data || !index.isValid())
+        return QModelIndex();
+    Q_ASSERT(index.model() == this);
+    const qint32 parentIndex = d->node(qint32(index.internalId())).parent;
+    if (parentIndex <= 0)
+        return QModelIndex();
+    const SharedMemoryImageNode parentNode = d->node(parentIndex);
+    return createIndex(parentNode.row, parentNode.column, quintptr(parentIndex));
+}
+
+/*!
+\reimp
+*/
+int SharedMemoryModel::rowCount(const QModelIndex &parent) const
+{
+    Q_D(const SharedMemoryModel);
+    if (!d->m_data)
+        return 0;
+    Q_ASSERT(!parent.isValid() || parent.model() == this);
+    return d->node(parent.isValid() ? qint32(parent.internalId()) : 0).rowCount;
+}
+
+/*!
+\reimp
+*/
+int SharedMemoryModel::columnCount(const QModelIndex &parent) const
+{
+    Q_D(const SharedMemoryModel);
+    if (!d->m_data)
+        return 0;
+    Q_ASSERT(!parent.isValid() || parent.model() == this);
+    return d->node(parent.isValid() ? qint32(parent.internalId()) : 0).columnCount;
+}
+
+/*!
+\reimp
+*/
+bool SharedMemoryModel::hasChildren(const QModelIndex &parent) const
+{
+    Q_D(const SharedMemoryModel);
+    if (!d->m_data)
+        return false;
+    Q_ASSERT(!parent.isValid() || parent.model() == this);
+    return d->node(parent.isValid() ? qint32(parent.internalId()) : 0).firstChild >= 0;
+}
+
+/*!
+\reimp
+*/
+QVariant SharedMemoryModel::data(const QModelIndex &index, int role) const
+{
+    Q_D(const SharedMemoryModel);
+    if (!d->m_data || !index.isValid())
+        return QVariant();
+    Q_ASSERT(index.model() == this);
+    return d->roleValue(d->node(qint32(index.internalId())).rolesOffset, role);
+}
+
+/*!
+\reimp
+*/
+QMap<int, QVariant> SharedMemoryModel::itemData(const QModelIndex &index) const
+{
+    Q_D(const SharedMemoryModel);
+    if (!d->m_data || !index.isValid())
+        return QMap<int, QVariant>();
+    Q_ASSERT(index.model() == this);
+    return d->roleValues(d->node(qint32(index.internalId())).rolesOffset);
+}
+
+/*!
+\reimp
+*/
+QVariant SharedMemoryModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    Q_D(const SharedMemoryModel);
+    if (!d->m_data || role != Qt::DisplayRole)
+        return QAbstractItemModel::headerData(section, orientation, role);
+    const qint32 rolesOffset = d->headerRolesOffset(section, orientation);
+    if (rolesOffset < 0)
+        return QAbstractItemModel::headerData(section, orientation, role);
+    return d->roleValue(rolesOffset, role);
+}
+
+/*!
+\reimp
+\details The flags are the ones of the published model without Qt::ItemIsEditable and Qt::ItemIsDropEnabled
+*/
+Qt::ItemFlags SharedMemoryModel::flags(const QModelIndex &index) const
+{
+    Q_D(const SharedMemoryModel);
+    if (!d->m_data || !index.isValid())
+        return Qt::NoItemFlags;
+    Q_ASSERT(index.model() == this);
+    const Qt::ItemFlags result(QFlag(d->node(qint32(index.internalId())).flags));
+    return result & ~(Qt::ItemIsEditable | Qt::ItemIsDropEnabled);
+}
+
+/*!
+\fn void SharedMemoryModelPublisher::generationChanged(qint64 generation)
+\brief This signal is emitted after a new \a generation has been published
+*/
+
+/*!
+\fn void SharedMemoryModel::keyChanged(const QString &key)
+\brief This signal is emitted when the \a key property changes
+*/
+
+/*!
+\fn void SharedMemoryModel::generationChanged(qint64 generation)
+\brief This signal is emitted when the model loads a new \a generation
+*/
@@ -0,0 +1,74 @@
+/****************************************************************************\
+   Copyright 2021 Luca Beldi
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+       http://www.apache.org/licenses/LICENSE-2.0
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+\****************************************************************************/
+
+#ifndef SHAREDMEMORYMODEL_H
+#define SHAREDMEMORYMODEL_H
+#include <modelutilities_global.h>
+#include <QAbstractItemModel>
+class SharedMemoryModelPrivate;
+class SharedMemoryModelPublisherPrivate;
+class MODELUTILITIES_EXPORT SharedMemoryModelPublisher : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QString key READ key CONSTANT)
+    Q_PROPERTY(qint64 generation READ generation NOTIFY generationChanged)
+    Q_DISABLE_COPY(SharedMemoryModelPublisher)
+    Q_DECLARE_PRIVATE_D(m_dptr, SharedMemoryModelPublisher)
+public:
+    explicit SharedMemoryModelPublisher(const QString &key, QObject *parent = Q_NULLPTR);
+    ~SharedMemoryModelPublisher();
+    QString key() const;
+    qint64 generation() const;
+    QString errorString() const;
+    bool publish(const QAbstractItemModel *model, const QModelIndex &parent = QModelIndex());
+Q_SIGNALS:
+    void generationChanged(qint64 generation);
+
+protected:
+    SharedMemoryModelPublisher(SharedMemoryModelPublisherPrivate &dptr, QObject *parent);
+    SharedMemoryModelPublisherPrivate *m_dptr;
+};
+
+class MODELUTILITIES_EXPORT SharedMemoryModel : public QAbstractItemModel
+{
+    Q_OBJECT
+    Q_PROPERTY(QString key READ key WRITE setKey NOTIFY keyChanged)
+    Q_PROPERTY(qint64 generation READ generation NOTIFY generationChanged)
+    Q_DISABLE_COPY(SharedMemoryModel)
+    Q_DECLARE_PRIVATE_D(m_dptr, SharedMemoryModel)
+public:
+    explicit SharedMemoryModel(QObject *parent = Q_NULLPTR);
+    explicit SharedMemoryModel(const QString &key, QObject *parent = Q_NULLPTR);
+    ~SharedMemoryModel();
+    QString key() const;
+    void setKey(const QString &key);
+    qint64 generation() const;
+    bool refresh();
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &index) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QMap<int, QVariant> itemData(const QModelIndex &index) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+Q_SIGNALS:
+    void keyChanged(const QString &key);
+    void generationChanged(qint64 generation);
+
+protected:
+    SharedMemoryModel(SharedMemoryModelPrivate &dptr, QObject *parent);
+    SharedMemoryModelPrivate *m_dptr;
+};
+#endif // SHAREDMEMORYMODEL_H
@@ -0,0 +1,263 @@
+/****************************************************************************\
+   Copyright 2021 Luca Beldi
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+       http://www.apache.org/licenses/LICENSE-2.0
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+\****************************************************************************/
+#ifndef STRUCTTABLEMODEL_H
+#define STRUCTTABLEMODEL_H
+#include <genericmodel.h>
+#include <QAbstractTableModel>
+#include <QVariant>
+#include <QVector>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+/*!
+\class StructTableColumn
+\brief Describes a column of StructTableModel backed by the data member \a Member of \a T
+\details Use the STRUCT_TABLE_COLUMN macro rather than spelling out the template arguments.
+The type of the member must be comparable with \c{operator<} and convertible to and from QVariant.
+Setting a value that QVariant::convert() can't turn into the type of the member fails and leaves the member unchanged.
+*/
+template <class T, class M, M T::*Member>
+struct StructTableColumn
+{
+    typedef T StructType;
+    typedef M ValueType;
+    static QVariant get(const T &value) { return QVariant::fromValue(value.*Member); }
+    static bool set(T &value, const QVariant &newValue)
+    {
+        // canConvert() only checks the types, a string that does not represent a number would silently become 0
+        QVariant converted = newValue;
+#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
+        if (!converted.convert(QMetaType::fromType<M>()))
+#else
+        if (!converted.convert(qMetaTypeId<M>()))
+#endif
+            return false;
+        value.*Member = converted.value<M>();
+        return true;
+    }
+    static bool isLessThan(const T &left, const T &right) { return left.*Member < right.*Member; }
+};
+#define STRUCT_TABLE_COLUMN(Type, member) StructTableColumn<Type, decltype(Type::member), &Type::member>
+
+/*!
+\class StructTableModel
+\brief A table model that stores its rows as a \c{std::vector} of plain structs
+\details Each column is declared at compile time as one of the data members of \a T using STRUCT_TABLE_COLUMN.
+The values are stored natively inside the structs, a QVariant is only created when data() is called
+so there is no per-cell QVariant storage or heap allocation.
+
+Qt::DisplayRole and Qt::EditRole read and write the member, all other roles are not supported.
+sort() compares the native values directly. Drag and drop use the default QAbstractItemModel serialisation and, like GenericModel,
+a single dragged cell also exports its value in the mime types GenericModel uses for it.
+
+\code
+struct Telemetry
+{
+    int id;
+    double value;
+    QString source;
+};
+StructTableModel<Telemetry, STRUCT_TABLE_COLUMN(Telemetry, id), STRUCT_TABLE_COLUMN(Telemetry, value)> model;
+\endcode
+*/
+template <class T, class... Columns>
+class StructTableModel : public QAbstractTableModel
+{
+    static_assert(sizeof...(Columns) > 0, "StructTableModel requires at least one column");
+    Q_DISABLE_COPY(StructTableModel)
+
+public:
+    enum { ColumnCount = sizeof...(Columns) };
+    explicit StructTableModel(QObject *parent = Q_NULLPTR)
+        : QAbstractTableModel(parent)
+        , m_headerData(ColumnCount)
+    { }
+    /*!
+    \brief Returns all the rows stored in the model
+    */
+    const std::vector<T> &rows() const { return m_rows; }
+    /*!
+    \brief Returns the struct stored in \a row
+    \details \a row must be a valid row of the model
+    */
+    const T &rowValue(int row) const
+    {
+        Q_ASSERT(row >= 0 && row < rowCount());
+        return m_rows[row];
+    }
+    /*!
+    \brief Replaces all the rows of the model with \a rows
+    */
+    void setRows(std::vector<T> rows)
+    {
+        beginResetModel();
+        m_rows = std::move(rows);
+        endResetModel();
+    }
+    /*!
+    \brief Replaces the struct stored in \a row with \a value
+    \details Returns false if \a row is not a valid row of the model
+    */
+    bool setRowValue(int row, const T &value)
+    {
+        if (row < 0 || row >= rowCount())
+            return false;
+        m_rows[row] = value;
+        dataChanged(index(row, 0), index(row, ColumnCount - 1));
+        return true;
+    }
+    /*!
+    \brief Adds \a value at the end of the model
+    */
+    void appendRow(const T &value)
+    {
+        const int row = rowCount();
+        beginInsertRows(QModelIndex(), row, row);
+        m_rows.push_back(value);
+        endInsertRows();
+    }
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override { return parent.isValid() ? 0 : static_cast<int>(m_rows.size()); }
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override { return parent.isValid() ? 0 : ColumnCount; }
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override
+    {
+        if (!index.isValid() || (role != Qt::DisplayRole && role != Qt::EditRole))
+            return QVariant();
+        Q_ASSERT(index.model() == this);
+        static const Getter getters[] = { &Columns::get... };
+        return getters[index.column()](m_rows[index.row()]);
+    }
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override
+    {
+        if (!index.isValid() || (role != Qt::DisplayRole && role != Qt::EditRole))
+            return false;
+        Q_ASSERT(index.model() == this);
+        static const Getter getters[] = { &Columns::get... };
+        static const Setter setters[] = { &Columns::set... };
+        T &rowData = m_rows[index.row()];
+        // both values hold the type of the member so the comparison is exact
+        const QVariant oldValue = getters[index.column()](rowData);
+        if (!setters[index.column()](rowData, value))
+            return false;
+        if (getters[index.column()](rowData) != oldValue)
+            dataChanged(index, index, QVector<int>{Qt::DisplayRole, Qt::EditRole});
+        return true;
+    }
+    Qt::ItemFlags flags(const QModelIndex &index) const override
+    {
+        if (!index.isValid())
+            return Qt::ItemIsDropEnabled;
+        return Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable | Qt::ItemIsDragEnabled | Qt::ItemNeverHasChildren;
+    }
+    /*!
+    \reimp
+    \details When a single index is dragged its value is also exported in the mime types GenericModel uses for it
+    */
+    QMimeData *mimeData(const QModelIndexList &indexes) const override
+    {
+        QMimeData *data = QAbstractTableModel::mimeData(indexes);
+        if (data && indexes.size() == 1)
+            GenericModel::mimeForVariant(data, indexes.first().data());
+        return data;
+    }
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override
+    {
+        if (orientation == Qt::Horizontal && section >= 0 && section < ColumnCount && (role == Qt::DisplayRole || role == Qt::EditRole)) {
+            const QVariant &value = m_headerData.at(section);
+            if (value.isValid())
+                return value;
+        }
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+    bool setHeaderData(int section, Qt::Orientation orientation, const QVariant &value, int role = Qt::EditRole) override
+    {
+        if (orientation != Qt::Horizontal || section < 0 || section >= ColumnCount || (role != Qt::DisplayRole && role != Qt::EditRole))
+            return false;
+        if (m_headerData.at(section) != value) {
+            m_headerData[section] = value;
+            headerDataChanged(orientation, section, section);
+        }
+        return true;
+    }
+    bool insertRows(int row, int count, const QModelIndex &parent = QModelIndex()) override
+    {
+        if (parent.isValid() || row < 0 || count <= 0 || row > rowCount())
+            return false;
+        beginInsertRows(parent, row, row + count - 1);
+        m_rows.insert(m_rows.begin() + row, count, T());
+        endInsertRows();
+        return true;
+    }
+    bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex()) override
+    {
+        if (parent.isValid() || row < 0 || count <= 0 || row + count > rowCount())
+            return false;
+        beginRemoveRows(parent, row, row + count - 1);
+        m_rows.erase(m_rows.begin() + row, m_rows.begin() + row + count);
+        endRemoveRows();
+        return true;
+    }
+    bool moveRows(const QModelIndex &sourceParent, int sourceRow, int count, const QModelIndex &destinationParent, int destinationChild) override
+    {
+        if (sourceParent.isValid() || destinationParent.isValid() || sourceRow < 0 || count <= 0 || sourceRow + count > rowCount()
+            || destinationChild < 0 || destinationChild > rowCount())
+            return false;
+        if (!beginMoveRows(sourceParent, sourceRow, sourceRow + count - 1, destinationParent, destinationChild))
+            return false;
+        const auto rowsBegin = m_rows.begin();
+        if (destinationChild < sourceRow)
+            std::rotate(rowsBegin + destinationChild, rowsBegin + sourceRow, rowsBegin + sourceRow + count);
+        else
+            std::rotate(rowsBegin + sourceRow, rowsBegin + sourceRow + count, rowsBegin + destinationChild);
+        endMoveRows();
+        return true;
+    }
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override
+    {
+        if (column < 0 || column >= ColumnCount || m_rows.size() < 2)
+            return;
+        static const LessThan lessThans[] = { &Columns::isLessThan... };
+        const LessThan isLessThan = lessThans[column];
+        layoutAboutToBeChanged(QList<QPersistentModelIndex>(), QAbstractItemModel::VerticalSortHint);
+        std::vector<int> sortedRows(m_rows.size());
+        std::iota(sortedRows.begin(), sortedRows.end(), 0);
+        std::stable_sort(sortedRows.begin(), sortedRows.end(), [this, isLessThan, order](int left, int right) -> bool {
+            if (order == Qt::AscendingOrder)
+                return isLessThan(m_rows[left], m_rows[right]);
+            return isLessThan(m_rows[right], m_rows[left]);
+        });
+        std::vector<T> newRows;
+        newRows.reserve(m_rows.size());
+        std::vector<int> newPositions(m_rows.size());
+        for (int i = 0, maxI = static_cast<int>(sortedRows.size()); i < maxI; ++i) {
+            newRows.push_back(std::move(m_rows[sortedRows[i]]));
+            newPositions[sortedRows[i]] = i;
+        }
+        m_rows.swap(newRows);
+        const QModelIndexList oldPersistentIndexes = persistentIndexList();
+        QModelIndexList newPersistentIndexes;
+        newPersistentIndexes.reserve(oldPersistentIndexes.size());
+        for (const QModelIndex &oldIndex : oldPersistentIndexes)
+            newPersistentIndexes.append(index(newPositions[oldIndex.row()], oldIndex.column()));
+        changePersistentIndexList(oldPersistentIndexes, newPersistentIndexes);
+        layoutChanged(QList<QPersistentModelIndex>(), QAbstractItemModel::VerticalSortHint);
+    }
+
+private:
+    typedef QVariant (*Getter)(const T &);
+    typedef bool (*Setter)(T &, const QVariant &);
+    typedef bool (*LessThan)(const T &, const T &);
+    std::vector<T> m_rows;
+    QVector<QVariant> m_headerData;
+};
+#endif // STRUCTTABLEMODEL_H
@@ -1,8 +1,11 @@
 #include "tst_genericmodel.h"
 #include <genericmodel.h>
+#include <fixedrolegenericmodel.h>
+#include <structtablemodel.h>
 #include <QtTest/QTest>
 #include <QtTest/QSignalSpy>
 #include <QMimeData>
+#include <QMutex>
 #include "../modeltestmanager.h"
 #include <random>
 
@@ -1351,6 +1354,816 @@ void tst_GenericModel::sortTreeRecursive()
     QCOMPARE(childFourIndex.row(), 2);
 }
 
+void tst_GenericModel::sortMultiKey()
+{
+    GenericModel testModel;
+    ModelTest probe(&testModel, nullptr);
+    QSignalSpy layoutAboutToBeChangedSpy(&testModel, SIGNAL(layoutAboutToBeChanged()));
+    QVERIFY(layoutAboutToBeChangedSpy.isValid());
+    QSignalSpy layoutChangedSpy(&testModel, SIGNAL(layoutChanged()));
+    QVERIFY(layoutChangedSpy.isValid());
+
+    testModel.insertColumns(0, 2);
+    testModel.insertRows(0, 6);
+    const QString groups[] = {QStringLiteral("b"), QStringLiteral("a"), QStringLiteral("b"),
+                              QStringLiteral("a"), QStringLiteral("b"), QStringLiteral("a")};
+    const int values[] = {2, 1, 3, 3, 2, 2};
+    for (int i = 0; i < 6; ++i) {
+        testModel.setData(testModel.index(i, 0), groups[i]);
+        testModel.setData(testModel.index(i, 1), values[i], Qt::UserRole);
+        testModel.setHeaderData(i, Qt::Vertical, i);
+    }
+    QPersistentModelIndex firstTieIndex(testModel.index(0, 1));
+    QPersistentModelIndex secondTieIndex(testModel.index(4, 1));
+    QPersistentModelIndex aThreeIndex(testModel.index(3, 0));
+
+    testModel.sort(QVector<GenericModel::SortKey>{GenericModel::SortKey(0, Qt::DisplayRole, Qt::AscendingOrder),
+                                                  GenericModel::SortKey(1, Qt::UserRole, Qt::DescendingOrder)});
+    QCOMPARE(layoutAboutToBeChangedSpy.count(), 1);
+    QCOMPARE(layoutChangedSpy.count(), 1);
+    const int expectedOrder[] = {3, 5, 1, 2, 0, 4};
+    for (int i = 0; i < 6; ++i) {
+        QCOMPARE(testModel.headerData(i, Qt::Vertical).toInt(), expectedOrder[i]);
+        QCOMPARE(testModel.index(i, 0).data().toString(), groups[expectedOrder[i]]);
+        QCOMPARE(testModel.index(i, 1).data(Qt::UserRole).toInt(), values[expectedOrder[i]]);
+    }
+    QCOMPARE(aThreeIndex.row(), 0);
+    QCOMPARE(aThreeIndex.column(), 0);
+    QCOMPARE(firstTieIndex.row(), 4);
+    QCOMPARE(secondTieIndex.row(), 5);
+
+    testModel.sort(QVector<GenericModel::SortKey>{GenericModel::SortKey(0), GenericModel::SortKey(2)});
+    QCOMPARE(layoutAboutToBeChangedSpy.count(), 1);
+    QCOMPARE(layoutChangedSpy.count(), 1);
+    testModel.sort(QVector<GenericModel::SortKey>());
+    QCOMPARE(layoutAboutToBeChangedSpy.count(), 1);
+    QCOMPARE(layoutChangedSpy.count(), 1);
+}
+
+void tst_GenericModel::keepSorted()
+{
+    GenericModel testModel;
+    ModelTest probe(&testModel, nullptr);
+    testModel.insertColumns(0, 2);
+    testModel.insertRows(0, 3);
+    testModel.setData(testModel.index(0, 0), 30);
+    testModel.setData(testModel.index(1, 0), 10);
+    testModel.setData(testModel.index(2, 0), 20);
+    testModel.setData(testModel.index(0, 1), QStringLiteral("thirty"));
+    testModel.keepSorted(0);
+    QCOMPARE(testModel.keepSortedColumn(), 0);
+    for (int i = 0; i < 3; ++i)
+        QCOMPARE(testModel.index(i, 0).data().toInt(), (i + 1) * 10);
+    QPersistentModelIndex thirtyIndex(testModel.index(2, 1));
+    QCOMPARE(thirtyIndex.data().toString(), QStringLiteral("thirty"));
+
+    QSignalSpy layoutChangedSpy(&testModel, SIGNAL(layoutChanged()));
+    QVERIFY(layoutChangedSpy.isValid());
+    QSignalSpy rowsMovedSpy(&testModel, SIGNAL(rowsMoved(QModelIndex, int, int, QModelIndex, int)));
+    QVERIFY(rowsMovedSpy.isValid());
+
+    // appending an empty row in ascending order does not move it
+    testModel.insertRow(testModel.rowCount());
+    QCOMPARE(rowsMovedSpy.count(), 0);
+    testModel.setData(testModel.index(3, 0), 15);
+    QCOMPARE(rowsMovedSpy.count(), 1);
+    QCOMPARE(testModel.index(1, 0).data().toInt(), 15);
+    QCOMPARE(testModel.index(3, 0).data().toInt(), 30);
+    QCOMPARE(thirtyIndex.row(), 3);
+
+    // an empty row inserted in the middle is moved to the bottom
+    testModel.insertRow(1);
+    QCOMPARE(rowsMovedSpy.count(), 2);
+    QVERIFY(!testModel.index(4, 0).data().isValid());
+    QCOMPARE(testModel.index(1, 0).data().toInt(), 15);
+
+    // changing the sorted value moves only the affected row
+    testModel.setData(testModel.index(0, 0), 25);
+    QCOMPARE(rowsMovedSpy.count(), 3);
+    const int expected[] = {15, 20, 25, 30};
+    for (int i = 0; i < 4; ++i)
+        QCOMPARE(testModel.index(i, 0).data().toInt(), expected[i]);
+    QCOMPARE(thirtyIndex.data().toString(), QStringLiteral("thirty"));
+    QCOMPARE(thirtyIndex.row(), 3);
+
+    // changing other columns or roles does not move anything
+    testModel.setData(testModel.index(0, 1), 100);
+    testModel.setData(testModel.index(0, 0), 100, Qt::UserRole);
+    QCOMPARE(rowsMovedSpy.count(), 3);
+    QCOMPARE(layoutChangedSpy.count(), 0);
+
+    // descending order keeps empty rows at the top
+    testModel.keepSorted(0, Qt::DisplayRole, Qt::DescendingOrder);
+    QCOMPARE(layoutChangedSpy.count(), 1);
+    QVERIFY(!testModel.index(0, 0).data().isValid());
+    QCOMPARE(testModel.index(1, 0).data().toInt(), 30);
+    testModel.insertRow(0);
+    testModel.setData(testModel.index(0, 0), 40);
+    QCOMPARE(rowsMovedSpy.count(), 4);
+    QCOMPARE(testModel.index(1, 0).data().toInt(), 40);
+    QCOMPARE(testModel.index(5, 0).data().toInt(), 15);
+
+    testModel.keepSorted(-1);
+    QCOMPARE(testModel.keepSortedColumn(), -1);
+    testModel.setData(testModel.index(5, 0), 50);
+    QCOMPARE(rowsMovedSpy.count(), 4);
+    QCOMPARE(testModel.index(5, 0).data().toInt(), 50);
+}
+
+void tst_GenericModel::keepSortedColumnShift()
+{
+    GenericModel testModel;
+    ModelTest probe(&testModel, nullptr);
+    testModel.insertColumns(0, 1);
+    testModel.insertRows(0, 3);
+    for (int i = 0; i < 3; ++i)
+        testModel.setData(testModel.index(i, 0), (i + 1) * 10);
+    testModel.keepSorted(0);
+    // the sorted column follows the data when columns are inserted in front of it
+    testModel.insertColumn(0);
+    QCOMPARE(testModel.keepSortedColumn(), 1);
+    testModel.insertRow(testModel.rowCount());
+    testModel.setData(testModel.index(3, 1), 15);
+    const int expected[] = {10, 15, 20, 30};
+    for (int i = 0; i < 4; ++i)
+        QCOMPARE(testModel.index(i, 1).data().toInt(), expected[i]);
+    testModel.insertColumn(2);
+    testModel.moveColumn(QModelIndex(), 1, QModelIndex(), 3);
+    QCOMPARE(testModel.keepSortedColumn(), 2);
+    testModel.removeColumn(0);
+    QCOMPARE(testModel.keepSortedColumn(), 1);
+    testModel.removeColumn(1);
+    QCOMPARE(testModel.keepSortedColumn(), -1);
+}
+
+void tst_GenericModel::valueInterning()
+{
+    GenericModel testModel;
+    ModelTest probe(&testModel, nullptr);
+    testModel.insertColumns(0, 2);
+    testModel.insertRows(0, 6);
+    QVERIFY(!testModel.isValueInterned(0, Qt::DisplayRole));
+    testModel.setValueInterning(0, Qt::EditRole, true);
+    QVERIFY(testModel.isValueInterned(0, Qt::DisplayRole));
+    QVERIFY(testModel.isValueInterned(0, Qt::EditRole));
+    QVERIFY(!testModel.isValueInterned(1, Qt::DisplayRole));
+    QVERIFY(!testModel.isValueInterned(0, Qt::UserRole));
+    for (int i = 0; i < 6; ++i) {
+        // build each string separately so they don't share memory to begin with
+        const QString value =
+                (i % 2 == 0) ? QString(QStringLiteral("Ital")) + QLatin1Char('y') : QString(QStringLiteral("Fra")) + QStringLiteral("nce");
+        testModel.setData(testModel.index(i, 0), value);
+        testModel.setData(testModel.index(i, 1), value);
+    }
+    QCOMPARE(testModel.internedValuesCount(), 2);
+    QCOMPARE(testModel.index(2, 0).data().toString(), QStringLiteral("Italy"));
+    QCOMPARE(testModel.index(3, 0).data().toString(), QStringLiteral("France"));
+    QVERIFY(testModel.index(0, 0).data().toString().constData() == testModel.index(4, 0).data().toString().constData());
+    QVERIFY(testModel.index(1, 0).data().toString().constData() == testModel.index(5, 0).data().toString().constData());
+    QVERIFY(testModel.index(0, 1).data().toString().constData() != testModel.index(2, 1).data().toString().constData());
+
+    testModel.setData(testModel.index(0, 0), 5);
+    QCOMPARE(testModel.internedValuesCount(), 2);
+    testModel.removeRows(1, 2);
+    QCOMPARE(testModel.internedValuesCount(), 2);
+    testModel.setItemData(testModel.index(0, 0), {std::make_pair(int(Qt::DisplayRole), QVariant(QStringLiteral("Spain")))});
+    QCOMPARE(testModel.internedValuesCount(), 3);
+    QVERIFY(testModel.clearItemData(testModel.index(2, 0)));
+    QCOMPARE(testModel.internedValuesCount(), 2);
+    testModel.removeRows(0, testModel.rowCount());
+    QCOMPARE(testModel.internedValuesCount(), 0);
+}
+
+void tst_GenericModel::valueInterningColumnShift()
+{
+    GenericModel testModel;
+    ModelTest probe(&testModel, nullptr);
+    testModel.insertColumns(0, 2);
+    testModel.insertRows(0, 2);
+    testModel.setValueInterning(0, Qt::DisplayRole, true);
+    testModel.setData(testModel.index(0, 0), QString(QStringLiteral("Ital")) + QLatin1Char('y'));
+    testModel.setData(testModel.index(1, 0), QString(QStringLiteral("Fra")) + QStringLiteral("nce"));
+    QCOMPARE(testModel.internedValuesCount(), 2);
+    // interning follows the column when another one is inserted before it
+    QVERIFY(testModel.insertColumn(0));
+    QVERIFY(!testModel.isValueInterned(0, Qt::DisplayRole));
+    QVERIFY(testModel.isValueInterned(1, Qt::DisplayRole));
+    testModel.setData(testModel.index(0, 0), QStringLiteral("Spain"));
+    QCOMPARE(testModel.internedValuesCount(), 2);
+    testModel.setData(testModel.index(0, 1), 5);
+    testModel.setData(testModel.index(1, 1), 5);
+    QCOMPARE(testModel.internedValuesCount(), 0);
+    testModel.setData(testModel.index(0, 1), QStringLiteral("Italy"));
+    QCOMPARE(testModel.internedValuesCount(), 1);
+    QVERIFY(testModel.moveColumn(QModelIndex(), 1, QModelIndex(), 0));
+    QVERIFY(testModel.isValueInterned(0, Qt::DisplayRole));
+    QVERIFY(!testModel.isValueInterned(1, Qt::DisplayRole));
+    testModel.setData(testModel.index(0, 0), 5);
+    QCOMPARE(testModel.internedValuesCount(), 0);
+    testModel.setData(testModel.index(1, 0), QStringLiteral("Italy"));
+    QVERIFY(testModel.removeColumn(2));
+    QVERIFY(testModel.removeColumn(1));
+    QCOMPARE(testModel.internedValuesCount(), 1);
+    QVERIFY(testModel.removeColumn(0));
+    QCOMPARE(testModel.internedValuesCount(), 0);
+    QVERIFY(!testModel.isValueInterned(0, Qt::DisplayRole));
+}
+
+void tst_GenericModel::valueInterningPlainCopy()
+{
+    GenericModel testModel;
+    ModelTest probe(&testModel, nullptr);
+    testModel.insertColumns(0, 2);
+    testModel.insertRows(0, 2);
+    testModel.setValueInterning(0, Qt::DisplayRole, true);
+    testModel.setData(testModel.index(0, 0), QString(QStringLiteral("Ital")) + QLatin1Char('y'));
+    QCOMPARE(testModel.internedValuesCount(), 1);
+    // the copy shares the pooled string but column 1 is not interned
+    testModel.setData(testModel.index(0, 1), testModel.index(0, 0).data());
+    QVERIFY(testModel.index(0, 0).data().toString().constData() == testModel.index(0, 1).data().toString().constData());
+    testModel.setData(testModel.index(0, 1), QStringLiteral("France"));
+    QCOMPARE(testModel.internedValuesCount(), 1);
+    testModel.setData(testModel.index(0, 1), testModel.index(0, 0).data());
+    testModel.removeColumn(1);
+    QCOMPARE(testModel.internedValuesCount(), 1);
+    // the pooled string is still shared with new values
+    testModel.setData(testModel.index(1, 0), QString(QStringLiteral("Ital")) + QLatin1Char('y'));
+    QCOMPARE(testModel.internedValuesCount(), 1);
+    QVERIFY(testModel.index(0, 0).data().toString().constData() == testModel.index(1, 0).data().toString().constData());
+    QCOMPARE(testModel.index(0, 0).data().toString(), QStringLiteral("Italy"));
+    testModel.setValueInterning(0, Qt::DisplayRole, false);
+    QCOMPARE(testModel.internedValuesCount(), 0);
+    testModel.setValueInterning(0, Qt::DisplayRole, true);
+    QCOMPARE(testModel.internedValuesCount(), 1);
+}
+
+void tst_GenericModel::columnAggregates()
+{
+    GenericModel testModel;
+    ModelTest probe(&testModel, nullptr);
+    testModel.insertColumns(0, 2);
+    testModel.insertRows(0, 4);
+    const int values[] = {4, 8, 15, 16};
+    for (int i = 0; i < 4; ++i)
+        testModel.setData(testModel.index(i, 0), values[i]);
+    QCOMPARE(testModel.aggregate(0).count, 0);
+    testModel.enableAggregates(0);
+    GenericModel::Aggregate result = testModel.aggregate(0);
+    QCOMPARE(result.count, 4);
+    QCOMPARE(result.sum, 43.0);
+    QCOMPARE(result.mean, 10.75);
+    QCOMPARE(result.minimum.toInt(), 4);
+    QCOMPARE(result.maximum.toInt(), 16);
+
+    testModel.setData(testModel.index(1, 0), 42);
+    result = testModel.aggregate(0, Qt::EditRole);
+    QCOMPARE(result.count, 4);
+    QCOMPARE(result.sum, 77.0);
+    QCOMPARE(result.maximum.toInt(), 42);
+
+    testModel.removeRow(0);
+    result = testModel.aggregate(0);
+    QCOMPARE(result.count, 3);
+    QCOMPARE(result.sum, 73.0);
+    QCOMPARE(result.minimum.toInt(), 15);
+    QCOMPARE(result.maximum.toInt(), 42);
+
+    testModel.insertColumn(0);
+    QCOMPARE(testModel.aggregate(0).count, 0);
+    QCOMPARE(testModel.aggregate(1).count, 3);
+    QVERIFY(testModel.clearItemData(testModel.index(0, 1)));
+    result = testModel.aggregate(1);
+    QCOMPARE(result.count, 2);
+    QCOMPARE(result.sum, 31.0);
+    QCOMPARE(result.mean, 15.5);
+    QCOMPARE(result.minimum.toInt(), 15);
+    QCOMPARE(result.maximum.toInt(), 16);
+
+    // only top level items are considered
+    const QModelIndex parentIdx = testModel.index(0, 1);
+    testModel.insertColumns(0, 2, parentIdx);
+    testModel.insertRow(0, parentIdx);
+    testModel.setData(testModel.index(0, 1, parentIdx), 1000);
+    QCOMPARE(testModel.aggregate(1).sum, 31.0);
+    testModel.moveRows(parentIdx, 0, 1, QModelIndex(), 0);
+    result = testModel.aggregate(1);
+    QCOMPARE(result.count, 3);
+    QCOMPARE(result.sum, 1031.0);
+    QCOMPARE(result.maximum.toInt(), 1000);
+
+    testModel.setData(testModel.index(0, 1), QStringLiteral("Text"));
+    result = testModel.aggregate(1);
+    QCOMPARE(result.count, 3);
+    QCOMPARE(result.sum, 31.0);
+    QCOMPARE(result.mean, 15.5);
+
+    testModel.removeColumn(1);
+    QCOMPARE(testModel.aggregate(1).count, 0);
+}
+
+void tst_GenericModel::changeTracking()
+{
+    GenericModel testModel;
+    ModelTest probe(&testModel, nullptr);
+    testModel.insertColumns(0, 2);
+    testModel.insertRows(0, 3);
+    QVERIFY(testModel.takeChangeSet().isEmpty());
+    testModel.setChangeTracking(true);
+    QVERIFY(testModel.isChangeTrackingEnabled());
+    QVERIFY(testModel.takeChangeSet().isEmpty());
+
+    testModel.setData(testModel.index(0, 1), 1);
+    testModel.setData(testModel.index(2, 0), 2);
+    testModel.setData(testModel.index(2, 0), 3);
+    GenericModel::ChangeSet changes = testModel.takeChangeSet();
+    QVERIFY(changes.operations.isEmpty());
+    QCOMPARE(changes.changedCells.size(), 1);
+    QBitArray changedBits = changes.changedCells.value(GenericModel::IndexPath());
+    QCOMPARE(changedBits.size(), 6);
+    QCOMPARE(changedBits.count(true), 2);
+    QVERIFY(changedBits.testBit(1));
+    QVERIFY(changedBits.testBit(4));
+    QVERIFY(testModel.takeChangeSet().isEmpty());
+
+    const QModelIndex parentIdx = testModel.index(1, 0);
+    testModel.insertColumns(0, 1, parentIdx);
+    testModel.insertRows(0, 2, parentIdx);
+    testModel.setData(testModel.index(1, 0, parentIdx), 4);
+    const GenericModel::IndexPath parentPath = testModel.pathForIndex(parentIdx);
+    QCOMPARE(parentPath.size(), 1);
+    QCOMPARE(parentPath.first(), qMakePair(1, 0));
+    QCOMPARE(testModel.indexForPath(parentPath), parentIdx);
+    QVERIFY(!testModel.indexForPath(GenericModel::IndexPath{qMakePair(5, 0)}).isValid());
+    testModel.removeRow(0);
+    testModel.setHeaderData(0, Qt::Horizontal, QStringLiteral("Header"));
+    testModel.setHeaderData(0, Qt::Horizontal, QStringLiteral("Header"), Qt::ToolTipRole);
+    changes = testModel.takeChangeSet();
+    QCOMPARE(changes.operations.size(), 4);
+    QCOMPARE(changes.operations.at(0).type, GenericModel::ChangeSet::InsertColumns);
+    QCOMPARE(changes.operations.at(0).parent, parentPath);
+    QCOMPARE(changes.operations.at(1).type, GenericModel::ChangeSet::InsertRows);
+    QCOMPARE(changes.operations.at(1).count, 2);
+    QCOMPARE(changes.operations.at(2).type, GenericModel::ChangeSet::RemoveRows);
+    QVERIFY(changes.operations.at(2).parent.isEmpty());
+    QCOMPARE(changes.operations.at(2).first, 0);
+    QCOMPARE(changes.operations.at(3).type, GenericModel::ChangeSet::HeaderData);
+    QCOMPARE(changes.operations.at(3).orientation, Qt::Horizontal);
+    QCOMPARE(changes.changedCells.size(), 1);
+    changedBits = changes.changedCells.value(GenericModel::IndexPath{qMakePair(0, 0)});
+    QCOMPARE(changedBits.size(), 2);
+    QVERIFY(!changedBits.testBit(0));
+    QVERIFY(changedBits.testBit(1));
+
+    testModel.moveRows(QModelIndex(), 1, 1, QModelIndex(), 0);
+    testModel.sort(0);
+    testModel.removeRow(0);
+    changes = testModel.takeChangeSet();
+    QCOMPARE(changes.operations.size(), 3);
+    QCOMPARE(changes.operations.at(0).type, GenericModel::ChangeSet::MoveRows);
+    QCOMPARE(changes.operations.at(0).first, 1);
+    QCOMPARE(changes.operations.at(0).destination, 0);
+    QCOMPARE(changes.operations.at(1).type, GenericModel::ChangeSet::Sort);
+    QCOMPARE(changes.operations.at(2).type, GenericModel::ChangeSet::RemoveRows);
+    QVERIFY(changes.changedCells.isEmpty());
+
+    testModel.setData(testModel.index(0, 0), 5);
+    testModel.setChangeTracking(false);
+    QVERIFY(testModel.takeChangeSet().isEmpty());
+}
+
+void tst_GenericModel::changeSetReplay()
+{
+    GenericModel testModel;
+    GenericModel replicaModel;
+    const int values[] = {3, 1, 4, 2};
+    for (GenericModel *model : {&testModel, &replicaModel}) {
+        model->insertColumns(0, 2);
+        model->insertRows(0, 4);
+        for (int i = 0; i < 4; ++i) {
+            model->setData(model->index(i, 0), values[i]);
+            model->setData(model->index(i, 1), i);
+        }
+    }
+    testModel.setChangeTracking(true);
+    testModel.sort(QVector<GenericModel::SortKey>{GenericModel::SortKey(0, Qt::DisplayRole, Qt::DescendingOrder)});
+    testModel.removeRow(0);
+    testModel.insertRows(1, 1);
+    testModel.sort(1);
+    const GenericModel::ChangeSet changes = testModel.takeChangeSet();
+    QCOMPARE(changes.operations.size(), 4);
+    const GenericModel::ChangeSet::Operation &sortOperation = changes.operations.first();
+    QCOMPARE(sortOperation.type, GenericModel::ChangeSet::Sort);
+    QCOMPARE(sortOperation.sortKeys.size(), 1);
+    QCOMPARE(sortOperation.sortKeys.first().order, Qt::DescendingOrder);
+    QVERIFY(sortOperation.recursive);
+    QCOMPARE(sortOperation.permutation, (QVector<int>{2, 0, 3, 1}));
+    for (const GenericModel::ChangeSet::Operation &operation : changes.operations) {
+        const QModelIndex parent = replicaModel.indexForPath(operation.parent);
+        switch (operation.type) {
+        case GenericModel::ChangeSet::Sort:
+            replicaModel.sort(operation.sortKeys, parent, operation.recursive);
+            break;
+        case GenericModel::ChangeSet::InsertRows:
+            replicaModel.insertRows(operation.first, operation.count, parent);
+            break;
+        case GenericModel::ChangeSet::RemoveRows:
+            replicaModel.removeRows(operation.first, operation.count, parent);
+            break;
+        default:
+            QFAIL("Unexpected operation");
+        }
+    }
+    QCOMPARE(replicaModel.rowCount(), testModel.rowCount());
+    for (int i = 0; i < testModel.rowCount(); ++i) {
+        for (int j = 0; j < testModel.columnCount(); ++j)
+            QCOMPARE(replicaModel.index(i, j).data(), testModel.index(i, j).data());
+    }
+}
+
+void tst_GenericModel::visitCells()
+{
+    GenericModel testModel;
+    testModel.insertColumns(0, 2);
+    testModel.insertRows(0, 50);
+    int expectedSum = 0;
+    for (int i = 0; i < 50; ++i) {
+        testModel.setData(testModel.index(i, 0), i);
+        expectedSum += i;
+    }
+    const QModelIndex parentIdx = testModel.index(3, 1);
+    testModel.insertColumn(0, parentIdx);
+    testModel.insertRows(0, 2, parentIdx);
+    testModel.setData(testModel.index(1, 0, parentIdx), 1000);
+    expectedSum += 1000;
+
+    int visitedCount = 0;
+    int visitedSum = 0;
+    int maxDepth = 0;
+    QVariant childData;
+    testModel.visit(QModelIndex(), [&](const GenericModel::CellView &cell) -> bool {
+        ++visitedCount;
+        visitedSum += cell.data(Qt::EditRole).toInt();
+        maxDepth = qMax(maxDepth, cell.depth());
+        if (cell.depth() == 1 && cell.row() == 1)
+            childData = cell.itemData().value(Qt::DisplayRole);
+        return true;
+    });
+    QCOMPARE(visitedCount, 102);
+    QCOMPARE(visitedSum, expectedSum);
+    QCOMPARE(maxDepth, 1);
+    QCOMPARE(childData.toInt(), 1000);
+
+    visitedCount = 0;
+    testModel.visit(QModelIndex(), [&](const GenericModel::CellView &cell) -> bool {
+        ++visitedCount;
+        return cell.rowCount() == 0;
+    });
+    QCOMPARE(visitedCount, 100);
+
+    visitedCount = 0;
+    testModel.visit(parentIdx, [&](const GenericModel::CellView &cell) -> bool {
+        ++visitedCount;
+        maxDepth = cell.depth();
+        return true;
+    });
+    QCOMPARE(visitedCount, 2);
+    QCOMPARE(maxDepth, 1);
+
+    QMutex resultMutex;
+    visitedCount = 0;
+    visitedSum = 0;
+    testModel.visitParallel(QModelIndex(), [&](const GenericModel::CellView &cell) -> bool {
+        const int value = cell.data().toInt();
+        QMutexLocker resultLocker(&resultMutex);
+        ++visitedCount;
+        visitedSum += value;
+        return true;
+    });
+    QCOMPARE(visitedCount, 102);
+    QCOMPARE(visitedSum, expectedSum);
+}
+
+void tst_GenericModel::fixedRoleModel()
+{
+    typedef FixedRoleGenericModel<Qt::DisplayRole, Qt::ToolTipRole, Qt::UserRole + 1> TestModelType;
+    static_assert(TestModelType::roleSlot(Qt::ToolTipRole) == 1, "Unexpected role slot");
+    static_assert(TestModelType::roleSlot(Qt::EditRole) == 0, "EditRole should be merged with DisplayRole");
+    static_assert(TestModelType::roleSlot(Qt::UserRole) == -1, "Unexpected role slot");
+    TestModelType testModel;
+    ModelTest probe(&testModel, nullptr);
+    QVERIFY(testModel.insertColumns(0, 2));
+    QVERIFY(testModel.insertRows(0, 3));
+    QCOMPARE(testModel.rowCount(), 3);
+    QCOMPARE(testModel.columnCount(), 2);
+    QSignalSpy dataChangedSpy(&testModel, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+    QVERIFY(dataChangedSpy.isValid());
+    QVERIFY(testModel.setData(testModel.index(0, 0), QStringLiteral("Hello")));
+    QCOMPARE(dataChangedSpy.count(), 1);
+    QCOMPARE(testModel.index(0, 0).data().toString(), QStringLiteral("Hello"));
+    QCOMPARE(testModel.index(0, 0).data(Qt::EditRole).toString(), QStringLiteral("Hello"));
+    QVERIFY(testModel.setData(testModel.index(0, 0), 5, Qt::UserRole + 1));
+    QVERIFY(!testModel.setData(testModel.index(0, 0), 5, Qt::UserRole));
+    QVERIFY(!testModel.index(0, 0).data(Qt::UserRole).isValid());
+    QCOMPARE(dataChangedSpy.count(), 2);
+    const QMap<int, QVariant> itemData = testModel.itemData(testModel.index(0, 0));
+    QCOMPARE(itemData.size(), 3);
+    QCOMPARE(itemData.value(Qt::UserRole + 1).toInt(), 5);
+    QMap<int, QVariant> newItemData;
+    newItemData.insert(Qt::ToolTipRole, QStringLiteral("Tip"));
+    QVERIFY(testModel.setItemData(testModel.index(1, 1), newItemData));
+    QCOMPARE(testModel.index(1, 1).data(Qt::ToolTipRole).toString(), QStringLiteral("Tip"));
+    newItemData.insert(Qt::UserRole, 1);
+    QVERIFY(!testModel.setItemData(testModel.index(1, 1), newItemData));
+
+    QVERIFY(testModel.setHeaderData(1, Qt::Horizontal, QStringLiteral("Header")));
+    QCOMPARE(testModel.headerData(1, Qt::Horizontal).toString(), QStringLiteral("Header"));
+    QVERIFY(testModel.insertColumn(0));
+    QCOMPARE(testModel.headerData(2, Qt::Horizontal).toString(), QStringLiteral("Header"));
+    QCOMPARE(testModel.index(0, 1).data().toString(), QStringLiteral("Hello"));
+    QCOMPARE(testModel.index(1, 2).data(Qt::ToolTipRole).toString(), QStringLiteral("Tip"));
+
+    const QModelIndex parentIdx = testModel.index(1, 2);
+    QVERIFY(testModel.insertColumns(0, 1, parentIdx));
+    QVERIFY(testModel.insertRows(0, 2, parentIdx));
+    QVERIFY(testModel.setData(testModel.index(1, 0, parentIdx), 42));
+    QCOMPARE(testModel.index(1, 0, parentIdx).parent(), parentIdx);
+    QVERIFY(testModel.moveRows(QModelIndex(), 1, 1, QModelIndex(), 0));
+    const QModelIndex movedParentIdx = testModel.index(0, 2);
+    QCOMPARE(testModel.rowCount(movedParentIdx), 2);
+    QCOMPARE(testModel.index(1, 0, movedParentIdx).data().toInt(), 42);
+    QCOMPARE(testModel.index(1, 1).data().toString(), QStringLiteral("Hello"));
+    QVERIFY(testModel.moveColumns(QModelIndex(), 2, 1, QModelIndex(), 0));
+    QCOMPARE(testModel.headerData(0, Qt::Horizontal).toString(), QStringLiteral("Header"));
+    QCOMPARE(testModel.index(1, 2).data().toString(), QStringLiteral("Hello"));
+    QVERIFY(!testModel.moveRows(QModelIndex(), 0, 1, testModel.index(0, 0), 0));
+    QVERIFY(testModel.removeColumn(2));
+    QVERIFY(!testModel.index(1, 1).data().isValid());
+    QVERIFY(testModel.removeRows(0, 2));
+    QCOMPARE(testModel.rowCount(), 1);
+    QVERIFY(testModel.clearItemData(testModel.index(0, 0)));
+    QVERIFY(testModel.itemData(testModel.index(0, 0)).isEmpty());
+}
+
+void tst_GenericModel::fixedRoleModelSortMove()
+{
+    typedef FixedRoleGenericModel<Qt::DisplayRole, Qt::UserRole> TestModelType;
+    TestModelType testModel;
+    ModelTest probe(&testModel, nullptr);
+    testModel.insertColumns(0, 2);
+    testModel.insertRows(0, 4);
+    const QStringList names{QStringLiteral("d"), QStringLiteral("b"), QStringLiteral("a"), QStringLiteral("c")};
+    for (int i = 0; i < testModel.rowCount(); ++i) {
+        testModel.setData(testModel.index(i, 0), names.at(i));
+        testModel.setData(testModel.index(i, 1), i % 2, Qt::UserRole);
+        testModel.setHeaderData(i, Qt::Vertical, names.at(i));
+    }
+    const QPersistentModelIndex persistentIdx = testModel.index(0, 1);
+    testModel.sort(0);
+    for (int i = 0; i < testModel.rowCount(); ++i) {
+        QCOMPARE(testModel.index(i, 0).data().toString(), QString(QLatin1Char('a' + i)));
+        QCOMPARE(testModel.headerData(i, Qt::Vertical).toString(), QString(QLatin1Char('a' + i)));
+    }
+    QCOMPARE(persistentIdx.row(), 3);
+    // same ordering as GenericModel: UserRole descending, ties broken by DisplayRole ascending
+    testModel.sort(QVector<GenericModel::SortKey>{GenericModel::SortKey(1, Qt::UserRole, Qt::DescendingOrder), GenericModel::SortKey(0)});
+    QCOMPARE(testModel.index(0, 0).data().toString(), QStringLiteral("b"));
+    QCOMPARE(testModel.index(1, 0).data().toString(), QStringLiteral("c"));
+    QCOMPARE(testModel.index(2, 0).data().toString(), QStringLiteral("a"));
+    QCOMPARE(testModel.index(3, 0).data().toString(), QStringLiteral("d"));
+
+    // rows and columns can move to a different parent
+    const QPersistentModelIndex parentIdx = testModel.index(0, 0);
+    QVERIFY(testModel.moveRows(QModelIndex(), 2, 2, parentIdx, 0));
+    QCOMPARE(testModel.rowCount(), 2);
+    QCOMPARE(testModel.rowCount(parentIdx), 2);
+    QCOMPARE(testModel.columnCount(parentIdx), 2);
+    QCOMPARE(testModel.index(1, 0, parentIdx).data().toString(), QStringLiteral("d"));
+    QVERIFY(!testModel.moveRows(QModelIndex(), 0, 1, testModel.index(0, 0, parentIdx), 0));
+    QCOMPARE(testModel.columnCount(testModel.index(0, 0, parentIdx)), 0);
+    QVERIFY(testModel.moveColumns(parentIdx, 1, 1, QModelIndex(), 2));
+    QCOMPARE(testModel.columnCount(), 3);
+    QCOMPARE(testModel.columnCount(parentIdx), 1);
+    QCOMPARE(testModel.index(0, 2).data(Qt::UserRole).toInt(), 0);
+    QCOMPARE(testModel.index(1, 2).data(Qt::UserRole).toInt(), 0);
+    QVERIFY(!testModel.index(1, 2).data().isValid());
+
+    QHash<int, QByteArray> roleNames;
+    roleNames.insert(Qt::UserRole, QByteArrayLiteral("parity"));
+    testModel.setRoleNames(roleNames);
+    QCOMPARE(testModel.roleNames(), roleNames);
+    QMimeData *mime = testModel.mimeData(QModelIndexList{testModel.index(1, 0)});
+    QVERIFY(mime);
+    QCOMPARE(mime->text(), QStringLiteral("c"));
+    delete mime;
+}
+
+namespace {
+struct TelemetrySample
+{
+    int id;
+    double value;
+    QString source;
+};
+}
+
+void tst_GenericModel::structTableModel()
+{
+    StructTableModel<TelemetrySample, STRUCT_TABLE_COLUMN(TelemetrySample, id), STRUCT_TABLE_COLUMN(TelemetrySample, source)> testModel;
+    ModelTest probe(&testModel, nullptr);
+    QCOMPARE(testModel.columnCount(), 2);
+    testModel.setRows(std::vector<TelemetrySample>{{3, 0.5, QStringLiteral("C")}, {1, 1.5, QStringLiteral("A")}});
+    testModel.appendRow(TelemetrySample{2, 2.5, QStringLiteral("B")});
+    QCOMPARE(testModel.rowCount(), 3);
+    QCOMPARE(testModel.index(0, 0).data().toInt(), 3);
+    QCOMPARE(testModel.index(2, 1).data().toString(), QStringLiteral("B"));
+    QVERIFY(!testModel.index(0, 0).data(Qt::ToolTipRole).isValid());
+    QVERIFY(testModel.setData(testModel.index(0, 1), QStringLiteral("D")));
+    QCOMPARE(testModel.rowValue(0).source, QStringLiteral("D"));
+    QCOMPARE(testModel.rowValue(0).value, 0.5);
+    QVERIFY(!testModel.setData(testModel.index(0, 0), QStringLiteral("abc")));
+    QCOMPARE(testModel.rowValue(0).id, 3);
+    QVERIFY(testModel.setData(testModel.index(0, 0), QStringLiteral("4")));
+    QCOMPARE(testModel.rowValue(0).id, 4);
+    QVERIFY(testModel.setData(testModel.index(0, 0), 3));
+    QSignalSpy dataChangedSpy(&testModel, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+    QVERIFY(dataChangedSpy.isValid());
+    // writing the value already stored is not signalled
+    QVERIFY(testModel.setData(testModel.index(0, 0), QStringLiteral("3")));
+    QVERIFY(testModel.setData(testModel.index(0, 1), QStringLiteral("D")));
+    QCOMPARE(dataChangedSpy.count(), 0);
+    QMimeData *mime = testModel.mimeData(QModelIndexList{testModel.index(0, 1)});
+    QVERIFY(mime);
+    QCOMPARE(mime->text(), QStringLiteral("D"));
+    delete mime;
+    QVERIFY(testModel.setHeaderData(1, Qt::Horizontal, QStringLiteral("Source")));
+    QCOMPARE(testModel.headerData(1, Qt::Horizontal).toString(), QStringLiteral("Source"));
+
+    const QPersistentModelIndex persistentIdx(testModel.index(0, 1));
+    testModel.sort(0);
+    QCOMPARE(testModel.index(0, 0).data().toInt(), 1);
+    QCOMPARE(testModel.index(1, 0).data().toInt(), 2);
+    QCOMPARE(testModel.index(2, 0).data().toInt(), 3);
+    QCOMPARE(persistentIdx.row(), 2);
+    QCOMPARE(persistentIdx.data().toString(), QStringLiteral("D"));
+    testModel.sort(1, Qt::DescendingOrder);
+    QCOMPARE(testModel.index(0, 1).data().toString(), QStringLiteral("D"));
+    QCOMPARE(testModel.index(2, 1).data().toString(), QStringLiteral("A"));
+
+    QVERIFY(testModel.moveRows(QModelIndex(), 2, 1, QModelIndex(), 0));
+    QCOMPARE(testModel.rowValue(0).id, 1);
+    QVERIFY(testModel.insertRows(1, 2));
+    QCOMPARE(testModel.rowCount(), 5);
+    QCOMPARE(testModel.rowValue(1).id, 0);
+    QVERIFY(testModel.removeRows(1, 2));
+    QCOMPARE(testModel.rowValue(1).id, 3);
+}
+
+void tst_GenericModel::typedValues()
+{
+    GenericModel testModel;
+    ModelTest probe(&testModel, nullptr);
+    testModel.insertColumns(0, 2);
+    testModel.insertRows(0, 4);
+    for (int i = 0; i < 3; ++i)
+        QVERIFY(testModel.setValue(testModel.index(i, 1), Qt::EditRole, i + 0.5));
+    QVERIFY(testModel.setValue(testModel.index(0, 0), Qt::UserRole, QStringLiteral("Text")));
+    QCOMPARE(testModel.value<double>(testModel.index(1, 1)), 1.5);
+    QCOMPARE(testModel.value<double>(testModel.index(1, 1), Qt::EditRole), 1.5);
+    QCOMPARE(testModel.value<double>(testModel.index(3, 1)), 0.0);
+    QCOMPARE(testModel.value<QString>(testModel.index(0, 0), Qt::UserRole), QStringLiteral("Text"));
+    QVERIFY(testModel.value<QString>(QModelIndex()).isEmpty());
+
+    double columnValues[4];
+    QVERIFY(testModel.readColumn(QModelIndex(), 1, Qt::DisplayRole, columnValues));
+    QCOMPARE(columnValues[0], 0.5);
+    QCOMPARE(columnValues[1], 1.5);
+    QCOMPARE(columnValues[2], 2.5);
+    QCOMPARE(columnValues[3], 0.0);
+    QVERIFY(!testModel.readColumn(QModelIndex(), 2, Qt::DisplayRole, columnValues));
+    QVERIFY(!testModel.readColumn<double>(QModelIndex(), 1, Qt::DisplayRole, nullptr));
+}
+
+void tst_GenericModel::applyDiff()
+{
+    GenericModel testModel;
+    ModelTest probe(&testModel, nullptr);
+    testModel.insertColumns(0, 2);
+    testModel.insertRows(0, 5);
+    const QStringList oldKeys{QStringLiteral("A"), QStringLiteral("B"), QStringLiteral("C"), QStringLiteral("D"), QStringLiteral("E")};
+    for (int i = 0; i < oldKeys.size(); ++i) {
+        testModel.setData(testModel.index(i, 0), oldKeys.at(i));
+        testModel.setData(testModel.index(i, 1), i);
+    }
+    testModel.insertColumn(0, testModel.index(1, 0));
+    testModel.insertRow(0, testModel.index(1, 0));
+    testModel.setData(testModel.index(0, 0, testModel.index(1, 0)), QStringLiteral("Child"));
+
+    GenericModel newModel;
+    newModel.insertColumns(0, 2);
+    newModel.insertRows(0, 5);
+    const QStringList newKeys{QStringLiteral("C"), QStringLiteral("A"), QStringLiteral("F"), QStringLiteral("D"), QStringLiteral("B")};
+    const int newValues[] = {2, 10, 5, 3, 1};
+    for (int i = 0; i < newKeys.size(); ++i) {
+        newModel.setData(newModel.index(i, 0), newKeys.at(i));
+        newModel.setData(newModel.index(i, 1), newValues[i]);
+    }
+    newModel.insertColumn(0, newModel.index(4, 0));
+    newModel.insertRow(0, newModel.index(4, 0));
+    newModel.setData(newModel.index(0, 0, newModel.index(4, 0)), QStringLiteral("Child"));
+    newModel.insertColumn(0, newModel.index(3, 0));
+    newModel.insertRow(0, newModel.index(3, 0));
+    newModel.setData(newModel.index(0, 0, newModel.index(3, 0)), QStringLiteral("New Child"));
+    QVERIFY(testModel.setHeaderData(1, Qt::Vertical, QStringLiteral("Header B")));
+    QVERIFY(newModel.setHeaderData(1, Qt::Vertical, QStringLiteral("Header A")));
+    QVERIFY(newModel.setHeaderData(2, Qt::Vertical, QStringLiteral("Header F")));
+
+    const QPersistentModelIndex persistentIdx(testModel.index(1, 0));
+    QSignalSpy resetSpy(&testModel, SIGNAL(modelReset()));
+    QVERIFY(resetSpy.isValid());
+    QSignalSpy removedSpy(&testModel, SIGNAL(rowsRemoved(QModelIndex, int, int)));
+    QVERIFY(removedSpy.isValid());
+    QSignalSpy insertedSpy(&testModel, SIGNAL(rowsInserted(QModelIndex, int, int)));
+    QVERIFY(insertedSpy.isValid());
+    QSignalSpy dataChangedSpy(&testModel, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+    QVERIFY(dataChangedSpy.isValid());
+    QSignalSpy headerChangedSpy(&testModel, SIGNAL(headerDataChanged(Qt::Orientation, int, int)));
+    QVERIFY(headerChangedSpy.isValid());
+    QVERIFY(!testModel.applyDiff(newModel, 2));
+    QVERIFY(testModel.applyDiff(newModel, 0));
+    QCOMPARE(resetSpy.count(), 0);
+    QCOMPARE(testModel.rowCount(), 5);
+    for (int i = 0; i < newKeys.size(); ++i) {
+        QCOMPARE(testModel.index(i, 0).data().toString(), newKeys.at(i));
+        QCOMPARE(testModel.index(i, 1).data().toInt(), newValues[i]);
+    }
+    QCOMPARE(persistentIdx.row(), 4);
+    QCOMPARE(testModel.index(0, 0, persistentIdx).data().toString(), QStringLiteral("Child"));
+    QCOMPARE(testModel.index(0, 0, testModel.index(3, 0)).data().toString(), QStringLiteral("New Child"));
+    // E removed, F inserted and D's child added
+    QCOMPARE(removedSpy.count(), 1);
+    QCOMPARE(insertedSpy.count(), 2);
+    // only A's value changed
+    QCOMPARE(dataChangedSpy.count(), 1);
+    QCOMPARE(dataChangedSpy.first().at(0).value<QModelIndex>(), testModel.index(1, 1));
+    // the vertical headers follow the rows: A gets its new header, F is inserted with its own and B loses the old one
+    for (int i = 0; i < newKeys.size(); ++i)
+        QCOMPARE(testModel.headerData(i, Qt::Vertical), newModel.headerData(i, Qt::Vertical));
+    QCOMPARE(headerChangedSpy.count(), 2);
+    QCOMPARE(headerChangedSpy.at(0).at(1).toInt(), 1);
+    QCOMPARE(headerChangedSpy.at(1).at(1).toInt(), 4);
+
+    dataChangedSpy.clear();
+    headerChangedSpy.clear();
+    QVERIFY(testModel.applyDiff(newModel, 0));
+    QCOMPARE(dataChangedSpy.count(), 0);
+    QCOMPARE(headerChangedSpy.count(), 0);
+    QCOMPARE(removedSpy.count(), 1);
+    QCOMPARE(insertedSpy.count(), 2);
+}
+
+void tst_GenericModel::parallelMatch()
+{
+    GenericModel testModel;
+    testModel.insertColumns(0, 2);
+    testModel.insertRows(0, 5000);
+    int expectedFound = 0;
+    for (int i = 0; i < 5000; ++i) {
+        testModel.setData(testModel.index(i, 0), QStringLiteral("Item %1").arg(i));
+        testModel.setData(testModel.index(i, 1), i % 7);
+        if (i % 7 == 3)
+            ++expectedFound;
+    }
+    const QModelIndex parentIdx = testModel.index(10, 0);
+    testModel.insertColumns(0, 2, parentIdx);
+    testModel.insertRow(0, parentIdx);
+    testModel.setData(testModel.index(0, 0, parentIdx), QStringLiteral("Item 1 child"));
+    testModel.setData(testModel.index(0, 1, parentIdx), 3);
+    ++expectedFound;
+
+    const QModelIndex start = testModel.index(4000, 0);
+    const QVector<Qt::MatchFlags> flagsToTest{Qt::MatchContains | Qt::MatchWrap,
+                                              Qt::MatchStartsWith | Qt::MatchWrap | Qt::MatchRecursive,
+                                              Qt::MatchFlags(Qt::MatchExactly),
+                                              Qt::MatchFixedString | Qt::MatchRecursive | Qt::MatchWrap,
+                                              Qt::MatchEndsWith | Qt::MatchRecursive,
+                                              Qt::MatchWildcard | Qt::MatchWrap | Qt::MatchRecursive};
+    const QStringList valuesToTest{QStringLiteral("item 1"), QStringLiteral("Item 1"), QStringLiteral("Item 4200"), QStringLiteral("item 1 CHILD"),
+                                   QStringLiteral("9"), QStringLiteral("Item 1*")};
+    for (int i = 0; i < flagsToTest.size(); ++i) {
+        const QModelIndexList expected = testModel.QAbstractItemModel::match(start, Qt::DisplayRole, valuesToTest.at(i), -1, flagsToTest.at(i));
+        QVERIFY(!expected.isEmpty());
+        QCOMPARE(testModel.match(start, Qt::DisplayRole, valuesToTest.at(i), -1, flagsToTest.at(i)), expected);
+        QCOMPARE(testModel.match(start, Qt::EditRole, valuesToTest.at(i), 2, flagsToTest.at(i)), expected.mid(0, 2));
+    }
+
+    const QModelIndexList found = testModel.findAll([](const QVariant &value) -> bool { return value.toInt() == 3; });
+    QCOMPARE(found.size(), expectedFound);
+    QCOMPARE(found.first(), testModel.index(3, 1));
+    QCOMPARE(found.at(1), testModel.index(0, 1, parentIdx));
+    QCOMPARE(testModel.findAll([](const QVariant &value) -> bool { return value.toInt() == 3; }, Qt::DisplayRole, Qt::MatchFlags()).size(),
+             expectedFound - 1);
+}
+
 void tst_GenericModel::moveRowsList()
 {
 
@@ -40,6 +40,22 @@ private Q_SLOTS:
     void sortTree();
     void sortTreeChildren();
     void sortTreeRecursive();
+    void sortMultiKey();
+    void keepSorted();
+    void keepSortedColumnShift();
+    void valueInterning();
+    void valueInterningPlainCopy();
+    void valueInterningColumnShift();
+    void columnAggregates();
+    void changeTracking();
+    void changeSetReplay();
+    void visitCells();
+    void fixedRoleModel();
+    void fixedRoleModelSortMove();
+    void structTableModel();
+    void typedValues();
+    void applyDiff();
+    void parallelMatch();
     void moveRowsList();
     void moveRowsTable();
     void moveRowsTreeSameBranch();
@@ -0,0 +1,3 @@
+#include "tst_modelreplica.h"
+#include <QtTest/QTest>
+QTEST_MAIN(tst_ModelReplica)
\ No newline at end of file
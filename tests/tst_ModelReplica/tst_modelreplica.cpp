@@ -0,0 +1,224 @@
+#include "tst_modelreplica.h"
+#include <QCoreApplication>
+#include <modelreplica.h>
+#include <QtTest/QTest>
+#include <QtTest/QSignalSpy>
+#include "../modeltestmanager.h"
+
+QString uniqueServerName(const char *testName)
+{
+    return QStringLiteral("tst_ModelReplica_%1_%2").arg(QCoreApplication::applicationPid()).arg(QLatin1String(testName));
+}
+
+void fillTreeModel(GenericModel *model)
+{
+    model->insertColumns(0, 2);
+    model->insertRows(0, 3);
+    for (int i = 0; i < model->rowCount(); ++i) {
+        for (int j = 0; j < model->columnCount(); ++j) {
+            model->setData(model->index(i, j), QStringLiteral("%1,%2").arg(i).arg(j));
+            model->setData(model->index(i, j), i * 10 + j, Qt::UserRole);
+        }
+        const QModelIndex parIdx = model->index(i, 0);
+        model->insertColumns(0, 2, parIdx);
+        model->insertRows(0, 2, parIdx);
+        for (int k = 0; k < model->rowCount(parIdx); ++k) {
+            for (int h = 0; h < model->columnCount(parIdx); ++h)
+                model->setData(model->index(k, h, parIdx), QStringLiteral("%1,%2,%3").arg(i).arg(k).arg(h));
+        }
+    }
+    model->setHeaderData(0, Qt::Horizontal, QStringLiteral("First"));
+    model->setHeaderData(1, Qt::Horizontal, QStringLiteral("Second"));
+}
+
+void tst_ModelReplica::compareModels(const QAbstractItemModel *source, const QAbstractItemModel *replica, const QModelIndex &sourcePar,
+                                     const QModelIndex &replicaPar)
+{
+    QCOMPARE(replica->rowCount(replicaPar), source->rowCount(sourcePar));
+    QCOMPARE(replica->columnCount(replicaPar), source->columnCount(sourcePar));
+    if (!sourcePar.isValid()) {
+        for (int i = 0; i < source->columnCount(); ++i)
+            QCOMPARE(replica->headerData(i, Qt::Horizontal), source->headerData(i, Qt::Horizontal));
+    }
+    for (int i = 0, maxRow = source->rowCount(sourcePar); i < maxRow; ++i) {
+        for (int j = 0, maxCol = source->columnCount(sourcePar); j < maxCol; ++j) {
+            const QModelIndex sourceIdx = source->index(i, j, sourcePar);
+            const QModelIndex replicaIdx = replica->index(i, j, replicaPar);
+            QCOMPARE(replica->itemData(replicaIdx), source->itemData(sourceIdx));
+            QCOMPARE(replica->flags(replicaIdx), source->flags(sourceIdx));
+            if (source->hasChildren(sourceIdx))
+                compareModels(source, replica, sourceIdx, replicaIdx);
+        }
+    }
+}
+
+void tst_ModelReplica::autoParent()
+{
+    QObject *parentObj = new QObject;
+    auto testItem = new ModelReplica(parentObj);
+    QSignalSpy testItemDestroyedSpy(testItem, SIGNAL(destroyed(QObject *)));
+    QVERIFY(testItemDestroyedSpy.isValid());
+    auto testSource = new ModelReplicaSource(parentObj);
+    QSignalSpy testSourceDestroyedSpy(testSource, SIGNAL(destroyed(QObject *)));
+    QVERIFY(testSourceDestroyedSpy.isValid());
+    delete parentObj;
+    QCOMPARE(testItemDestroyedSpy.count(), 1);
+    QCOMPARE(testSourceDestroyedSpy.count(), 1);
+}
+
+void tst_ModelReplica::initialSnapshot()
+{
+    GenericModel baseModel;
+    fillTreeModel(&baseModel);
+    ModelReplicaSource source(&baseModel);
+    QVERIFY2(source.listen(uniqueServerName("initialSnapshot")), qPrintable(source.errorString()));
+    ModelReplica replica;
+    new ModelTest(&replica, &replica);
+    QSignalSpy synchronisedSpy(&replica, SIGNAL(synchronised()));
+    QVERIFY(synchronisedSpy.isValid());
+    QSignalSpy modelResetSpy(&replica, SIGNAL(modelReset()));
+    QVERIFY(modelResetSpy.isValid());
+    QSignalSpy rowsInsertedSpy(&replica, SIGNAL(rowsInserted(QModelIndex, int, int)));
+    QVERIFY(rowsInsertedSpy.isValid());
+    replica.connectToSource(source.serverName());
+    QVERIFY(synchronisedSpy.wait());
+    QVERIFY(replica.isConnected());
+    QCOMPARE(source.replicaCount(), 1);
+    QCOMPARE(modelResetSpy.count(), 1);
+    QCOMPARE(rowsInsertedSpy.count(), 0);
+    compareModels(&baseModel, &replica, QModelIndex(), QModelIndex());
+}
+
+void tst_ModelReplica::streamChanges()
+{
+    GenericModel baseModel;
+    fillTreeModel(&baseModel);
+    ModelReplicaSource source(&baseModel);
+    QVERIFY2(source.listen(uniqueServerName("streamChanges")), qPrintable(source.errorString()));
+    ModelReplica replica;
+    new ModelTest(&replica, &replica);
+    QSignalSpy synchronisedSpy(&replica, SIGNAL(synchronised()));
+    QVERIFY(synchronisedSpy.isValid());
+    replica.connectToSource(source.serverName());
+    QVERIFY(synchronisedSpy.wait());
+    QSignalSpy modelResetSpy(&replica, SIGNAL(modelReset()));
+    QVERIFY(modelResetSpy.isValid());
+    QSignalSpy dataChangedSpy(&replica, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+    QVERIFY(dataChangedSpy.isValid());
+
+    // all these changes happen in the same event loop iteration and reach the replica as one batch
+    baseModel.setData(baseModel.index(0, 1), QStringLiteral("Changed"));
+    baseModel.insertRows(1, 2, baseModel.index(2, 0));
+    baseModel.setData(baseModel.index(1, 0, baseModel.index(2, 0)), QStringLiteral("New"));
+    baseModel.insertRow(0);
+    baseModel.setData(baseModel.index(0, 0), QStringLiteral("Top"));
+    baseModel.removeRows(0, 1, baseModel.index(2, 0));
+    baseModel.insertColumn(2);
+    baseModel.setHeaderData(2, Qt::Horizontal, QStringLiteral("Third"));
+    baseModel.moveRows(QModelIndex(), 3, 1, QModelIndex(), 0);
+    baseModel.moveRows(baseModel.index(2, 0), 0, 1, baseModel.index(1, 0), 1);
+    QTRY_COMPARE(replica.rowCount(), baseModel.rowCount());
+    QTRY_COMPARE(replica.columnCount(), baseModel.columnCount());
+    QTRY_COMPARE(replica.headerData(2, Qt::Horizontal).toString(), QStringLiteral("Third"));
+    compareModels(&baseModel, &replica, QModelIndex(), QModelIndex());
+    QCOMPARE(modelResetSpy.count(), 0);
+    QVERIFY(dataChangedSpy.count() > 0);
+    QCOMPARE(synchronisedSpy.count(), 1);
+
+    baseModel.removeRows(0, 2);
+    QTRY_COMPARE(replica.rowCount(), baseModel.rowCount());
+    compareModels(&baseModel, &replica, QModelIndex(), QModelIndex());
+
+    // header roles removed from the source are removed from the replica
+    baseModel.setHeaderData(0, Qt::Horizontal, QStringLiteral("Tip"), Qt::ToolTipRole);
+    QTRY_COMPARE(replica.headerData(0, Qt::Horizontal, Qt::ToolTipRole).toString(), QStringLiteral("Tip"));
+    baseModel.setHeaderData(0, Qt::Horizontal, QVariant(), Qt::ToolTipRole);
+    QTRY_VERIFY(!replica.headerData(0, Qt::Horizontal, Qt::ToolTipRole).isValid());
+    QCOMPARE(modelResetSpy.count(), 0);
+}
+
+void tst_ModelReplica::sortSendsPermutation()
+{
+    GenericModel baseModel;
+    fillTreeModel(&baseModel);
+    ModelReplicaSource source(&baseModel);
+    QVERIFY2(source.listen(uniqueServerName("sortSendsPermutation")), qPrintable(source.errorString()));
+    ModelReplica replica;
+    new ModelTest(&replica, &replica);
+    QSignalSpy synchronisedSpy(&replica, SIGNAL(synchronised()));
+    QVERIFY(synchronisedSpy.isValid());
+    replica.connectToSource(source.serverName());
+    QVERIFY(synchronisedSpy.wait());
+    QSignalSpy modelResetSpy(&replica, SIGNAL(modelReset()));
+    QVERIFY(modelResetSpy.isValid());
+    QSignalSpy layoutChangedSpy(&replica, SIGNAL(layoutChanged()));
+    QVERIFY(layoutChangedSpy.isValid());
+    const QPersistentModelIndex trackedIndex = replica.index(0, 1);
+    baseModel.setData(baseModel.index(1, 0), QStringLiteral("1,0 changed"));
+    baseModel.sort(0, Qt::DescendingOrder);
+    QTRY_COMPARE(replica.index(0, 0).data().toString(), baseModel.index(0, 0).data().toString());
+    compareModels(&baseModel, &replica, QModelIndex(), QModelIndex());
+    QCOMPARE(modelResetSpy.count(), 0);
+    QCOMPARE(layoutChangedSpy.count(), 1);
+    QCOMPARE(trackedIndex.row(), 2);
+    QCOMPARE(trackedIndex.data().toString(), QStringLiteral("0,1"));
+
+    // a recursive sort sends the permutation of every level that changed
+    layoutChangedSpy.clear();
+    baseModel.sort(QVector<GenericModel::SortKey>{GenericModel::SortKey(1, Qt::DisplayRole, Qt::DescendingOrder)}, QModelIndex(), true);
+    QTRY_COMPARE(layoutChangedSpy.count(), 3);
+    compareModels(&baseModel, &replica, QModelIndex(), QModelIndex());
+    QCOMPARE(modelResetSpy.count(), 0);
+    QCOMPARE(synchronisedSpy.count(), 1);
+}
+
+void tst_ModelReplica::layoutChangeSendsSnapshot()
+{
+    GenericModel baseModel;
+    fillTreeModel(&baseModel);
+    ModelReplicaSource source(&baseModel);
+    QVERIFY2(source.listen(uniqueServerName("layoutChangeSendsSnapshot")), qPrintable(source.errorString()));
+    ModelReplica replica;
+    new ModelTest(&replica, &replica);
+    QSignalSpy synchronisedSpy(&replica, SIGNAL(synchronised()));
+    QVERIFY(synchronisedSpy.isValid());
+    replica.connectToSource(source.serverName());
+    QVERIFY(synchronisedSpy.wait());
+    // a layout change that is not a sort can't be expressed as a permutation
+    baseModel.setData(baseModel.index(1, 0), QStringLiteral("1,0 changed"));
+    baseModel.layoutAboutToBeChanged();
+    baseModel.layoutChanged();
+    QVERIFY(synchronisedSpy.wait());
+    QCOMPARE(synchronisedSpy.count(), 2);
+    compareModels(&baseModel, &replica, QModelIndex(), QModelIndex());
+
+    GenericModel otherModel;
+    otherModel.insertColumns(0, 1);
+    otherModel.insertRows(0, 1);
+    otherModel.setData(otherModel.index(0, 0), QStringLiteral("Other"));
+    source.setModel(&otherModel);
+    QVERIFY(synchronisedSpy.wait());
+    compareModels(&otherModel, &replica, QModelIndex(), QModelIndex());
+}
+
+void tst_ModelReplica::sourceDisconnects()
+{
+    GenericModel baseModel;
+    fillTreeModel(&baseModel);
+    ModelReplicaSource source(&baseModel);
+    QVERIFY2(source.listen(uniqueServerName("sourceDisconnects")), qPrintable(source.errorString()));
+    ModelReplica replica;
+    QSignalSpy synchronisedSpy(&replica, SIGNAL(synchronised()));
+    QVERIFY(synchronisedSpy.isValid());
+    QSignalSpy disconnectedSpy(&replica, SIGNAL(disconnected()));
+    QVERIFY(disconnectedSpy.isValid());
+    replica.connectToSource(source.serverName());
+    QVERIFY(synchronisedSpy.wait());
+    source.close();
+    QVERIFY(!source.isListening());
+    QCOMPARE(source.replicaCount(), 0);
+    QTRY_COMPARE(disconnectedSpy.count(), 1);
+    QVERIFY(!replica.isConnected());
+    // the last state received is kept
+    compareModels(&baseModel, &replica, QModelIndex(), QModelIndex());
+}
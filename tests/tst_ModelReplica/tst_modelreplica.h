@@ -0,0 +1,22 @@
+#ifndef TST_MODELREPLICA_H
+#define TST_MODELREPLICA_H
+
+#include <QObject>
+class QAbstractItemModel;
+class QModelIndex;
+class tst_ModelReplica : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void autoParent();
+    void initialSnapshot();
+    void streamChanges();
+    void sortSendsPermutation();
+    void layoutChangeSendsSnapshot();
+    void sourceDisconnects();
+
+protected:
+    void compareModels(const QAbstractItemModel *source, const QAbstractItemModel *replica, const QModelIndex &sourcePar,
+                       const QModelIndex &replicaPar);
+};
+#endif // TST_MODELREPLICA_H
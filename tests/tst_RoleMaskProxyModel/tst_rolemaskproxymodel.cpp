@@ -1,4 +1,5 @@
 #include <QtTest/QTest>
+#include <QBuffer>
 #include <QStringListModel>
 #include <rolemaskproxymodel.h>
 #include <QSortFilterProxyModel>
@@ -662,6 +663,440 @@ void tst_RoleMaskProxyModel::testMaskFlags()
     QVERIFY(!proxyModel.maskedFlags(proxyIdx));
 }
 
+void tst_RoleMaskProxyModel::testMaskRanges()
+{
+#ifdef QTMODELUTILITIES_GENERICMODEL
+    GenericModel baseModel;
+    baseModel.insertColumns(0, 3);
+    baseModel.insertRows(0, 5);
+    for (int i = 0; i < baseModel.rowCount(); ++i) {
+        for (int j = 0; j < baseModel.columnCount(); ++j)
+            baseModel.setData(baseModel.index(i, j), i, Qt::UserRole);
+    }
+    RoleMaskProxyModel proxyModel;
+    new ModelTest(&proxyModel, &baseModel);
+    proxyModel.addMaskedRole(Qt::UserRole);
+    proxyModel.setSourceModel(&baseModel);
+    QSignalSpy maskedDataChangedSpy(&proxyModel, SIGNAL(maskedDataChanged(QModelIndex, QModelIndex, QVector<int>)));
+    QVERIFY(maskedDataChangedSpy.isValid());
+    QVERIFY(!proxyModel.setMaskedColumnData(0, Qt::UserRole + 1, 1));
+    QVERIFY(!proxyModel.setMaskedColumnData(3, Qt::UserRole, 1));
+    QVERIFY(proxyModel.setMaskedColumnData(1, Qt::UserRole, 100));
+    QCOMPARE(maskedDataChangedSpy.count(), 1);
+    QCOMPARE(maskedDataChangedSpy.at(0).at(0).value<QModelIndex>(), proxyModel.index(0, 1));
+    QCOMPARE(maskedDataChangedSpy.at(0).at(1).value<QModelIndex>(), proxyModel.index(4, 1));
+    for (int i = 0; i < proxyModel.rowCount(); ++i)
+        QCOMPARE(proxyModel.index(i, 1).data(Qt::UserRole).toInt(), 100);
+    QCOMPARE(proxyModel.index(0, 0).data(Qt::UserRole).toInt(), 0);
+    QCOMPARE(proxyModel.maskedItemData(proxyModel.index(0, 1)).value(Qt::UserRole).toInt(), 100);
+    QVERIFY(proxyModel.setData(proxyModel.index(2, 1), 5, Qt::UserRole));
+    QCOMPARE(proxyModel.index(2, 1).data(Qt::UserRole).toInt(), 5);
+    QVERIFY(proxyModel.setMaskedRowData(3, Qt::UserRole, 200));
+    for (int j = 0; j < proxyModel.columnCount(); ++j)
+        QCOMPARE(proxyModel.index(3, j).data(Qt::UserRole).toInt(), 200);
+    QCOMPARE(proxyModel.index(2, 1).data(Qt::UserRole).toInt(), 5);
+    QVERIFY(proxyModel.setMaskedColumnFlags(2, Qt::ItemIsEnabled));
+    QCOMPARE(proxyModel.flags(proxyModel.index(1, 2)), Qt::ItemFlags(Qt::ItemIsEnabled));
+    QVERIFY(proxyModel.maskedFlags(proxyModel.index(1, 2)));
+    QVERIFY(!proxyModel.maskedFlags(proxyModel.index(1, 1)));
+
+    QVERIFY(baseModel.insertRow(0));
+    QVERIFY(!proxyModel.index(0, 0).data(Qt::UserRole).isValid());
+    QCOMPARE(proxyModel.index(0, 1).data(Qt::UserRole).toInt(), 100);
+    QCOMPARE(proxyModel.flags(proxyModel.index(0, 2)), Qt::ItemFlags(Qt::ItemIsEnabled));
+    QCOMPARE(proxyModel.index(4, 0).data(Qt::UserRole).toInt(), 200);
+    QCOMPARE(proxyModel.index(3, 0).data(Qt::UserRole).toInt(), 2);
+    QCOMPARE(proxyModel.index(3, 1).data(Qt::UserRole).toInt(), 5);
+    QVERIFY(baseModel.removeRow(4));
+    QCOMPARE(proxyModel.index(4, 0).data(Qt::UserRole).toInt(), 4);
+    QCOMPARE(proxyModel.index(4, 1).data(Qt::UserRole).toInt(), 100);
+
+    QVERIFY(!proxyModel.setMaskedRangeData(proxyModel.index(1, 0), proxyModel.index(0, 0), Qt::UserRole, 300));
+    QVERIFY(proxyModel.setMaskedRangeData(proxyModel.index(0, 0), proxyModel.index(1, 0), Qt::UserRole, 300));
+    QCOMPARE(proxyModel.index(0, 0).data(Qt::UserRole).toInt(), 300);
+    QCOMPARE(proxyModel.index(1, 0).data(Qt::UserRole).toInt(), 300);
+    QCOMPARE(proxyModel.index(2, 0).data(Qt::UserRole).toInt(), 1);
+    QVERIFY(baseModel.moveRows(QModelIndex(), 0, 1, QModelIndex(), 5));
+    QCOMPARE(proxyModel.index(0, 0).data(Qt::UserRole).toInt(), 300);
+    QCOMPARE(proxyModel.index(1, 0).data(Qt::UserRole).toInt(), 1);
+    QCOMPARE(proxyModel.index(4, 0).data(Qt::UserRole).toInt(), 300);
+
+    QVERIFY(proxyModel.setMaskedColumnData(1, Qt::UserRole, QVariant()));
+    QCOMPARE(proxyModel.index(0, 1).data(Qt::UserRole).toInt(), 0);
+    QCOMPARE(proxyModel.index(2, 1).data(Qt::UserRole).toInt(), 5);
+    proxyModel.clearMaskedRanges();
+    QCOMPARE(proxyModel.index(0, 0).data(Qt::UserRole).toInt(), 0);
+    QCOMPARE(proxyModel.flags(proxyModel.index(0, 2)), baseModel.flags(baseModel.index(0, 2)));
+    QVERIFY(!proxyModel.maskedFlags(proxyModel.index(0, 2)));
+#else
+    QSKIP("This test requires the GenericModel module");
+#endif
+}
+
+void tst_RoleMaskProxyModel::testMaskRangesSort()
+{
+#ifdef QTMODELUTILITIES_GENERICMODEL
+    GenericModel baseModel;
+    baseModel.insertColumns(0, 2);
+    baseModel.insertRows(0, 8);
+    const int values[] = {0, 4, 1, 5, 2, 6, 3, 7};
+    for (int i = 0; i < baseModel.rowCount(); ++i) {
+        baseModel.setData(baseModel.index(i, 0), values[i]);
+        baseModel.setData(baseModel.index(i, 1), i);
+    }
+    RoleMaskProxyModel proxyModel;
+    new ModelTest(&proxyModel, &baseModel);
+    proxyModel.addMaskedRole(Qt::UserRole);
+    proxyModel.setSourceModel(&baseModel);
+    QVERIFY(proxyModel.setMaskedRangeData(proxyModel.index(0, 0), proxyModel.index(3, 1), Qt::UserRole, 1));
+    QVERIFY(proxyModel.setMaskedRangeData(proxyModel.index(2, 0), proxyModel.index(5, 1), Qt::UserRole, 2));
+    const QVariant expected[] = {1, 1, 2, 2, 2, 2, QVariant(), QVariant()};
+    // the rules are split in one piece per block of rows that stays together
+    baseModel.sort(0);
+    for (int i = 0; i < proxyModel.rowCount(); ++i) {
+        const int sourceRow = proxyModel.index(i, 1).data().toInt();
+        QCOMPARE(proxyModel.index(i, 0).data(Qt::UserRole), expected[sourceRow]);
+        QCOMPARE(proxyModel.index(i, 1).data(Qt::UserRole), expected[sourceRow]);
+    }
+    // restoring the order merges the pieces back
+    baseModel.sort(1);
+    for (int i = 0; i < proxyModel.rowCount(); ++i) {
+        QCOMPARE(proxyModel.index(i, 0).data(Qt::UserRole), expected[i]);
+        QCOMPARE(proxyModel.index(i, 1).data(Qt::UserRole), expected[i]);
+    }
+    QVERIFY(baseModel.insertRow(2));
+    QCOMPARE(proxyModel.index(1, 0).data(Qt::UserRole).toInt(), 1);
+    QCOMPARE(proxyModel.index(2, 0).data(Qt::UserRole).toInt(), 1);
+    QCOMPARE(proxyModel.index(3, 0).data(Qt::UserRole).toInt(), 2);
+    QCOMPARE(proxyModel.index(6, 0).data(Qt::UserRole).toInt(), 2);
+    QVERIFY(!proxyModel.index(7, 0).data(Qt::UserRole).isValid());
+#else
+    QSKIP("This test requires the GenericModel module");
+#endif
+}
+
+void tst_RoleMaskProxyModel::testNestedMaskedParents()
+{
+#ifdef QTMODELUTILITIES_GENERICMODEL
+    GenericModel baseModel;
+    baseModel.insertColumn(0);
+    baseModel.insertRows(0, 3);
+    for (int i = 0; i < baseModel.rowCount(); ++i) {
+        const QModelIndex parIdx = baseModel.index(i, 0);
+        baseModel.insertColumn(0, parIdx);
+        baseModel.insertRows(0, 2, parIdx);
+        baseModel.insertColumn(0, baseModel.index(0, 0, parIdx));
+        baseModel.insertRows(0, 2, baseModel.index(0, 0, parIdx));
+    }
+    RoleMaskProxyModel proxyModel;
+    new ModelTest(&proxyModel, &baseModel);
+    proxyModel.addMaskedRole(Qt::UserRole);
+    proxyModel.setSourceModel(&baseModel);
+    QVERIFY(proxyModel.setData(proxyModel.index(1, 0), 10, Qt::UserRole));
+    QVERIFY(proxyModel.setData(proxyModel.index(0, 0, proxyModel.index(1, 0)), 20, Qt::UserRole));
+    QVERIFY(proxyModel.setData(proxyModel.index(1, 0, proxyModel.index(0, 0, proxyModel.index(1, 0))), 30, Qt::UserRole));
+    QVERIFY(proxyModel.setData(proxyModel.index(1, 0, proxyModel.index(2, 0)), 40, Qt::UserRole));
+    QCOMPARE(proxyModel.index(1, 0, proxyModel.index(0, 0, proxyModel.index(1, 0))).data(Qt::UserRole).toInt(), 30);
+
+    QVERIFY(baseModel.removeRow(1));
+    QVERIFY(!proxyModel.index(1, 0).data(Qt::UserRole).isValid());
+    QCOMPARE(proxyModel.index(1, 0, proxyModel.index(1, 0)).data(Qt::UserRole).toInt(), 40);
+    QVERIFY(baseModel.insertRow(1));
+    baseModel.insertColumn(0, baseModel.index(1, 0));
+    baseModel.insertRows(0, 2, baseModel.index(1, 0));
+    baseModel.insertColumn(0, baseModel.index(0, 0, baseModel.index(1, 0)));
+    baseModel.insertRows(0, 2, baseModel.index(0, 0, baseModel.index(1, 0)));
+    QVERIFY(!proxyModel.index(1, 0).data(Qt::UserRole).isValid());
+    QVERIFY(!proxyModel.index(0, 0, proxyModel.index(1, 0)).data(Qt::UserRole).isValid());
+    QVERIFY(!proxyModel.index(1, 0, proxyModel.index(0, 0, proxyModel.index(1, 0))).data(Qt::UserRole).isValid());
+
+    QVERIFY(baseModel.moveRows(baseModel.index(2, 0), 1, 1, baseModel.index(0, 0), 0));
+    QCOMPARE(proxyModel.index(0, 0, proxyModel.index(0, 0)).data(Qt::UserRole).toInt(), 40);
+    QVERIFY(!proxyModel.index(1, 0, proxyModel.index(0, 0)).data(Qt::UserRole).isValid());
+    QCOMPARE(proxyModel.rowCount(proxyModel.index(2, 0)), 1);
+    QVERIFY(!proxyModel.index(0, 0, proxyModel.index(2, 0)).data(Qt::UserRole).isValid());
+    proxyModel.clearMaskedData(proxyModel.index(0, 0, proxyModel.index(0, 0)));
+    QVERIFY(!proxyModel.index(0, 0, proxyModel.index(0, 0)).data(Qt::UserRole).isValid());
+#else
+    QSKIP("This test requires the GenericModel module");
+#endif
+}
+
+void tst_RoleMaskProxyModel::testPropagateCheckState()
+{
+#ifdef QTMODELUTILITIES_GENERICMODEL
+    GenericModel baseModel;
+    baseModel.insertColumns(0, 2);
+    baseModel.insertRows(0, 2);
+    for (int i = 0; i < baseModel.rowCount(); ++i) {
+        const QModelIndex parIdx = baseModel.index(i, 0);
+        baseModel.insertColumns(0, 2, parIdx);
+        baseModel.insertRows(0, 3, parIdx);
+        for (int j = 0; j < baseModel.rowCount(parIdx); ++j) {
+            baseModel.insertColumn(0, baseModel.index(j, 0, parIdx));
+            baseModel.insertRows(0, 2, baseModel.index(j, 0, parIdx));
+        }
+    }
+    RoleMaskProxyModel proxyModel;
+    new ModelTest(&proxyModel, &baseModel);
+    proxyModel.setSourceModel(&baseModel);
+    QSignalSpy propagateCheckStateChangedSpy(&proxyModel, SIGNAL(propagateCheckStateChanged(bool)));
+    QVERIFY(propagateCheckStateChangedSpy.isValid());
+    proxyModel.setPropagateCheckState(true);
+    QCOMPARE(propagateCheckStateChangedSpy.count(), 1);
+    QVERIFY(proxyModel.maskedRoles().contains(Qt::CheckStateRole));
+    const QModelIndex rootIdx = proxyModel.index(0, 0);
+    const QModelIndex childIdx = proxyModel.index(1, 0, rootIdx);
+    QSignalSpy dataChangedSpy(&proxyModel, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+    QVERIFY(dataChangedSpy.isValid());
+    QVERIFY(proxyModel.setData(rootIdx, Qt::Checked, Qt::CheckStateRole));
+    // one signal for each level below the root plus one for the root itself
+    QCOMPARE(dataChangedSpy.count(), 5);
+    bool grandChildrenSignalled = false;
+    for (int i = 0; i < dataChangedSpy.count(); ++i) {
+        const QModelIndex topLeft = dataChangedSpy.at(i).at(0).value<QModelIndex>();
+        const QModelIndex bottomRight = dataChangedSpy.at(i).at(1).value<QModelIndex>();
+        QVERIFY(dataChangedSpy.at(i).at(2).value<QVector<int>>().contains(Qt::CheckStateRole));
+        if (topLeft.parent() == childIdx && topLeft.row() == 0 && bottomRight.row() == 1)
+            grandChildrenSignalled = true;
+    }
+    QVERIFY(grandChildrenSignalled);
+    QCOMPARE(rootIdx.data(Qt::CheckStateRole).toInt(), int(Qt::Checked));
+    QCOMPARE(proxyModel.index(1, 0, childIdx).data(Qt::CheckStateRole).toInt(), int(Qt::Checked));
+    QVERIFY(!proxyModel.index(1, 0).data(Qt::CheckStateRole).isValid());
+    QVERIFY(!proxyModel.index(0, 1, rootIdx).data(Qt::CheckStateRole).isValid());
+
+    QVERIFY(proxyModel.setData(childIdx, Qt::Unchecked, Qt::CheckStateRole));
+    QCOMPARE(childIdx.data(Qt::CheckStateRole).toInt(), int(Qt::Unchecked));
+    QCOMPARE(proxyModel.index(0, 0, childIdx).data(Qt::CheckStateRole).toInt(), int(Qt::Unchecked));
+    QCOMPARE(proxyModel.index(0, 0, rootIdx).data(Qt::CheckStateRole).toInt(), int(Qt::Checked));
+    QCOMPARE(rootIdx.data(Qt::CheckStateRole).toInt(), int(Qt::PartiallyChecked));
+    QCOMPARE(proxyModel.itemData(rootIdx).value(Qt::CheckStateRole).toInt(), int(Qt::PartiallyChecked));
+
+    QVERIFY(proxyModel.setData(proxyModel.index(0, 0, rootIdx), Qt::Unchecked, Qt::CheckStateRole));
+    QVERIFY(proxyModel.setData(proxyModel.index(2, 0, rootIdx), Qt::Unchecked, Qt::CheckStateRole));
+    QCOMPARE(rootIdx.data(Qt::CheckStateRole).toInt(), int(Qt::Unchecked));
+    for (int i = 0; i < proxyModel.rowCount(rootIdx); ++i)
+        QVERIFY(!proxyModel.maskedItemData(proxyModel.index(i, 0, rootIdx)).contains(Qt::CheckStateRole));
+
+    const QModelIndex grandChildIdx = proxyModel.index(0, 0, proxyModel.index(2, 0, rootIdx));
+    QVERIFY(proxyModel.setData(grandChildIdx, Qt::Checked, Qt::CheckStateRole));
+    QCOMPARE(proxyModel.index(2, 0, rootIdx).data(Qt::CheckStateRole).toInt(), int(Qt::PartiallyChecked));
+    QCOMPARE(rootIdx.data(Qt::CheckStateRole).toInt(), int(Qt::PartiallyChecked));
+    QCOMPARE(childIdx.data(Qt::CheckStateRole).toInt(), int(Qt::Unchecked));
+
+    QVERIFY(proxyModel.setData(rootIdx, Qt::Checked, Qt::CheckStateRole));
+    QCOMPARE(grandChildIdx.data(Qt::CheckStateRole).toInt(), int(Qt::Checked));
+    QVERIFY(!proxyModel.maskedItemData(grandChildIdx).contains(Qt::CheckStateRole));
+    QCOMPARE(proxyModel.index(1, 0, childIdx).data(Qt::CheckStateRole).toInt(), int(Qt::Checked));
+
+    QVERIFY(proxyModel.setData(proxyModel.index(2, 0, rootIdx), Qt::Unchecked, Qt::CheckStateRole));
+    QCOMPARE(rootIdx.data(Qt::CheckStateRole).toInt(), int(Qt::PartiallyChecked));
+    QVERIFY(baseModel.removeRow(2, baseModel.index(0, 0)));
+    QCOMPARE(rootIdx.data(Qt::CheckStateRole).toInt(), int(Qt::Checked));
+    QVERIFY(proxyModel.setData(proxyModel.index(0, 0, childIdx), Qt::Unchecked, Qt::CheckStateRole));
+    QCOMPARE(childIdx.data(Qt::CheckStateRole).toInt(), int(Qt::PartiallyChecked));
+    proxyModel.clearMaskedData(proxyModel.index(0, 0, childIdx));
+    QCOMPARE(childIdx.data(Qt::CheckStateRole).toInt(), int(Qt::Checked));
+    QCOMPARE(rootIdx.data(Qt::CheckStateRole).toInt(), int(Qt::Checked));
+
+    proxyModel.setPropagateCheckState(false);
+    QCOMPARE(propagateCheckStateChangedSpy.count(), 2);
+    QCOMPARE(rootIdx.data(Qt::CheckStateRole).toInt(), int(Qt::Checked));
+    QVERIFY(!childIdx.data(Qt::CheckStateRole).isValid());
+#else
+    QSKIP("This test requires the GenericModel module");
+#endif
+}
+
+void tst_RoleMaskProxyModel::testComputedRoles()
+{
+    QStringListModel baseModel(QStringList() << QStringLiteral("a") << QStringLiteral("bb") << QStringLiteral("ccc"));
+    RoleMaskProxyModel proxyModel;
+    new ModelTest(&proxyModel, &baseModel);
+    proxyModel.setMaskedRoles({Qt::UserRole + 1});
+    proxyModel.setSourceModel(&baseModel);
+    int calls = 0;
+    proxyModel.setComputedRole(
+            Qt::UserRole,
+            [&calls](const QModelIndex &idx) -> QVariant {
+                ++calls;
+                return idx.data(Qt::DisplayRole).toString().size();
+            },
+            {Qt::DisplayRole});
+    QVERIFY(proxyModel.maskedRoles().contains(Qt::UserRole));
+    QCOMPARE(proxyModel.computedRoles(), QList<int>{Qt::UserRole});
+    QCOMPARE(proxyModel.index(1, 0).data(Qt::UserRole).toInt(), 2);
+    QCOMPARE(proxyModel.index(1, 0).data(Qt::UserRole).toInt(), 2);
+    QCOMPARE(proxyModel.itemData(proxyModel.index(1, 0)).value(Qt::UserRole).toInt(), 2);
+    QCOMPARE(calls, 1);
+    QCOMPARE(proxyModel.index(2, 0).data(Qt::UserRole).toInt(), 3);
+    QCOMPARE(calls, 2);
+    QSignalSpy proxyDataChangeSpy(&proxyModel, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+    QVERIFY(proxyDataChangeSpy.isValid());
+    // a change to a role the function does not read keeps the cached value
+    QVERIFY(proxyModel.setData(proxyModel.index(1, 0), 1, Qt::UserRole + 1));
+    QCOMPARE(proxyModel.index(1, 0).data(Qt::UserRole).toInt(), 2);
+    QCOMPARE(calls, 2);
+    proxyDataChangeSpy.clear();
+    QVERIFY(baseModel.setData(baseModel.index(1, 0), QStringLiteral("dddd")));
+    bool computedSignalled = false;
+    for (const QList<QVariant> &args : proxyDataChangeSpy) {
+        if (args.at(2).value<QVector<int>>().contains(Qt::UserRole))
+            computedSignalled = args.at(0).value<QModelIndex>() == proxyModel.index(1, 0);
+    }
+    QVERIFY(computedSignalled);
+    QCOMPARE(proxyModel.index(1, 0).data(Qt::UserRole).toInt(), 4);
+    QCOMPARE(proxyModel.index(2, 0).data(Qt::UserRole).toInt(), 3);
+    QCOMPARE(calls, 3);
+    // an explicitly masked value wins over the computed one
+    QVERIFY(proxyModel.setData(proxyModel.index(0, 0), 10, Qt::UserRole));
+    QCOMPARE(proxyModel.index(0, 0).data(Qt::UserRole).toInt(), 10);
+    QCOMPARE(calls, 3);
+    QVERIFY(baseModel.insertRows(0, 1));
+    QVERIFY(baseModel.setData(baseModel.index(0, 0), QStringLiteral("eeeee")));
+    QCOMPARE(proxyModel.index(0, 0).data(Qt::UserRole).toInt(), 5);
+    QCOMPARE(proxyModel.index(1, 0).data(Qt::UserRole).toInt(), 10);
+    QCOMPARE(proxyModel.index(2, 0).data(Qt::UserRole).toInt(), 4);
+    proxyModel.removeComputedRole(Qt::UserRole);
+    QVERIFY(proxyModel.computedRoles().isEmpty());
+    QVERIFY(!proxyModel.index(2, 0).data(Qt::UserRole).isValid());
+    QCOMPARE(proxyModel.index(1, 0).data(Qt::UserRole).toInt(), 10);
+}
+
+void tst_RoleMaskProxyModel::testOverlayLayers()
+{
+    QStringListModel baseModel(QStringList() << QStringLiteral("a") << QStringLiteral("b") << QStringLiteral("c") << QStringLiteral("d"));
+    RoleMaskProxyModel proxyModel;
+    new ModelTest(&proxyModel, &baseModel);
+    proxyModel.setMaskedRoles({Qt::UserRole});
+    proxyModel.setSourceModel(&baseModel);
+    QVERIFY(proxyModel.addOverlayLayer(QStringLiteral("errors"), 1));
+    QVERIFY(proxyModel.addOverlayLayer(QStringLiteral("notes")));
+    QVERIFY(!proxyModel.addOverlayLayer(QStringLiteral("notes")));
+    QCOMPARE(proxyModel.overlayLayers(), QStringList() << QStringLiteral("errors") << QStringLiteral("notes"));
+    QVERIFY(!proxyModel.setOverlayData(QStringLiteral("missing"), proxyModel.index(0, 0), 1, Qt::UserRole));
+    QVERIFY(!proxyModel.setOverlayData(QStringLiteral("notes"), proxyModel.index(0, 0), 1, Qt::ToolTipRole));
+    QVERIFY(proxyModel.setData(proxyModel.index(0, 0), 1, Qt::UserRole));
+    QVERIFY(proxyModel.setOverlayData(QStringLiteral("notes"), proxyModel.index(0, 0), 2, Qt::UserRole));
+    QVERIFY(proxyModel.setOverlayData(QStringLiteral("notes"), proxyModel.index(1, 0), 2, Qt::UserRole));
+    QVERIFY(proxyModel.setOverlayData(QStringLiteral("notes"), proxyModel.index(3, 0), 2, Qt::UserRole));
+    QVERIFY(proxyModel.setOverlayData(QStringLiteral("errors"), proxyModel.index(1, 0), 3, Qt::UserRole));
+    QCOMPARE(proxyModel.index(0, 0).data(Qt::UserRole).toInt(), 2);
+    QCOMPARE(proxyModel.index(1, 0).data(Qt::UserRole).toInt(), 3);
+    QCOMPARE(proxyModel.itemData(proxyModel.index(1, 0)).value(Qt::UserRole).toInt(), 3);
+    QVERIFY(!proxyModel.index(2, 0).data(Qt::UserRole).isValid());
+    QSignalSpy proxyDataChangeSpy(&proxyModel, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+    QVERIFY(proxyDataChangeSpy.isValid());
+    proxyModel.setOverlayLayerEnabled(QStringLiteral("notes"), false);
+    QVERIFY(!proxyModel.isOverlayLayerEnabled(QStringLiteral("notes")));
+    // one signal for each block of contiguous rows with values in the layer
+    QCOMPARE(proxyDataChangeSpy.count(), 2);
+    QCOMPARE(proxyDataChangeSpy.at(0).at(0).value<QModelIndex>().row() + proxyDataChangeSpy.at(1).at(0).value<QModelIndex>().row(), 3);
+    QCOMPARE(proxyModel.index(0, 0).data(Qt::UserRole).toInt(), 1);
+    QCOMPARE(proxyModel.index(1, 0).data(Qt::UserRole).toInt(), 3);
+    QVERIFY(!proxyModel.index(3, 0).data(Qt::UserRole).isValid());
+    QCOMPARE(proxyModel.overlayData(QStringLiteral("notes"), proxyModel.index(3, 0), Qt::UserRole).toInt(), 2);
+    proxyDataChangeSpy.clear();
+    QVERIFY(proxyModel.setOverlayData(QStringLiteral("notes"), proxyModel.index(2, 0), 2, Qt::UserRole));
+    QCOMPARE(proxyDataChangeSpy.count(), 0);
+    proxyModel.setOverlayLayerEnabled(QStringLiteral("notes"), true);
+    QCOMPARE(proxyDataChangeSpy.count(), 1);
+    QCOMPARE(proxyDataChangeSpy.at(0).at(0).value<QModelIndex>(), proxyModel.index(0, 0));
+    QCOMPARE(proxyDataChangeSpy.at(0).at(1).value<QModelIndex>(), proxyModel.index(3, 0));
+    proxyModel.setOverlayLayerPriority(QStringLiteral("notes"), 2);
+    QCOMPARE(proxyModel.overlayLayers().first(), QStringLiteral("notes"));
+    QCOMPARE(proxyModel.index(1, 0).data(Qt::UserRole).toInt(), 2);
+    // the layers follow the rows they are attached to
+    QVERIFY(baseModel.insertRows(0, 1));
+    QCOMPARE(proxyModel.index(2, 0).data(Qt::UserRole).toInt(), 2);
+    QVERIFY(baseModel.removeRows(0, 1));
+    proxyModel.clearOverlayLayer(QStringLiteral("notes"));
+    QCOMPARE(proxyModel.overlayLayers().size(), 2);
+    QCOMPARE(proxyModel.index(0, 0).data(Qt::UserRole).toInt(), 1);
+    QCOMPARE(proxyModel.index(1, 0).data(Qt::UserRole).toInt(), 3);
+    proxyDataChangeSpy.clear();
+    proxyModel.setOverlayLayerEnabled(QStringLiteral("notes"), false);
+    QCOMPARE(proxyDataChangeSpy.count(), 0);
+    proxyModel.removeOverlayLayer(QStringLiteral("errors"));
+    QCOMPARE(proxyModel.overlayLayers(), QStringList() << QStringLiteral("notes"));
+    QVERIFY(!proxyModel.index(1, 0).data(Qt::UserRole).isValid());
+    QVERIFY(proxyModel.maskedItemData(proxyModel.index(1, 0)).isEmpty());
+}
+
+void tst_RoleMaskProxyModel::testCommitToSource()
+{
+    QStringListModel baseModel(QStringList() << QStringLiteral("a") << QStringLiteral("b") << QStringLiteral("c") << QStringLiteral("d"));
+    RoleMaskProxyModel proxyModel;
+    new ModelTest(&proxyModel, &baseModel);
+    proxyModel.setMaskedRoles({Qt::DisplayRole, Qt::UserRole});
+    proxyModel.setSourceModel(&baseModel);
+    QVERIFY(proxyModel.setData(proxyModel.index(0, 0), QStringLiteral("x")));
+    QVERIFY(proxyModel.setData(proxyModel.index(1, 0), QStringLiteral("y")));
+    QVERIFY(proxyModel.setData(proxyModel.index(3, 0), QStringLiteral("z")));
+    QVERIFY(proxyModel.setData(proxyModel.index(2, 0), 5, Qt::UserRole));
+    QSignalSpy proxyDataChangeSpy(&proxyModel, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+    QVERIFY(proxyDataChangeSpy.isValid());
+    QVERIFY(proxyModel.commitToSource({Qt::DisplayRole}));
+    QCOMPARE(baseModel.stringList(), QStringList() << QStringLiteral("x") << QStringLiteral("y") << QStringLiteral("c") << QStringLiteral("z"));
+    // one signal for each block of contiguous rows
+    QCOMPARE(proxyDataChangeSpy.count(), 2);
+    QVERIFY(proxyModel.maskedItemData(proxyModel.index(0, 0)).isEmpty());
+    QVERIFY(proxyModel.maskedItemData(proxyModel.index(3, 0)).isEmpty());
+    QCOMPARE(proxyModel.index(3, 0).data().toString(), QStringLiteral("z"));
+    QCOMPARE(proxyModel.index(2, 0).data(Qt::UserRole).toInt(), 5);
+    // the source model does not accept this role so the value stays in the proxy
+    QVERIFY(!proxyModel.commitToSource());
+    QCOMPARE(proxyModel.index(2, 0).data(Qt::UserRole).toInt(), 5);
+}
+
+void tst_RoleMaskProxyModel::testSaveLoadMaskedData()
+{
+    QStringListModel baseModel(QStringList() << QStringLiteral("a") << QStringLiteral("b") << QStringLiteral("c") << QStringLiteral("d"));
+    RoleMaskProxyModel proxyModel;
+    proxyModel.setMaskedRoles({Qt::UserRole, Qt::DisplayRole});
+    proxyModel.setSourceModel(&baseModel);
+    QVERIFY(proxyModel.setData(proxyModel.index(1, 0), QStringLiteral("x")));
+    QVERIFY(proxyModel.setData(proxyModel.index(3, 0), 7, Qt::UserRole));
+    QVERIFY(proxyModel.setMaskedFlags(proxyModel.index(3, 0), Qt::ItemIsEnabled));
+    QVERIFY(proxyModel.setMaskedRowData(2, Qt::UserRole, 3));
+    QVERIFY(proxyModel.addOverlayLayer(QStringLiteral("notes"), 1));
+    QVERIFY(proxyModel.setOverlayData(QStringLiteral("notes"), proxyModel.index(0, 0), 9, Qt::UserRole));
+    QVERIFY(proxyModel.setMaskedRoleDefaultValue(Qt::UserRole, -1));
+    QByteArray savedData;
+    QBuffer saveBuffer(&savedData);
+    QVERIFY(proxyModel.saveMaskedData(&saveBuffer));
+    saveBuffer.close();
+
+    RoleMaskProxyModel loadedModel;
+    new ModelTest(&loadedModel, &baseModel);
+    loadedModel.setSourceModel(&baseModel);
+    QSignalSpy maskedRolesChangedSpy(&loadedModel, SIGNAL(maskedRolesChanged()));
+    QVERIFY(maskedRolesChangedSpy.isValid());
+    QBuffer loadBuffer(&savedData);
+    QVERIFY(loadedModel.loadMaskedData(&loadBuffer));
+    loadBuffer.close();
+    QCOMPARE(maskedRolesChangedSpy.count(), 1);
+    QVERIFY(loadedModel.maskedRoles().contains(Qt::UserRole));
+    QCOMPARE(loadedModel.overlayLayers(), QStringList() << QStringLiteral("notes"));
+    QCOMPARE(loadedModel.overlayLayerPriority(QStringLiteral("notes")), 1);
+    QCOMPARE(loadedModel.maskedRoleDefaultValue(Qt::UserRole).toInt(), -1);
+    for (int i = 0; i < baseModel.rowCount(); ++i) {
+        QCOMPARE(loadedModel.index(i, 0).data(), proxyModel.index(i, 0).data());
+        QCOMPARE(loadedModel.index(i, 0).data(Qt::UserRole), proxyModel.index(i, 0).data(Qt::UserRole));
+        QCOMPARE(loadedModel.flags(loadedModel.index(i, 0)), proxyModel.flags(proxyModel.index(i, 0)));
+    }
+    QCOMPARE(loadedModel.index(0, 0).data(Qt::UserRole).toInt(), 9);
+    QCOMPARE(loadedModel.index(2, 0).data(Qt::UserRole).toInt(), 3);
+
+    // a truncated stream leaves the proxy unchanged
+    QByteArray truncatedData = savedData.left(savedData.size() / 2);
+    QBuffer truncatedBuffer(&truncatedData);
+    QVERIFY(!loadedModel.loadMaskedData(&truncatedBuffer));
+    QCOMPARE(loadedModel.index(1, 0).data().toString(), QStringLiteral("x"));
+    QCOMPARE(loadedModel.index(3, 0).data(Qt::UserRole).toInt(), 7);
+}
+
 void tst_RoleMaskProxyModel::testInsertRow()
 {
     QFETCH(QAbstractItemModel *, baseModel);
@@ -691,6 +1126,31 @@ void tst_RoleMaskProxyModel::testInsertRow()
     baseModel->deleteLater();
 }
 
+void tst_RoleMaskProxyModel::testAppendRows()
+{
+    QStringListModel baseModel(QStringList() << QStringLiteral("1") << QStringLiteral("2") << QStringLiteral("3"));
+    RoleMaskProxyModel proxyModel;
+    new ModelTest(&proxyModel, &baseModel);
+    proxyModel.setMaskedRoles({Qt::UserRole, Qt::UserRole + 1});
+    proxyModel.setMaskHeaderData(true);
+    proxyModel.setSourceModel(&baseModel);
+    QVERIFY(proxyModel.setData(proxyModel.index(2, 0), 2, Qt::UserRole));
+    QVERIFY(proxyModel.setMaskedRangeData(proxyModel.index(1, 0), proxyModel.index(2, 0), Qt::UserRole + 1, 12));
+    QVERIFY(proxyModel.setHeaderData(2, Qt::Vertical, 22, Qt::UserRole));
+    for (int i = 0; i < 4; ++i)
+        QVERIFY(baseModel.insertRows(baseModel.rowCount(), 256));
+    QCOMPARE(proxyModel.rowCount(), 3 + 4 * 256);
+    QCOMPARE(proxyModel.index(2, 0).data(Qt::UserRole).toInt(), 2);
+    QCOMPARE(proxyModel.headerData(2, Qt::Vertical, Qt::UserRole).toInt(), 22);
+    QVERIFY(!proxyModel.index(3, 0).data(Qt::UserRole).isValid());
+    QVERIFY(!proxyModel.headerData(3, Qt::Vertical, Qt::UserRole).isValid());
+    QVERIFY(!proxyModel.index(3, 0).data(Qt::UserRole + 1).isValid());
+    QVERIFY(proxyModel.setData(proxyModel.index(proxyModel.rowCount() - 1, 0), 5, Qt::UserRole));
+    QVERIFY(baseModel.insertRows(0, 1));
+    QCOMPARE(proxyModel.index(3, 0).data(Qt::UserRole).toInt(), 2);
+    QCOMPARE(proxyModel.index(proxyModel.rowCount() - 1, 0).data(Qt::UserRole).toInt(), 5);
+}
+
 void tst_RoleMaskProxyModel::testInsertRow_data()
 {
     QTest::addColumn<QAbstractItemModel *>("baseModel");
@@ -954,6 +1414,51 @@ void tst_RoleMaskProxyModel::testDataChangeSignals()
     baseModel->deleteLater();
 }
 
+void tst_RoleMaskProxyModel::testDataChangeRanges()
+{
+    QAbstractItemModel *baseModel = createTableModel(this);
+    if (!baseModel)
+        QSKIP("This test requires the Qt GUI or GenericModel modules");
+    RoleMaskProxyModel proxyModel;
+    new ModelTest(&proxyModel, baseModel);
+    proxyModel.addMaskedRole(Qt::UserRole);
+    proxyModel.setSourceModel(baseModel);
+    QVERIFY(proxyModel.setMaskedRowData(1, Qt::UserRole, 10));
+    for (int j = 0; j < proxyModel.columnCount(); ++j)
+        QVERIFY(proxyModel.setData(proxyModel.index(2, j), 20, Qt::UserRole));
+    QVERIFY(proxyModel.setData(proxyModel.index(4, 0), 40, Qt::UserRole));
+    QSignalSpy proxyDataChangeSpy(&proxyModel, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+    QVERIFY(proxyDataChangeSpy.isValid());
+    baseModel->dataChanged(baseModel->index(0, 0), baseModel->index(4, 2), QVector<int>{Qt::UserRole});
+    QCOMPARE(proxyDataChangeSpy.count(), 2);
+    QList<QVariant> arguments = proxyDataChangeSpy.takeFirst();
+    QCOMPARE(arguments.at(0).value<QModelIndex>(), proxyModel.index(0, 0));
+    QCOMPARE(arguments.at(1).value<QModelIndex>(), proxyModel.index(0, 2));
+    QCOMPARE(arguments.at(2).value<QVector<int>>(), QVector<int>{Qt::UserRole});
+    arguments = proxyDataChangeSpy.takeFirst();
+    QCOMPARE(arguments.at(0).value<QModelIndex>(), proxyModel.index(3, 0));
+    QCOMPARE(arguments.at(1).value<QModelIndex>(), proxyModel.index(4, 2));
+    QCOMPARE(arguments.at(2).value<QVector<int>>(), QVector<int>{Qt::UserRole});
+
+    baseModel->dataChanged(baseModel->index(0, 0), baseModel->index(4, 2), QVector<int>{Qt::DisplayRole, Qt::UserRole});
+    QCOMPARE(proxyDataChangeSpy.count(), 3);
+    arguments = proxyDataChangeSpy.at(1);
+    QCOMPARE(arguments.at(0).value<QModelIndex>(), proxyModel.index(1, 0));
+    QCOMPARE(arguments.at(1).value<QModelIndex>(), proxyModel.index(2, 2));
+    QCOMPARE(arguments.at(2).value<QVector<int>>(), (QVector<int>{Qt::DisplayRole, Qt::EditRole}));
+    proxyDataChangeSpy.clear();
+
+    baseModel->dataChanged(baseModel->index(1, 0), baseModel->index(2, 1), QVector<int>{Qt::UserRole});
+    QCOMPARE(proxyDataChangeSpy.count(), 0);
+    baseModel->dataChanged(baseModel->index(4, 0), baseModel->index(4, 0), QVector<int>{Qt::UserRole});
+    QCOMPARE(proxyDataChangeSpy.count(), 0);
+    proxyModel.setTransparentIfEmpty(false);
+    proxyDataChangeSpy.clear();
+    baseModel->dataChanged(baseModel->index(0, 0), baseModel->index(4, 2), QVector<int>{Qt::UserRole});
+    QCOMPARE(proxyDataChangeSpy.count(), 0);
+    baseModel->deleteLater();
+}
+
 void tst_RoleMaskProxyModel::testTransparentIfEmpty()
 {
     QFETCH(QAbstractItemModel *, baseModel);
@@ -1290,6 +1795,211 @@ void tst_RoleMaskProxyModel::testSort()
     }
 }
 
+void tst_RoleMaskProxyModel::testSortTree()
+{
+#ifdef QTMODELUTILITIES_GENERICMODEL
+    GenericModel baseModel;
+    baseModel.insertColumns(0, 2);
+    baseModel.insertRows(0, 5);
+    for (int i = 0; i < baseModel.rowCount(); ++i) {
+        baseModel.setData(baseModel.index(i, 0), (i * 3) % 5);
+        const QModelIndex parIdx = baseModel.index(i, 0);
+        baseModel.insertColumns(0, 2, parIdx);
+        baseModel.insertRows(0, 4, parIdx);
+        for (int j = 0; j < baseModel.rowCount(parIdx); ++j)
+            baseModel.setData(baseModel.index(j, 0, parIdx), 3 - j);
+    }
+    RoleMaskProxyModel proxyModel;
+    new ModelTest(&proxyModel, &baseModel);
+    proxyModel.addMaskedRole(Qt::UserRole);
+    proxyModel.setSourceModel(&baseModel);
+    for (int i = 0; i < proxyModel.rowCount(); ++i) {
+        const QModelIndex parIdx = proxyModel.index(i, 0);
+        QVERIFY(proxyModel.setData(proxyModel.index(i, 1), parIdx.data().toInt() * 10, Qt::UserRole));
+        for (int j = 0; j < proxyModel.rowCount(parIdx); j += 2) {
+            const int currentData = proxyModel.index(j, 0, parIdx).data().toInt();
+            QVERIFY(proxyModel.setData(proxyModel.index(j, 0, parIdx), currentData, Qt::UserRole));
+            QVERIFY(proxyModel.setData(proxyModel.index(j, 1, parIdx), currentData + 100, Qt::UserRole));
+        }
+    }
+    baseModel.sort(0, Qt::AscendingOrder);
+    for (int i = 0; i < proxyModel.rowCount(); ++i) {
+        const QModelIndex parIdx = proxyModel.index(i, 0);
+        QCOMPARE(parIdx.data().toInt(), i);
+        QVERIFY(!parIdx.data(Qt::UserRole).isValid());
+        QCOMPARE(proxyModel.index(i, 1).data(Qt::UserRole).toInt(), i * 10);
+        for (int j = 0; j < proxyModel.rowCount(parIdx); ++j) {
+            QCOMPARE(proxyModel.index(j, 0, parIdx).data().toInt(), j);
+            if (j % 2 == 0) {
+                QVERIFY(!proxyModel.index(j, 0, parIdx).data(Qt::UserRole).isValid());
+                QVERIFY(!proxyModel.index(j, 1, parIdx).data(Qt::UserRole).isValid());
+            } else {
+                QCOMPARE(proxyModel.index(j, 0, parIdx).data(Qt::UserRole).toInt(), j);
+                QCOMPARE(proxyModel.index(j, 1, parIdx).data(Qt::UserRole).toInt(), j + 100);
+            }
+        }
+    }
+#else
+    QSKIP("This test requires the GenericModel module");
+#endif
+}
+
+void tst_RoleMaskProxyModel::testSortSubtree()
+{
+#ifdef QTMODELUTILITIES_GENERICMODEL
+    GenericModel baseModel;
+    baseModel.insertColumns(0, 2);
+    baseModel.insertRows(0, 3);
+    for (int i = 0; i < baseModel.rowCount(); ++i) {
+        baseModel.setData(baseModel.index(i, 0), 2 - i);
+        const QModelIndex parIdx = baseModel.index(i, 0);
+        baseModel.insertColumns(0, 2, parIdx);
+        baseModel.insertRows(0, 3, parIdx);
+        for (int j = 0; j < baseModel.rowCount(parIdx); ++j) {
+            baseModel.setData(baseModel.index(j, 0, parIdx), 2 - j);
+            const QModelIndex childIdx = baseModel.index(j, 0, parIdx);
+            baseModel.insertColumn(0, childIdx);
+            baseModel.insertRows(0, 2, childIdx);
+            baseModel.setData(baseModel.index(0, 0, childIdx), 1);
+            baseModel.setData(baseModel.index(1, 0, childIdx), 0);
+        }
+    }
+    RoleMaskProxyModel proxyModel;
+    new ModelTest(&proxyModel, &baseModel);
+    proxyModel.setMaskedRoles({Qt::UserRole, Qt::UserRole + 1});
+    proxyModel.setMaskHeaderData(true);
+    proxyModel.setSourceModel(&baseModel);
+    QVERIFY(proxyModel.setHeaderData(0, Qt::Vertical, 100, Qt::UserRole));
+    QVERIFY(proxyModel.setData(proxyModel.index(0, 1), 101, Qt::UserRole));
+    const QModelIndex sortedParent = proxyModel.index(1, 0);
+    QVERIFY(proxyModel.setData(proxyModel.index(0, 0, proxyModel.index(0, 0)), 102, Qt::UserRole));
+    QVERIFY(proxyModel.setData(proxyModel.index(0, 1, sortedParent), 103, Qt::UserRole));
+    QVERIFY(proxyModel.setData(proxyModel.index(0, 0, proxyModel.index(2, 0, sortedParent)), 104, Qt::UserRole));
+    QVERIFY(proxyModel.setMaskedRowData(0, Qt::UserRole + 1, 105, sortedParent));
+    baseModel.sort(0, baseModel.index(1, 0), Qt::AscendingOrder);
+    QCOMPARE(proxyModel.index(0, 0).data().toInt(), 2);
+    QCOMPARE(proxyModel.headerData(0, Qt::Vertical, Qt::UserRole).toInt(), 100);
+    QCOMPARE(proxyModel.index(0, 1).data(Qt::UserRole).toInt(), 101);
+    QCOMPARE(proxyModel.index(0, 0, proxyModel.index(0, 0)).data(Qt::UserRole).toInt(), 102);
+    QCOMPARE(proxyModel.index(2, 1, sortedParent).data(Qt::UserRole).toInt(), 103);
+    QVERIFY(!proxyModel.index(0, 1, sortedParent).data(Qt::UserRole).isValid());
+    QVERIFY(!proxyModel.index(0, 0, proxyModel.index(2, 0, sortedParent)).data(Qt::UserRole).isValid());
+    QCOMPARE(proxyModel.index(1, 0, proxyModel.index(0, 0, sortedParent)).data(Qt::UserRole).toInt(), 104);
+    QCOMPARE(proxyModel.index(2, 0, sortedParent).data(Qt::UserRole + 1).toInt(), 105);
+    QVERIFY(!proxyModel.index(0, 0, sortedParent).data(Qt::UserRole + 1).isValid());
+#else
+    QSKIP("This test requires the GenericModel module");
+#endif
+}
+
+void tst_RoleMaskProxyModel::testProxySort()
+{
+    QStringListModel baseModel(QStringList() << QStringLiteral("c") << QStringLiteral("a") << QStringLiteral("d") << QStringLiteral("b"));
+    RoleMaskProxyModel proxyModel;
+    new ModelTest(&proxyModel, &baseModel);
+    proxyModel.setMaskedRoles({Qt::UserRole, Qt::UserRole + 1});
+    proxyModel.setSourceModel(&baseModel);
+    for (int i = 0; i < proxyModel.rowCount(); ++i)
+        QVERIFY(proxyModel.setData(proxyModel.index(i, 0), i, Qt::UserRole));
+    const QPersistentModelIndex persistentIdx(proxyModel.index(1, 0));
+    QSignalSpy layoutChangedSpy(&proxyModel, SIGNAL(layoutChanged(QList<QPersistentModelIndex>, QAbstractItemModel::LayoutChangeHint)));
+    QVERIFY(layoutChangedSpy.isValid());
+    proxyModel.sort(0);
+    QCOMPARE(layoutChangedSpy.count(), 1);
+    const QStringList ascending{QStringLiteral("a"), QStringLiteral("b"), QStringLiteral("c"), QStringLiteral("d")};
+    for (int i = 0; i < proxyModel.rowCount(); ++i)
+        QCOMPARE(proxyModel.index(i, 0).data().toString(), ascending.at(i));
+    // the source keeps its order and the masked data follows the rows
+    QCOMPARE(baseModel.index(0, 0).data().toString(), QStringLiteral("c"));
+    QCOMPARE(proxyModel.index(0, 0).data(Qt::UserRole).toInt(), 1);
+    QCOMPARE(persistentIdx.row(), 0);
+    QCOMPARE(proxyModel.mapToSource(proxyModel.index(3, 0)), baseModel.index(2, 0));
+    QCOMPARE(proxyModel.mapFromSource(baseModel.index(2, 0)), proxyModel.index(3, 0));
+    QCOMPARE(proxyModel.headerData(0, Qt::Vertical), baseModel.headerData(1, Qt::Vertical));
+    // the rectangle covers scattered source rows
+    QVERIFY(proxyModel.setMaskedRangeData(proxyModel.index(0, 0), proxyModel.index(1, 0), Qt::UserRole + 1, 10));
+    QCOMPARE(proxyModel.index(0, 0).data(Qt::UserRole + 1).toInt(), 10);
+    QCOMPARE(proxyModel.index(1, 0).data(Qt::UserRole + 1).toInt(), 10);
+    QVERIFY(!proxyModel.index(2, 0).data(Qt::UserRole + 1).isValid());
+    QVERIFY(!proxyModel.index(3, 0).data(Qt::UserRole + 1).isValid());
+
+    proxyModel.setSortRole(Qt::UserRole);
+    proxyModel.sort(0, Qt::DescendingOrder);
+    const QStringList descendingMasked{QStringLiteral("b"), QStringLiteral("d"), QStringLiteral("a"), QStringLiteral("c")};
+    for (int i = 0; i < proxyModel.rowCount(); ++i)
+        QCOMPARE(proxyModel.index(i, 0).data().toString(), descendingMasked.at(i));
+    QVERIFY(proxyModel.setData(proxyModel.index(0, 0), QStringLiteral("e")));
+    QCOMPARE(baseModel.index(3, 0).data().toString(), QStringLiteral("e"));
+    QSignalSpy dataChangedSpy(&proxyModel, SIGNAL(dataChanged(QModelIndex, QModelIndex, QVector<int>)));
+    QVERIFY(dataChangedSpy.isValid());
+    QVERIFY(baseModel.setData(baseModel.index(0, 0), QStringLiteral("f")));
+    QCOMPARE(dataChangedSpy.count(), 1);
+    QCOMPARE(dataChangedSpy.first().at(0).value<QModelIndex>(), proxyModel.index(3, 0));
+
+    // removing keeps the order of the other rows, inserted rows show up where the source put them
+    QVERIFY(proxyModel.removeRows(1, 2));
+    QCOMPARE(baseModel.rowCount(), 2);
+    QCOMPARE(proxyModel.index(0, 0).data().toString(), QStringLiteral("e"));
+    QCOMPARE(proxyModel.index(1, 0).data().toString(), QStringLiteral("f"));
+    QVERIFY(baseModel.insertRows(0, 1));
+    QVERIFY(baseModel.setData(baseModel.index(0, 0), QStringLiteral("g")));
+    QCOMPARE(proxyModel.index(0, 0).data().toString(), QStringLiteral("g"));
+    QCOMPARE(proxyModel.index(1, 0).data().toString(), QStringLiteral("e"));
+    QCOMPARE(proxyModel.index(2, 0).data().toString(), QStringLiteral("f"));
+
+    proxyModel.sort(-1);
+    for (int i = 0; i < proxyModel.rowCount(); ++i)
+        QCOMPARE(proxyModel.index(i, 0), proxyModel.mapFromSource(baseModel.index(i, 0)));
+    QCOMPARE(proxyModel.index(1, 0).data().toString(), QStringLiteral("f"));
+}
+
+void tst_RoleMaskProxyModel::testProxySortTree()
+{
+#ifdef QTMODELUTILITIES_GENERICMODEL
+    GenericModel baseModel;
+    baseModel.insertColumns(0, 2);
+    baseModel.insertRows(0, 5);
+    for (int i = 0; i < baseModel.rowCount(); ++i) {
+        baseModel.setData(baseModel.index(i, 0), (i * 3) % 5);
+        const QModelIndex parIdx = baseModel.index(i, 0);
+        baseModel.insertColumns(0, 2, parIdx);
+        baseModel.insertRows(0, 4, parIdx);
+        for (int j = 0; j < baseModel.rowCount(parIdx); ++j)
+            baseModel.setData(baseModel.index(j, 0, parIdx), 3 - j);
+    }
+    RoleMaskProxyModel proxyModel;
+    new ModelTest(&proxyModel, &baseModel);
+    proxyModel.addMaskedRole(Qt::UserRole);
+    proxyModel.setSourceModel(&baseModel);
+    for (int i = 0; i < proxyModel.rowCount(); ++i) {
+        const QModelIndex parIdx = proxyModel.index(i, 0);
+        for (int j = 0; j < proxyModel.rowCount(parIdx); ++j)
+            QVERIFY(proxyModel.setData(proxyModel.index(j, 1, parIdx), parIdx.data().toInt() * 10 + proxyModel.index(j, 0, parIdx).data().toInt(),
+                                       Qt::UserRole));
+    }
+    const QPersistentModelIndex persistentIdx(proxyModel.index(3, 1, proxyModel.index(1, 0)));
+    proxyModel.sort(0);
+    for (int i = 0; i < proxyModel.rowCount(); ++i) {
+        const QModelIndex parIdx = proxyModel.index(i, 0);
+        QCOMPARE(parIdx.data().toInt(), i);
+        QCOMPARE(parIdx.parent(), QModelIndex());
+        for (int j = 0; j < proxyModel.rowCount(parIdx); ++j) {
+            const QModelIndex childIdx = proxyModel.index(j, 1, parIdx);
+            QCOMPARE(childIdx.parent(), parIdx);
+            QCOMPARE(proxyModel.index(j, 0, parIdx).data().toInt(), j);
+            QCOMPARE(childIdx.data(Qt::UserRole).toInt(), i * 10 + j);
+            QCOMPARE(proxyModel.mapFromSource(proxyModel.mapToSource(childIdx)), childIdx);
+        }
+    }
+    QCOMPARE(persistentIdx.data(Qt::UserRole).toInt(), 30);
+    QCOMPARE(persistentIdx.row(), 0);
+    QCOMPARE(persistentIdx.parent().row(), 3);
+    QCOMPARE(baseModel.index(1, 0).data().toInt(), 3);
+#else
+    QSKIP("This test requires the GenericModel module");
+#endif
+}
+
 void tst_RoleMaskProxyModel::testEmptyProxy()
 {
     QSortFilterProxyModel emptyProxy;
@@ -16,12 +16,14 @@ private Q_SLOTS:
     void testUseRoleMask_data();
     void testInsertRow();
     void testInsertRow_data();
+    void testAppendRows();
     void testProperties();
     void testInsertColumn();
     void testInsertColumn_data();
     void testNullModel();
     void testDataChangeSignals_data();
     void testDataChangeSignals();
+    void testDataChangeRanges();
     void testTransparentIfEmpty();
     void testTransparentIfEmpty_data();
     void testMergeDisplayEdit();
@@ -33,6 +35,10 @@ private Q_SLOTS:
     void testSetItemDataDataChanged_data();
     void testSetItemDataDataChanged();
     void testSort();
+    void testSortTree();
+    void testSortSubtree();
+    void testProxySort();
+    void testProxySortTree();
     void testEmptyProxy();
     void testMoveRowAfter();
     void testMoveRowBefore();
@@ -47,6 +53,14 @@ private Q_SLOTS:
     void testItemDataTransParent();
     void testDefaultValueNonTransparent();
     void testMaskFlags();
+    void testMaskRanges();
+    void testMaskRangesSort();
+    void testNestedMaskedParents();
+    void testPropagateCheckState();
+    void testComputedRoles();
+    void testOverlayLayers();
+    void testCommitToSource();
+    void testSaveLoadMaskedData();
 #if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
     void testMultiData();
     void testClearItemData();
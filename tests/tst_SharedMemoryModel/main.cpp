@@ -0,0 +1,3 @@
+#include "tst_sharedmemorymodel.h"
+#include <QtTest/QTest>
+QTEST_MAIN(tst_SharedMemoryModel)
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include "tst_sharedmemorymodel.h"
+#include <QCoreApplication>
+#include <QStringListModel>
+#include <QSharedMemory>
+#include <sharedmemorymodel.h>
+#include <QtTest/QTest>
+#include <QtTest/QSignalSpy>
+#include "../modeltestmanager.h"
+#include <cstring>
+
+QString uniqueKey(const char *testName)
+{
+    return QStringLiteral("tst_SharedMemoryModel_%1_%2").arg(QCoreApplication::applicationPid()).arg(QLatin1String(testName));
+}
+
+void tst_SharedMemoryModel::compareModels(const QAbstractItemModel *source, const QAbstractItemModel *shared, const QModelIndex &sourcePar,
+                                          const QModelIndex &sharedPar)
+{
+    QCOMPARE(shared->rowCount(sharedPar), source->rowCount(sourcePar));
+    QCOMPARE(shared->columnCount(sharedPar), source->columnCount(sourcePar));
+    for (int i = 0, maxRow = source->rowCount(sourcePar); i < maxRow; ++i) {
+        for (int j = 0, maxCol = source->columnCount(sourcePar); j < maxCol; ++j) {
+            const QModelIndex sourceIdx = source->index(i, j, sourcePar);
+            const QModelIndex sharedIdx = shared->index(i, j, sharedPar);
+            QCOMPARE(shared->itemData(sharedIdx), source->itemData(sourceIdx));
+            QCOMPARE(shared->flags(sharedIdx), source->flags(sourceIdx) & ~(Qt::ItemIsEditable | Qt::ItemIsDropEnabled));
+            QCOMPARE(sharedIdx.parent(), sharedPar);
+            if (source->hasChildren(sourceIdx))
+                compareModels(source, shared, sourceIdx, sharedIdx);
+        }
+    }
+}
+
+void tst_SharedMemoryModel::autoParent()
+{
+    QObject *parentObj = new QObject;
+    auto testItem = new SharedMemoryModel(parentObj);
+    QSignalSpy testItemDestroyedSpy(testItem, SIGNAL(destroyed(QObject *)));
+    QVERIFY(testItemDestroyedSpy.isValid());
+    auto testPublisher = new SharedMemoryModelPublisher(uniqueKey("autoParent"), parentObj);
+    QSignalSpy testPublisherDestroyedSpy(testPublisher, SIGNAL(destroyed(QObject *)));
+    QVERIFY(testPublisherDestroyedSpy.isValid());
+    delete parentObj;
+    QCOMPARE(testItemDestroyedSpy.count(), 1);
+    QCOMPARE(testPublisherDestroyedSpy.count(), 1);
+}
+
+void tst_SharedMemoryModel::publishList()
+{
+    QStringListModel baseModel(QStringList{QStringLiteral("Alpha"), QStringLiteral("Beta"), QStringLiteral("Gamma")});
+    SharedMemoryModelPublisher publisher(uniqueKey("publishList"));
+    QCOMPARE(publisher.generation(), qint64(0));
+    if (!publisher.publish(&baseModel))
+        QSKIP(qPrintable(QStringLiteral("Shared memory not available: ") + publisher.errorString()));
+    QCOMPARE(publisher.generation(), qint64(1));
+    SharedMemoryModel sharedModel(publisher.key());
+    new ModelTest(&sharedModel, &sharedModel);
+    QCOMPARE(sharedModel.generation(), qint64(1));
+    compareModels(&baseModel, &sharedModel, QModelIndex(), QModelIndex());
+    QCOMPARE(sharedModel.headerData(0, Qt::Horizontal), baseModel.headerData(0, Qt::Horizontal));
+    QCOMPARE(sharedModel.headerData(2, Qt::Vertical), baseModel.headerData(2, Qt::Vertical));
+    QVERIFY(!sharedModel.setData(sharedModel.index(0, 0), QStringLiteral("Delta")));
+    QCOMPARE(sharedModel.index(0, 0).data().toString(), QStringLiteral("Alpha"));
+}
+
+void tst_SharedMemoryModel::publishTree()
+{
+#ifdef COMPLEX_MODEL_SUPPORT
+    ComplexModel baseModel;
+    baseModel.insertColumns(0, 2);
+    baseModel.insertRows(0, 3);
+    for (int i = 0; i < baseModel.rowCount(); ++i) {
+        for (int j = 0; j < baseModel.columnCount(); ++j) {
+            baseModel.setData(baseModel.index(i, j), QStringLiteral("%1,%2").arg(i).arg(j));
+            baseModel.setData(baseModel.index(i, j), i * 10 + j, Qt::UserRole);
+        }
+        const QModelIndex parIdx = baseModel.index(i, 0);
+        baseModel.insertColumns(0, 2, parIdx);
+        baseModel.insertRows(0, 4, parIdx);
+        for (int k = 0; k < baseModel.rowCount(parIdx); ++k) {
+            for (int h = 0; h < baseModel.columnCount(parIdx); ++h)
+                baseModel.setData(baseModel.index(k, h, parIdx), QStringLiteral("%1,%2,%3").arg(i).arg(k).arg(h));
+        }
+    }
+    SharedMemoryModelPublisher publisher(uniqueKey("publishTree"));
+    if (!publisher.publish(&baseModel))
+        QSKIP(qPrintable(QStringLiteral("Shared memory not available: ") + publisher.errorString()));
+    SharedMemoryModel sharedModel(publisher.key());
+    new ModelTest(&sharedModel, &sharedModel);
+    compareModels(&baseModel, &sharedModel, QModelIndex(), QModelIndex());
+
+    const QModelIndex branch = baseModel.index(1, 0);
+    QVERIFY(publisher.publish(&baseModel, branch));
+    QVERIFY(sharedModel.refresh());
+    compareModels(&baseModel, &sharedModel, branch, QModelIndex());
+#else
+    QSKIP("This test requires the Qt GUI or GenericModel modules");
+#endif
+}
+
+void tst_SharedMemoryModel::generationSwap()
+{
+    QStringListModel baseModel(QStringList{QStringLiteral("Alpha"), QStringLiteral("Beta")});
+    SharedMemoryModelPublisher publisher(uniqueKey("generationSwap"));
+    SharedMemoryModel sharedModel;
+    new ModelTest(&sharedModel, &sharedModel);
+    QVERIFY(!sharedModel.refresh());
+    QSignalSpy publisherGenerationSpy(&publisher, SIGNAL(generationChanged(qint64)));
+    QVERIFY(publisherGenerationSpy.isValid());
+    if (!publisher.publish(&baseModel))
+        QSKIP(qPrintable(QStringLiteral("Shared memory not available: ") + publisher.errorString()));
+    QCOMPARE(publisherGenerationSpy.count(), 1);
+    QSignalSpy keyChangedSpy(&sharedModel, SIGNAL(keyChanged(QString)));
+    QVERIFY(keyChangedSpy.isValid());
+    QSignalSpy generationChangedSpy(&sharedModel, SIGNAL(generationChanged(qint64)));
+    QVERIFY(generationChangedSpy.isValid());
+    QSignalSpy modelResetSpy(&sharedModel, SIGNAL(modelReset()));
+    QVERIFY(modelResetSpy.isValid());
+    sharedModel.setKey(publisher.key());
+    QCOMPARE(keyChangedSpy.count(), 1);
+    QCOMPARE(generationChangedSpy.count(), 1);
+    QCOMPARE(sharedModel.rowCount(), 2);
+
+    baseModel.setStringList(QStringList{QStringLiteral("Gamma"), QStringLiteral("Delta"), QStringLiteral("Epsilon")});
+    QVERIFY(publisher.publish(&baseModel));
+    QCOMPARE(publisher.generation(), qint64(2));
+    // the reader keeps showing the old generation until it refreshes
+    QCOMPARE(sharedModel.rowCount(), 2);
+    QCOMPARE(sharedModel.index(0, 0).data().toString(), QStringLiteral("Alpha"));
+    modelResetSpy.clear();
+    QVERIFY(sharedModel.refresh());
+    QCOMPARE(modelResetSpy.count(), 1);
+    QCOMPARE(sharedModel.generation(), qint64(2));
+    compareModels(&baseModel, &sharedModel, QModelIndex(), QModelIndex());
+    modelResetSpy.clear();
+    QVERIFY(sharedModel.refresh());
+    QCOMPARE(modelResetSpy.count(), 0);
+}
+
+void tst_SharedMemoryModel::previousGenerationKept()
+{
+    QStringListModel baseModel(QStringList{QStringLiteral("Alpha"), QStringLiteral("Beta")});
+    SharedMemoryModelPublisher publisher(uniqueKey("previousGenerationKept"));
+    if (!publisher.publish(&baseModel))
+        QSKIP(qPrintable(QStringLiteral("Shared memory not available: ") + publisher.errorString()));
+    QVERIFY(publisher.publish(&baseModel));
+    QCOMPARE(publisher.generation(), qint64(2));
+    // a reader that read generation 1 just before the swap can still attach to it
+    QSharedMemory previousData(publisher.key() + QStringLiteral("_1"));
+    QVERIFY(previousData.attach(QSharedMemory::ReadOnly));
+}
+
+void tst_SharedMemoryModel::rejectCorruptImage()
+{
+    QStringListModel baseModel(QStringList{QStringLiteral("Alpha"), QStringLiteral("Beta")});
+    SharedMemoryModelPublisher publisher(uniqueKey("rejectCorruptImageSource"));
+    if (!publisher.publish(&baseModel))
+        QSKIP(qPrintable(QStringLiteral("Shared memory not available: ") + publisher.errorString()));
+    QSharedMemory validData(publisher.key() + QStringLiteral("_1"));
+    QVERIFY(validData.attach(QSharedMemory::ReadOnly));
+    validData.lock();
+    const QByteArray validImage(static_cast<const char *>(validData.constData()), validData.size());
+    validData.unlock();
+    // header, root node and first child are 8 qint32 each, the last field of a node is its role table offset
+    const int firstChildRolesOffset = 2 * 8 * int(sizeof(qint32)) + 7 * int(sizeof(qint32));
+    QByteArray badRolesImage = validImage;
+    const qint32 badOffset = 0x7FFFFFF0;
+    std::memcpy(badRolesImage.data() + firstChildRolesOffset, &badOffset, sizeof(qint32));
+    const QVector<QByteArray> corruptImages{validImage.left(validImage.size() / 2), badRolesImage, QByteArray(validImage.size(), 'x')};
+    for (int i = 0; i < corruptImages.size(); ++i) {
+        const QString key = uniqueKey("rejectCorruptImage") + QString::number(i);
+        QSharedMemory control(key);
+        QVERIFY(control.create(int(2 * sizeof(quint32) + sizeof(qint64))));
+        const quint32 controlHeader[] = {0x534D4D43, 0};
+        const qint64 generation = 1;
+        control.lock();
+        std::memcpy(control.data(), controlHeader, sizeof(controlHeader));
+        std::memcpy(static_cast<char *>(control.data()) + sizeof(controlHeader), &generation, sizeof(qint64));
+        control.unlock();
+        QSharedMemory corruptData(key + QStringLiteral("_1"));
+        const QByteArray &corruptImage = corruptImages.at(i);
+        QVERIFY(corruptData.create(corruptImage.size()));
+        corruptData.lock();
+        std::memcpy(corruptData.data(), corruptImage.constData(), corruptImage.size());
+        corruptData.unlock();
+        SharedMemoryModel sharedModel;
+        sharedModel.setKey(key);
+        QVERIFY(!sharedModel.refresh());
+        QCOMPARE(sharedModel.generation(), qint64(0));
+        QCOMPARE(sharedModel.rowCount(), 0);
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef TST_SHAREDMEMORYMODEL_H
+#define TST_SHAREDMEMORYMODEL_H
+
+#include <QObject>
+class QAbstractItemModel;
+class QModelIndex;
+class tst_SharedMemoryModel : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void autoParent();
+    void publishList();
+    void publishTree();
+    void generationSwap();
+    void previousGenerationKept();
+    void rejectCorruptImage();
+
+protected:
+    void compareModels(const QAbstractItemModel *source, const QAbstractItemModel *shared, const QModelIndex &sourcePar,
+                       const QModelIndex &sharedPar);
+};
+#endif // TST_SHAREDMEMORYMODEL_H